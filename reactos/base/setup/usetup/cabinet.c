@@ -11,6 +11,7 @@
 #include "usetup.h"
 
 #include <zlib.h>
+#include "../../../dll/win32/itss/lzx.h"
 
 #define NDEBUG
 #include <debug.h>
@@ -64,6 +65,9 @@ static PCABINET_EXTRACT ExtractHandler = NULL;
 static PCABINET_DISK_CHANGE DiskChangeHandler = NULL;
 static z_stream ZStream;
 static PVOID CabinetReservedArea = NULL;
+static PCFDATA CachedCFData = NULL;     // Data block held in BlockBuffer
+static UCHAR BlockBuffer[CAB_BLOCKSIZE];    // Uncompressed data of CachedCFData
+static PCFDATA NextCFData = NULL;       // Data block following the last one decoded
 
 
 /* Needed by zlib, but we don't want the dependency on msvcrt.dll */
@@ -212,6 +216,113 @@ MSZipFree(voidpf opaque, voidpf address)
     RtlFreeHeap(ProcessHeap, 0, address);
 }
 
+/* LZX codec */
+
+/*
+ * The decoder is the one from dll/win32/itss. Each data block of a
+ * folder holds one 32 KB LZX frame. The decoder state carries over
+ * from block to block, so the blocks of a folder have to be decoded
+ * in order.
+ */
+
+/* The decoder may read a few bytes past the end of a block */
+#define LZX_INPUT_SLACK  4
+
+static struct LZXstate *LzxState = NULL;
+static ULONG LzxWindowBits = 0;
+static UCHAR LzxInput[CAB_MAX_COMPSIZE + LZX_INPUT_SLACK];
+
+/*
+ * FUNCTION: Prepares the LZX codec for the first block of a folder
+ */
+static
+VOID
+LzxReset(VOID)
+{
+    LZXreset(LzxState);
+}
+
+/*
+ * FUNCTION: Sets the window size of the LZX codec
+ * ARGUMENTS:
+ *     WindowBits = The window is 2^WindowBits bytes
+ * RETURNS:
+ *     FALSE if the window size is not supported
+ */
+static
+BOOLEAN
+LzxSetWindow(ULONG WindowBits)
+{
+    if (WindowBits == LzxWindowBits)
+        return TRUE;
+
+    if (LzxState)
+    {
+        LZXteardown(LzxState);
+        LzxState = NULL;
+    }
+
+    LzxWindowBits = 0;
+    NextCFData = NULL;
+
+    /* This fails for window sizes other than 2^15 to 2^21 */
+    LzxState = LZXinit(WindowBits);
+    if (!LzxState)
+    {
+        DPRINT1("Cannot set up LZX window size (%u)\n", WindowBits);
+        return FALSE;
+    }
+
+    LzxWindowBits = WindowBits;
+    return TRUE;
+}
+
+/*
+ * FUNCTION: Uncompresses data in a buffer
+ * ARGUMENTS:
+ *     OutputBuffer = Pointer to buffer to place uncompressed data
+ *     InputBuffer  = Pointer to buffer with data to be uncompressed
+ *     InputLength  = Length of input buffer before, and amount consumed after
+ *     OutputLength = Uncompressed size of the block before, amount filled after
+ * NOTES:
+ *     Only whole blocks are supported, and the blocks of a folder
+ *     must be passed in order, starting after LzxReset()
+ */
+ULONG
+LzxCodecUncompress(PVOID OutputBuffer,
+                   PVOID InputBuffer,
+                   PLONG InputLength,
+                   PLONG OutputLength)
+{
+    int Status;
+
+    DPRINT("LzxCodecUncompress(OutputBuffer = %x, InputBuffer = %x, "
+           "InputLength = %d, OutputLength = %d)\n", OutputBuffer,
+           InputBuffer, *InputLength, *OutputLength);
+
+    if (*InputLength <= 0 || *InputLength > CAB_MAX_COMPSIZE ||
+        *OutputLength <= 0 || *OutputLength > CAB_BLOCKSIZE)
+    {
+        return CS_BADSTREAM;
+    }
+
+    /* The block may end at the end of the cabinet mapping */
+    memcpy(LzxInput, InputBuffer, *InputLength);
+    memset(LzxInput + *InputLength, 0, LZX_INPUT_SLACK);
+
+    Status = LZXdecompress(LzxState,
+                           LzxInput,
+                           (unsigned char *)OutputBuffer,
+                           *InputLength,
+                           *OutputLength);
+    if (Status == DECR_NOMEMORY)
+        return CS_NOMEMORY;
+    if (Status != DECR_OK)
+        return CS_BADSTREAM;
+
+    return CS_SUCCESS;
+}
+
 static BOOL
 ConvertSystemTimeToFileTime(CONST SYSTEMTIME *lpSystemTime,
                             LPFILETIME lpFileTime)
@@ -383,6 +494,9 @@ CloseCabinet(VOID)
         FileBuffer = NULL;
     }
 
+    CachedCFData = NULL;
+    NextCFData = NULL;
+
     return 0;
 }
 
@@ -418,6 +532,13 @@ VOID
 CabinetCleanup(VOID)
 {
     CabinetClose();
+
+    if (LzxState)
+    {
+        LZXteardown(LzxState);
+        LzxState = NULL;
+    }
+    LzxWindowBits = 0;
 }
 
 /*
@@ -802,6 +923,98 @@ CabinetFindNext(PCAB_SEARCH Search)
     return CAB_STATUS_SUCCESS;
 }
 
+/*
+ * FUNCTION: Uncompresses a data block into a buffer
+ * ARGUMENTS:
+ *     CFData = Pointer to the data block
+ *     Buffer = Pointer to buffer of CAB_BLOCKSIZE bytes
+ * RETURNS
+ *     Status of operation
+ */
+static ULONG
+DecodeBlock(PCFDATA CFData, PUCHAR Buffer)
+{
+    LONG InputLength, OutputLength;
+    ULONG Status;
+
+    if (CFData->UncompSize > CAB_BLOCKSIZE)
+    {
+        DPRINT1("Data block too large (%u bytes)\n", CFData->UncompSize);
+        return CAB_STATUS_INVALID_CAB;
+    }
+
+    NextCFData = NULL;
+
+    /* Positive lengths tell the codec that this is a whole block */
+    InputLength = CFData->CompSize;
+    OutputLength = CFData->UncompSize;
+    Status = CodecUncompress(Buffer,
+                             (PUCHAR)(CFData + 1) + DataReserved,
+                             &InputLength,
+                             &OutputLength);
+    if (Status != CS_SUCCESS)
+    {
+        DPRINT("Cannot uncompress block\n");
+        if (Status == CS_NOMEMORY)
+            return CAB_STATUS_NOMEMORY;
+        return CAB_STATUS_INVALID_CAB;
+    }
+
+    if (OutputLength != CFData->UncompSize)
+    {
+        DPRINT1("Block uncompressed to %d bytes instead of %u\n",
+                OutputLength, CFData->UncompSize);
+        return CAB_STATUS_INVALID_CAB;
+    }
+
+    NextCFData = (PCFDATA)((char *)(CFData + 1) + DataReserved + CFData->CompSize);
+    return CAB_STATUS_SUCCESS;
+}
+
+/*
+ * FUNCTION: Uncompresses a data block into the block buffer
+ * ARGUMENTS:
+ *     FirstCFData = Pointer to the first data block of the folder
+ *     CFData      = Pointer to the data block
+ * RETURNS
+ *     Status of operation
+ * NOTES
+ *     The last block stays in the buffer, so files that share
+ *     a block only cost one decompression when extracted in order
+ */
+static ULONG
+UncompressBlock(PCFDATA FirstCFData, PCFDATA CFData)
+{
+    PCFDATA Block;
+    ULONG Status;
+
+    if (CFData == CachedCFData)
+        return CAB_STATUS_SUCCESS;
+
+    CachedCFData = NULL;
+
+    /* LZX blocks depend on the ones before them in the folder. If the
+       decoder did not just stop in front of this block, start over */
+    if (CodecId == CAB_CODEC_LZX &&
+        (CFData == FirstCFData || CFData != NextCFData))
+    {
+        LzxReset();
+        for (Block = FirstCFData; Block != CFData; Block = NextCFData)
+        {
+            Status = DecodeBlock(Block, BlockBuffer);
+            if (Status != CAB_STATUS_SUCCESS)
+                return Status;
+        }
+    }
+
+    Status = DecodeBlock(CFData, BlockBuffer);
+    if (Status != CAB_STATUS_SUCCESS)
+        return Status;
+
+    CachedCFData = CFData;
+    return CAB_STATUS_SUCCESS;
+}
+
 #if 0
 int
 Validate(VOID)
@@ -820,10 +1033,10 @@ Validate(VOID)
 ULONG
 CabinetExtractFile(PCAB_SEARCH Search)
 {
-    ULONG Size;                 // remaining file bytes to decompress
-    ULONG CurrentOffset;        // current uncompressed offset within the folder
-    PUCHAR CurrentBuffer;       // current pointer to compressed data in the block
-    LONG RemainingBlock;        // remaining comp data in the block
+    ULONG Size;                 // remaining file bytes to copy
+    ULONG CurrentOffset;        // uncompressed offset of CFData within the folder
+    ULONG BlockOffset;          // offset of the next file byte within CFData
+    ULONG Length;
     HANDLE DestFile;
     HANDLE DestFileSection;
     PVOID DestFileBuffer;       // mapped view of dest file
@@ -840,8 +1053,6 @@ CabinetExtractFile(PCAB_SEARCH Search)
     FILE_BASIC_INFORMATION FileBasic;
     PCFFOLDER CurrentFolder;
     LARGE_INTEGER MaxDestFileSize;
-    LONG InputLength, OutputLength;
-    char Junk[512];
 
     if (wcscmp(Search->Cabinet, CabinetName) != 0)
     {
@@ -878,6 +1089,11 @@ CabinetExtractFile(PCAB_SEARCH Search)
         case CAB_COMP_MSZIP:
             CabinetSelectCodec(CAB_CODEC_MSZIP);
             break;
+        case CAB_COMP_LZX:
+            if (!LzxSetWindow((CurrentFolder->CompressionType >> 8) & 0x1F))
+                return CAB_STATUS_UNSUPPCOMP;
+            CabinetSelectCodec(CAB_CODEC_LZX);
+            break;
         default:
             return CAB_STATUS_UNSUPPCOMP;
     }
@@ -1019,10 +1235,14 @@ CabinetExtractFile(PCAB_SEARCH Search)
         ExtractHandler(Search->File, DestName);
     }
 
-    if (Search->CFData)
+    if (Search->CFData && Search->Offset <= Search->File->FileOffset)
         CFData = Search->CFData;
     else
-        CFData = (PCFDATA)(CabinetFolders[Search->File->FolderIndex].DataOffset + FileBuffer);
+    {
+        /* New folder, or the file comes before the last one */
+        CFData = (PCFDATA)(CurrentFolder->DataOffset + FileBuffer);
+        Search->Offset = 0;
+    }
 
     CurrentOffset = Search->Offset;
     while (CurrentOffset + CFData->UncompSize <= Search->File->FileOffset)
@@ -1032,80 +1252,36 @@ CabinetExtractFile(PCAB_SEARCH Search)
         CurrentOffset += CFData->UncompSize;
         CFData = (PCFDATA)((char *)(CFData + 1) + DataReserved + CFData->CompSize);
     }
-    
+
     Search->CFData = CFData;
     Search->Offset = CurrentOffset;
 
-    /* now decompress and discard any data in
-       the block before the start of the file */
-
-    /* start of comp data */
-    CurrentBuffer = ((unsigned char *)(CFData + 1)) + DataReserved;
-    RemainingBlock = CFData->CompSize;
-    InputLength = RemainingBlock;
-
-    while (CurrentOffset < Search->File->FileOffset)
-    {
-        /* compute remaining uncomp bytes to start
-           of file, bounded by sizeof junk */
-        OutputLength = Search->File->FileOffset - CurrentOffset;
-        if (OutputLength > (LONG)sizeof(Junk))
-            OutputLength = sizeof (Junk);
-
-        /* negate to signal NOT end of block */
-        OutputLength = -OutputLength;
-        CodecUncompress(Junk, CurrentBuffer, &InputLength, &OutputLength);
-        /* add the uncomp bytes extracted to current folder offset */
-        CurrentOffset += OutputLength;
-        /* add comp bytes consumed to CurrentBuffer */
-        CurrentBuffer += InputLength;
-        /* subtract bytes consumed from bytes remaining in block */
-        RemainingBlock -= InputLength;
-        /* neg for resume decompression of the same block */
-        InputLength = -RemainingBlock;
-    }
-
-    /* now CurrentBuffer points to the first comp byte
-       of the file, so we can begin decompressing */
-
-    /* Size = remaining uncomp bytes of the file to decompress */
+    /* Copy the file out of the uncompressed blocks. The block that
+       the file ends in is kept for the next file in the folder */
     Size = Search->File->FileSize;
+    BlockOffset = Search->File->FileOffset - CurrentOffset;
     while (Size > 0)
     {
-        OutputLength = Size;
-        DPRINT("Decompressing block at %x with RemainingBlock = %d, Size = %d\n",
-               CurrentBuffer, RemainingBlock, Size);
+        DPRINT("Copying from block at %x with BlockOffset = %d, Size = %d\n",
+               CFData, BlockOffset, Size);
 
-        Status = CodecUncompress(CurrentDestBuffer,
-                                 CurrentBuffer,
-                                 &InputLength,
-                                 &OutputLength);
-
-        if (Status != CS_SUCCESS)
-        {
-            DPRINT("Cannot uncompress block\n");
-            if (Status == CS_NOMEMORY)
-                Status = CAB_STATUS_NOMEMORY;
-            Status = CAB_STATUS_INVALID_CAB;
+        Status = UncompressBlock((PCFDATA)(CurrentFolder->DataOffset + FileBuffer), CFData);
+        if (Status != CAB_STATUS_SUCCESS)
             goto UnmapDestFile;
-        }
 
-        /* advance dest buffer by bytes produced */
-        CurrentDestBuffer = (PVOID)((ULONG_PTR)CurrentDestBuffer + OutputLength);
-        /* advance src buffer by bytes consumed */
-        CurrentBuffer += InputLength;
-        /* reduce remaining file bytes by bytes produced */
-        Size -= OutputLength;
-        /* reduce remaining block size by bytes consumed */
-        RemainingBlock -= InputLength;
-        if (Size > 0 && RemainingBlock == 0)
+        Length = min(Size, CFData->UncompSize - BlockOffset);
+        memcpy(CurrentDestBuffer, BlockBuffer + BlockOffset, Length);
+
+        /* advance dest buffer by bytes copied */
+        CurrentDestBuffer = (PVOID)((ULONG_PTR)CurrentDestBuffer + Length);
+        /* reduce remaining file bytes by bytes copied */
+        Size -= Length;
+        if (Size > 0)
         {
             /* used up this block, move on to the next */
             DPRINT("Out of block data\n");
-            CFData = (PCFDATA)CurrentBuffer;
-            RemainingBlock = CFData->CompSize;
-            CurrentBuffer = (unsigned char *)(CFData + 1) + DataReserved;
-            InputLength = RemainingBlock;
+            CFData = (PCFDATA)((char *)(CFData + 1) + DataReserved + CFData->CompSize);
+            BlockOffset = 0;
         }
     }
 
@@ -1147,6 +1323,9 @@ CabinetSelectCodec(ULONG Id)
         case CAB_CODEC_MSZIP:
             CodecUncompress = MSZipCodecUncompress;
             break;
+        case CAB_CODEC_LZX:
+            CodecUncompress = LzxCodecUncompress;
+            break;
         default:
             return;
     }
@@ -13,6 +13,7 @@
 #define CAB_SIGNATURE        0x4643534D // "MSCF"
 #define CAB_VERSION          0x0103
 #define CAB_BLOCKSIZE        32768
+#define CAB_MAX_COMPSIZE     (CAB_BLOCKSIZE + 6144) // LZX may expand data that does not compress
 
 #define CAB_COMP_MASK        0x00FF
 #define CAB_COMP_NONE        0x0000
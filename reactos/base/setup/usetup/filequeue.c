@@ -55,6 +55,21 @@ typedef struct _FILEQUEUEHEADER
 } FILEQUEUEHEADER, *PFILEQUEUEHEADER;
 
 
+typedef struct _SORTENTRY
+{
+    PQUEUEENTRY Entry;
+    ULONG Sequence;         /* Position in the queue */
+    ULONG CabinetIndex;     /* Position in the cabinet, MAXULONG if not found */
+} SORTENTRY, *PSORTENTRY;
+
+
+typedef struct _CABINETFILES
+{
+    PSORTENTRY First;       /* Queue entries of one cabinet, sorted by name */
+    ULONG Count;
+} CABINETFILES, *PCABINETFILES;
+
+
 /* FUNCTIONS ****************************************************************/
 
 HSPFILEQ
@@ -329,6 +344,227 @@ SetupQueueCopy(
 }
 
 
+static
+VOID
+BuildCabinetPath(
+    PWSTR CabinetName,
+    PQUEUEENTRY Entry)
+{
+    wcscpy(CabinetName, Entry->SourceRootPath);
+    if (Entry->SourcePath != NULL)
+        wcscat(CabinetName, Entry->SourcePath);
+    wcscat(CabinetName, L"\\");
+    wcscat(CabinetName, Entry->SourceCabinet);
+}
+
+
+static
+int
+CompareCabinets(
+    PQUEUEENTRY Entry1,
+    PQUEUEENTRY Entry2)
+{
+    int Result;
+
+    Result = wcscmp(Entry1->SourceRootPath, Entry2->SourceRootPath);
+    if (Result != 0)
+        return Result;
+
+    Result = wcscmp(Entry1->SourcePath ? Entry1->SourcePath : L"",
+                    Entry2->SourcePath ? Entry2->SourcePath : L"");
+    if (Result != 0)
+        return Result;
+
+    return wcscmp(Entry1->SourceCabinet, Entry2->SourceCabinet);
+}
+
+
+static
+int
+CompareSequence(
+    PSORTENTRY Entry1,
+    PSORTENTRY Entry2)
+{
+    if (Entry1->Sequence == Entry2->Sequence)
+        return 0;
+
+    return (Entry1->Sequence < Entry2->Sequence) ? -1 : 1;
+}
+
+
+/* Groups the cabinet files by cabinet, and sorts them by name within a cabinet */
+static
+int
+__cdecl
+CompareByName(
+    const void *Sort1,
+    const void *Sort2)
+{
+    PSORTENTRY Entry1 = (PSORTENTRY)Sort1;
+    PSORTENTRY Entry2 = (PSORTENTRY)Sort2;
+    int Result;
+
+    if ((Entry1->Entry->SourceCabinet == NULL) != (Entry2->Entry->SourceCabinet == NULL))
+        return (Entry1->Entry->SourceCabinet == NULL) ? -1 : 1;
+
+    if (Entry1->Entry->SourceCabinet == NULL)
+        return CompareSequence(Entry1, Entry2);
+
+    Result = CompareCabinets(Entry1->Entry, Entry2->Entry);
+    if (Result != 0)
+        return Result;
+
+    return wcscmp(Entry1->Entry->SourceFilename, Entry2->Entry->SourceFilename);
+}
+
+
+/* Puts the plain files first in queue order, then the cabinet files in cabinet order */
+static
+int
+__cdecl
+CompareByPosition(
+    const void *Sort1,
+    const void *Sort2)
+{
+    PSORTENTRY Entry1 = (PSORTENTRY)Sort1;
+    PSORTENTRY Entry2 = (PSORTENTRY)Sort2;
+    int Result;
+
+    if ((Entry1->Entry->SourceCabinet == NULL) != (Entry2->Entry->SourceCabinet == NULL))
+        return (Entry1->Entry->SourceCabinet == NULL) ? -1 : 1;
+
+    if (Entry1->Entry->SourceCabinet != NULL)
+    {
+        Result = CompareCabinets(Entry1->Entry, Entry2->Entry);
+        if (Result != 0)
+            return Result;
+
+        if (Entry1->CabinetIndex != Entry2->CabinetIndex)
+            return (Entry1->CabinetIndex < Entry2->CabinetIndex) ? -1 : 1;
+    }
+
+    return CompareSequence(Entry1, Entry2);
+}
+
+
+static
+int
+__cdecl
+CompareFileName(
+    const void *Key,
+    const void *Sort)
+{
+    return wcscmp((PCWSTR)Key, ((PSORTENTRY)Sort)->Entry->SourceFilename);
+}
+
+
+static
+VOID
+SetCabinetIndex(
+    PVOID Context,
+    PCWSTR FileName,
+    ULONG Index)
+{
+    PCABINETFILES Files = (PCABINETFILES)Context;
+    PSORTENTRY Found, Last = Files->First + Files->Count;
+
+    Found = (PSORTENTRY)bsearch(FileName,
+                                Files->First,
+                                Files->Count,
+                                sizeof(SORTENTRY),
+                                CompareFileName);
+    if (Found == NULL)
+        return;
+
+    /* The same file may be queued for several targets */
+    while (Found > Files->First && wcscmp((Found - 1)->Entry->SourceFilename, FileName) == 0)
+        Found--;
+
+    for (; Found < Last && wcscmp(Found->Entry->SourceFilename, FileName) == 0; Found++)
+    {
+        if (Found->CabinetIndex == MAXULONG)
+            Found->CabinetIndex = Index;
+    }
+}
+
+
+/*
+ * Sorts the copy queue into cabinet order. The cabinet code keeps the last
+ * uncompressed data block around, so extracting the files in the order they
+ * are stored decompresses every folder only once.
+ */
+static
+VOID
+SortCopyQueue(
+    PFILEQUEUEHEADER QueueHeader)
+{
+    WCHAR CabinetName[MAX_PATH];
+    CABINETFILES Files;
+    PSORTENTRY SortEntries;
+    PQUEUEENTRY Entry;
+    ULONG i, j;
+
+    if (QueueHeader->CopyCount < 2)
+        return;
+
+    SortEntries = (PSORTENTRY)RtlAllocateHeap(ProcessHeap,
+                                              0,
+                                              QueueHeader->CopyCount * sizeof(SORTENTRY));
+    if (SortEntries == NULL)
+    {
+        /* Not fatal, the files are just extracted in queue order */
+        DPRINT1("Cannot sort the copy queue\n");
+        return;
+    }
+
+    for (i = 0, Entry = QueueHeader->CopyHead; Entry != NULL; i++, Entry = Entry->Next)
+    {
+        SortEntries[i].Entry = Entry;
+        SortEntries[i].Sequence = i;
+        SortEntries[i].CabinetIndex = MAXULONG;
+    }
+
+    qsort(SortEntries, QueueHeader->CopyCount, sizeof(SORTENTRY), CompareByName);
+
+    /* Look up the position of the files in each cabinet */
+    for (i = 0; i < QueueHeader->CopyCount; i = j)
+    {
+        for (j = i + 1; j < QueueHeader->CopyCount; j++)
+        {
+            if (SortEntries[i].Entry->SourceCabinet == NULL ||
+                SortEntries[j].Entry->SourceCabinet == NULL ||
+                CompareCabinets(SortEntries[i].Entry, SortEntries[j].Entry) != 0)
+            {
+                break;
+            }
+        }
+
+        if (SortEntries[i].Entry->SourceCabinet == NULL)
+            continue;
+
+        BuildCabinetPath(CabinetName, SortEntries[i].Entry);
+        Files.First = &SortEntries[i];
+        Files.Count = j - i;
+        SetupEnumerateCabinet(CabinetName, SetCabinetIndex, &Files);
+    }
+
+    qsort(SortEntries, QueueHeader->CopyCount, sizeof(SORTENTRY), CompareByPosition);
+
+    /* Relink the queue in the new order */
+    for (i = 0; i < QueueHeader->CopyCount; i++)
+    {
+        Entry = SortEntries[i].Entry;
+        Entry->Prev = (i > 0) ? SortEntries[i - 1].Entry : NULL;
+        Entry->Next = (i + 1 < QueueHeader->CopyCount) ? SortEntries[i + 1].Entry : NULL;
+    }
+
+    QueueHeader->CopyHead = SortEntries[0].Entry;
+    QueueHeader->CopyTail = SortEntries[QueueHeader->CopyCount - 1].Entry;
+
+    RtlFreeHeap(ProcessHeap, 0, SortEntries);
+}
+
+
 BOOL
 WINAPI
 SetupCommitFileQueueW(
@@ -354,6 +590,8 @@ SetupCommitFileQueueW(
 
     QueueHeader = (PFILEQUEUEHEADER)QueueHandle;
 
+    SortCopyQueue(QueueHeader);
+
     MsgHandler(Context,
                SPFILENOTIFY_STARTQUEUE,
                0,
@@ -435,11 +673,7 @@ SetupCommitFileQueueW(
         if (Entry->SourceCabinet != NULL)
         {
             /* Extract the file */
-            wcscpy(CabinetName, Entry->SourceRootPath);
-            if (Entry->SourcePath != NULL)
-                wcscat(CabinetName, Entry->SourcePath);
-            wcscat(CabinetName, L"\\");
-            wcscat(CabinetName, Entry->SourceCabinet);
+            BuildCabinetPath(CabinetName, Entry);
             Status = SetupExtractFile(CabinetName, Entry->SourceFilename, FileDstPath);
         }
         else
@@ -410,6 +410,84 @@ done:
 }
 
 #ifdef __REACTOS__
+static
+NTSTATUS
+SetupOpenCabinet(
+    PWCHAR CabinetFileName)
+{
+    ULONG CabStatus;
+
+    if ((HasCurrentCabinet) && (wcscmp(CabinetFileName, CurrentCabinetName) == 0))
+        return STATUS_SUCCESS;
+
+    DPRINT("Using new cabinet\n");
+
+    if (HasCurrentCabinet)
+    {
+        CabinetCleanup();
+        HasCurrentCabinet = FALSE;
+    }
+
+    wcscpy(CurrentCabinetName, CabinetFileName);
+
+    CabinetInitialize();
+    CabinetSetEventHandlers(NULL, NULL, NULL);
+    CabinetSetCabinetName(CabinetFileName);
+
+    CabStatus = CabinetOpen();
+    if (CabStatus != CAB_STATUS_SUCCESS)
+    {
+        DPRINT("Cannot open cabinet (%d)\n", CabStatus);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    DPRINT("Opened cabinet %S\n", CabinetGetCabinetName());
+    HasCurrentCabinet = TRUE;
+
+    /* We have to start at the beginning here */
+    wcsncpy(Search.Cabinet, CabinetGetCabinetName(), MAX_PATH);
+    Search.File = NULL;
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+SetupEnumerateCabinet(
+    PWCHAR CabinetFileName,
+    PSETUP_ENUM_CABINET_ROUTINE EnumRoutine,
+    PVOID Context)
+{
+    CAB_SEARCH EnumSearch;
+    WCHAR AnyFile[] = L"*";
+    WCHAR FileName[MAX_PATH];
+    ANSI_STRING AnsiString;
+    UNICODE_STRING UnicodeString;
+    NTSTATUS Status;
+    ULONG CabStatus;
+
+    Status = SetupOpenCabinet(CabinetFileName);
+    if (!NT_SUCCESS(Status))
+        return Status;
+
+    /* Use our own search so that the extraction position is kept */
+    CabStatus = CabinetFindFirst(AnyFile, &EnumSearch);
+    while (CabStatus == CAB_STATUS_SUCCESS)
+    {
+        RtlInitAnsiString(&AnsiString, EnumSearch.File->FileName);
+        UnicodeString.Buffer = FileName;
+        UnicodeString.Length = 0;
+        UnicodeString.MaximumLength = sizeof(FileName);
+        RtlAnsiStringToUnicodeString(&UnicodeString, &AnsiString, FALSE);
+        FileName[UnicodeString.Length / sizeof(WCHAR)] = UNICODE_NULL;
+
+        EnumRoutine(Context, FileName, EnumSearch.Index);
+
+        CabStatus = CabinetFindNext(&EnumSearch);
+    }
+
+    return STATUS_SUCCESS;
+}
+
 NTSTATUS
 SetupExtractFile(
     PWCHAR CabinetFileName,
@@ -417,6 +495,7 @@ SetupExtractFile(
     PWCHAR DestinationPathName)
 {
     ULONG CabStatus;
+    NTSTATUS Status;
 
     DPRINT("SetupExtractFile(CabinetFileName %S, SourceFileName %S, DestinationPathName %S)\n",
            CabinetFileName, SourceFileName, DestinationPathName);
@@ -426,48 +505,17 @@ SetupExtractFile(
         DPRINT("CurrentCabinetName: %S\n", CurrentCabinetName);
     }
 
-    if ((HasCurrentCabinet) && (wcscmp(CabinetFileName, CurrentCabinetName) == 0))
-    {
-        DPRINT("Using same cabinet as last time\n");
-
-        /* Use our last location because the files should be sequential */
-        CabStatus = CabinetFindNextFileSequential(SourceFileName, &Search);
-        if (CabStatus != CAB_STATUS_SUCCESS)
-        {
-            DPRINT("Sequential miss on file: %S\n", SourceFileName);
+    Status = SetupOpenCabinet(CabinetFileName);
+    if (!NT_SUCCESS(Status))
+        return Status;
 
-            /* Looks like we got unlucky */
-            CabStatus = CabinetFindFirst(SourceFileName, &Search);
-        }
-    }
-    else
+    /* Use our last location because the files should be sequential */
+    CabStatus = CabinetFindNextFileSequential(SourceFileName, &Search);
+    if (CabStatus != CAB_STATUS_SUCCESS)
     {
-        DPRINT("Using new cabinet\n");
-
-        if (HasCurrentCabinet)
-        {
-            CabinetCleanup();
-        }
-
-        wcscpy(CurrentCabinetName, CabinetFileName);
-
-        CabinetInitialize();
-        CabinetSetEventHandlers(NULL, NULL, NULL);
-        CabinetSetCabinetName(CabinetFileName);
-
-        CabStatus = CabinetOpen();
-        if (CabStatus == CAB_STATUS_SUCCESS)
-        {
-            DPRINT("Opened cabinet %S\n", CabinetGetCabinetName());
-            HasCurrentCabinet = TRUE;
-        }
-        else
-        {
-            DPRINT("Cannot open cabinet (%d)\n", CabStatus);
-            return STATUS_UNSUCCESSFUL;
-        }
+        DPRINT("Sequential miss on file: %S\n", SourceFileName);
 
-        /* We have to start at the beginning here */
+        /* Looks like we got unlucky */
         CabStatus = CabinetFindFirst(SourceFileName, &Search);
     }
 
@@ -35,6 +35,18 @@ SetupCopyFile(
     PWCHAR SourceFileName,
     PWCHAR DestinationFileName);
 
+typedef VOID
+(*PSETUP_ENUM_CABINET_ROUTINE)(
+    PVOID Context,
+    PCWSTR FileName,
+    ULONG Index);
+
+NTSTATUS
+SetupEnumerateCabinet(
+    PWCHAR CabinetFileName,
+    PSETUP_ENUM_CABINET_ROUTINE EnumRoutine,
+    PVOID Context);
+
 NTSTATUS
 SetupExtractFile(
     PWCHAR CabinetFileName,
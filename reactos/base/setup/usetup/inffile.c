@@ -71,10 +71,11 @@ InfpOpenInfFileW(
     NTSTATUS Status;
 
     RtlInitUnicodeString(&FileNameU, FileName);
-    Status = InfOpenFile(&hInf,
-                         &FileNameU,
-                         LANGIDFROMLCID(LocaleId),
-                         &ErrorLineUL);
+    Status = InfOpenFileEx(&hInf,
+                           &FileNameU,
+                           LANGIDFROMLCID(LocaleId),
+                           INF_OPEN_ARENA,
+                           &ErrorLineUL);
     *ErrorLine = (UINT)ErrorLineUL;
     if (!NT_SUCCESS(Status))
         return INVALID_HANDLE_VALUE;
@@ -35,7 +35,19 @@
  *
  ***************************************************************************/
 
+#if defined(__REACTOS__) && defined(LZX_STANDALONE)
+/* Also built into usetup and cabman, which have no Win32 heap */
+#include <stdlib.h>
+#include <string.h>
+#include "lzx.h"
+typedef int LONG;
+typedef unsigned int ULONG;
+#define GetProcessHeap() NULL
+#define HeapAlloc(Heap, Flags, Size) malloc(Size)
+#define HeapFree(Heap, Flags, Ptr) free(Ptr)
+#else
 #include "precomp.h"
+#endif
 
 /* sized types */
 typedef unsigned char  UBYTE; /* 8 bits exactly    */
@@ -174,6 +186,9 @@ struct LZXstate *LZXinit(int window)
 
     /* allocate state and associated window */
     pState = HeapAlloc(GetProcessHeap(), 0, sizeof(struct LZXstate));
+#ifdef __REACTOS__
+    if (!pState) return NULL;
+#endif
     if (!(pState->window = HeapAlloc(GetProcessHeap(), 0, wndsize)))
     {
         HeapFree(GetProcessHeap(), 0, pState);
@@ -480,6 +495,9 @@ int LZXdecompress(struct LZXstate *pState, unsigned char *inpos, unsigned char *
     int togo = outlen, this_run, main_element, aligned_bits;
     int match_length, length_footer, extra, verbatim_bits;
     int copy_length;
+#ifdef __REACTOS__
+    ULONG frame_start = window_posn & (window_size - 1);
+#endif
 
     INIT_BITSTREAM;
 
@@ -735,11 +753,23 @@ int LZXdecompress(struct LZXstate *pState, unsigned char *inpos, unsigned char *
                     return DECR_ILLEGALDATA; /* might as well */
             }
 
+#ifdef __REACTOS__
+            /* A match may run past the end of the frame, into the zero
+             * padding of the short last frame of a cabinet folder */
+            if (this_run < 0) {
+                if ((ULONG)-this_run > pState->block_remaining) return DECR_ILLEGALDATA;
+                pState->block_remaining -= -this_run;
+            }
+#endif
         }
     }
 
     if (togo != 0) return DECR_ILLEGALDATA;
+#ifdef __REACTOS__
+    memcpy(outpos, window + frame_start, (size_t) outlen);
+#else
     memcpy(outpos, window + ((!window_posn) ? window_size : window_posn) - outlen, (size_t) outlen);
+#endif
 
     pState->window_posn = window_posn;
     pState->R0 = R0;
@@ -2464,8 +2464,43 @@ WSPIoctl(IN  SOCKET Handle,
             Ret = NO_ERROR;
             break;
         case SIO_GET_EXTENSION_FUNCTION_POINTER:
-            Errno = WSAEINVAL;
+        {
+            static const GUID TransmitFileGuid = WSAID_TRANSMITFILE;
+            static const GUID AcceptExGuid = WSAID_ACCEPTEX;
+            static const GUID GetAcceptExSockaddrsGuid = WSAID_GETACCEPTEXSOCKADDRS;
+            PVOID Function;
+
+            if (cbInBuffer < sizeof(GUID) || IS_INTRESOURCE(lpvInBuffer))
+            {
+                Errno = WSAEFAULT;
+                break;
+            }
+
+            if (IsEqualGUID(lpvInBuffer, &TransmitFileGuid))
+                Function = MsafdTransmitFile;
+            else if (IsEqualGUID(lpvInBuffer, &AcceptExGuid))
+                Function = MsafdAcceptEx;
+            else if (IsEqualGUID(lpvInBuffer, &GetAcceptExSockaddrsGuid))
+                Function = MsafdGetAcceptExSockaddrs;
+            else
+            {
+                Errno = WSAEINVAL;
+                break;
+            }
+
+            if (cbOutBuffer < sizeof(PVOID) || IS_INTRESOURCE(lpvOutBuffer))
+            {
+                cbRet = sizeof(PVOID);
+                Errno = WSAEFAULT;
+                break;
+            }
+
+            *(PVOID*)lpvOutBuffer = Function;
+            cbRet = sizeof(PVOID);
+            Errno = NO_ERROR;
+            Ret = NO_ERROR;
             break;
+        }
         case SIO_ADDRESS_LIST_QUERY:
             if (IS_INTRESOURCE(lpvOutBuffer) || cbOutBuffer == 0)
             {
@@ -2726,6 +2761,7 @@ WSPSetSockOpt(
 {
     PSOCKET_INFORMATION Socket;
     INT Errno;
+    ULONG BufferSize;
 
     /* Get the Socket Structure associate to this Socket*/
     Socket = GetSocketStructure(s);
@@ -2809,10 +2845,35 @@ WSPSetSockOpt(
                   return SOCKET_ERROR;
               }
 
-              /* TODO: The total per-socket buffer space reserved for sends */
-              ERR("Setting send buf to %x is not implemented yet\n", optval);
+              /* AFD buffers this much for sends that TCP can't take yet */
+              BufferSize = *(PULONG)optval;
+              if (BufferSize != 0 &&
+                  SetSocketInformation(Socket, AFD_INFO_SEND_WINDOW_SIZE, NULL, &BufferSize, NULL, NULL, NULL) != NO_ERROR)
+              {
+                  if (lpErrno) *lpErrno = WSAENOBUFS;
+                  return SOCKET_ERROR;
+              }
+              Socket->SharedData->SizeOfSendBuffer = BufferSize;
               return NO_ERROR;
 
+           case SO_RCVBUF:
+              if (optlen < sizeof(DWORD))
+              {
+                  if (lpErrno) *lpErrno = WSAEFAULT;
+                  return SOCKET_ERROR;
+              }
+
+              /* AFD buffers this much received data, and TCP sizes its window after it */
+              BufferSize = *(PULONG)optval;
+              if (BufferSize != 0 &&
+                  SetSocketInformation(Socket, AFD_INFO_RECEIVE_WINDOW_SIZE, NULL, &BufferSize, NULL, NULL, NULL) != NO_ERROR)
+              {
+                  if (lpErrno) *lpErrno = WSAENOBUFS;
+                  return SOCKET_ERROR;
+              }
+              Socket->SharedData->SizeOfRecvBuffer = BufferSize;
+              goto SendToHelper;
+
            case SO_ERROR:
               if (optlen < sizeof(INT))
               {
@@ -3950,6 +4011,9 @@ DllMain(HANDLE hInstDll,
         /* Initialize the lock that protects our socket list */
         InitializeCriticalSection(&SocketListLock);
 
+        /* And the one that protects the AcceptEx wait threads */
+        InitializeCriticalSection(&SockAcceptExLock);
+
         TRACE("MSAFD.DLL has been loaded\n");
 
         break;
@@ -3964,6 +4028,7 @@ DllMain(HANDLE hInstDll,
 
         /* Delete the socket list lock */
         DeleteCriticalSection(&SocketListLock);
+        DeleteCriticalSection(&SockAcceptExLock);
 
         break;
     }
@@ -0,0 +1,611 @@
+/*
+ * COPYRIGHT:   See COPYING in the top level directory
+ * PROJECT:     ReactOS Ancillary Function Driver DLL
+ * FILE:        dll/win32/msafd/misc/extensions.c
+ * PURPOSE:     Microsoft Winsock extension functions (TransmitFile, AcceptEx)
+ */
+
+#include <msafd.h>
+
+#include <wine/debug.h>
+WINE_DEFAULT_DEBUG_CHANNEL(msafd);
+
+/* Steps of an AcceptEx, each one is an AFD request */
+enum
+{
+    AcceptExListen,
+    AcceptExAccept,
+    AcceptExReceive,
+    AcceptExDone
+};
+
+typedef struct _ACCEPTEX_CONTEXT
+{
+    PSOCKET_INFORMATION ListenSocket;
+    PSOCKET_INFORMATION AcceptSocketInfo;
+    SOCKET AcceptSocket;
+    PVOID OutputBuffer;
+    DWORD ReceiveDataLength;
+    DWORD LocalAddressLength;
+    DWORD RemoteAddressLength;
+    DWORD BytesReceived;
+    LPOVERLAPPED Overlapped;
+    ULONG Step;
+    HANDLE Event;
+    IO_STATUS_BLOCK IoStatus;
+    AFD_ACCEPT_DATA AcceptData;
+    AFD_WSABUF Buffer;
+    AFD_RECV_INFO RecvInfo;
+    UCHAR ListenData[0x1A];
+} ACCEPTEX_CONTEXT, *PACCEPTEX_CONTEXT;
+
+/*
+ * Overlapped AcceptEx requests are driven by a wait thread, which waits for
+ * the events of up to MAXIMUM_WAIT_OBJECTS - 1 of them. Slot 0 holds the
+ * event that wakes the thread up when a request is added.
+ */
+typedef struct _ACCEPTEX_WAITER
+{
+    LIST_ENTRY ListEntry;
+    ULONG Count;
+    ULONG Reserved;
+    HANDLE Events[MAXIMUM_WAIT_OBJECTS];
+    PACCEPTEX_CONTEXT Contexts[MAXIMUM_WAIT_OBJECTS];
+} ACCEPTEX_WAITER, *PACCEPTEX_WAITER;
+
+CRITICAL_SECTION SockAcceptExLock;
+static LIST_ENTRY SockAcceptExWaiters = { &SockAcceptExWaiters, &SockAcceptExWaiters };
+
+BOOL
+PASCAL
+MsafdTransmitFile(SOCKET Handle,
+                  HANDLE File,
+                  DWORD NumberOfBytesToWrite,
+                  DWORD NumberOfBytesPerSend,
+                  LPOVERLAPPED Overlapped,
+                  LPTRANSMIT_FILE_BUFFERS TransmitBuffers,
+                  DWORD Flags)
+{
+    IO_STATUS_BLOCK         DummyIOSB;
+    PIO_STATUS_BLOCK        IOSB;
+    AFD_TRANSMIT_FILE_INFO  TransmitInfo;
+    PSOCKET_INFORMATION     Socket;
+    LARGE_INTEGER           Zero;
+    NTSTATUS                Status;
+    HANDLE                  Event;
+    HANDLE                  SockEvent = NULL;
+    INT                     Errno;
+
+    TRACE("Called (%x)\n", Handle);
+
+    /* Get the Socket Structure associate to this Socket*/
+    Socket = GetSocketStructure(Handle);
+    if (!Socket)
+    {
+        WSASetLastError(WSAENOTSOCK);
+        return FALSE;
+    }
+    if (Socket->SharedData->State != SocketConnected ||
+        Socket->SharedData->SocketType != SOCK_STREAM)
+    {
+        WSASetLastError(WSAENOTCONN);
+        return FALSE;
+    }
+
+    /* Set up the Transmit Structure */
+    RtlZeroMemory(&TransmitInfo, sizeof(TransmitInfo));
+    TransmitInfo.FileHandle = File;
+    TransmitInfo.WriteLength = NumberOfBytesToWrite;
+    TransmitInfo.SendPerRequest = NumberOfBytesPerSend;
+    TransmitInfo.Flags = Flags & (AFD_TF_DISCONNECT | AFD_TF_REUSE_SOCKET);
+    if (TransmitBuffers)
+    {
+        TransmitInfo.Head.buf = TransmitBuffers->Head;
+        TransmitInfo.Head.len = TransmitBuffers->HeadLength;
+        TransmitInfo.Tail.buf = TransmitBuffers->Tail;
+        TransmitInfo.Tail.len = TransmitBuffers->TailLength;
+    }
+
+    if (Overlapped)
+    {
+        /* Overlapped requests say where to start */
+        TransmitInfo.Offset.LowPart = Overlapped->Offset;
+        TransmitInfo.Offset.HighPart = Overlapped->OffsetHigh;
+
+        Event = Overlapped->hEvent;
+        IOSB = (PIO_STATUS_BLOCK)&Overlapped->Internal;
+    }
+    else
+    {
+        /* Otherwise we start at the current file position */
+        Zero.QuadPart = 0;
+        if (File && !SetFilePointerEx(File, Zero, &TransmitInfo.Offset, FILE_CURRENT))
+        {
+            WSASetLastError(WSAEINVAL);
+            return FALSE;
+        }
+
+        Status = NtCreateEvent(&SockEvent, EVENT_ALL_ACCESS, NULL, 1, FALSE);
+        if (!NT_SUCCESS(Status))
+        {
+            WSASetLastError(WSAENOBUFS);
+            return FALSE;
+        }
+
+        Event = SockEvent;
+        IOSB = &DummyIOSB;
+    }
+
+    IOSB->Status = STATUS_PENDING;
+
+    /* Send IOCTL, AFD sends the file straight from the cache */
+    Status = NtDeviceIoControlFile((HANDLE)Handle,
+                                   Event,
+                                   NULL,
+                                   Overlapped,
+                                   IOSB,
+                                   IOCTL_AFD_TRANSMIT_FILE,
+                                   &TransmitInfo,
+                                   sizeof(TransmitInfo),
+                                   NULL,
+                                   0);
+
+    if (SockEvent)
+    {
+        /* Wait for completion of not overlapped */
+        if (Status == STATUS_PENDING)
+        {
+            WaitForSingleObject(SockEvent, INFINITE);
+            Status = IOSB->Status;
+        }
+        NtClose(SockEvent);
+    }
+
+    if (Status == STATUS_PENDING)
+    {
+        TRACE("Leaving (Pending)\n");
+        WSASetLastError(WSA_IO_PENDING);
+        return FALSE;
+    }
+
+    /* Re-enable Async Event */
+    SockReenableAsyncSelectEvent(Socket, FD_WRITE);
+
+    MsafdReturnWithErrno(Status, &Errno, 0, NULL);
+    if (Errno != NO_ERROR)
+    {
+        WSASetLastError(Errno);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static
+NTSTATUS
+AcceptExConnected(PACCEPTEX_CONTEXT Context)
+{
+    PCHAR   AddressBuffer;
+    INT     AddressLength, Errno;
+
+    Context->ListenSocket->SharedData->SocketLastError = NO_ERROR;
+
+    Context->AcceptSocketInfo->SharedData->State = SocketConnected;
+    Context->AcceptSocketInfo->SharedData->ConnectTime = GetCurrentTimeInSeconds();
+
+    /* Re-enable Async Event */
+    SockReenableAsyncSelectEvent(Context->ListenSocket, FD_ACCEPT);
+
+    /* Each address is stored behind its length, see MsafdGetAcceptExSockaddrs */
+    AddressBuffer = (PCHAR)Context->OutputBuffer + Context->ReceiveDataLength;
+
+    AddressLength = Context->LocalAddressLength - sizeof(INT);
+    if (WSPGetSockName(Context->AcceptSocket,
+                       (LPSOCKADDR)(AddressBuffer + sizeof(INT)),
+                       &AddressLength,
+                       &Errno) == SOCKET_ERROR)
+    {
+        return STATUS_ACCESS_VIOLATION;
+    }
+    *(PINT)AddressBuffer = AddressLength;
+    AddressBuffer += Context->LocalAddressLength;
+
+    AddressLength = Context->RemoteAddressLength - sizeof(INT);
+    if (WSPGetPeerName(Context->AcceptSocket,
+                       (LPSOCKADDR)(AddressBuffer + sizeof(INT)),
+                       &AddressLength,
+                       &Errno) == SOCKET_ERROR)
+    {
+        return STATUS_ACCESS_VIOLATION;
+    }
+    *(PINT)AddressBuffer = AddressLength;
+
+    return STATUS_SUCCESS;
+}
+
+/*
+ * Issues the AFD requests of an AcceptEx until one of them pends. Returns
+ * STATUS_PENDING when Context->Event will be signaled, and the final status
+ * once the accept is over. Nothing may touch the context after an AFD
+ * request pended, the wait thread owns it from then on.
+ */
+static
+NTSTATUS
+AcceptExStep(PACCEPTEX_CONTEXT Context)
+{
+    PAFD_RECEIVED_ACCEPT_DATA ListenReceiveData;
+    NTSTATUS Status;
+
+    for (;;)
+    {
+        Status = Context->IoStatus.Status;
+        if (!NT_SUCCESS(Status))
+        {
+            Context->ListenSocket->SharedData->SocketLastError = TranslateNtStatusError(Status);
+            return Status;
+        }
+
+        switch (Context->Step++)
+        {
+            case AcceptExListen:
+                /* Wait for a connection */
+                Status = NtDeviceIoControlFile((HANDLE)Context->ListenSocket->Handle,
+                                               Context->Event,
+                                               NULL,
+                                               NULL,
+                                               &Context->IoStatus,
+                                               IOCTL_AFD_WAIT_FOR_LISTEN,
+                                               NULL,
+                                               0,
+                                               Context->ListenData,
+                                               sizeof(Context->ListenData));
+                break;
+
+            case AcceptExAccept:
+                /* Hand it to the socket the caller created in advance */
+                ListenReceiveData = (PAFD_RECEIVED_ACCEPT_DATA)Context->ListenData;
+                Context->AcceptData.ListenHandle = (HANDLE)Context->AcceptSocket;
+                Context->AcceptData.SequenceNumber = ListenReceiveData->SequenceNumber;
+
+                Status = NtDeviceIoControlFile((HANDLE)Context->ListenSocket->Handle,
+                                               Context->Event,
+                                               NULL,
+                                               NULL,
+                                               &Context->IoStatus,
+                                               IOCTL_AFD_ACCEPT,
+                                               &Context->AcceptData,
+                                               sizeof(Context->AcceptData),
+                                               NULL,
+                                               0);
+                break;
+
+            case AcceptExReceive:
+                Status = AcceptExConnected(Context);
+                if (!NT_SUCCESS(Status) || !Context->ReceiveDataLength)
+                    return Status;
+
+                /* Then wait for the first block of data */
+                Context->Buffer.buf = Context->OutputBuffer;
+                Context->Buffer.len = Context->ReceiveDataLength;
+                Context->RecvInfo.BufferArray = &Context->Buffer;
+                Context->RecvInfo.BufferCount = 1;
+                Context->RecvInfo.TdiFlags = TDI_RECEIVE_NORMAL;
+                Context->RecvInfo.AfdFlags = Context->Overlapped ? AFD_OVERLAPPED : 0;
+
+                Status = NtDeviceIoControlFile((HANDLE)Context->AcceptSocket,
+                                               Context->Event,
+                                               NULL,
+                                               NULL,
+                                               &Context->IoStatus,
+                                               IOCTL_AFD_RECV,
+                                               &Context->RecvInfo,
+                                               sizeof(Context->RecvInfo),
+                                               NULL,
+                                               0);
+                break;
+
+            default:
+                Context->BytesReceived = (DWORD)Context->IoStatus.Information;
+                return STATUS_SUCCESS;
+        }
+
+        if (Status == STATUS_PENDING)
+            return Status;
+
+        /* Completed inline, so the event must not wake anyone up */
+        NtClearEvent(Context->Event);
+        Context->IoStatus.Status = Status;
+    }
+}
+
+static
+VOID
+AcceptExComplete(PACCEPTEX_CONTEXT Context,
+                 NTSTATUS Status)
+{
+    LPOVERLAPPED Overlapped = Context->Overlapped;
+
+    /* Complete the overlapped request the same way the I/O manager does */
+    Overlapped->InternalHigh = Context->BytesReceived;
+    Overlapped->Internal = Status;
+    if (Overlapped->hEvent)
+        SetEvent(Overlapped->hEvent);
+
+    NtClose(Context->Event);
+    HeapFree(GlobalHeap, 0, Context);
+}
+
+static
+DWORD
+WINAPI
+AcceptExWaitThread(LPVOID Parameter)
+{
+    PACCEPTEX_WAITER    Waiter = Parameter;
+    PACCEPTEX_CONTEXT   Context;
+    HANDLE              Events[MAXIMUM_WAIT_OBJECTS];
+    DWORD               Count, Index;
+    NTSTATUS            Status;
+
+    for (;;)
+    {
+        EnterCriticalSection(&SockAcceptExLock);
+        Count = Waiter->Count;
+        RtlCopyMemory(Events, Waiter->Events, Count * sizeof(HANDLE));
+        LeaveCriticalSection(&SockAcceptExLock);
+
+        Index = WaitForMultipleObjects(Count, Events, FALSE, INFINITE) - WAIT_OBJECT_0;
+        if (Index >= Count)
+        {
+            /* It Failed, sleep for a second */
+            Sleep(1000);
+            continue;
+        }
+
+        /* A new request was added */
+        if (Index == 0)
+            continue;
+
+        /* Only this thread removes requests, so the slot is still the same */
+        Context = Waiter->Contexts[Index];
+        Status = AcceptExStep(Context);
+        if (Status == STATUS_PENDING)
+            continue;
+
+        EnterCriticalSection(&SockAcceptExLock);
+        Waiter->Count--;
+        Waiter->Events[Index] = Waiter->Events[Waiter->Count];
+        Waiter->Contexts[Index] = Waiter->Contexts[Waiter->Count];
+        LeaveCriticalSection(&SockAcceptExLock);
+
+        AcceptExComplete(Context, Status);
+    }
+
+    return 0;
+}
+
+/*
+ * Reserves a slot with a wait thread before the first AFD request is issued,
+ * so that a pending request always finds one.
+ */
+static
+PACCEPTEX_WAITER
+AcceptExReserveWait(VOID)
+{
+    PACCEPTEX_WAITER    Waiter;
+    PLIST_ENTRY         Entry;
+    HANDLE              Thread;
+
+    EnterCriticalSection(&SockAcceptExLock);
+
+    for (Entry = SockAcceptExWaiters.Flink;
+         Entry != &SockAcceptExWaiters;
+         Entry = Entry->Flink)
+    {
+        Waiter = CONTAINING_RECORD(Entry, ACCEPTEX_WAITER, ListEntry);
+        if (Waiter->Count + Waiter->Reserved < MAXIMUM_WAIT_OBJECTS)
+        {
+            Waiter->Reserved++;
+            LeaveCriticalSection(&SockAcceptExLock);
+            return Waiter;
+        }
+    }
+
+    /* All of them are busy, start another one */
+    Waiter = HeapAlloc(GlobalHeap, 0, sizeof(*Waiter));
+    if (!Waiter)
+    {
+        LeaveCriticalSection(&SockAcceptExLock);
+        return NULL;
+    }
+
+    Waiter->Events[0] = CreateEventW(NULL, FALSE, FALSE, NULL);
+    if (!Waiter->Events[0])
+    {
+        HeapFree(GlobalHeap, 0, Waiter);
+        LeaveCriticalSection(&SockAcceptExLock);
+        return NULL;
+    }
+    Waiter->Count = 1;
+    Waiter->Reserved = 1;
+
+    Thread = CreateThread(NULL, 0, AcceptExWaitThread, Waiter, 0, NULL);
+    if (!Thread)
+    {
+        CloseHandle(Waiter->Events[0]);
+        HeapFree(GlobalHeap, 0, Waiter);
+        LeaveCriticalSection(&SockAcceptExLock);
+        return NULL;
+    }
+    CloseHandle(Thread);
+
+    InsertTailList(&SockAcceptExWaiters, &Waiter->ListEntry);
+
+    LeaveCriticalSection(&SockAcceptExLock);
+    return Waiter;
+}
+
+static
+VOID
+AcceptExQueueWait(PACCEPTEX_WAITER Waiter,
+                  PACCEPTEX_CONTEXT Context)
+{
+    EnterCriticalSection(&SockAcceptExLock);
+
+    Waiter->Reserved--;
+    if (Context)
+    {
+        Waiter->Events[Waiter->Count] = Context->Event;
+        Waiter->Contexts[Waiter->Count] = Context;
+        Waiter->Count++;
+        SetEvent(Waiter->Events[0]);
+    }
+
+    LeaveCriticalSection(&SockAcceptExLock);
+}
+
+BOOL
+PASCAL
+MsafdAcceptEx(SOCKET ListenSocket,
+              SOCKET AcceptSocket,
+              PVOID OutputBuffer,
+              DWORD ReceiveDataLength,
+              DWORD LocalAddressLength,
+              DWORD RemoteAddressLength,
+              LPDWORD BytesReceived,
+              LPOVERLAPPED Overlapped)
+{
+    PSOCKET_INFORMATION Socket;
+    PSOCKET_INFORMATION AcceptSocketInfo;
+    PACCEPTEX_CONTEXT   Context;
+    PACCEPTEX_WAITER    Waiter = NULL;
+    NTSTATUS            Status;
+    INT                 Errno;
+
+    TRACE("Called (%x, %x)\n", ListenSocket, AcceptSocket);
+
+    Socket = GetSocketStructure(ListenSocket);
+    AcceptSocketInfo = GetSocketStructure(AcceptSocket);
+    if (!Socket || !AcceptSocketInfo)
+    {
+        WSASetLastError(WSAENOTSOCK);
+        return FALSE;
+    }
+    if (!Socket->SharedData->Listening ||
+        AcceptSocketInfo->SharedData->State != SocketOpen)
+    {
+        WSASetLastError(WSAEINVAL);
+        return FALSE;
+    }
+    if (!OutputBuffer ||
+        (!BytesReceived && !Overlapped) ||
+        LocalAddressLength < Socket->SharedData->SizeOfLocalAddress + 16 ||
+        RemoteAddressLength < Socket->SharedData->SizeOfRemoteAddress + 16)
+    {
+        WSASetLastError(WSAEFAULT);
+        return FALSE;
+    }
+
+    Context = HeapAlloc(GlobalHeap, HEAP_ZERO_MEMORY, sizeof(*Context));
+    if (!Context)
+    {
+        WSASetLastError(WSAENOBUFS);
+        return FALSE;
+    }
+
+    Status = NtCreateEvent(&Context->Event, EVENT_ALL_ACCESS, NULL, 1, FALSE);
+    if (!NT_SUCCESS(Status))
+    {
+        HeapFree(GlobalHeap, 0, Context);
+        WSASetLastError(WSAENOBUFS);
+        return FALSE;
+    }
+
+    Context->ListenSocket = Socket;
+    Context->AcceptSocketInfo = AcceptSocketInfo;
+    Context->AcceptSocket = AcceptSocket;
+    Context->OutputBuffer = OutputBuffer;
+    Context->ReceiveDataLength = ReceiveDataLength;
+    Context->LocalAddressLength = LocalAddressLength;
+    Context->RemoteAddressLength = RemoteAddressLength;
+    Context->Overlapped = Overlapped;
+    Context->Step = AcceptExListen;
+    Context->IoStatus.Status = STATUS_SUCCESS;
+
+    if (Overlapped)
+    {
+        Waiter = AcceptExReserveWait();
+        if (!Waiter)
+        {
+            NtClose(Context->Event);
+            HeapFree(GlobalHeap, 0, Context);
+            WSASetLastError(WSAENOBUFS);
+            return FALSE;
+        }
+
+        Overlapped->Internal = STATUS_PENDING;
+        Overlapped->InternalHigh = 0;
+        if (Overlapped->hEvent)
+            ResetEvent(Overlapped->hEvent);
+
+        /* The wait thread carries on once AFD signals the event */
+        Status = AcceptExStep(Context);
+        if (Status == STATUS_PENDING)
+        {
+            AcceptExQueueWait(Waiter, Context);
+            WSASetLastError(WSA_IO_PENDING);
+            return FALSE;
+        }
+
+        AcceptExQueueWait(Waiter, NULL);
+    }
+    else
+    {
+        while ((Status = AcceptExStep(Context)) == STATUS_PENDING)
+            WaitForSingleObject(Context->Event, INFINITE);
+    }
+
+    if (BytesReceived)
+        *BytesReceived = Context->BytesReceived;
+
+    if (Overlapped)
+    {
+        AcceptExComplete(Context, Status);
+    }
+    else
+    {
+        NtClose(Context->Event);
+        HeapFree(GlobalHeap, 0, Context);
+    }
+
+    MsafdReturnWithErrno(Status, &Errno, 0, NULL);
+    if (Errno != NO_ERROR)
+    {
+        WSASetLastError(Errno);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+VOID
+PASCAL
+MsafdGetAcceptExSockaddrs(PVOID OutputBuffer,
+                          DWORD ReceiveDataLength,
+                          DWORD LocalAddressLength,
+                          DWORD RemoteAddressLength,
+                          LPSOCKADDR* LocalSockaddr,
+                          LPINT LocalSockaddrLength,
+                          LPSOCKADDR* RemoteSockaddr,
+                          LPINT RemoteSockaddrLength)
+{
+    PCHAR AddressBuffer = (PCHAR)OutputBuffer + ReceiveDataLength;
+
+    *LocalSockaddrLength = *(PINT)AddressBuffer;
+    *LocalSockaddr = (LPSOCKADDR)(AddressBuffer + sizeof(INT));
+
+    AddressBuffer += LocalAddressLength;
+    *RemoteSockaddrLength = *(PINT)AddressBuffer;
+    *RemoteSockaddr = (LPSOCKADDR)(AddressBuffer + sizeof(INT));
+}
+
+/* EOF */
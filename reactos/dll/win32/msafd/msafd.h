@@ -37,6 +37,7 @@ extern LIST_ENTRY SockHelpersListHead;
 extern HANDLE SockEvent;
 extern HANDLE SockAsyncCompletionPort;
 extern BOOLEAN SockAsyncSelectCalled;
+extern CRITICAL_SECTION SockAcceptExLock;
 
 typedef enum _SOCKET_STATE {
     SocketOpen,
@@ -428,6 +429,43 @@ PSOCKET_INFORMATION GetSocketStructure(
 
 INT TranslateNtStatusError( NTSTATUS Status );
 
+DWORD GetCurrentTimeInSeconds( VOID );
+
+BOOL
+PASCAL
+MsafdTransmitFile(
+    SOCKET Handle,
+    HANDLE File,
+    DWORD NumberOfBytesToWrite,
+    DWORD NumberOfBytesPerSend,
+    LPOVERLAPPED Overlapped,
+    LPTRANSMIT_FILE_BUFFERS TransmitBuffers,
+    DWORD Flags);
+
+BOOL
+PASCAL
+MsafdAcceptEx(
+    SOCKET ListenSocket,
+    SOCKET AcceptSocket,
+    PVOID OutputBuffer,
+    DWORD ReceiveDataLength,
+    DWORD LocalAddressLength,
+    DWORD RemoteAddressLength,
+    LPDWORD BytesReceived,
+    LPOVERLAPPED Overlapped);
+
+VOID
+PASCAL
+MsafdGetAcceptExSockaddrs(
+    PVOID OutputBuffer,
+    DWORD ReceiveDataLength,
+    DWORD LocalAddressLength,
+    DWORD RemoteAddressLength,
+    LPSOCKADDR* LocalSockaddr,
+    LPINT LocalSockaddrLength,
+    LPSOCKADDR* RemoteSockaddr,
+    LPINT RemoteSockaddrLength);
+
 VOID DeleteSocketStructure( SOCKET Handle );
 
 int GetSocketInformation(
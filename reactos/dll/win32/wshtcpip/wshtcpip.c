@@ -174,6 +174,10 @@ GetTdiTypeId(
                 /* FIXME: Return proper option */
                 ASSERT(FALSE);
                 break;
+             case SO_RCVBUF:
+                *TdiType = INFO_TYPE_CONNECTION;
+                *TdiId = TCP_SOCKET_WINDOW;
+                return;
              default:
                 break;
           }
@@ -694,6 +698,19 @@ WSHSetSocketInformation(
                     DPRINT1("Set: SO_KEEPALIVE not yet supported\n");
                     return 0;
 
+                case SO_RCVBUF:
+                    if (OptionLength < sizeof(INT))
+                    {
+                        return WSAEFAULT;
+                    }
+                    /* Only TCP has a receive window to size */
+                    if (Context->SocketType != SOCK_STREAM)
+                    {
+                        return 0;
+                    }
+                    /* Send this to TCPIP */
+                    break;
+
                 default:
                     /* Invalid option */
                     DPRINT1("Set: Received unexpected SOL_SOCKET option %d\n", OptionName);
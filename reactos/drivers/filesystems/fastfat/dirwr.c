@@ -891,6 +891,7 @@ FATDelEntry(
             WriteCluster(DeviceExt, CurrentCluster, 0);
             CurrentCluster = NextCluster;
         }
+        FsRtlResetLargeMcb(&pFcb->ClusterMcb, FALSE);
     }
 
     return STATUS_SUCCESS;
@@ -958,6 +959,7 @@ FATXDelEntry(
             WriteCluster(DeviceExt, CurrentCluster, 0);
             CurrentCluster = NextCluster;
         }
+        FsRtlResetLargeMcb(&pFcb->ClusterMcb, FALSE);
     }
 
     return STATUS_SUCCESS;
@@ -31,19 +31,30 @@ VfatFastIoCheckIfPossible(
     OUT PIO_STATUS_BLOCK IoStatus,
     IN PDEVICE_OBJECT DeviceObject)
 {
-    /* Prevent all Fast I/O requests */
-    DPRINT("VfatFastIoCheckIfPossible(): returning FALSE.\n");
+    PVFATFCB FCB = FileObject->FsContext;
+    LARGE_INTEGER LargeLength;
+
+    DPRINT("VfatFastIoCheckIfPossible()\n");
 
-    UNREFERENCED_PARAMETER(FileObject);
-    UNREFERENCED_PARAMETER(FileOffset);
-    UNREFERENCED_PARAMETER(Length);
     UNREFERENCED_PARAMETER(Wait);
-    UNREFERENCED_PARAMETER(LockKey);
-    UNREFERENCED_PARAMETER(CheckForReadOperation);
     UNREFERENCED_PARAMETER(IoStatus);
     UNREFERENCED_PARAMETER(DeviceObject);
 
-    return FALSE;
+    /* Only reads of regular files go through the cache manager directly */
+    if (!CheckForReadOperation ||
+        vfatFCBIsDirectory(FCB) ||
+        BooleanFlagOn(FCB->Flags, FCB_IS_FAT | FCB_IS_PAGE_FILE | FCB_IS_VOLUME))
+    {
+        return FALSE;
+    }
+
+    LargeLength.QuadPart = Length;
+    return FsRtlFastCheckLockForRead(&FCB->FileLock,
+                                     FileOffset,
+                                     &LargeLength,
+                                     LockKey,
+                                     FileObject,
+                                     PsGetCurrentProcess());
 }
 
 static FAST_IO_READ VfatFastIoRead;
@@ -453,15 +464,14 @@ VfatMdlRead(
 {
     DPRINT("VfatMdlRead\n");
 
-    UNREFERENCED_PARAMETER(FileObject);
-    UNREFERENCED_PARAMETER(FileOffset);
-    UNREFERENCED_PARAMETER(Length);
-    UNREFERENCED_PARAMETER(LockKey);
-    UNREFERENCED_PARAMETER(MdlChain);
-    UNREFERENCED_PARAMETER(IoStatus);
-    UNREFERENCED_PARAMETER(DeviceObject);
-
-    return FALSE;
+    /* VfatFastIoCheckIfPossible decides which files qualify */
+    return FsRtlMdlReadDev(FileObject,
+                           FileOffset,
+                           Length,
+                           LockKey,
+                           MdlChain,
+                           IoStatus,
+                           DeviceObject);
 }
 
 static FAST_IO_MDL_READ_COMPLETE VfatMdlReadComplete;
@@ -476,11 +486,7 @@ VfatMdlReadComplete(
 {
     DPRINT("VfatMdlReadComplete\n");
 
-    UNREFERENCED_PARAMETER(FileObject);
-    UNREFERENCED_PARAMETER(MdlChain);
-    UNREFERENCED_PARAMETER(DeviceObject);
-
-    return FALSE;
+    return FsRtlMdlReadCompleteDev(FileObject, MdlChain, DeviceObject);
 }
 
 static FAST_IO_PREPARE_MDL_WRITE VfatPrepareMdlWrite;
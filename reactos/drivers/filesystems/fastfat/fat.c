@@ -19,6 +19,9 @@
 #define  CACHEPAGESIZE(pDeviceExt) ((pDeviceExt)->FatInfo.BytesPerCluster > PAGE_SIZE ? \
 		   (pDeviceExt)->FatInfo.BytesPerCluster : PAGE_SIZE)
 
+/* Free clusters wanted after the first cluster of a new chain */
+#define VFAT_PREFERRED_RUN 16
+
 /* FUNCTIONS ****************************************************************/
 
 /*
@@ -164,223 +167,15 @@ FAT12GetNextCluster(
 }
 
 /*
- * FUNCTION: Finds the first available cluster in a FAT16 table
- */
-NTSTATUS
-FAT16FindAndMarkAvailableCluster(
-    PDEVICE_EXTENSION DeviceExt,
-    PULONG Cluster)
-{
-    ULONG FatLength;
-    ULONG StartCluster;
-    ULONG i, j;
-    PVOID BaseAddress;
-    ULONG ChunkSize;
-    PVOID Context = 0;
-    LARGE_INTEGER Offset;
-    PUSHORT Block;
-    PUSHORT BlockEnd;
-
-    ChunkSize = CACHEPAGESIZE(DeviceExt);
-    FatLength = (DeviceExt->FatInfo.NumberOfClusters + 2);
-    *Cluster = 0;
-    StartCluster = DeviceExt->LastAvailableCluster;
-
-    for (j = 0; j < 2; j++)
-    {
-        for (i = StartCluster; i < FatLength;)
-        {
-            Offset.QuadPart = ROUND_DOWN(i * 2, ChunkSize);
-            _SEH2_TRY
-            {
-                CcPinRead(DeviceExt->FATFileObject, &Offset, ChunkSize, PIN_WAIT, &Context, &BaseAddress);
-            }
-            _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
-            {
-                DPRINT1("CcPinRead(Offset %x, Length %u) failed\n", (ULONG)Offset.QuadPart, ChunkSize);
-                _SEH2_YIELD(return _SEH2_GetExceptionCode());
-            }
-            _SEH2_END;
-
-            Block = (PUSHORT)((ULONG_PTR)BaseAddress + (i * 2) % ChunkSize);
-            BlockEnd = (PUSHORT)((ULONG_PTR)BaseAddress + ChunkSize);
-
-            /* Now process the whole block */
-            while (Block < BlockEnd && i < FatLength)
-            {
-                if (*Block == 0)
-                {
-                    DPRINT("Found available cluster 0x%x\n", i);
-                    DeviceExt->LastAvailableCluster = *Cluster = i;
-                    *Block = 0xffff;
-                    CcSetDirtyPinnedData(Context, NULL);
-                    CcUnpinData(Context);
-                    if (DeviceExt->AvailableClustersValid)
-                        InterlockedDecrement((PLONG)&DeviceExt->AvailableClusters);
-                    return STATUS_SUCCESS;
-                }
-
-                Block++;
-                i++;
-            }
-
-            CcUnpinData(Context);
-        }
-
-        FatLength = StartCluster;
-        StartCluster = 2;
-    }
-
-    return STATUS_DISK_FULL;
-}
-
-/*
- * FUNCTION: Finds the first available cluster in a FAT12 table
- */
-NTSTATUS
-FAT12FindAndMarkAvailableCluster(
-    PDEVICE_EXTENSION DeviceExt,
-    PULONG Cluster)
-{
-    ULONG FatLength;
-    ULONG StartCluster;
-    ULONG Entry;
-    PUSHORT CBlock;
-    ULONG i, j;
-    PVOID BaseAddress;
-    PVOID Context;
-    LARGE_INTEGER Offset;
-
-    FatLength = DeviceExt->FatInfo.NumberOfClusters + 2;
-    *Cluster = 0;
-    StartCluster = DeviceExt->LastAvailableCluster;
-    Offset.QuadPart = 0;
-    _SEH2_TRY
-    {
-        CcPinRead(DeviceExt->FATFileObject, &Offset, DeviceExt->FatInfo.FATSectors * DeviceExt->FatInfo.BytesPerSector, PIN_WAIT, &Context, &BaseAddress);
-    }
-    _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
-    {
-        DPRINT1("CcPinRead(Offset %x, Length %u) failed\n", (ULONG)Offset.QuadPart, DeviceExt->FatInfo.FATSectors * DeviceExt->FatInfo.BytesPerSector);
-        _SEH2_YIELD(return _SEH2_GetExceptionCode());
-    }
-    _SEH2_END;
-
-    for (j = 0; j < 2; j++)
-    {
-        for (i = StartCluster; i < FatLength; i++)
-        {
-            CBlock = (PUSHORT)((char*)BaseAddress + (i * 12) / 8);
-            if ((i % 2) == 0)
-            {
-                Entry = *CBlock & 0xfff;
-            }
-            else
-            {
-                Entry = *CBlock >> 4;
-            }
-
-            if (Entry == 0)
-            {
-                DPRINT("Found available cluster 0x%x\n", i);
-                DeviceExt->LastAvailableCluster = *Cluster = i;
-                if ((i % 2) == 0)
-                    *CBlock = (*CBlock & 0xf000) | 0xfff;
-                else
-                    *CBlock = (*CBlock & 0xf) | 0xfff0;
-                CcSetDirtyPinnedData(Context, NULL);
-                CcUnpinData(Context);
-                if (DeviceExt->AvailableClustersValid)
-                    InterlockedDecrement((PLONG)&DeviceExt->AvailableClusters);
-                return STATUS_SUCCESS;
-            }
-        }
-        FatLength = StartCluster;
-        StartCluster = 2;
-    }
-    CcUnpinData(Context);
-    return STATUS_DISK_FULL;
-}
-
-/*
- * FUNCTION: Finds the first available cluster in a FAT32 table
- */
-NTSTATUS
-FAT32FindAndMarkAvailableCluster(
-    PDEVICE_EXTENSION DeviceExt,
-    PULONG Cluster)
-{
-    ULONG FatLength;
-    ULONG StartCluster;
-    ULONG i, j;
-    PVOID BaseAddress;
-    ULONG ChunkSize;
-    PVOID Context;
-    LARGE_INTEGER Offset;
-    PULONG Block;
-    PULONG BlockEnd;
-
-    ChunkSize = CACHEPAGESIZE(DeviceExt);
-    FatLength = (DeviceExt->FatInfo.NumberOfClusters + 2);
-    *Cluster = 0;
-    StartCluster = DeviceExt->LastAvailableCluster;
-
-    for (j = 0; j < 2; j++)
-    {
-        for (i = StartCluster; i < FatLength;)
-        {
-            Offset.QuadPart = ROUND_DOWN(i * 4, ChunkSize);
-            _SEH2_TRY
-            {
-                CcPinRead(DeviceExt->FATFileObject, &Offset, ChunkSize, PIN_WAIT, &Context, &BaseAddress);
-            }
-            _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
-            {
-                DPRINT1("CcPinRead(Offset %x, Length %u) failed\n", (ULONG)Offset.QuadPart, ChunkSize);
-                _SEH2_YIELD(return _SEH2_GetExceptionCode());
-            }
-            _SEH2_END;
-            Block = (PULONG)((ULONG_PTR)BaseAddress + (i * 4) % ChunkSize);
-            BlockEnd = (PULONG)((ULONG_PTR)BaseAddress + ChunkSize);
-
-            /* Now process the whole block */
-            while (Block < BlockEnd && i < FatLength)
-            {
-                if ((*Block & 0x0fffffff) == 0)
-                {
-                    DPRINT("Found available cluster 0x%x\n", i);
-                    DeviceExt->LastAvailableCluster = *Cluster = i;
-                    *Block = 0x0fffffff;
-                    CcSetDirtyPinnedData(Context, NULL);
-                    CcUnpinData(Context);
-                    if (DeviceExt->AvailableClustersValid)
-                        InterlockedDecrement((PLONG)&DeviceExt->AvailableClusters);
-                    return STATUS_SUCCESS;
-                }
-
-                Block++;
-                i++;
-            }
-
-            CcUnpinData(Context);
-        }
-        FatLength = StartCluster;
-        StartCluster = 2;
-    }
-    return STATUS_DISK_FULL;
-}
-
-/*
- * FUNCTION: Counts free cluster in a FAT12 table
+ * FUNCTION: Builds the free cluster bitmap from a FAT12 table
  */
 static
 NTSTATUS
-FAT12CountAvailableClusters(
+FAT12BuildClusterBitMap(
     PDEVICE_EXTENSION DeviceExt)
 {
     ULONG Entry;
     PVOID BaseAddress;
-    ULONG ulCount = 0;
     ULONG i;
     ULONG numberofclusters;
     LARGE_INTEGER Offset;
@@ -412,30 +207,27 @@ FAT12CountAvailableClusters(
             Entry = *CBlock >> 4;
         }
 
-        if (Entry == 0)
-            ulCount++;
+        if (Entry != 0)
+            RtlSetBit(&DeviceExt->ClusterBitMap, i);
     }
 
     CcUnpinData(Context);
-    DeviceExt->AvailableClusters = ulCount;
-    DeviceExt->AvailableClustersValid = TRUE;
 
     return STATUS_SUCCESS;
 }
 
 
 /*
- * FUNCTION: Counts free clusters in a FAT16 table
+ * FUNCTION: Builds the free cluster bitmap from a FAT16 table
  */
 static
 NTSTATUS
-FAT16CountAvailableClusters(
+FAT16BuildClusterBitMap(
     PDEVICE_EXTENSION DeviceExt)
 {
     PUSHORT Block;
     PUSHORT BlockEnd;
     PVOID BaseAddress = NULL;
-    ULONG ulCount = 0;
     ULONG i;
     ULONG ChunkSize;
     PVOID Context = NULL;
@@ -463,8 +255,8 @@ FAT16CountAvailableClusters(
         /* Now process the whole block */
         while (Block < BlockEnd && i < FatLength)
         {
-            if (*Block == 0)
-                ulCount++;
+            if (*Block != 0)
+                RtlSetBit(&DeviceExt->ClusterBitMap, i);
             Block++;
             i++;
         }
@@ -472,25 +264,21 @@ FAT16CountAvailableClusters(
         CcUnpinData(Context);
     }
 
-    DeviceExt->AvailableClusters = ulCount;
-    DeviceExt->AvailableClustersValid = TRUE;
-
     return STATUS_SUCCESS;
 }
 
 
 /*
- * FUNCTION: Counts free clusters in a FAT32 table
+ * FUNCTION: Builds the free cluster bitmap from a FAT32 table
  */
 static
 NTSTATUS
-FAT32CountAvailableClusters(
+FAT32BuildClusterBitMap(
     PDEVICE_EXTENSION DeviceExt)
 {
     PULONG Block;
     PULONG BlockEnd;
     PVOID BaseAddress = NULL;
-    ULONG ulCount = 0;
     ULONG i;
     ULONG ChunkSize;
     PVOID Context = NULL;
@@ -519,8 +307,8 @@ FAT32CountAvailableClusters(
         /* Now process the whole block */
         while (Block < BlockEnd && i < FatLength)
         {
-            if ((*Block & 0x0fffffff) == 0)
-                ulCount++;
+            if ((*Block & 0x0fffffff) != 0)
+                RtlSetBit(&DeviceExt->ClusterBitMap, i);
             Block++;
             i++;
         }
@@ -528,32 +316,149 @@ FAT32CountAvailableClusters(
         CcUnpinData(Context);
     }
 
-    DeviceExt->AvailableClusters = ulCount;
+    return STATUS_SUCCESS;
+}
+
+/*
+ * FUNCTION: Reads the FAT once at mount time and records the allocated
+ *           clusters in the in-memory free cluster bitmap
+ */
+NTSTATUS
+InitializeClusterBitMap(
+    PDEVICE_EXTENSION DeviceExt)
+{
+    NTSTATUS Status;
+    PULONG Buffer;
+    ULONG BitMapSize;
+
+    BitMapSize = DeviceExt->FatInfo.NumberOfClusters + 2;
+    Buffer = ExAllocatePoolWithTag(PagedPool, ROUND_UP(BitMapSize, 32) / 8, TAG_BITMAP);
+    if (Buffer == NULL)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlInitializeBitMap(&DeviceExt->ClusterBitMap, Buffer, BitMapSize);
+    RtlClearAllBits(&DeviceExt->ClusterBitMap);
+
+    /* Clusters 0 and 1 are reserved */
+    RtlSetBits(&DeviceExt->ClusterBitMap, 0, 2);
+
+    if (DeviceExt->FatInfo.FatType == FAT12)
+        Status = FAT12BuildClusterBitMap(DeviceExt);
+    else if (DeviceExt->FatInfo.FatType == FAT16 || DeviceExt->FatInfo.FatType == FATX16)
+        Status = FAT16BuildClusterBitMap(DeviceExt);
+    else
+        Status = FAT32BuildClusterBitMap(DeviceExt);
+
+    if (!NT_SUCCESS(Status))
+    {
+        UninitializeClusterBitMap(DeviceExt);
+        return Status;
+    }
+
+    DeviceExt->AvailableClusters = RtlNumberOfClearBits(&DeviceExt->ClusterBitMap);
     DeviceExt->AvailableClustersValid = TRUE;
 
     return STATUS_SUCCESS;
 }
 
+VOID
+UninitializeClusterBitMap(
+    PDEVICE_EXTENSION DeviceExt)
+{
+    if (DeviceExt->ClusterBitMap.Buffer != NULL)
+    {
+        ExFreePoolWithTag(DeviceExt->ClusterBitMap.Buffer, TAG_BITMAP);
+        DeviceExt->ClusterBitMap.Buffer = NULL;
+    }
+}
+
+/*
+ * FUNCTION: Finds an available cluster in the free cluster bitmap and marks
+ *           it as end of chain. PreviousCluster is the last cluster of the
+ *           chain being extended, or 0 when a new chain is started. When the
+ *           chain cannot continue in place, a free run of RunLength clusters
+ *           is looked for, or the longest one if there is none that large
+ */
+static
+NTSTATUS
+FindAndMarkAvailableCluster(
+    PDEVICE_EXTENSION DeviceExt,
+    ULONG PreviousCluster,
+    ULONG RunLength,
+    PULONG Cluster)
+{
+    NTSTATUS Status;
+    ULONG OldValue;
+    ULONG i;
+
+    *Cluster = 0;
+
+    for (;;)
+    {
+        i = 0xffffffff;
+
+        if (PreviousCluster != 0)
+        {
+            /* Keep the chain contiguous if the following cluster is free */
+            if (PreviousCluster + 1 < DeviceExt->ClusterBitMap.SizeOfBitMap &&
+                !RtlTestBit(&DeviceExt->ClusterBitMap, PreviousCluster + 1))
+            {
+                i = PreviousCluster + 1;
+            }
+        }
+        else
+        {
+            /* Start a new chain in a free run, so that it can grow in place */
+            RunLength = max(RunLength, VFAT_PREFERRED_RUN);
+        }
+
+        if (i == 0xffffffff)
+            i = RtlFindClearBits(&DeviceExt->ClusterBitMap, RunLength, DeviceExt->LastAvailableCluster);
+        if (i == 0xffffffff && RtlFindLongestRunClear(&DeviceExt->ClusterBitMap, &i) == 0)
+            return STATUS_DISK_FULL;
+
+        Status = DeviceExt->WriteCluster(DeviceExt, i, 0xffffffff, &OldValue);
+        if (!NT_SUCCESS(Status))
+            return Status;
+
+        RtlSetBit(&DeviceExt->ClusterBitMap, i);
+
+        if (OldValue == 0)
+        {
+            if (DeviceExt->AvailableClustersValid)
+                InterlockedDecrement((PLONG)&DeviceExt->AvailableClusters);
+            break;
+        }
+
+        /* The FAT was changed behind our back, restore the entry and retry.
+           The bitmap counted the cluster as free, so recount it next time */
+        DPRINT1("Cluster 0x%x is not free (0x%x)\n", i, OldValue);
+        DeviceExt->WriteCluster(DeviceExt, i, OldValue, &OldValue);
+        DeviceExt->AvailableClustersValid = FALSE;
+    }
+
+    DPRINT("Found available cluster 0x%x\n", i);
+    DeviceExt->LastAvailableCluster = *Cluster = i;
+    return STATUS_SUCCESS;
+}
+
 NTSTATUS
 CountAvailableClusters(
     PDEVICE_EXTENSION DeviceExt,
     PLARGE_INTEGER Clusters)
 {
-    NTSTATUS Status = STATUS_SUCCESS;
     ExAcquireResourceExclusiveLite (&DeviceExt->FatResource, TRUE);
     if (!DeviceExt->AvailableClustersValid)
     {
-        if (DeviceExt->FatInfo.FatType == FAT12)
-            Status = FAT12CountAvailableClusters(DeviceExt);
-        else if (DeviceExt->FatInfo.FatType == FAT16 || DeviceExt->FatInfo.FatType == FATX16)
-            Status = FAT16CountAvailableClusters(DeviceExt);
-        else
-            Status = FAT32CountAvailableClusters(DeviceExt);
+        DeviceExt->AvailableClusters = RtlNumberOfClearBits(&DeviceExt->ClusterBitMap);
+        DeviceExt->AvailableClustersValid = TRUE;
     }
     Clusters->QuadPart = DeviceExt->AvailableClusters;
     ExReleaseResourceLite (&DeviceExt->FatResource);
 
-    return Status;
+    return STATUS_SUCCESS;
 }
 
 
@@ -706,12 +611,21 @@ WriteCluster(
 
     ExAcquireResourceExclusiveLite (&DeviceExt->FatResource, TRUE);
     Status = DeviceExt->WriteCluster(DeviceExt, ClusterToWrite, NewValue, &OldValue);
-    if (DeviceExt->AvailableClustersValid)
+    if (NT_SUCCESS(Status))
     {
+        /* Keep the free cluster bitmap in sync with the FAT */
         if (OldValue && NewValue == 0)
-            InterlockedIncrement((PLONG)&DeviceExt->AvailableClusters);
+        {
+            RtlClearBit(&DeviceExt->ClusterBitMap, ClusterToWrite);
+            if (DeviceExt->AvailableClustersValid)
+                InterlockedIncrement((PLONG)&DeviceExt->AvailableClusters);
+        }
         else if (OldValue == 0 && NewValue)
-            InterlockedDecrement((PLONG)&DeviceExt->AvailableClusters);
+        {
+            RtlSetBit(&DeviceExt->ClusterBitMap, ClusterToWrite);
+            if (DeviceExt->AvailableClustersValid)
+                InterlockedDecrement((PLONG)&DeviceExt->AvailableClusters);
+        }
     }
     ExReleaseResourceLite(&DeviceExt->FatResource);
     return Status;
@@ -782,7 +696,7 @@ GetNextClusterExtend(
      */
     if (CurrentCluster == 0)
     {
-        Status = DeviceExt->FindAndMarkAvailableCluster(DeviceExt, &NewCluster);
+        Status = FindAndMarkAvailableCluster(DeviceExt, 0, 1, &NewCluster);
         if (!NT_SUCCESS(Status))
         {
             ExReleaseResourceLite(&DeviceExt->FatResource);
@@ -801,7 +715,7 @@ GetNextClusterExtend(
         /* We are after last existing cluster, we must add one to file */
         /* Firstly, find the next available open allocation unit and
            mark it as end of file */
-        Status = DeviceExt->FindAndMarkAvailableCluster(DeviceExt, &NewCluster);
+        Status = FindAndMarkAvailableCluster(DeviceExt, CurrentCluster, 1, &NewCluster);
         if (!NT_SUCCESS(Status))
         {
             ExReleaseResourceLite(&DeviceExt->FatResource);
@@ -818,4 +732,52 @@ GetNextClusterExtend(
     return Status;
 }
 
+/*
+ * FUNCTION: Appends ClusterCount clusters to the chain ending at LastCluster,
+ *           or starts a new chain if LastCluster is 0. The whole allocation is
+ *           reserved as one contiguous run whenever the free space allows it
+ */
+NTSTATUS
+ExtendClusterChain(
+    PDEVICE_EXTENSION DeviceExt,
+    ULONG LastCluster,
+    ULONG ClusterCount,
+    PULONG FirstNewCluster,
+    PULONG LastNewCluster)
+{
+    ULONG NewCluster;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    DPRINT("ExtendClusterChain(DeviceExt %p, LastCluster %x, ClusterCount %u)\n",
+           DeviceExt, LastCluster, ClusterCount);
+
+    *FirstNewCluster = 0;
+    *LastNewCluster = LastCluster;
+
+    ExAcquireResourceExclusiveLite(&DeviceExt->FatResource, TRUE);
+    for (; ClusterCount > 0; ClusterCount--)
+    {
+        Status = FindAndMarkAvailableCluster(DeviceExt, *LastNewCluster, ClusterCount, &NewCluster);
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        /* The new cluster is already end of chain, link it behind the previous one */
+        if (*LastNewCluster != 0)
+        {
+            WriteCluster(DeviceExt, *LastNewCluster, NewCluster);
+        }
+
+        if (*FirstNewCluster == 0)
+        {
+            *FirstNewCluster = NewCluster;
+        }
+        *LastNewCluster = NewCluster;
+    }
+    ExReleaseResourceLite(&DeviceExt->FatResource);
+
+    return Status;
+}
+
 /* EOF */
@@ -146,10 +146,11 @@ vfatNewFCB(
     ExInitializeResourceLite(&rcFCB->PagingIoResource);
     ExInitializeResourceLite(&rcFCB->MainResource);
     FsRtlInitializeFileLock(&rcFCB->FileLock, NULL, NULL);
-    ExInitializeFastMutex(&rcFCB->LastMutex);
+    FsRtlInitializeLargeMcb(&rcFCB->ClusterMcb, NonPagedPool);
     rcFCB->RFCB.PagingIoResource = &rcFCB->PagingIoResource;
     rcFCB->RFCB.Resource = &rcFCB->MainResource;
-    rcFCB->RFCB.IsFastIoPossible = FastIoIsNotPossible;
+    /* VfatFastIoCheckIfPossible filters out everything but file reads */
+    rcFCB->RFCB.IsFastIoPossible = FastIoIsQuestionable;
     InitializeListHead(&rcFCB->ParentListHead);
 
     return  rcFCB;
@@ -273,6 +274,7 @@ vfatDestroyFCB(
     ExFreePool(pFCB->PathNameBuffer);
     ExDeleteResourceLite(&pFCB->PagingIoResource);
     ExDeleteResourceLite(&pFCB->MainResource);
+    FsRtlUninitializeLargeMcb(&pFCB->ClusterMcb);
     ASSERT(IsListEmpty(&pFCB->ParentListHead));
     ExFreeToNPagedLookasideList(&VfatGlobalData->FcbLookasideList, pFCB);
 }
@@ -1208,7 +1208,7 @@ VfatSetAllocationSizeInformation(
     PLARGE_INTEGER AllocationSize)
 {
     ULONG OldSize;
-    ULONG Cluster, FirstCluster;
+    ULONG Cluster, FirstCluster, LastCluster;
     NTSTATUS Status;
 
     ULONG ClusterSize = DeviceExt->FatInfo.BytesPerCluster;
@@ -1241,23 +1241,10 @@ VfatSetAllocationSizeInformation(
         AllocSizeChanged = TRUE;
         if (FirstCluster == 0)
         {
-            Fcb->LastCluster = Fcb->LastOffset = 0;
-            Status = NextCluster(DeviceExt, FirstCluster, &FirstCluster, TRUE);
+            /* Reserve the whole allocation as one run */
+            Status = ExtendClusterChain(DeviceExt, 0, (NewSize - 1) / ClusterSize + 1,
+                                        &FirstCluster, &NCluster);
             if (!NT_SUCCESS(Status))
-            {
-                DPRINT1("NextCluster failed. Status = %x\n", Status);
-                return Status;
-            }
-
-            if (FirstCluster == 0xffffffff)
-            {
-                return STATUS_DISK_FULL;
-            }
-
-            Status = OffsetToCluster(DeviceExt, FirstCluster,
-                                     ROUND_DOWN(NewSize - 1, ClusterSize),
-                                     &NCluster, TRUE);
-            if (NCluster == 0xffffffff || !NT_SUCCESS(Status))
             {
                 /* disk is full */
                 NCluster = Cluster = FirstCluster;
@@ -1291,41 +1278,21 @@ VfatSetAllocationSizeInformation(
         }
         else
         {
-            if (Fcb->LastCluster > 0)
-            {
-                if (Fcb->RFCB.AllocationSize.u.LowPart - ClusterSize == Fcb->LastOffset)
-                {
-                    Cluster = Fcb->LastCluster;
-                    Status = STATUS_SUCCESS;
-                }
-                else
-                {
-                    Status = OffsetToCluster(DeviceExt, Fcb->LastCluster,
-                                             Fcb->RFCB.AllocationSize.u.LowPart - ClusterSize - Fcb->LastOffset,
-                                             &Cluster, FALSE);
-                }
-            }
-            else
-            {
-                Status = OffsetToCluster(DeviceExt, FirstCluster,
-                                         Fcb->RFCB.AllocationSize.u.LowPart - ClusterSize,
-                                         &Cluster, FALSE);
-            }
-
+            /* Find the last cluster within the chain */
+            Status = OffsetToClusterRun(DeviceExt, Fcb,
+                                        Fcb->RFCB.AllocationSize.u.LowPart - ClusterSize,
+                                        ClusterSize, &Cluster, &NCluster);
             if (!NT_SUCCESS(Status))
             {
                 return Status;
             }
 
-            Fcb->LastCluster = Cluster;
-            Fcb->LastOffset = Fcb->RFCB.AllocationSize.u.LowPart - ClusterSize;
-
-            /* FIXME: Check status */
-            /* Cluster points now to the last cluster within the chain */
-            Status = OffsetToCluster(DeviceExt, Cluster,
-                                     ROUND_DOWN(NewSize - 1, ClusterSize) - Fcb->LastOffset,
-                                     &NCluster, TRUE);
-            if (NCluster == 0xffffffff || !NT_SUCCESS(Status))
+            /* Reserve all the missing clusters as one run */
+            Status = ExtendClusterChain(DeviceExt, Cluster,
+                                        (NewSize - 1) / ClusterSize + 1 -
+                                        Fcb->RFCB.AllocationSize.u.LowPart / ClusterSize,
+                                        &NCluster, &LastCluster);
+            if (!NT_SUCCESS(Status))
             {
                 /* disk is full */
                 NCluster = Cluster;
@@ -1355,8 +1322,8 @@ VfatSetAllocationSizeInformation(
         DPRINT("Can set file size\n");
 
         AllocSizeChanged = TRUE;
-        /* FIXME: Use the cached cluster/offset better way. */
-        Fcb->LastCluster = Fcb->LastOffset = 0;
+        /* Drop the freed clusters from the extent cache */
+        FsRtlTruncateLargeMcb(&Fcb->ClusterMcb, NewSize > 0 ? (NewSize - 1) / ClusterSize + 1 : 0);
         UpdateFileSize(FileObject, Fcb, NewSize, ClusterSize, vfatVolumeIsFatX(DeviceExt));
         if (NewSize > 0)
         {
@@ -614,7 +614,6 @@ VfatMount(
     {
         case FAT12:
             DeviceExt->GetNextCluster = FAT12GetNextCluster;
-            DeviceExt->FindAndMarkAvailableCluster = FAT12FindAndMarkAvailableCluster;
             DeviceExt->WriteCluster = FAT12WriteCluster;
             DeviceExt->CleanShutBitMask = 0;
             break;
@@ -622,7 +621,6 @@ VfatMount(
         case FAT16:
         case FATX16:
             DeviceExt->GetNextCluster = FAT16GetNextCluster;
-            DeviceExt->FindAndMarkAvailableCluster = FAT16FindAndMarkAvailableCluster;
             DeviceExt->WriteCluster = FAT16WriteCluster;
             DeviceExt->CleanShutBitMask = 0x8000;
             break;
@@ -630,7 +628,6 @@ VfatMount(
         case FAT32:
         case FATX32:
             DeviceExt->GetNextCluster = FAT32GetNextCluster;
-            DeviceExt->FindAndMarkAvailableCluster = FAT32FindAndMarkAvailableCluster;
             DeviceExt->WriteCluster = FAT32WriteCluster;
             DeviceExt->CleanShutBitMask = 0x80000000;
             break;
@@ -714,6 +711,12 @@ VfatMount(
     _SEH2_END;
 
     DeviceExt->LastAvailableCluster = 2;
+    Status = InitializeClusterBitMap(DeviceExt);
+    if (!NT_SUCCESS(Status))
+    {
+        goto ByeBye;
+    }
+
     ExInitializeResourceLite(&DeviceExt->FatResource);
 
     InitializeListHead(&DeviceExt->FcbListHead);
@@ -776,6 +779,8 @@ ByeBye:
             ObDereferenceObject (DeviceExt->FATFileObject);
         if (DeviceExt && DeviceExt->SpareVPB)
             ExFreePoolWithTag(DeviceExt->SpareVPB, TAG_VFAT);
+        if (DeviceExt)
+            UninitializeClusterBitMap(DeviceExt);
         if (Fcb)
             vfatDestroyFCB(Fcb);
         if (Ccb)
@@ -1182,6 +1187,7 @@ VfatDismountVolume(
     ExDeleteResourceLite(&DeviceExt->DirResource);
     ExDeleteResourceLite(&DeviceExt->FatResource);
     ObDereferenceObject(DeviceExt->FATFileObject);
+    UninitializeClusterBitMap(DeviceExt);
 
     return STATUS_SUCCESS;
 }
@@ -273,7 +273,6 @@ HASHENTRY;
 typedef struct DEVICE_EXTENSION *PDEVICE_EXTENSION;
 
 typedef NTSTATUS (*PGET_NEXT_CLUSTER)(PDEVICE_EXTENSION,ULONG,PULONG);
-typedef NTSTATUS (*PFIND_AND_MARK_AVAILABLE_CLUSTER)(PDEVICE_EXTENSION,PULONG);
 typedef NTSTATUS (*PWRITE_CLUSTER)(PDEVICE_EXTENSION,ULONG,ULONG,PULONG);
 
 typedef BOOLEAN (*PIS_DIRECTORY_EMPTY)(struct _VFATFCB*);
@@ -306,12 +305,12 @@ typedef struct DEVICE_EXTENSION
     ULONG LastAvailableCluster;
     ULONG AvailableClusters;
     BOOLEAN AvailableClustersValid;
+    RTL_BITMAP ClusterBitMap; /* Set bits are allocated clusters, guarded by FatResource */
     ULONG Flags;
     struct _VFATFCB *VolumeFcb;
 
     /* Pointers to functions for manipulating FAT. */
     PGET_NEXT_CLUSTER GetNextCluster;
-    PFIND_AND_MARK_AVAILABLE_CLUSTER FindAndMarkAvailableCluster;
     PWRITE_CLUSTER WriteCluster;
     ULONG CleanShutBitMask;
 
@@ -477,13 +476,11 @@ typedef struct _VFATFCB
     FILE_LOCK FileLock;
 
     /*
-     * Optimization: caching of last read/write cluster+offset pair. Can't
-     * be in VFATCCB because it must be reset everytime the allocated clusters
-     * change.
+     * Extent cache of the cluster chain, mapping file cluster indexes to
+     * disk clusters. Can't be in VFATCCB because it must be truncated
+     * everytime clusters are freed from the chain.
      */
-    FAST_MUTEX LastMutex;
-    ULONG LastCluster;
-    ULONG LastOffset;
+    LARGE_MCB ClusterMcb;
 } VFATFCB, *PVFATFCB;
 
 #define CCB_DELETE_ON_CLOSE     0x0001
@@ -502,6 +499,7 @@ typedef struct _VFATCCB
 #define TAG_FCB  'BCFV'
 #define TAG_IRP  'PRIV'
 #define TAG_VFAT 'TAFV'
+#define TAG_BITMAP 'PMBV'
 
 #define ENTRIES_PER_SECTOR (BLOCKSIZE / sizeof(FATDirEntry))
 
@@ -764,11 +762,6 @@ FAT12GetNextCluster(
     ULONG CurrentCluster,
     PULONG NextCluster);
 
-NTSTATUS
-FAT12FindAndMarkAvailableCluster(
-    PDEVICE_EXTENSION DeviceExt,
-    PULONG Cluster);
-
 NTSTATUS
 FAT12WriteCluster(
     PDEVICE_EXTENSION DeviceExt,
@@ -782,11 +775,6 @@ FAT16GetNextCluster(
     ULONG CurrentCluster,
     PULONG NextCluster);
 
-NTSTATUS
-FAT16FindAndMarkAvailableCluster(
-    PDEVICE_EXTENSION DeviceExt,
-    PULONG Cluster);
-
 NTSTATUS
 FAT16WriteCluster(
     PDEVICE_EXTENSION DeviceExt,
@@ -800,11 +788,6 @@ FAT32GetNextCluster(
     ULONG CurrentCluster,
     PULONG NextCluster);
 
-NTSTATUS
-FAT32FindAndMarkAvailableCluster(
-    PDEVICE_EXTENSION DeviceExt,
-    PULONG Cluster);
-
 NTSTATUS
 FAT32WriteCluster(
     PDEVICE_EXTENSION DeviceExt,
@@ -842,12 +825,28 @@ CountAvailableClusters(
     PDEVICE_EXTENSION DeviceExt,
     PLARGE_INTEGER Clusters);
 
+NTSTATUS
+InitializeClusterBitMap(
+    PDEVICE_EXTENSION DeviceExt);
+
+VOID
+UninitializeClusterBitMap(
+    PDEVICE_EXTENSION DeviceExt);
+
 NTSTATUS
 WriteCluster(
     PDEVICE_EXTENSION DeviceExt,
     ULONG ClusterToWrite,
     ULONG NewValue);
 
+NTSTATUS
+ExtendClusterChain(
+    PDEVICE_EXTENSION DeviceExt,
+    ULONG LastCluster,
+    ULONG ClusterCount,
+    PULONG FirstNewCluster,
+    PULONG LastNewCluster);
+
 /* fcb.c */
 
 PVFATFCB
@@ -1041,6 +1040,15 @@ NextCluster(
     PULONG CurrentCluster,
     BOOLEAN Extend);
 
+NTSTATUS
+OffsetToClusterRun(
+    PDEVICE_EXTENSION DeviceExt,
+    PVFATFCB Fcb,
+    ULONG FileOffset,
+    ULONG Length,
+    PULONG Cluster,
+    PULONG ClusterCount);
+
 /* shutdown.c */
 
 DRIVER_DISPATCH
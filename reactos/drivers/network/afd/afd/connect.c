@@ -247,9 +247,7 @@ NTSTATUS
 MakeSocketIntoConnection(PAFD_FCB FCB) {
     NTSTATUS Status;
 
-    ASSERT(!FCB->Recv.Window);
-    ASSERT(!FCB->Send.Window);
-
+    /* The windows exist already if SO_RCVBUF or SO_SNDBUF were set */
     if (!FCB->Recv.Size)
     {
         Status = TdiQueryMaxDatagramLength(FCB->Connection.Object,
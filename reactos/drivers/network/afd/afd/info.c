@@ -98,6 +98,66 @@ AfdGetInfo( PDEVICE_OBJECT DeviceObject, PIRP Irp,
     return UnlockAndMaybeComplete( FCB, Status, Irp, 0 );
 }
 
+NTSTATUS
+AfdSetRecvWindowSize( PAFD_FCB FCB, UINT Size ) {
+    PCHAR NewBuffer;
+
+    /* The transport may not be receiving into the current window */
+    ASSERT(FCB->ReceiveIrp.InFlightRequest == NULL);
+
+    NewBuffer = ExAllocatePool(PagedPool, Size);
+    if (!NewBuffer)
+        return STATUS_NO_MEMORY;
+
+    if (FCB->Recv.Content > Size)
+        FCB->Recv.Content = Size;
+    if (FCB->Recv.BytesUsed > FCB->Recv.Content)
+        FCB->Recv.BytesUsed = FCB->Recv.Content;
+
+    if (FCB->Recv.Window)
+    {
+        RtlCopyMemory(NewBuffer,
+                      FCB->Recv.Window,
+                      FCB->Recv.Content);
+
+        ExFreePool(FCB->Recv.Window);
+    }
+
+    FCB->Recv.Size = Size;
+    FCB->Recv.Window = NewBuffer;
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+AfdSetSendWindowSize( PAFD_FCB FCB, UINT Size ) {
+    PCHAR NewBuffer;
+
+    /* The transport may not be sending out of the current window */
+    ASSERT(FCB->SendIrp.InFlightRequest == NULL);
+
+    NewBuffer = ExAllocatePool(PagedPool, Size);
+    if (!NewBuffer)
+        return STATUS_NO_MEMORY;
+
+    if (FCB->Send.BytesUsed > Size)
+        FCB->Send.BytesUsed = Size;
+
+    if (FCB->Send.Window)
+    {
+        RtlCopyMemory(NewBuffer,
+                      FCB->Send.Window,
+                      FCB->Send.BytesUsed);
+
+        ExFreePool(FCB->Send.Window);
+    }
+
+    FCB->Send.Size = Size;
+    FCB->Send.Window = NewBuffer;
+
+    return STATUS_SUCCESS;
+}
+
 NTSTATUS NTAPI
 AfdSetInfo( PDEVICE_OBJECT DeviceObject, PIRP Irp,
             PIO_STACK_LOCATION IrpSp ) {
@@ -105,7 +165,6 @@ AfdSetInfo( PDEVICE_OBJECT DeviceObject, PIRP Irp,
     PAFD_INFO InfoReq = LockRequest(Irp, IrpSp, FALSE, NULL);
     PFILE_OBJECT FileObject = IrpSp->FileObject;
     PAFD_FCB FCB = FileObject->FsContext;
-    PCHAR NewBuffer;
 
     UNREFERENCED_PARAMETER(DeviceObject);
 
@@ -124,56 +183,44 @@ AfdSetInfo( PDEVICE_OBJECT DeviceObject, PIRP Irp,
                 FCB->OobInline = InfoReq->Information.Boolean;
                 break;
             case AFD_INFO_RECEIVE_WINDOW_SIZE:
-                NewBuffer = ExAllocatePool(PagedPool, InfoReq->Information.Ulong);
-                if (NewBuffer)
+                if (InfoReq->Information.Ulong == 0)
                 {
-                    if (FCB->Recv.Content > InfoReq->Information.Ulong)
-                        FCB->Recv.Content = InfoReq->Information.Ulong;
-
-                    if (FCB->Recv.Window)
-                    {
-                        RtlCopyMemory(NewBuffer,
-                                      FCB->Recv.Window,
-                                      FCB->Recv.Content);
-
-                        ExFreePool(FCB->Recv.Window);
-                    }
-
-                    FCB->Recv.Size = InfoReq->Information.Ulong;
-                    FCB->Recv.Window = NewBuffer;
-
-                    Status = STATUS_SUCCESS;
+                    Status = STATUS_INVALID_PARAMETER;
+                    break;
                 }
-                else
+
+                /* The transport may be receiving into the current window,
+                   the new size is applied once that receive completes */
+                if (FCB->ReceiveIrp.InFlightRequest)
                 {
-                    Status = STATUS_NO_MEMORY;
+                    AFD_DbgPrint(MID_TRACE,("Receive in flight, deferring %u byte window\n",
+                                            InfoReq->Information.Ulong));
+                    FCB->Recv.PendingSize = InfoReq->Information.Ulong;
+                    break;
                 }
+
+                FCB->Recv.PendingSize = 0;
+                Status = AfdSetRecvWindowSize(FCB, InfoReq->Information.Ulong);
                 break;
             case AFD_INFO_SEND_WINDOW_SIZE:
-                NewBuffer = ExAllocatePool(PagedPool, InfoReq->Information.Ulong);
-                if (NewBuffer)
+                if (InfoReq->Information.Ulong == 0)
                 {
-                    if (FCB->Send.BytesUsed > InfoReq->Information.Ulong)
-                        FCB->Send.BytesUsed = InfoReq->Information.Ulong;
-
-                    if (FCB->Send.Window)
-                    {
-                        RtlCopyMemory(NewBuffer,
-                                      FCB->Send.Window,
-                                      FCB->Send.BytesUsed);
-
-                        ExFreePool(FCB->Send.Window);
-                    }
-
-                    FCB->Send.Size = InfoReq->Information.Ulong;
-                    FCB->Send.Window = NewBuffer;
-
-                    Status = STATUS_SUCCESS;
+                    Status = STATUS_INVALID_PARAMETER;
+                    break;
                 }
-                else
+
+                /* The transport may be sending out of the current window,
+                   the new size is applied once that send completes */
+                if (FCB->SendIrp.InFlightRequest)
                 {
-                    Status = STATUS_NO_MEMORY;
+                    AFD_DbgPrint(MID_TRACE,("Send in flight, deferring %u byte window\n",
+                                            InfoReq->Information.Ulong));
+                    FCB->Send.PendingSize = InfoReq->Information.Ulong;
+                    break;
                 }
+
+                FCB->Send.PendingSize = 0;
+                Status = AfdSetSendWindowSize(FCB, InfoReq->Information.Ulong);
                 break;
             default:
                 AFD_DbgPrint(MIN_TRACE,("Unknown request %u\n", InfoReq->InformationClass));
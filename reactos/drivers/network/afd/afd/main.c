@@ -421,10 +421,13 @@ AfdCleanupSocket(PDEVICE_OBJECT DeviceObject, PIRP Irp,
            NextEntry = CurrentEntry->Flink;
            CurrentIrp = CONTAINING_RECORD(CurrentEntry, IRP, Tail.Overlay.ListEntry);
 
-           /* The cancel routine will remove the IRP from the list */
-           IoCancelIrp(CurrentIrp);
-
-           CurrentEntry = NextEntry;
+           /* The cancel routine will remove the IRP from the list, except for
+            * a direct receive which completes when the transport hands its
+            * buffer back. Either can complete other requests too, so start over */
+           if (IoCancelIrp(CurrentIrp))
+               CurrentEntry = FCB->PendingIrpList[Function].Flink;
+           else
+               CurrentEntry = NextEntry;
         }
     }
 
@@ -474,6 +477,7 @@ AfdCloseSocket(PDEVICE_OBJECT DeviceObject, PIRP Irp,
     ASSERT(IsListEmpty(&FCB->PendingIrpList[FUNCTION_RECV]));
     ASSERT(IsListEmpty(&FCB->PendingIrpList[FUNCTION_PREACCEPT]));
     ASSERT(IsListEmpty(&FCB->PendingIrpList[FUNCTION_DISCONNECT]));
+    ASSERT(IsListEmpty(&FCB->PendingIrpList[FUNCTION_TRANSMIT]));
 
     while (!IsListEmpty(&FCB->PendingConnections))
     {
@@ -905,6 +909,9 @@ AfdDispatch(PDEVICE_OBJECT DeviceObject, PIRP Irp)
         case IOCTL_AFD_SEND_DATAGRAM:
             return AfdPacketSocketWriteData( DeviceObject, Irp, IrpSp );
 
+        case IOCTL_AFD_TRANSMIT_FILE:
+            return AfdTransmitFile( DeviceObject, Irp, IrpSp );
+
         case IOCTL_AFD_GET_INFO:
             return AfdGetInfo( DeviceObject, Irp, IrpSp );
 
@@ -1195,6 +1202,10 @@ AfdCancelHandler(PDEVICE_OBJECT DeviceObject,
             Function = FUNCTION_DISCONNECT;
             break;
 
+        case IOCTL_AFD_TRANSMIT_FILE:
+            Function = FUNCTION_TRANSMIT;
+            break;
+
         default:
             ASSERT(FALSE);
             UnlockAndMaybeComplete(FCB, STATUS_CANCELLED, Irp, 0);
@@ -1208,6 +1219,20 @@ AfdCancelHandler(PDEVICE_OBJECT DeviceObject,
 
         if (CurrentIrp == Irp)
         {
+            /* A transmit may have a send in flight; it completes itself */
+            if (Function == FUNCTION_TRANSMIT)
+            {
+                TransmitFileCancel(FCB, Irp);
+                return;
+            }
+
+            /* The transport may still be receiving straight into this request */
+            if (Function == FUNCTION_RECV && RecallDirectReceive(FCB, Irp))
+            {
+                SocketStateUnlock(FCB);
+                return;
+            }
+
             RemoveEntryList(CurrentEntry);
             CleanupPendingIrp(FCB, Irp, IrpSp, NULL);
             UnlockAndMaybeComplete(FCB, STATUS_CANCELLED, Irp, 0);
@@ -10,14 +10,86 @@
 
 #include "afd.h"
 
+static IO_COMPLETION_ROUTINE DirectReceiveComplete;
+static NTSTATUS NTAPI DirectReceiveComplete
+( PDEVICE_OBJECT DeviceObject,
+  PIRP Irp,
+  PVOID Context ) {
+    /* The MDL belongs to the receive request; keep the I/O manager from freeing it */
+    Irp->MdlAddress = NULL;
+
+    return ReceiveComplete( DeviceObject, Irp, Context );
+}
+
+static BOOLEAN ReceiveDirect( PAFD_FCB FCB )
+{
+    PIRP NextIrp;
+    PIO_STACK_LOCATION NextIrpSp;
+    PAFD_RECV_INFO RecvReq;
+    PAFD_MAPBUF Map;
+    NTSTATUS Status;
+
+    /* Buffered data has to be consumed first to keep the stream in order */
+    if (FCB->Recv.Content != FCB->Recv.BytesUsed) return FALSE;
+    if (IsListEmpty(&FCB->PendingIrpList[FUNCTION_RECV])) return FALSE;
+
+    NextIrp = CONTAINING_RECORD(FCB->PendingIrpList[FUNCTION_RECV].Flink,
+                                IRP, Tail.Overlay.ListEntry);
+    NextIrpSp = IoGetCurrentIrpStackLocation( NextIrp );
+    RecvReq = GetLockedData(NextIrp, NextIrpSp);
+
+    /* A peek has to leave the data behind for the next request */
+    if (RecvReq->TdiFlags & TDI_RECEIVE_PEEK) return FALSE;
+
+    Map = (PAFD_MAPBUF)(RecvReq->BufferArray + RecvReq->BufferCount);
+    if (!RecvReq->BufferArray || !RecvReq->BufferCount || !Map[0].Mdl) return FALSE;
+
+    /* The window is empty, so it can start over when this completes */
+    FCB->Recv.Content = 0;
+    FCB->Recv.BytesUsed = 0;
+
+    AFD_DbgPrint(MID_TRACE,("Receiving directly into %p\n", NextIrp));
+
+    /* The transport fills the request's own locked pages. Keep each
+       receive no larger than a window receive would be */
+    FCB->TdiReceiveDirect = TRUE;
+    FCB->DirectReceiveIrp = NextIrp;
+    Status = TdiReceiveMdl( &FCB->ReceiveIrp.InFlightRequest,
+                            FCB->Connection.Object,
+                            TDI_RECEIVE_NORMAL,
+                            Map[0].Mdl,
+                            MIN(RecvReq->BufferArray[0].len, FCB->Recv.Size),
+                            DirectReceiveComplete,
+                            FCB );
+    if (Status != STATUS_PENDING)
+    {
+        FCB->TdiReceiveDirect = FALSE;
+        FCB->DirectReceiveIrp = NULL;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
 static VOID RefillSocketBuffer( PAFD_FCB FCB )
 {
     /* Make sure nothing's in flight first */
     if (FCB->ReceiveIrp.InFlightRequest) return;
 
+    /* Apply a window size that was set while the last receive was in flight,
+       once the window holds no more data than fits into the new one */
+    if (FCB->Recv.PendingSize && FCB->Recv.PendingSize >= FCB->Recv.Content)
+    {
+        if (NT_SUCCESS(AfdSetRecvWindowSize(FCB, FCB->Recv.PendingSize)))
+            FCB->Recv.PendingSize = 0;
+    }
+
     /* Now ensure that receive is still allowed */
     if (FCB->TdiReceiveClosed) return;
 
+    /* Skip the window if a request is already waiting for the data */
+    if (ReceiveDirect(FCB)) return;
+
     /* Check if the buffer is full */
     if (FCB->Recv.Content == FCB->Recv.Size)
     {
@@ -52,6 +124,15 @@ static VOID RefillSocketBuffer( PAFD_FCB FCB )
 
 static VOID HandleReceiveComplete( PAFD_FCB FCB, NTSTATUS Status, ULONG_PTR Information )
 {
+    /* We pulled the receive back ourselves, so the connection is fine */
+    if (Status == STATUS_CANCELLED && FCB->TdiReceiveRecalled && !FCB->TdiReceiveClosed)
+    {
+        FCB->TdiReceiveRecalled = FALSE;
+        RefillSocketBuffer(FCB);
+        return;
+    }
+
+    FCB->TdiReceiveRecalled = FALSE;
     FCB->LastReceiveStatus = Status;
 
     /* We got closed while the receive was in progress */
@@ -85,6 +166,78 @@ static VOID HandleReceiveComplete( PAFD_FCB FCB, NTSTATUS Status, ULONG_PTR Info
     }
 }
 
+static VOID HandleDirectReceiveComplete( PAFD_FCB FCB, PIRP Irp )
+{
+    PIRP NextIrp = FCB->DirectReceiveIrp;
+    PIO_STACK_LOCATION NextIrpSp;
+    PAFD_RECV_INFO RecvReq;
+    NTSTATUS Status = Irp->IoStatus.Status;
+    ULONG_PTR Information = Irp->IoStatus.Information;
+
+    FCB->TdiReceiveDirect = FALSE;
+    FCB->DirectReceiveIrp = NULL;
+
+    /* The request stays queued until the transport is done with its buffer */
+    ASSERT(NextIrp);
+
+    NextIrpSp = IoGetCurrentIrpStackLocation( NextIrp );
+    RecvReq = GetLockedData(NextIrp, NextIrpSp);
+
+    if (Status == STATUS_SUCCESS && Information != 0 && !FCB->TdiReceiveClosed)
+    {
+        /* The data is already in the request's buffer */
+        AFD_DbgPrint(MID_TRACE,("Completing direct recv %p (%u)\n", NextIrp,
+                                (UINT)Information));
+        FCB->TdiReceiveRecalled = FALSE;
+        FCB->LastReceiveStatus = Status;
+        RemoveEntryList(&NextIrp->Tail.Overlay.ListEntry);
+        UnlockBuffers( RecvReq->BufferArray,
+                       RecvReq->BufferCount, FALSE );
+        NextIrp->IoStatus.Status = Status;
+        NextIrp->IoStatus.Information = Information;
+        if( NextIrp->MdlAddress ) UnlockRequest( NextIrp, NextIrpSp );
+        (void)IoSetCancelRoutine(NextIrp, NULL);
+        IoCompleteRequest( NextIrp, IO_NETWORK_INCREMENT );
+
+        RefillSocketBuffer(FCB);
+        return;
+    }
+
+    if (NextIrp->Cancel)
+    {
+        /* The cancel routine left this to us because the buffer was still in use */
+        AFD_DbgPrint(MID_TRACE,("Completing recalled recv %p\n", NextIrp));
+        RemoveEntryList(&NextIrp->Tail.Overlay.ListEntry);
+        UnlockBuffers( RecvReq->BufferArray,
+                       RecvReq->BufferCount, FALSE );
+        NextIrp->IoStatus.Status = STATUS_CANCELLED;
+        NextIrp->IoStatus.Information = 0;
+        if( NextIrp->MdlAddress ) UnlockRequest( NextIrp, NextIrpSp );
+        (void)IoSetCancelRoutine(NextIrp, NULL);
+        IoCompleteRequest( NextIrp, IO_NETWORK_INCREMENT );
+    }
+
+    /* Nothing landed in the window, and data for a closed socket is discarded */
+    HandleReceiveComplete( FCB, Status, 0 );
+}
+
+BOOLEAN RecallDirectReceive( PAFD_FCB FCB, PIRP Irp )
+{
+    /* The transport must not write into a request that is going away */
+    if (!FCB->TdiReceiveDirect || FCB->DirectReceiveIrp != Irp) return FALSE;
+
+    AFD_DbgPrint(MID_TRACE,("Recalling direct recv into %p\n", Irp));
+
+    /* ReceiveComplete completes the request once the receive comes back */
+    if (!FCB->TdiReceiveRecalled)
+    {
+        FCB->TdiReceiveRecalled = TRUE;
+        IoCancelIrp(FCB->ReceiveIrp.InFlightRequest);
+    }
+
+    return TRUE;
+}
+
 static BOOLEAN CantReadMore( PAFD_FCB FCB ) {
     UINT BytesAvailable = FCB->Recv.Content - FCB->Recv.BytesUsed;
 
@@ -165,9 +318,20 @@ static NTSTATUS ReceiveActivity( PAFD_FCB FCB, PIRP Irp ) {
         /* Success here means that we got an EOF.  Complete a pending read
          * with zero bytes if we haven't yet overread, then kill the others.
          */
+        if (FCB->TdiReceiveDirect)
+        {
+            /* The transport still owns the first request's buffer, so the
+             * requests are completed once the receive comes back */
+            RecallDirectReceive( FCB, FCB->DirectReceiveIrp );
+        }
+
         while( !IsListEmpty( &FCB->PendingIrpList[FUNCTION_RECV] ) ) {
-            NextIrpEntry = RemoveHeadList(&FCB->PendingIrpList[FUNCTION_RECV]);
+            NextIrpEntry = FCB->PendingIrpList[FUNCTION_RECV].Flink;
             NextIrp = CONTAINING_RECORD(NextIrpEntry, IRP, Tail.Overlay.ListEntry);
+            if (FCB->TdiReceiveDirect && NextIrp == FCB->DirectReceiveIrp)
+                break;
+
+            RemoveEntryList(NextIrpEntry);
             NextIrpSp = IoGetCurrentIrpStackLocation( NextIrp );
             RecvReq = GetLockedData(NextIrp, NextIrpSp);
 
@@ -287,6 +451,10 @@ NTSTATUS NTAPI ReceiveComplete
     FCB->ReceiveIrp.InFlightRequest = NULL;
 
     if( FCB->State == SOCKET_STATE_CLOSED ) {
+        FCB->TdiReceiveDirect = FALSE;
+        FCB->TdiReceiveRecalled = FALSE;
+        FCB->DirectReceiveIrp = NULL;
+
         /* Cleanup our IRP queue because the FCB is being destroyed */
         while( !IsListEmpty( &FCB->PendingIrpList[FUNCTION_RECV] ) ) {
             NextIrpEntry = RemoveHeadList(&FCB->PendingIrpList[FUNCTION_RECV]);
@@ -308,7 +476,10 @@ NTSTATUS NTAPI ReceiveComplete
         return STATUS_INVALID_PARAMETER;
     }
 
-    HandleReceiveComplete( FCB, Irp->IoStatus.Status, Irp->IoStatus.Information );
+    if (FCB->TdiReceiveDirect)
+        HandleDirectReceiveComplete( FCB, Irp );
+    else
+        HandleReceiveComplete( FCB, Irp->IoStatus.Status, Irp->IoStatus.Information );
 
     ReceiveActivity( FCB, NULL );
 
@@ -532,6 +703,19 @@ AfdConnectedSocketReadData(PDEVICE_OBJECT DeviceObject, PIRP Irp,
         AFD_DbgPrint(MID_TRACE,("Leaving read irp\n"));
         IoMarkIrpPending( Irp );
         (void)IoSetCancelRoutine(Irp, AfdCancelHandler);
+
+        /* If the window receive is still waiting for data, pull it back so
+         * the data can go straight into the waiting request instead */
+        if (FCB->ReceiveIrp.InFlightRequest && !FCB->TdiReceiveDirect &&
+            FCB->Recv.Content == FCB->Recv.BytesUsed)
+        {
+            FCB->TdiReceiveRecalled = TRUE;
+            IoCancelIrp(FCB->ReceiveIrp.InFlightRequest);
+        }
+        else
+        {
+            RefillSocketBuffer(FCB);
+        }
     } else {
         AFD_DbgPrint(MID_TRACE,("Completed with status %x\n", Status));
     }
@@ -674,6 +858,14 @@ PacketSocketRecvComplete(
     } else
         FCB->PollState &= ~AFD_EVENT_RECEIVE;
 
+    /* Apply a window size that was set while the receive was in flight,
+       once the window holds no more data than fits into the new one */
+    if (FCB->Recv.PendingSize && FCB->Recv.PendingSize >= FCB->Recv.Content)
+    {
+        if (NT_SUCCESS(AfdSetRecvWindowSize(FCB, FCB->Recv.PendingSize)))
+            FCB->Recv.PendingSize = 0;
+    }
+
     if( NT_SUCCESS(Irp->IoStatus.Status) ) {
         /* Now relaunch the datagram request */
         Status = TdiReceiveDatagram
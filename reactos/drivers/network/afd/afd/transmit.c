@@ -0,0 +1,583 @@
+/*
+ * COPYRIGHT:        See COPYING in the top level directory
+ * PROJECT:          ReactOS kernel
+ * FILE:             drivers/net/afd/afd/transmit.c
+ * PURPOSE:          Ancillary functions driver -- TransmitFile support
+ */
+
+#include "afd.h"
+
+/* Amount of file data mapped at once, and the default size of a single send */
+#define AFD_TRANSMIT_CHUNK_SIZE         (64 * 1024)
+
+/* What a transmit is sending */
+#define TRANSMIT_HEAD                   0
+#define TRANSMIT_FILE                   1
+#define TRANSMIT_TAIL                   2
+#define TRANSMIT_DONE                   3
+
+/*
+ * A transmit request is queued on FCB->PendingIrpList[FUNCTION_TRANSMIT].
+ * The first one starts once the ordinary sends have drained, and then
+ * moves on from the completion of each of its sends. Only reading the
+ * file needs a work item. Everything is done with the socket locked.
+ */
+typedef struct _AFD_TRANSMIT_FILE_CONTEXT {
+    PIO_WORKITEM WorkItem;
+    PIRP Irp;
+    PAFD_FCB FCB;
+    PFILE_OBJECT FileObject;
+    AFD_TRANSMIT_FILE_INFO Info;
+    ULONG Phase;
+    NTSTATUS Status;
+    ULONG BytesSent;
+    /* Data being sent: a locked MDL and the part of it still to go */
+    PMDL Source;
+    ULONG SourceOffset;
+    ULONG SourceEnd;
+    /* Part of the file still to read */
+    LARGE_INTEGER FileOffset;
+    ULONGLONG FileRemaining;
+    PMDL MdlChain;                  /* Cached pages from FsRtlMdlRead */
+    PCHAR ReadBuffer;               /* Bounce buffer for files that are not cached */
+    PMDL ReadMdl;
+    PMDL HeadMdl;                   /* Caller's head and tail buffers, locked */
+    PMDL TailMdl;
+    PMDL PartialMdl;
+    PIRP SendIrp;                   /* Send in flight */
+    BOOLEAN Started;
+    BOOLEAN Issuing;                /* Inside TdiSendMdl */
+    BOOLEAN WorkQueued;
+    BOOLEAN Cancelled;
+} AFD_TRANSMIT_FILE_CONTEXT, *PAFD_TRANSMIT_FILE_CONTEXT;
+
+static VOID TransmitFileNext( PAFD_TRANSMIT_FILE_CONTEXT Context );
+
+static VOID TransmitReleaseFileData
+( PAFD_TRANSMIT_FILE_CONTEXT Context ) {
+    if (Context->MdlChain)
+    {
+        FsRtlMdlReadComplete(Context->FileObject, Context->MdlChain);
+        Context->MdlChain = NULL;
+    }
+    Context->Source = NULL;
+}
+
+/* Locks one of the caller's head and tail buffers for the whole transmit */
+static NTSTATUS TransmitLockBuffer
+( PVOID Buffer, ULONG Length, KPROCESSOR_MODE LockMode, PMDL *Mdl ) {
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    *Mdl = IoAllocateMdl(Buffer, Length, FALSE, FALSE, NULL);
+    if (!*Mdl)
+        return STATUS_NO_MEMORY;
+
+    _SEH2_TRY {
+        MmProbeAndLockPages(*Mdl, LockMode, IoReadAccess);
+    } _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER) {
+        IoFreeMdl(*Mdl);
+        *Mdl = NULL;
+        Status = STATUS_ACCESS_VIOLATION;
+    } _SEH2_END;
+
+    return Status;
+}
+
+static VOID TransmitUnlockBuffers
+( PAFD_TRANSMIT_FILE_CONTEXT Context ) {
+    if (Context->HeadMdl)
+    {
+        MmUnlockPages(Context->HeadMdl);
+        IoFreeMdl(Context->HeadMdl);
+        Context->HeadMdl = NULL;
+    }
+    if (Context->TailMdl)
+    {
+        MmUnlockPages(Context->TailMdl);
+        IoFreeMdl(Context->TailMdl);
+        Context->TailMdl = NULL;
+    }
+}
+
+/* Called with the socket locked once nothing is in flight any longer */
+static VOID TransmitFileFinish
+( PAFD_TRANSMIT_FILE_CONTEXT Context ) {
+    PAFD_FCB FCB = Context->FCB;
+    PIRP Irp = Context->Irp;
+    NTSTATUS Status = Context->Status;
+
+    ASSERT(!Context->SendIrp && !Context->WorkQueued);
+
+    if (Context->Cancelled && NT_SUCCESS(Status))
+        Status = STATUS_CANCELLED;
+
+    /* Start a graceful disconnect once the last send is out */
+    if (NT_SUCCESS(Status) &&
+        (Context->Info.Flags & (AFD_TF_DISCONNECT | AFD_TF_REUSE_SOCKET)) &&
+        !FCB->SendClosed && !FCB->DisconnectPending &&
+        FCB->ConnectCallInfo && FCB->RemoteAddress)
+    {
+        FCB->DisconnectFlags = TDI_DISCONNECT_RELEASE;
+        FCB->DisconnectTimeout.QuadPart = -1000000;
+        FCB->DisconnectPending = TRUE;
+        FCB->SendClosed = TRUE;
+        FCB->PollState &= ~AFD_EVENT_SEND;
+        RetryDisconnectCompletion(FCB);
+    }
+
+    AFD_DbgPrint(MID_TRACE,("TransmitFile done: %x, %u bytes\n", Status, Context->BytesSent));
+
+    RemoveEntryList(&Irp->Tail.Overlay.ListEntry);
+    (void)IoSetCancelRoutine(Irp, NULL);
+
+    TransmitReleaseFileData(Context);
+    if (Context->FileObject)
+        ObDereferenceObject(Context->FileObject);
+    if (Context->ReadMdl)
+        IoFreeMdl(Context->ReadMdl);
+    if (Context->ReadBuffer)
+        ExFreePool(Context->ReadBuffer);
+    TransmitUnlockBuffers(Context);
+    IoFreeWorkItem(Context->WorkItem);
+
+    Irp->IoStatus.Status = Status;
+    Irp->IoStatus.Information = Context->BytesSent;
+    ExFreePool(Context);
+
+    IoCompleteRequest(Irp, IO_NETWORK_INCREMENT);
+
+    /* Let the next transmit go */
+    TransmitFileRetry(FCB);
+}
+
+static IO_COMPLETION_ROUTINE TransmitSendComplete;
+static NTSTATUS NTAPI TransmitSendComplete
+( PDEVICE_OBJECT DeviceObject,
+  PIRP Irp,
+  PVOID Context ) {
+    PAFD_TRANSMIT_FILE_CONTEXT TransmitContext = Context;
+    PAFD_FCB FCB = TransmitContext->FCB;
+
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    /* The MDL belongs to the sender; keep the I/O manager from freeing it */
+    Irp->MdlAddress = NULL;
+
+    if( !SocketAcquireStateLock( FCB ) )
+        return STATUS_FILE_CLOSED;
+
+    ASSERT(TransmitContext->SendIrp == Irp);
+    TransmitContext->SendIrp = NULL;
+
+    MmPrepareMdlForReuse(TransmitContext->PartialMdl);
+    IoFreeMdl(TransmitContext->PartialMdl);
+    TransmitContext->PartialMdl = NULL;
+
+    if (!NT_SUCCESS(Irp->IoStatus.Status))
+    {
+        TransmitContext->Status = Irp->IoStatus.Status;
+    }
+    else if (Irp->IoStatus.Information == 0)
+    {
+        TransmitContext->Status = STATUS_FILE_CLOSED;
+    }
+    else
+    {
+        /* The transport may take less than we offered */
+        TransmitContext->SourceOffset += (ULONG)Irp->IoStatus.Information;
+        TransmitContext->BytesSent += (ULONG)Irp->IoStatus.Information;
+    }
+
+    /* When the send completed right away, the sender carries on itself */
+    if (!TransmitContext->Issuing)
+        TransmitFileNext(TransmitContext);
+
+    SocketStateUnlock( FCB );
+
+    return STATUS_SUCCESS;
+}
+
+/* Send the next piece of the source, returns FALSE if it is still in flight */
+static BOOLEAN TransmitSendNext
+( PAFD_TRANSMIT_FILE_CONTEXT Context ) {
+    PCHAR VirtualAddress;
+    ULONG Length;
+    NTSTATUS Status;
+
+    Length = MIN(Context->SourceEnd - Context->SourceOffset, Context->Info.SendPerRequest);
+    VirtualAddress = (PCHAR)MmGetMdlVirtualAddress(Context->Source) + Context->SourceOffset;
+
+    Context->PartialMdl = IoAllocateMdl(VirtualAddress, Length, FALSE, FALSE, NULL);
+    if (!Context->PartialMdl)
+    {
+        Context->Status = STATUS_INSUFFICIENT_RESOURCES;
+        return TRUE;
+    }
+
+    IoBuildPartialMdl(Context->Source, Context->PartialMdl, VirtualAddress, Length);
+
+    Context->Issuing = TRUE;
+    Status = TdiSendMdl(&Context->SendIrp,
+                        Context->FCB->Connection.Object,
+                        0,
+                        Context->PartialMdl,
+                        Length,
+                        TransmitSendComplete,
+                        Context);
+    Context->Issuing = FALSE;
+
+    if (Status != STATUS_PENDING)
+    {
+        /* The request never got to the transport */
+        Context->SendIrp = NULL;
+        IoFreeMdl(Context->PartialMdl);
+        Context->PartialMdl = NULL;
+        Context->Status = Status;
+        return TRUE;
+    }
+
+    return Context->SendIrp == NULL;
+}
+
+/* Reads the next chunk of the file, at passive level */
+static NTSTATUS TransmitReadFile
+( PAFD_TRANSMIT_FILE_CONTEXT Context ) {
+    NTSTATUS Status;
+    IO_STATUS_BLOCK IoStatus;
+    PDEVICE_OBJECT DeviceObject;
+    KEVENT Event;
+    ULONG Length;
+    PIRP Irp;
+
+    /* The last chunk has been sent */
+    TransmitReleaseFileData(Context);
+
+    Length = (ULONG)MIN(Context->FileRemaining, AFD_TRANSMIT_CHUNK_SIZE);
+
+    /* Send straight from the cache manager's pages when we can */
+    if (FsRtlMdlRead(Context->FileObject, &Context->FileOffset, Length, 0, &Context->MdlChain, &IoStatus))
+    {
+        Status = IoStatus.Status;
+        Length = (ULONG)IoStatus.Information;
+
+        if (NT_SUCCESS(Status) && Context->MdlChain)
+        {
+            Context->Source = Context->MdlChain;
+            Context->SourceOffset = 0;
+            Context->SourceEnd = MmGetMdlByteCount(Context->MdlChain);
+        }
+    }
+    else
+    {
+        /* Files that are not cached are read through a bounce buffer */
+        if (!Context->ReadBuffer)
+        {
+            Context->ReadBuffer = ExAllocatePool(NonPagedPool, AFD_TRANSMIT_CHUNK_SIZE);
+            if (!Context->ReadBuffer)
+                return STATUS_INSUFFICIENT_RESOURCES;
+
+            Context->ReadMdl = IoAllocateMdl(Context->ReadBuffer, AFD_TRANSMIT_CHUNK_SIZE, FALSE, FALSE, NULL);
+            if (!Context->ReadMdl)
+                return STATUS_INSUFFICIENT_RESOURCES;
+
+            MmBuildMdlForNonPagedPool(Context->ReadMdl);
+        }
+
+        DeviceObject = IoGetRelatedDeviceObject(Context->FileObject);
+
+        KeInitializeEvent(&Event, NotificationEvent, FALSE);
+        Irp = IoBuildSynchronousFsdRequest(IRP_MJ_READ,
+                                           DeviceObject,
+                                           Context->ReadBuffer,
+                                           Length,
+                                           &Context->FileOffset,
+                                           &Event,
+                                           &IoStatus);
+        if (!Irp)
+            return STATUS_INSUFFICIENT_RESOURCES;
+
+        IoGetNextIrpStackLocation(Irp)->FileObject = Context->FileObject;
+
+        Status = IoCallDriver(DeviceObject, Irp);
+        if (Status == STATUS_PENDING)
+        {
+            KeWaitForSingleObject(&Event, Executive, KernelMode, FALSE, NULL);
+            Status = IoStatus.Status;
+        }
+
+        Length = NT_SUCCESS(Status) ? (ULONG)IoStatus.Information : 0;
+        if (Length)
+        {
+            Context->Source = Context->ReadMdl;
+            Context->SourceOffset = 0;
+            Context->SourceEnd = Length;
+        }
+    }
+
+    if (Status == STATUS_END_OF_FILE || (NT_SUCCESS(Status) && !Length))
+    {
+        /* The file got shorter than we were asked to send */
+        Context->FileRemaining = 0;
+        return STATUS_SUCCESS;
+    }
+
+    if (NT_SUCCESS(Status))
+    {
+        Context->FileOffset.QuadPart += Length;
+        Context->FileRemaining -= MIN(Context->FileRemaining, Length);
+    }
+
+    return Status;
+}
+
+static IO_WORKITEM_ROUTINE TransmitFileWorker;
+static VOID NTAPI TransmitFileWorker
+( PDEVICE_OBJECT DeviceObject,
+  PVOID Context ) {
+    PAFD_TRANSMIT_FILE_CONTEXT TransmitContext = Context;
+    PAFD_FCB FCB = TransmitContext->FCB;
+    NTSTATUS Status = STATUS_CANCELLED;
+
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    /* Nothing else touches the file data while the work item is queued */
+    if (!TransmitContext->Cancelled)
+        Status = TransmitReadFile(TransmitContext);
+
+    SocketAcquireStateLock(FCB);
+
+    TransmitContext->WorkQueued = FALSE;
+    if (!NT_SUCCESS(Status))
+        TransmitContext->Status = Status;
+
+    TransmitFileNext(TransmitContext);
+
+    SocketStateUnlock(FCB);
+}
+
+/* Moves the transmit on until it waits for a send or the file, or is done */
+static VOID TransmitFileNext
+( PAFD_TRANSMIT_FILE_CONTEXT Context ) {
+    for (;;)
+    {
+        if (Context->SendIrp || Context->WorkQueued)
+            return;
+
+        if (Context->Cancelled || !NT_SUCCESS(Context->Status))
+        {
+            TransmitFileFinish(Context);
+            return;
+        }
+
+        if (Context->Source && Context->SourceOffset < Context->SourceEnd)
+        {
+            if (!TransmitSendNext(Context))
+                return;
+            continue;
+        }
+
+        /* The cached pages of a chunk come as one MDL per view */
+        if (Context->Source && Context->Source->Next)
+        {
+            Context->Source = Context->Source->Next;
+            Context->SourceOffset = 0;
+            Context->SourceEnd = MmGetMdlByteCount(Context->Source);
+            continue;
+        }
+
+        switch (Context->Phase)
+        {
+            case TRANSMIT_HEAD:
+                Context->Source = NULL;
+                Context->Phase = TRANSMIT_FILE;
+                break;
+
+            case TRANSMIT_FILE:
+                if (Context->FileObject && Context->FileRemaining)
+                {
+                    /* The file system wants passive level */
+                    Context->WorkQueued = TRUE;
+                    IoQueueWorkItem(Context->WorkItem, TransmitFileWorker, DelayedWorkQueue, Context);
+                    return;
+                }
+
+                TransmitReleaseFileData(Context);
+                Context->Phase = TRANSMIT_TAIL;
+                if (Context->TailMdl)
+                {
+                    Context->Source = Context->TailMdl;
+                    Context->SourceOffset = 0;
+                    Context->SourceEnd = Context->Info.Tail.len;
+                }
+                else
+                {
+                    Context->Source = NULL;
+                }
+                break;
+
+            default:
+                Context->Phase = TRANSMIT_DONE;
+                TransmitFileFinish(Context);
+                return;
+        }
+    }
+}
+
+/* Starts the first queued transmit once the ordinary sends have drained */
+VOID TransmitFileRetry( PAFD_FCB FCB ) {
+    PAFD_TRANSMIT_FILE_CONTEXT Context;
+    PIRP Irp;
+
+    if (IsListEmpty(&FCB->PendingIrpList[FUNCTION_TRANSMIT]))
+        return;
+
+    Irp = CONTAINING_RECORD(FCB->PendingIrpList[FUNCTION_TRANSMIT].Flink, IRP, Tail.Overlay.ListEntry);
+    Context = Irp->Tail.Overlay.DriverContext[0];
+
+    if (Context->Started)
+        return;
+
+    if (FCB->SendClosed || (FCB->PollState & (AFD_EVENT_CLOSE | AFD_EVENT_ABORT)))
+        Context->Status = STATUS_FILE_CLOSED;
+    else if (!IsListEmpty(&FCB->PendingIrpList[FUNCTION_SEND]) || FCB->SendIrp.InFlightRequest)
+        return;
+
+    Context->Started = TRUE;
+    TransmitFileNext(Context);
+}
+
+/* Called by AfdCancelHandler with the socket locked; unlocks it */
+VOID TransmitFileCancel( PAFD_FCB FCB, PIRP Irp ) {
+    PAFD_TRANSMIT_FILE_CONTEXT Context = Irp->Tail.Overlay.DriverContext[0];
+
+    Context->Cancelled = TRUE;
+
+    /* The send completion finishes the request; a work item does so itself */
+    if (Context->SendIrp)
+        IoCancelIrp(Context->SendIrp);
+    else
+        TransmitFileNext(Context);
+
+    SocketStateUnlock(FCB);
+}
+
+NTSTATUS NTAPI
+AfdTransmitFile(PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                PIO_STACK_LOCATION IrpSp) {
+    PFILE_OBJECT FileObject = IrpSp->FileObject;
+    PAFD_FCB FCB = FileObject->FsContext;
+    PAFD_TRANSMIT_FILE_INFO TransmitReq;
+    PAFD_TRANSMIT_FILE_CONTEXT Context;
+    AFD_TRANSMIT_FILE_INFO Info;
+    FILE_STANDARD_INFORMATION StandardInfo;
+    KPROCESSOR_MODE LockMode;
+    ULONG ReturnedLength;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    AFD_DbgPrint(MID_TRACE,("Called on %p\n", FCB));
+
+    if( !SocketAcquireStateLock( FCB ) ) return LostSocket( Irp );
+
+    if( (FCB->Flags & AFD_ENDPOINT_CONNECTIONLESS) ||
+        FCB->State != SOCKET_STATE_CONNECTED ) {
+        AFD_DbgPrint(MIN_TRACE,("Socket not connected\n"));
+        return UnlockAndMaybeComplete( FCB, STATUS_INVALID_CONNECTION, Irp, 0 );
+    }
+
+    if( FCB->SendClosed ) {
+        AFD_DbgPrint(MIN_TRACE,("No more sends\n"));
+        return UnlockAndMaybeComplete( FCB, STATUS_FILE_CLOSED, Irp, 0 );
+    }
+
+    if( IrpSp->Parameters.DeviceIoControl.InputBufferLength < sizeof(*TransmitReq) )
+        return UnlockAndMaybeComplete( FCB, STATUS_INVALID_PARAMETER, Irp, 0 );
+
+    if( !(TransmitReq = LockRequest( Irp, IrpSp, FALSE, &LockMode )) )
+        return UnlockAndMaybeComplete( FCB, STATUS_NO_MEMORY, Irp, 0 );
+
+    Info = *TransmitReq;
+    UnlockRequest( Irp, IrpSp );
+
+    if( !Info.SendPerRequest )
+        Info.SendPerRequest = AFD_TRANSMIT_CHUNK_SIZE;
+
+    Context = ExAllocatePool( NonPagedPool, sizeof(*Context) );
+    if( !Context )
+        return UnlockAndMaybeComplete( FCB, STATUS_NO_MEMORY, Irp, 0 );
+
+    RtlZeroMemory( Context, sizeof(*Context) );
+    Context->Irp = Irp;
+    Context->FCB = FCB;
+    Context->Info = Info;
+    Context->Phase = TRANSMIT_HEAD;
+    Context->Status = STATUS_SUCCESS;
+
+    /* The head and tail are sent straight from the caller's buffers; lock
+       them while we are still in the caller's context */
+    if( Info.Head.len )
+        Status = TransmitLockBuffer( Info.Head.buf, Info.Head.len, LockMode, &Context->HeadMdl );
+    if( NT_SUCCESS(Status) && Info.Tail.len )
+        Status = TransmitLockBuffer( Info.Tail.buf, Info.Tail.len, LockMode, &Context->TailMdl );
+
+    if( !NT_SUCCESS(Status) ) {
+        TransmitUnlockBuffers( Context );
+        ExFreePool( Context );
+        return UnlockAndMaybeComplete( FCB, Status, Irp, 0 );
+    }
+
+    if( Context->HeadMdl ) {
+        Context->Source = Context->HeadMdl;
+        Context->SourceEnd = Info.Head.len;
+    }
+
+    /* The handle is only valid in the caller's context; no file just sends the buffers */
+    if( Info.FileHandle ) {
+        Status = ObReferenceObjectByHandle( Info.FileHandle,
+                                            FILE_READ_DATA,
+                                            *IoFileObjectType,
+                                            Irp->RequestorMode,
+                                            (PVOID*)&Context->FileObject,
+                                            NULL );
+        if( NT_SUCCESS(Status) ) {
+            Context->FileOffset = Info.Offset;
+            Context->FileRemaining = Info.WriteLength;
+
+            /* No length means everything up to the end of the file */
+            if( !Context->FileRemaining ) {
+                Status = IoQueryFileInformation( Context->FileObject,
+                                                 FileStandardInformation,
+                                                 sizeof(StandardInfo),
+                                                 &StandardInfo,
+                                                 &ReturnedLength );
+                if( NT_SUCCESS(Status) && StandardInfo.EndOfFile.QuadPart > Info.Offset.QuadPart )
+                    Context->FileRemaining = StandardInfo.EndOfFile.QuadPart - Info.Offset.QuadPart;
+            }
+        }
+
+        if( !NT_SUCCESS(Status) ) {
+            AFD_DbgPrint(MIN_TRACE,("Bad file handle (0x%x)\n", Status));
+            if( Context->FileObject ) ObDereferenceObject( Context->FileObject );
+            TransmitUnlockBuffers( Context );
+            ExFreePool( Context );
+            return UnlockAndMaybeComplete( FCB, Status, Irp, 0 );
+        }
+    }
+
+    Context->WorkItem = IoAllocateWorkItem( DeviceObject );
+    if( !Context->WorkItem ) {
+        if( Context->FileObject ) ObDereferenceObject( Context->FileObject );
+        TransmitUnlockBuffers( Context );
+        ExFreePool( Context );
+        return UnlockAndMaybeComplete( FCB, STATUS_NO_MEMORY, Irp, 0 );
+    }
+
+    /* Queue it where AfdCancelHandler and AfdCleanupSocket find it */
+    Irp->Tail.Overlay.DriverContext[0] = Context;
+    Status = QueueUserModeIrp( FCB, Irp, FUNCTION_TRANSMIT );
+    if( Status == STATUS_PENDING )
+        TransmitFileRetry( FCB );
+
+    SocketStateUnlock( FCB );
+
+    return Status;
+}
@@ -93,6 +93,7 @@ static NTSTATUS NTAPI SendComplete
         }
 
         RetryDisconnectCompletion(FCB);
+        TransmitFileRetry(FCB);
 
         SocketStateUnlock( FCB );
 
@@ -156,6 +157,14 @@ static NTSTATUS NTAPI SendComplete
 
     ASSERT(SendLength == 0);
 
+    /* Apply a window size that was set while the send was in flight,
+       once the queued data fits into the new window */
+    if (FCB->Send.PendingSize && FCB->Send.PendingSize >= FCB->Send.BytesUsed)
+    {
+        if (NT_SUCCESS(AfdSetSendWindowSize(FCB, FCB->Send.PendingSize)))
+            FCB->Send.PendingSize = 0;
+    }
+
    if ( !HaltSendQueue && !IsListEmpty( &FCB->PendingIrpList[FUNCTION_SEND] ) ) {
         NextIrpEntry = FCB->PendingIrpList[FUNCTION_SEND].Flink;
         NextIrp = CONTAINING_RECORD(NextIrpEntry, IRP, Tail.Overlay.ListEntry);
@@ -248,8 +257,10 @@ static NTSTATUS NTAPI SendComplete
     }
     else
     {
-        /* Nothing is waiting so try to complete a pending disconnect */
+        /* Nothing is waiting so try to complete a pending disconnect,
+         * or start a transmit that waits for the sends to drain */
         RetryDisconnectCompletion(FCB);
+        TransmitFileRetry(FCB);
     }
 
     SocketStateUnlock( FCB );
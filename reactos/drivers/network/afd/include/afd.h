@@ -70,7 +70,8 @@ typedef struct IPADDR_ENTRY {
 #define FUNCTION_ACCEPT                 4
 #define FUNCTION_DISCONNECT             5
 #define FUNCTION_CLOSE                  6
-#define MAX_FUNCTIONS                   7
+#define FUNCTION_TRANSMIT               7
+#define MAX_FUNCTIONS                   8
 
 #define IN_FLIGHT_REQUESTS              5
 
@@ -131,6 +132,7 @@ typedef struct _AFD_IN_FLIGHT_REQUEST {
 typedef struct _AFD_DATA_WINDOW {
     PCHAR Window;
     UINT BytesUsed, Size, Content;
+    UINT PendingSize; /* set while a transfer is in flight, or 0 */
 } AFD_DATA_WINDOW, *PAFD_DATA_WINDOW;
 
 typedef struct _AFD_STORED_DATAGRAM {
@@ -158,6 +160,8 @@ typedef struct _AFD_FCB {
     AFD_TDI_OBJECT AddressFile, Connection;
     AFD_IN_FLIGHT_REQUEST ConnectIrp, ListenIrp, ReceiveIrp, SendIrp, DisconnectIrp;
     AFD_DATA_WINDOW Send, Recv;
+    BOOLEAN TdiReceiveDirect, TdiReceiveRecalled;
+    PIRP DirectReceiveIrp;
     KMUTEX Mutex;
     PKEVENT EventSelect;
     DWORD EventSelectTriggers;
@@ -232,6 +236,12 @@ AfdSetContext( PDEVICE_OBJECT DeviceObject, PIRP Irp,
 
 /* info.c */
 
+NTSTATUS
+AfdSetRecvWindowSize( PAFD_FCB FCB, UINT Size );
+
+NTSTATUS
+AfdSetSendWindowSize( PAFD_FCB FCB, UINT Size );
+
 NTSTATUS NTAPI
 AfdGetInfo( PDEVICE_OBJECT DeviceObject, PIRP Irp,
 	    PIO_STACK_LOCATION IrpSp );
@@ -293,6 +303,8 @@ IO_COMPLETION_ROUTINE ReceiveComplete;
 
 IO_COMPLETION_ROUTINE PacketSocketRecvComplete;
 
+BOOLEAN RecallDirectReceive( PAFD_FCB FCB, PIRP Irp );
+
 NTSTATUS NTAPI
 AfdConnectedSocketReadData(PDEVICE_OBJECT DeviceObject, PIRP Irp, PIO_STACK_LOCATION IrpSp, BOOLEAN Short);
 NTSTATUS NTAPI
@@ -352,6 +364,15 @@ NTSTATUS TdiReceive
   PIO_COMPLETION_ROUTINE  CompletionRoutine,
   PVOID CompletionContext);
 
+NTSTATUS TdiReceiveMdl
+( PIRP *Irp,
+  PFILE_OBJECT ConnectionObject,
+  USHORT Flags,
+  PMDL Mdl,
+  UINT BufferLength,
+  PIO_COMPLETION_ROUTINE  CompletionRoutine,
+  PVOID CompletionContext);
+
 NTSTATUS TdiSend
 ( PIRP *Irp,
   PFILE_OBJECT ConnectionObject,
@@ -361,6 +382,15 @@ NTSTATUS TdiSend
   PIO_COMPLETION_ROUTINE  CompletionRoutine,
   PVOID CompletionContext);
 
+NTSTATUS TdiSendMdl
+( PIRP *Irp,
+  PFILE_OBJECT ConnectionObject,
+  USHORT Flags,
+  PMDL Mdl,
+  UINT BufferLength,
+  PIO_COMPLETION_ROUTINE  CompletionRoutine,
+  PVOID CompletionContext);
+
 NTSTATUS TdiReceiveDatagram(
     PIRP *Irp,
     PFILE_OBJECT TransportObject,
@@ -384,6 +414,14 @@ NTSTATUS TdiQueryMaxDatagramLength(
         PFILE_OBJECT FileObject,
         PUINT MaxDatagramLength);
 
+/* transmit.c */
+
+NTSTATUS NTAPI
+AfdTransmitFile(PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                PIO_STACK_LOCATION IrpSp);
+VOID TransmitFileRetry( PAFD_FCB FCB );
+VOID TransmitFileCancel( PAFD_FCB FCB, PIRP Irp );
+
 /* write.c */
 
 NTSTATUS NTAPI
@@ -7,7 +7,12 @@
 
 #pragma once
 
+/* Number of (protocol, port) hash chains for address files, power of two */
+#define ADDRESS_FILE_HASH_SIZE 256
+
 extern LIST_ENTRY AddressFileListHead;
+extern LIST_ENTRY AddressFileHashTable[ADDRESS_FILE_HASH_SIZE];
+extern LIST_ENTRY TcpAddressFileHashTable[ADDRESS_FILE_HASH_SIZE];
 extern KSPIN_LOCK AddressFileListLock;
 extern LIST_ENTRY ConnectionEndpointListHead;
 extern KSPIN_LOCK ConnectionEndpointListLock;
@@ -22,6 +27,10 @@ NTSTATUS FileOpenAddress(
 NTSTATUS FileCloseAddress(
   PTDI_REQUEST Request);
 
+VOID AddrFileSetPort(
+  PADDRESS_FILE AddrFile,
+  USHORT Port);
+
 NTSTATUS FileOpenConnection(
   PTDI_REQUEST Request,
   PVOID ClientContext);
@@ -129,6 +129,7 @@ typedef struct _DATAGRAM_SEND_REQUEST {
    field holds a pointer to this structure */
 typedef struct _ADDRESS_FILE {
     LIST_ENTRY ListEntry;                 /* Entry on list */
+    LIST_ENTRY HashEntry;                 /* Entry on (protocol, port) hash chain */
     LONG RefCount;                        /* Reference count */
     OBJECT_FREE_ROUTINE Free;             /* Routine to use to free resources for the object */
     KSPIN_LOCK Lock;                      /* Spin lock to manipulate this structure */
@@ -198,6 +199,7 @@ typedef struct _ADDRESS_FILE {
 
 /* Structure used to search through Address Files */
 typedef struct _AF_SEARCH {
+    PLIST_ENTRY Head;       /* Hash chain being searched */
     PLIST_ENTRY Next;       /* Next address file to check */
     PIP_ADDRESS Address;    /* Pointer to address to be found */
     USHORT Port;            /* Network port */
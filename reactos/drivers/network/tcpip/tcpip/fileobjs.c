@@ -10,6 +10,8 @@
 
 #include "precomp.h"
 
+#include <fileobjs.h>
+
 /* Uncomment for logging of connections and address files every 10 seconds */
 //#define LOG_OBJECTS
 
@@ -17,6 +19,25 @@
 LIST_ENTRY AddressFileListHead;
 KSPIN_LOCK AddressFileListLock;
 
+/* Address files hashed by protocol and port, protected by AddressFileListLock.
+ * Files bound to a specific address and to the wildcard address share a chain.
+ * TCP files have their own chains: they can change chains when they connect
+ * or listen, and datagram searches must never have one as their cursor */
+LIST_ENTRY AddressFileHashTable[ADDRESS_FILE_HASH_SIZE];
+LIST_ENTRY TcpAddressFileHashTable[ADDRESS_FILE_HASH_SIZE];
+
+static
+PLIST_ENTRY
+AddrFileHashChain(
+    USHORT Port,
+    USHORT Protocol)
+{
+    if (Protocol == IPPROTO_TCP)
+        return &TcpAddressFileHashTable[WN2H(Port) & (ADDRESS_FILE_HASH_SIZE - 1)];
+
+    return &AddressFileHashTable[(WN2H(Port) ^ Protocol) & (ADDRESS_FILE_HASH_SIZE - 1)];
+}
+
 /* List of all connection endpoint file objects managed by this driver */
 LIST_ENTRY ConnectionEndpointListHead;
 KSPIN_LOCK ConnectionEndpointListLock;
@@ -42,13 +63,14 @@ PADDRESS_FILE AddrSearchFirst(
     SearchContext->Address  = Address;
     SearchContext->Port     = Port;
     SearchContext->Protocol = Protocol;
+    SearchContext->Head     = AddrFileHashChain(Port, Protocol);
 
     TcpipAcquireSpinLock(&AddressFileListLock, &OldIrql);
 
-    SearchContext->Next = AddressFileListHead.Flink;
+    SearchContext->Next = SearchContext->Head->Flink;
 
-    if (!IsListEmpty(&AddressFileListHead))
-        ReferenceObject(CONTAINING_RECORD(SearchContext->Next, ADDRESS_FILE, ListEntry));
+    if (!IsListEmpty(SearchContext->Head))
+        ReferenceObject(CONTAINING_RECORD(SearchContext->Next, ADDRESS_FILE, HashEntry));
 
     TcpipReleaseSpinLock(&AddressFileListLock, OldIrql);
 
@@ -191,12 +213,13 @@ PADDRESS_FILE AddrFindShared(
     PLIST_ENTRY CurrentEntry;
     KIRQL OldIrql;
     PADDRESS_FILE Current = NULL;
+    PLIST_ENTRY Head = AddrFileHashChain(Port, Protocol);
 
     TcpipAcquireSpinLock(&AddressFileListLock, &OldIrql);
 
-    CurrentEntry = AddressFileListHead.Flink;
-    while (CurrentEntry != &AddressFileListHead) {
-        Current = CONTAINING_RECORD(CurrentEntry, ADDRESS_FILE, ListEntry);
+    CurrentEntry = Head->Flink;
+    while (CurrentEntry != Head) {
+        Current = CONTAINING_RECORD(CurrentEntry, ADDRESS_FILE, HashEntry);
 
         /* See if this address matches the search criteria */
         if ((Current->Port == Port) &&
@@ -236,19 +259,19 @@ PADDRESS_FILE AddrSearchNext(
     
     TcpipAcquireSpinLock(&AddressFileListLock, &OldIrql);
 
-    if (SearchContext->Next == &AddressFileListHead)
+    if (SearchContext->Next == SearchContext->Head)
     {
         TcpipReleaseSpinLock(&AddressFileListLock, OldIrql);
         return NULL;
     }
 
     /* Save this pointer so we can dereference it later */
-    StartingAddrFile = CONTAINING_RECORD(SearchContext->Next, ADDRESS_FILE, ListEntry);
+    StartingAddrFile = CONTAINING_RECORD(SearchContext->Next, ADDRESS_FILE, HashEntry);
 
     CurrentEntry = SearchContext->Next;
 
-    while (CurrentEntry != &AddressFileListHead) {
-        Current = CONTAINING_RECORD(CurrentEntry, ADDRESS_FILE, ListEntry);
+    while (CurrentEntry != SearchContext->Head) {
+        Current = CONTAINING_RECORD(CurrentEntry, ADDRESS_FILE, HashEntry);
 
         IPAddress = &Current->Address;
 
@@ -275,10 +298,10 @@ PADDRESS_FILE AddrSearchNext(
     {
         SearchContext->Next = CurrentEntry->Flink;
 
-        if (SearchContext->Next != &AddressFileListHead)
+        if (SearchContext->Next != SearchContext->Head)
         {
             /* Reference the next address file to prevent the link from disappearing behind our back */
-            ReferenceObject(CONTAINING_RECORD(SearchContext->Next, ADDRESS_FILE, ListEntry));
+            ReferenceObject(CONTAINING_RECORD(SearchContext->Next, ADDRESS_FILE, HashEntry));
         }
 
         /* Reference the returned address file before dereferencing the starting
@@ -288,10 +311,11 @@ PADDRESS_FILE AddrSearchNext(
     else
         Current = NULL;
 
-    DereferenceObject(StartingAddrFile);
-
     TcpipReleaseSpinLock(&AddressFileListLock, OldIrql);
 
+    /* The last reference frees the address file, which takes the list lock */
+    DereferenceObject(StartingAddrFile);
+
     return Current;
 }
 
@@ -314,9 +338,10 @@ VOID AddrFileFree(
   /* We should not be associated with a connection here */
   ASSERT(!AddrFile->Connection);
 
-  /* Remove address file from the global list */
+  /* Remove address file from the global list and its hash chain */
   TcpipAcquireSpinLock(&AddressFileListLock, &OldIrql);
   RemoveEntryList(&AddrFile->ListEntry);
+  RemoveEntryList(&AddrFile->HashEntry);
   TcpipReleaseSpinLock(&AddressFileListLock, OldIrql);
 
   /* FIXME: Kill TCP connections on this address file object */
@@ -361,6 +386,29 @@ VOID AddrFileFree(
 }
 
 
+VOID AddrFileSetPort(
+    PADDRESS_FILE AddrFile,
+    USHORT Port)
+/*
+ * FUNCTION: Sets the port of an address file once it is known
+ * ARGUMENTS:
+ *     AddrFile = Pointer to address file object
+ *     Port     = Port number (network byte order)
+ */
+{
+    KIRQL OldIrql;
+
+    /* Only TCP chains are safe to move between, see AddrFileHashChain */
+    ASSERT(AddrFile->Protocol == IPPROTO_TCP);
+
+    TcpipAcquireSpinLock(&AddressFileListLock, &OldIrql);
+    AddrFile->Port = Port;
+    RemoveEntryList(&AddrFile->HashEntry);
+    InsertTailList(AddrFileHashChain(Port, AddrFile->Protocol), &AddrFile->HashEntry);
+    TcpipReleaseSpinLock(&AddressFileListLock, OldIrql);
+}
+
+
 VOID ControlChannelFree(
     PVOID Object)
 /*
@@ -392,6 +440,7 @@ NTSTATUS FileOpenAddress(
   PVOID Options)
 {
   PADDRESS_FILE AddrFile;
+  KIRQL OldIrql;
 
   TI_DbgPrint(MID_TRACE, ("Called (Proto %d).\n", Protocol));
 
@@ -541,11 +590,11 @@ NTSTATUS FileOpenAddress(
   /* Return address file object */
   Request->Handle.AddressHandle = AddrFile;
 
-  /* Add address file to global list */
-  ExInterlockedInsertTailList(
-    &AddressFileListHead,
-    &AddrFile->ListEntry,
-    &AddressFileListLock);
+  /* Add address file to global list and to its hash chain */
+  TcpipAcquireSpinLock(&AddressFileListLock, &OldIrql);
+  InsertTailList(&AddressFileListHead, &AddrFile->ListEntry);
+  InsertTailList(AddrFileHashChain(AddrFile->Port, AddrFile->Protocol), &AddrFile->HashEntry);
+  TcpipReleaseSpinLock(&AddressFileListLock, OldIrql);
 
   TI_DbgPrint(MAX_TRACE, ("Leaving.\n"));
 
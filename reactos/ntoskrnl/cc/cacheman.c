@@ -13,29 +13,8 @@
 #define NDEBUG
 #include <debug.h>
 
-BOOLEAN CcPfEnablePrefetcher;
-PFSN_PREFETCHER_GLOBALS CcPfGlobals;
-
 /* FUNCTIONS *****************************************************************/
 
-VOID
-NTAPI
-INIT_FUNCTION
-CcPfInitializePrefetcher(VOID)
-{
-    /* Notify debugger */
-    DbgPrintEx(DPFLTR_PREFETCHER_ID,
-               DPFLTR_TRACE_LEVEL,
-               "CCPF: InitializePrefetecher()\n");
-
-    /* Setup the Prefetcher Data */
-    InitializeListHead(&CcPfGlobals.ActiveTraces);
-    InitializeListHead(&CcPfGlobals.CompletedTraces);
-    ExInitializeFastMutex(&CcPfGlobals.CompletedTracesLock);
-
-    /* FIXME: Setup the rest of the prefetecher */
-}
-
 BOOLEAN
 NTAPI
 INIT_FUNCTION
@@ -77,8 +56,71 @@ CcRemapBcb (
     return 0;
 }
 
+static
+VOID
+NTAPI
+CcPerformReadAhead (
+    IN PVOID Context)
+{
+    PROS_PRIVATE_CACHE_MAP PrivateCacheMap = Context;
+    PROS_SHARED_CACHE_MAP SharedCacheMap = PrivateCacheMap->SharedCacheMap;
+    LONGLONG CurrentOffset, EndOffset;
+    PVOID BaseAddress;
+    BOOLEAN Valid;
+    PROS_VACB Vacb;
+    NTSTATUS Status;
+
+    CurrentOffset = PrivateCacheMap->ReadAheadWorkOffset.QuadPart;
+    EndOffset = CurrentOffset + PrivateCacheMap->ReadAheadWorkLength;
+
+    /* Never wait for the file system, a read ahead can always be skipped */
+    if (SharedCacheMap->Callbacks->AcquireForReadAhead(SharedCacheMap->LazyWriteContext, FALSE))
+    {
+        /* Stop early once the file object is closed */
+        while (CurrentOffset < EndOffset &&
+               CurrentOffset < SharedCacheMap->SectionSize.QuadPart &&
+               PrivateCacheMap->FileObject != NULL)
+        {
+            Status = CcRosRequestVacb(SharedCacheMap,
+                                      CurrentOffset,
+                                      &BaseAddress,
+                                      &Valid,
+                                      &Vacb);
+            if (!NT_SUCCESS(Status))
+                break;
+
+            /* Readers of this view wait on the VACB lock until we are done */
+            if (!Valid)
+            {
+                Status = CcReadVirtualAddress(Vacb);
+                Valid = NT_SUCCESS(Status);
+            }
+
+            CcRosReleaseVacb(SharedCacheMap, Vacb, Valid, FALSE, FALSE);
+            if (!Valid)
+            {
+                DPRINT("Read ahead at %I64x failed, Status %lx\n", CurrentOffset, Status);
+                break;
+            }
+
+            CurrentOffset += VACB_MAPPING_GRANULARITY;
+        }
+
+        SharedCacheMap->Callbacks->ReleaseFromReadAhead(SharedCacheMap->LazyWriteContext);
+    }
+
+    KeAcquireGuardedMutex(&ViewLock);
+
+    /* Let the next sequential read retry what we could not read */
+    if (CurrentOffset < PrivateCacheMap->ReadAheadOffset.QuadPart)
+        PrivateCacheMap->ReadAheadOffset.QuadPart = CurrentOffset;
+
+    CcRosReadAheadDone(PrivateCacheMap);
+    KeReleaseGuardedMutex(&ViewLock);
+}
+
 /*
- * @unimplemented
+ * @implemented
  */
 VOID
 NTAPI
@@ -88,11 +130,78 @@ CcScheduleReadAhead (
 	IN	ULONG			Length
 	)
 {
-	UNIMPLEMENTED;
+    PROS_PRIVATE_CACHE_MAP PrivateCacheMap;
+    PROS_SHARED_CACHE_MAP SharedCacheMap;
+    LONGLONG ReadEnd, NextView, Start, End;
+    ULONG ReadAheadLength;
+    BOOLEAN Sequential;
+
+    CCTRACE(CC_API_DEBUG, "FileObject=%p FileOffset=%I64d Length=%lu\n",
+        FileObject, FileOffset->QuadPart, Length);
+
+    if (Length == 0)
+        return;
+
+    KeAcquireGuardedMutex(&ViewLock);
+
+    PrivateCacheMap = FileObject->PrivateCacheMap;
+    if (PrivateCacheMap == NULL ||
+        BooleanFlagOn(PrivateCacheMap->SharedCacheMap->Flags, READAHEAD_DISABLED))
+    {
+        KeReleaseGuardedMutex(&ViewLock);
+        return;
+    }
+    SharedCacheMap = PrivateCacheMap->SharedCacheMap;
+
+    /* The read is sequential if it starts at most one granule after the previous
+     * one ended. The first read has nothing to follow, so it never is */
+    ReadEnd = FileOffset->QuadPart + Length;
+    Sequential = (PrivateCacheMap->LastReadEnd.QuadPart != 0 &&
+                  FileOffset->QuadPart >= PrivateCacheMap->LastReadOffset.QuadPart &&
+                  FileOffset->QuadPart <= PrivateCacheMap->LastReadEnd.QuadPart + PrivateCacheMap->ReadAheadMask);
+    PrivateCacheMap->LastReadOffset = *FileOffset;
+    PrivateCacheMap->LastReadEnd.QuadPart = ReadEnd;
+
+    if (!Sequential)
+    {
+        PrivateCacheMap->ReadAheadOffset.QuadPart = 0;
+        KeReleaseGuardedMutex(&ViewLock);
+        return;
+    }
+
+    /* Prefetch the views following the one the read ended in, but never more
+     * than one read ahead length beyond it */
+    ReadAheadLength = ROUND_UP(max(PrivateCacheMap->ReadAheadMask + 1, VACB_MAPPING_GRANULARITY),
+                               VACB_MAPPING_GRANULARITY);
+    NextView = ROUND_UP(ReadEnd, VACB_MAPPING_GRANULARITY);
+    Start = max(NextView, PrivateCacheMap->ReadAheadOffset.QuadPart);
+    End = min(NextView + ReadAheadLength,
+              ROUND_UP(SharedCacheMap->FileSize.QuadPart, VACB_MAPPING_GRANULARITY));
+
+    if (Start >= End || PrivateCacheMap->ReadAheadActive)
+    {
+        KeReleaseGuardedMutex(&ViewLock);
+        return;
+    }
+
+    /* Keep the shared cache map around until the worker is done with it */
+    SharedCacheMap->OpenCount++;
+
+    PrivateCacheMap->ReadAheadActive = TRUE;
+    PrivateCacheMap->ReadAheadOffset.QuadPart = End;
+    PrivateCacheMap->ReadAheadWorkOffset.QuadPart = Start;
+    PrivateCacheMap->ReadAheadWorkLength = (ULONG)(End - Start);
+    ExInitializeWorkItem(&PrivateCacheMap->ReadAheadWorkItem,
+                         CcPerformReadAhead,
+                         PrivateCacheMap);
+
+    KeReleaseGuardedMutex(&ViewLock);
+
+    ExQueueWorkItem(&PrivateCacheMap->ReadAheadWorkItem, DelayedWorkQueue);
 }
 
 /*
- * @unimplemented
+ * @implemented
  */
 VOID
 NTAPI
@@ -102,10 +211,29 @@ CcSetAdditionalCacheAttributes (
 	IN	BOOLEAN		DisableWriteBehind
 	)
 {
+    PROS_SHARED_CACHE_MAP SharedCacheMap;
+    KIRQL OldIrql;
+
     CCTRACE(CC_API_DEBUG, "FileObject=%p DisableReadAhead=%d DisableWriteBehind=%d\n",
         FileObject, DisableReadAhead, DisableWriteBehind);
 
-	UNIMPLEMENTED;
+    SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
+    if (SharedCacheMap == NULL)
+        return;
+
+    KeAcquireSpinLock(&SharedCacheMap->CacheMapLock, &OldIrql);
+
+    if (DisableReadAhead)
+        SetFlag(SharedCacheMap->Flags, READAHEAD_DISABLED);
+    else
+        ClearFlag(SharedCacheMap->Flags, READAHEAD_DISABLED);
+
+    if (DisableWriteBehind)
+        SetFlag(SharedCacheMap->Flags, WRITEBEHIND_DISABLED);
+    else
+        ClearFlag(SharedCacheMap->Flags, WRITEBEHIND_DISABLED);
+
+    KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, OldIrql);
 }
 
 /*
@@ -133,7 +261,7 @@ CcSetBcbOwnerPointer (
 }
 
 /*
- * @unimplemented
+ * @implemented
  */
 VOID
 NTAPI
@@ -142,14 +270,28 @@ CcSetDirtyPageThreshold (
 	IN	ULONG		DirtyPageThreshold
 	)
 {
+    PROS_SHARED_CACHE_MAP SharedCacheMap;
+    PFSRTL_COMMON_FCB_HEADER Fcb;
+
     CCTRACE(CC_API_DEBUG, "FileObject=%p DirtyPageThreshold=%lu\n",
         FileObject, DirtyPageThreshold);
 
-	UNIMPLEMENTED;
+    SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
+    if (SharedCacheMap != NULL)
+    {
+        SharedCacheMap->DirtyPageThreshold = DirtyPageThreshold;
+    }
+
+    /* Tell the file system CcCanIWrite now enforces a limit on this file */
+    Fcb = FileObject->FsContext;
+    if (Fcb != NULL && DirtyPageThreshold != 0)
+    {
+        SetFlag(Fcb->Flags, FSRTL_FLAG_LIMIT_MODIFIED_PAGES);
+    }
 }
 
 /*
- * @unimplemented
+ * @implemented
  */
 VOID
 NTAPI
@@ -158,8 +300,21 @@ CcSetReadAheadGranularity (
 	IN	ULONG		Granularity
 	)
 {
+    PROS_PRIVATE_CACHE_MAP PrivateCacheMap;
+
     CCTRACE(CC_API_DEBUG, "FileObject=%p Granularity=%lu\n",
         FileObject, Granularity);
 
-	UNIMPLEMENTED;
+    /* The granularity must be a power of 2, at least a page */
+    if (Granularity < PAGE_SIZE || (Granularity & (Granularity - 1)) != 0)
+    {
+        DPRINT1("Invalid read ahead granularity %lu\n", Granularity);
+        return;
+    }
+
+    PrivateCacheMap = FileObject->PrivateCacheMap;
+    if (PrivateCacheMap != NULL)
+    {
+        PrivateCacheMap->ReadAheadMask = Granularity - 1;
+    }
 }
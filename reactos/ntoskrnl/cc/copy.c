@@ -34,6 +34,16 @@ ULONG CcFastReadWait;
 ULONG CcFastReadNoWait;
 ULONG CcFastReadResourceMiss;
 
+/* Dirty pages allowed in the cache before writers get throttled */
+ULONG CcDirtyPageThreshold = 0;
+/* Free memory below which writers are throttled no matter the dirty page count */
+#define CC_MIN_AVAILABLE_PAGES 256
+
+/* Writers held back by CcCanIWrite/CcDeferWrite, in order, protected by ViewLock */
+static LIST_ENTRY CcDeferredWrites;
+
+extern KEVENT MpwThreadEvent;
+
 /* FUNCTIONS *****************************************************************/
 
 VOID
@@ -60,6 +70,119 @@ CcInitCacheZeroPage (
     MiZeroPhysicalPage(CcZeroPage);
 }
 
+VOID
+NTAPI
+CcInitDeferredWrites (
+    VOID)
+{
+    InitializeListHead(&CcDeferredWrites);
+
+    /* Allow an eighth of the memory to be dirty, but at least a few views */
+    CcDirtyPageThreshold = max(MmNumberOfPhysicalPages / 8,
+                               4 * VACB_MAPPING_GRANULARITY / PAGE_SIZE);
+}
+
+static
+BOOLEAN
+CcIsGlobalWriteThrottled (
+    ULONG Pages)
+{
+    /* With nothing dirty, flushing cannot help */
+    if (DirtyPageCount == 0)
+        return FALSE;
+
+    return (DirtyPageCount + Pages > CcDirtyPageThreshold ||
+            MmAvailablePages < CC_MIN_AVAILABLE_PAGES + Pages);
+}
+
+static
+BOOLEAN
+CcIsFileWriteThrottled (
+    PFILE_OBJECT FileObject,
+    ULONG Pages)
+{
+    PROS_SHARED_CACHE_MAP SharedCacheMap;
+
+    SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
+    if (SharedCacheMap == NULL ||
+        SharedCacheMap->DirtyPageThreshold == 0 ||
+        SharedCacheMap->DirtyPages == 0)
+    {
+        return FALSE;
+    }
+
+    return (SharedCacheMap->DirtyPages + Pages > SharedCacheMap->DirtyPageThreshold);
+}
+
+BOOLEAN
+NTAPI
+CcPostDeferredWrites (
+    VOID)
+/*
+ * FUNCTION: Lets the deferred writes that fit in the dirty page limits go,
+ * oldest first. Returns TRUE if writes are still waiting.
+ * NOTE: Only the lazy writer and CcDeferWrite post deferred writes.
+ */
+{
+    PROS_DEFERRED_WRITE DeferredWrite;
+    PLIST_ENTRY ListEntry;
+    BOOLEAN Pending;
+    ULONG ReleasedPages = 0;
+
+    for (;;)
+    {
+        DeferredWrite = NULL;
+
+        KeAcquireGuardedMutex(&ViewLock);
+        for (ListEntry = CcDeferredWrites.Flink;
+             ListEntry != &CcDeferredWrites;
+             ListEntry = ListEntry->Flink)
+        {
+            PROS_DEFERRED_WRITE Current;
+            ULONG Pages;
+
+            Current = CONTAINING_RECORD(ListEntry, ROS_DEFERRED_WRITE, DeferredWriteLinks);
+            Pages = BYTES_TO_PAGES(Current->BytesToWrite);
+
+            /* The writers released so far haven't dirtied their pages yet,
+             * so charge them against the limits too */
+            Pages += ReleasedPages;
+
+            /* Later writes must not overtake one held back by the global limits,
+             * a per file limit only holds back writes to that file */
+            if (CcIsGlobalWriteThrottled(Pages))
+                break;
+            if (CcIsFileWriteThrottled(Current->FileObject, Pages))
+                continue;
+
+            RemoveEntryList(&Current->DeferredWriteLinks);
+            ReleasedPages += BYTES_TO_PAGES(Current->BytesToWrite);
+            DeferredWrite = Current;
+            break;
+        }
+
+        if (DeferredWrite != NULL && DeferredWrite->Event != NULL)
+        {
+            /* The waiter owns the entry, don't touch it once signaled */
+            KeSetEvent(DeferredWrite->Event, IO_NO_INCREMENT, FALSE);
+            KeReleaseGuardedMutex(&ViewLock);
+            continue;
+        }
+
+        Pending = !IsListEmpty(&CcDeferredWrites);
+        KeReleaseGuardedMutex(&ViewLock);
+
+        if (DeferredWrite == NULL)
+            break;
+
+        DeferredWrite->PostRoutine(DeferredWrite->Context1, DeferredWrite->Context2);
+        ObDereferenceObject(DeferredWrite->FileObject);
+        ExFreePoolWithTag(DeferredWrite, TAG_DEFERRED_WRITE);
+    }
+
+    return Pending;
+}
+
 NTSTATUS
 NTAPI
 CcReadVirtualAddress (
@@ -333,7 +456,7 @@ CcCopyData (
 }
 
 /*
- * @unimplemented
+ * @implemented
  */
 BOOLEAN
 NTAPI
@@ -343,9 +466,73 @@ CcCanIWrite (
     IN BOOLEAN Wait,
     IN BOOLEAN Retrying)
 {
+    ROS_DEFERRED_WRITE DeferredWrite;
+    LARGE_INTEGER Timeout;
+    KEVENT WaitEvent;
+    ULONG Pages, LastDirtyPageCount;
+    NTSTATUS Status;
+
     CCTRACE(CC_API_DEBUG, "FileObject=%p BytesToWrite=%lu Wait=%d Retrying=%d\n",
         FileObject, BytesToWrite, Wait, Retrying);
 
+    /* Write through leaves nothing dirty behind */
+    if (BooleanFlagOn(FileObject->Flags, FO_WRITE_THROUGH))
+        return TRUE;
+
+    Pages = BYTES_TO_PAGES(BytesToWrite);
+
+    KeAcquireGuardedMutex(&ViewLock);
+
+    /* New writers queue behind the ones already held back */
+    if ((Retrying || IsListEmpty(&CcDeferredWrites)) &&
+        !CcIsGlobalWriteThrottled(Pages) &&
+        !CcIsFileWriteThrottled(FileObject, Pages))
+    {
+        KeReleaseGuardedMutex(&ViewLock);
+        return TRUE;
+    }
+
+    if (!Wait)
+    {
+        KeReleaseGuardedMutex(&ViewLock);
+        KeSetEvent(&MpwThreadEvent, IO_NO_INCREMENT, FALSE);
+        return FALSE;
+    }
+
+    KeInitializeEvent(&WaitEvent, NotificationEvent, FALSE);
+    RtlZeroMemory(&DeferredWrite, sizeof(DeferredWrite));
+    DeferredWrite.FileObject = FileObject;
+    DeferredWrite.BytesToWrite = BytesToWrite;
+    DeferredWrite.Event = &WaitEvent;
+    if (Retrying)
+        InsertHeadList(&CcDeferredWrites, &DeferredWrite.DeferredWriteLinks);
+    else
+        InsertTailList(&CcDeferredWrites, &DeferredWrite.DeferredWriteLinks);
+
+    /* Wait for the lazy writer to post us. The caller may hold locks the
+     * flush needs, so give up throttling once the flush stops making progress */
+    Timeout.QuadPart = -250 * 10 * 1000;
+    for (;;)
+    {
+        LastDirtyPageCount = DirtyPageCount;
+        KeReleaseGuardedMutex(&ViewLock);
+
+        KeSetEvent(&MpwThreadEvent, IO_NO_INCREMENT, FALSE);
+        Status = KeWaitForSingleObject(&WaitEvent, Executive, KernelMode, FALSE, &Timeout);
+
+        KeAcquireGuardedMutex(&ViewLock);
+        if (Status == STATUS_SUCCESS || KeReadStateEvent(&WaitEvent))
+            break;
+
+        if (DirtyPageCount >= LastDirtyPageCount)
+        {
+            DPRINT1("Dirty pages are not being flushed, letting the write through\n");
+            RemoveEntryList(&DeferredWrite.DeferredWriteLinks);
+            break;
+        }
+    }
+    KeReleaseGuardedMutex(&ViewLock);
+
     return TRUE;
 }
 
@@ -370,13 +557,20 @@ CcCopyRead (
            FileObject, FileOffset->QuadPart, Length, Wait,
            Buffer, IoStatus);
 
-    return CcCopyData(FileObject,
-                      FileOffset->QuadPart,
-                      Buffer,
-                      Length,
-                      CcOperationRead,
-                      Wait,
-                      IoStatus);
+    if (!CcCopyData(FileObject,
+                    FileOffset->QuadPart,
+                    Buffer,
+                    Length,
+                    CcOperationRead,
+                    Wait,
+                    IoStatus))
+    {
+        return FALSE;
+    }
+
+    /* Get the next views in while the caller consumes this one */
+    CcScheduleReadAhead(FileObject, FileOffset, Length);
+    return TRUE;
 }
 
 /*
@@ -410,7 +604,7 @@ CcCopyWrite (
 }
 
 /*
- * @unimplemented
+ * @implemented
  */
 VOID
 NTAPI
@@ -422,10 +616,39 @@ CcDeferWrite (
     IN ULONG BytesToWrite,
     IN BOOLEAN Retrying)
 {
+    PROS_DEFERRED_WRITE DeferredWrite;
+
     CCTRACE(CC_API_DEBUG, "FileObject=%p PostRoutine=%p Context1=%p Context2=%p BytesToWrite=%lu Retrying=%d\n",
         FileObject, PostRoutine, Context1, Context2, BytesToWrite, Retrying);
 
-    PostRoutine(Context1, Context2);
+    DeferredWrite = ExAllocatePoolWithTag(NonPagedPool, sizeof(*DeferredWrite), TAG_DEFERRED_WRITE);
+    if (DeferredWrite == NULL)
+    {
+        /* Can't queue it, better write now than never */
+        PostRoutine(Context1, Context2);
+        return;
+    }
+
+    ObReferenceObject(FileObject);
+    DeferredWrite->FileObject = FileObject;
+    DeferredWrite->BytesToWrite = BytesToWrite;
+    DeferredWrite->Event = NULL;
+    DeferredWrite->PostRoutine = PostRoutine;
+    DeferredWrite->Context1 = Context1;
+    DeferredWrite->Context2 = Context2;
+
+    KeAcquireGuardedMutex(&ViewLock);
+    if (Retrying)
+        InsertHeadList(&CcDeferredWrites, &DeferredWrite->DeferredWriteLinks);
+    else
+        InsertTailList(&CcDeferredWrites, &DeferredWrite->DeferredWriteLinks);
+    KeReleaseGuardedMutex(&ViewLock);
+
+    /* Post it right away if the limits allow, otherwise the lazy writer will */
+    if (CcPostDeferredWrites())
+    {
+        KeSetEvent(&MpwThreadEvent, IO_NO_INCREMENT, FALSE);
+    }
 }
 
 /*
@@ -28,10 +28,93 @@ CcMdlRead (
     OUT PIO_STATUS_BLOCK IoStatus
     )
 {
+    NTSTATUS Status;
+    LONGLONG CurrentOffset;
+    ULONG BytesLocked, PartialLength;
+    PROS_SHARED_CACHE_MAP SharedCacheMap;
+    PROS_VACB Vacb;
+    PVOID BaseAddress;
+    BOOLEAN Valid;
+    PMDL Mdl, *NextMdl;
+
     CCTRACE(CC_API_DEBUG, "FileObject=%p FileOffset=%I64d Length=%lu\n",
         FileObject, FileOffset->QuadPart, Length);
 
-    UNIMPLEMENTED;
+    SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
+    CurrentOffset = FileOffset->QuadPart;
+    BytesLocked = 0;
+    NextMdl = MdlChain;
+    *MdlChain = NULL;
+
+    /* Describe the cached pages of each view with an MDL and chain them */
+    while (Length > 0)
+    {
+        PartialLength = min(Length, VACB_MAPPING_GRANULARITY - CurrentOffset % VACB_MAPPING_GRANULARITY);
+        Status = CcRosRequestVacb(SharedCacheMap,
+                                  ROUND_DOWN(CurrentOffset, VACB_MAPPING_GRANULARITY),
+                                  &BaseAddress,
+                                  &Valid,
+                                  &Vacb);
+        if (!NT_SUCCESS(Status))
+            goto Failure;
+        if (!Valid)
+        {
+            Status = CcReadVirtualAddress(Vacb);
+            if (!NT_SUCCESS(Status))
+            {
+                CcRosReleaseVacb(SharedCacheMap, Vacb, FALSE, FALSE, FALSE);
+                goto Failure;
+            }
+        }
+
+        BaseAddress = (PUCHAR)BaseAddress + CurrentOffset % VACB_MAPPING_GRANULARITY;
+        Mdl = IoAllocateMdl(BaseAddress, PartialLength, FALSE, FALSE, NULL);
+        if (Mdl == NULL)
+        {
+            CcRosReleaseVacb(SharedCacheMap, Vacb, TRUE, FALSE, FALSE);
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto Failure;
+        }
+
+        /* The locked pages stay valid after the view is released */
+        Status = STATUS_SUCCESS;
+        _SEH2_TRY
+        {
+            MmProbeAndLockPages(Mdl, KernelMode, IoReadAccess);
+        }
+        _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+        {
+            Status = _SEH2_GetExceptionCode();
+        }
+        _SEH2_END;
+
+        CcRosReleaseVacb(SharedCacheMap, Vacb, TRUE, FALSE, FALSE);
+
+        if (!NT_SUCCESS(Status))
+        {
+            IoFreeMdl(Mdl);
+            goto Failure;
+        }
+
+        *NextMdl = Mdl;
+        NextMdl = &Mdl->Next;
+
+        Length -= PartialLength;
+        CurrentOffset += PartialLength;
+        BytesLocked += PartialLength;
+    }
+
+    IoStatus->Status = STATUS_SUCCESS;
+    IoStatus->Information = BytesLocked;
+
+    /* Get the next views in while the caller sends this one */
+    CcScheduleReadAhead(FileObject, FileOffset, BytesLocked);
+    return;
+
+Failure:
+    CcMdlReadComplete2(FileObject, *MdlChain);
+    *MdlChain = NULL;
+    ExRaiseStatus(Status);
 }
 
 /*
@@ -105,12 +188,43 @@ CcMdlReadComplete (
         FastDispatch->MdlReadComplete(FileObject,
                                       MdlChain,
                                       DeviceObject);
+        return;
     }
 
     /* Use slow path */
     CcMdlReadComplete2(FileObject, MdlChain);
 }
 
+/*
+ * Unlocks and frees an MDL chain built by CcPrepareMdlWrite and drops the
+ * mapping reference it holds on each view, marking the views dirty if the
+ * caller wrote through them.
+ */
+static
+VOID
+CcpReleaseMdlWriteChain (
+    IN PFILE_OBJECT FileObject,
+    IN LONGLONG FileOffset,
+    IN PMDL MdlChain,
+    IN BOOLEAN Dirty)
+{
+    PROS_SHARED_CACHE_MAP SharedCacheMap;
+    PMDL Mdl;
+
+    SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
+
+    while ((Mdl = MdlChain))
+    {
+        MdlChain = Mdl->Next;
+        MmUnlockPages(Mdl);
+        CcRosUnmapVacb(SharedCacheMap,
+                       ROUND_DOWN(FileOffset, VACB_MAPPING_GRANULARITY),
+                       Dirty);
+        FileOffset += Mdl->ByteCount;
+        IoFreeMdl(Mdl);
+    }
+}
+
 /*
  * @implemented
  */
@@ -136,6 +250,7 @@ CcMdlWriteComplete (
                                        FileOffset,
                                        MdlChain,
                                        DeviceObject);
+        return;
     }
 
     /* Use slow path */
@@ -149,11 +264,15 @@ CcMdlWriteComplete2 (
     IN PLARGE_INTEGER FileOffset,
     IN PMDL MdlChain)
 {
-    UNIMPLEMENTED;
+    CCTRACE(CC_API_DEBUG, "FileObject=%p FileOffset=%I64d MdlChain=%p\n",
+        FileObject, FileOffset->QuadPart, MdlChain);
+
+    /* The caller has written the data, let the lazy writer flush it */
+    CcpReleaseMdlWriteChain(FileObject, FileOffset->QuadPart, MdlChain, TRUE);
 }
 
 /*
- * @unimplemented
+ * @implemented
  */
 VOID
 NTAPI
@@ -161,11 +280,51 @@ CcMdlWriteAbort (
     IN PFILE_OBJECT FileObject,
     IN PMDL MdlChain)
 {
-    UNIMPLEMENTED;
+    PROS_SHARED_CACHE_MAP SharedCacheMap;
+    PLIST_ENTRY ListEntry;
+    PROS_VACB Vacb;
+    PUCHAR Address;
+    LONGLONG FileOffset = 0;
+    BOOLEAN Found = FALSE;
+    KIRQL OldIrql;
+
+    CCTRACE(CC_API_DEBUG, "FileObject=%p MdlChain=%p\n", FileObject, MdlChain);
+
+    if (MdlChain == NULL)
+        return;
+
+    /* The chain starts in the view that maps the first MDL */
+    SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
+    Address = MmGetMdlVirtualAddress(MdlChain);
+
+    KeAcquireGuardedMutex(&ViewLock);
+    KeAcquireSpinLock(&SharedCacheMap->CacheMapLock, &OldIrql);
+    for (ListEntry = SharedCacheMap->CacheMapVacbListHead.Flink;
+         ListEntry != &SharedCacheMap->CacheMapVacbListHead;
+         ListEntry = ListEntry->Flink)
+    {
+        Vacb = CONTAINING_RECORD(ListEntry, ROS_VACB, CacheMapVacbListEntry);
+        if (Address >= (PUCHAR)Vacb->BaseAddress &&
+            Address < (PUCHAR)Vacb->BaseAddress + VACB_MAPPING_GRANULARITY)
+        {
+            FileOffset = Vacb->FileOffset.QuadPart + (Address - (PUCHAR)Vacb->BaseAddress);
+            Found = TRUE;
+            break;
+        }
+    }
+    KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, OldIrql);
+    KeReleaseGuardedMutex(&ViewLock);
+
+    /* The views are referenced by the chain, so they cannot be gone */
+    ASSERT(Found);
+    if (!Found)
+        return;
+
+    CcpReleaseMdlWriteChain(FileObject, FileOffset, MdlChain, FALSE);
 }
 
 /*
- * @unimplemented
+ * @implemented
  */
 VOID
 NTAPI
@@ -176,8 +335,94 @@ CcPrepareMdlWrite (
     OUT PMDL * MdlChain,
     OUT PIO_STATUS_BLOCK IoStatus)
 {
+    NTSTATUS Status;
+    LONGLONG CurrentOffset;
+    ULONG BytesLocked, PartialLength;
+    PROS_SHARED_CACHE_MAP SharedCacheMap;
+    PROS_VACB Vacb;
+    PVOID BaseAddress;
+    BOOLEAN Valid;
+    PMDL Mdl, *NextMdl;
+
     CCTRACE(CC_API_DEBUG, "FileObject=%p FileOffset=%I64d Length=%lu\n",
         FileObject, FileOffset->QuadPart, Length);
 
-    UNIMPLEMENTED;
+    SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
+    CurrentOffset = FileOffset->QuadPart;
+    BytesLocked = 0;
+    NextMdl = MdlChain;
+    *MdlChain = NULL;
+
+    /*
+     * Describe the cached pages of each view with an MDL and chain them.
+     * Each view stays mapped until CcMdlWriteComplete marks it dirty, or
+     * CcMdlWriteAbort drops it.
+     */
+    while (Length > 0)
+    {
+        PartialLength = min(Length, VACB_MAPPING_GRANULARITY - CurrentOffset % VACB_MAPPING_GRANULARITY);
+        Status = CcRosRequestVacb(SharedCacheMap,
+                                  ROUND_DOWN(CurrentOffset, VACB_MAPPING_GRANULARITY),
+                                  &BaseAddress,
+                                  &Valid,
+                                  &Vacb);
+        if (!NT_SUCCESS(Status))
+            goto Failure;
+
+        /* The caller may write only part of the view, keep the rest */
+        if (!Valid)
+        {
+            Status = CcReadVirtualAddress(Vacb);
+            if (!NT_SUCCESS(Status))
+            {
+                CcRosReleaseVacb(SharedCacheMap, Vacb, FALSE, FALSE, FALSE);
+                goto Failure;
+            }
+        }
+
+        BaseAddress = (PUCHAR)BaseAddress + CurrentOffset % VACB_MAPPING_GRANULARITY;
+        Mdl = IoAllocateMdl(BaseAddress, PartialLength, FALSE, FALSE, NULL);
+        if (Mdl == NULL)
+        {
+            CcRosReleaseVacb(SharedCacheMap, Vacb, TRUE, FALSE, FALSE);
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto Failure;
+        }
+
+        Status = STATUS_SUCCESS;
+        _SEH2_TRY
+        {
+            MmProbeAndLockPages(Mdl, KernelMode, IoWriteAccess);
+        }
+        _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+        {
+            Status = _SEH2_GetExceptionCode();
+        }
+        _SEH2_END;
+
+        if (!NT_SUCCESS(Status))
+        {
+            CcRosReleaseVacb(SharedCacheMap, Vacb, TRUE, FALSE, FALSE);
+            IoFreeMdl(Mdl);
+            goto Failure;
+        }
+
+        CcRosReleaseVacb(SharedCacheMap, Vacb, TRUE, FALSE, TRUE);
+
+        *NextMdl = Mdl;
+        NextMdl = &Mdl->Next;
+
+        Length -= PartialLength;
+        CurrentOffset += PartialLength;
+        BytesLocked += PartialLength;
+    }
+
+    IoStatus->Status = STATUS_SUCCESS;
+    IoStatus->Information = BytesLocked;
+    return;
+
+Failure:
+    CcpReleaseMdlWriteChain(FileObject, FileOffset->QuadPart, *MdlChain, FALSE);
+    *MdlChain = NULL;
+    ExRaiseStatus(Status);
 }
@@ -0,0 +1,960 @@
+/*
+ * COPYRIGHT:       See COPYING in the top level directory
+ * PROJECT:         ReactOS kernel
+ * FILE:            ntoskrnl/cc/prefetch.c
+ * PURPOSE:         Logical prefetcher: traces the page faults of boot and
+ *                  application launches and replays them on the next launch
+ */
+
+/* NOTES **********************************************************************
+ *
+ * A trace records every section page fault that has to be resolved from a
+ * file, for the launching process or, during boot, for the whole system. It
+ * ends after ten timer periods, when its log is full or when the process
+ * exits. It is then sorted and saved as \SystemRoot\Prefetch\NAME-HASH.pf.
+ *
+ * On the next launch the scenario file is read back from a worker thread,
+ * and the traced pages are read through the cache in large sorted runs, a
+ * few of them in flight at once. The page faults then find the data in the
+ * VACBs instead of going to the disk.
+ */
+
+/* INCLUDES ******************************************************************/
+
+#include <ntoskrnl.h>
+#define NDEBUG
+#include <debug.h>
+
+/* GLOBALS *******************************************************************/
+
+BOOLEAN CcPfEnablePrefetcher;
+ULONG CcPfEnablePrefetcherParameter = PF_ENABLE_APP_LAUNCH_PREFETCH | PF_ENABLE_BOOT_PREFETCH;
+PFSN_PREFETCHER_GLOBALS CcPfGlobals;
+
+#define TAG_PREFETCH 'fPcC'
+
+/* Application launches are traced for 10 seconds, boot for 2 minutes */
+#define PFSN_APP_LAUNCH_PERIOD_MS   1000
+#define PFSN_APP_LAUNCH_MAX_FAULTS  8192
+#define PFSN_APP_LAUNCH_MAX_FILES   256
+#define PFSN_BOOT_PERIOD_MS         12000
+#define PFSN_BOOT_MAX_FAULTS        32768
+#define PFSN_BOOT_MAX_FILES         1024
+#define PFSN_MAX_ACTIVE_TRACES      8
+
+/* Don't bother saving launches that barely faulted */
+#define PFSN_MIN_SAVED_FAULTS       16
+
+/* Replay reads, in pages: runs are merged across small holes */
+#define PF_MAX_RUN_PAGES            (VACB_MAPPING_GRANULARITY / PAGE_SIZE)
+#define PF_MAX_GAP_PAGES            4
+#define PF_MAX_PENDING_READS        8
+#define PF_MAX_SCENARIO_SIZE        (4 * 1024 * 1024)
+
+static const PF_SCENARIO_ID CcPfBootScenarioId = { L"NTOSBOOT", 0xB00DFAAD };
+
+typedef struct _PFSN_PREFETCH_CONTEXT
+{
+    WORK_QUEUE_ITEM WorkItem;
+    PF_SCENARIO_ID ScenarioId;
+} PFSN_PREFETCH_CONTEXT, *PPFSN_PREFETCH_CONTEXT;
+
+typedef struct _PFSN_PENDING_READ
+{
+    IO_STATUS_BLOCK IoStatusBlock;
+    KEVENT Event;
+    ULONG Pages; /* 0 if the slot is free */
+} PFSN_PENDING_READ, *PPFSN_PENDING_READ;
+
+/* FUNCTIONS *****************************************************************/
+
+static
+VOID
+CcPfGetScenarioId (
+    PCUNICODE_STRING ImagePath,
+    PPF_SCENARIO_ID ScenarioId)
+{
+    USHORT i, Start, Length;
+    WCHAR Char;
+
+    RtlZeroMemory(ScenarioId, sizeof(*ScenarioId));
+
+    /* The hash covers the full path, so that same-named images don't collide */
+    Start = 0;
+    for (i = 0; i < ImagePath->Length / sizeof(WCHAR); i++)
+    {
+        Char = RtlUpcaseUnicodeChar(ImagePath->Buffer[i]);
+        ScenarioId->HashId = ScenarioId->HashId * 37 + Char;
+        if (Char == L'\\')
+            Start = i + 1;
+    }
+
+    Length = min(ImagePath->Length / sizeof(WCHAR) - Start,
+                 RTL_NUMBER_OF(ScenarioId->ScenName) - 1);
+    for (i = 0; i < Length; i++)
+        ScenarioId->ScenName[i] = RtlUpcaseUnicodeChar(ImagePath->Buffer[Start + i]);
+}
+
+static
+NTSTATUS
+CcPfOpenScenarioFile (
+    PPF_SCENARIO_ID ScenarioId,
+    BOOLEAN Create,
+    PHANDLE Handle)
+{
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK IoStatusBlock;
+    UNICODE_STRING FileName;
+    WCHAR Buffer[64];
+    HANDLE DirectoryHandle;
+    NTSTATUS Status;
+
+    if (Create)
+    {
+        /* Make sure the directory exists */
+        RtlInitUnicodeString(&FileName, L"\\SystemRoot\\Prefetch");
+        InitializeObjectAttributes(&ObjectAttributes,
+                                   &FileName,
+                                   OBJ_CASE_INSENSITIVE | OBJ_KERNEL_HANDLE,
+                                   NULL,
+                                   NULL);
+        Status = ZwCreateFile(&DirectoryHandle,
+                              FILE_LIST_DIRECTORY | SYNCHRONIZE,
+                              &ObjectAttributes,
+                              &IoStatusBlock,
+                              NULL,
+                              FILE_ATTRIBUTE_DIRECTORY,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE,
+                              FILE_OPEN_IF,
+                              FILE_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT,
+                              NULL,
+                              0);
+        if (!NT_SUCCESS(Status))
+            return Status;
+        ZwClose(DirectoryHandle);
+    }
+
+    Status = RtlStringCbPrintfW(Buffer,
+                                sizeof(Buffer),
+                                L"\\SystemRoot\\Prefetch\\%ws-%08lX.pf",
+                                ScenarioId->ScenName,
+                                ScenarioId->HashId);
+    if (!NT_SUCCESS(Status))
+        return Status;
+    RtlInitUnicodeString(&FileName, Buffer);
+
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &FileName,
+                               OBJ_CASE_INSENSITIVE | OBJ_KERNEL_HANDLE,
+                               NULL,
+                               NULL);
+    return ZwCreateFile(Handle,
+                        (Create ? FILE_WRITE_DATA : FILE_READ_DATA) | SYNCHRONIZE,
+                        &ObjectAttributes,
+                        &IoStatusBlock,
+                        NULL,
+                        FILE_ATTRIBUTE_NORMAL,
+                        Create ? 0 : FILE_SHARE_READ,
+                        Create ? FILE_OVERWRITE_IF : FILE_OPEN,
+                        FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT,
+                        NULL,
+                        0);
+}
+
+static
+int
+__cdecl
+CcPfCompareLogEntries (
+    const void *First,
+    const void *Second)
+{
+    const PF_LOG_ENTRY *Entry1 = First, *Entry2 = Second;
+
+    if (Entry1->FileKey != Entry2->FileKey)
+        return Entry1->FileKey < Entry2->FileKey ? -1 : 1;
+    if (Entry1->FileOffset != Entry2->FileOffset)
+        return Entry1->FileOffset < Entry2->FileOffset ? -1 : 1;
+    return 0;
+}
+
+static
+NTSTATUS
+CcPfSaveTrace (
+    PPFSN_TRACE_HEADER Trace)
+{
+    PPFSN_LOG_ENTRIES Log = Trace->CurrentTraceBuffer;
+    POBJECT_NAME_INFORMATION *Names;
+    PPF_SECTION_INFO SectionInfo;
+    PPF_TRACE_HEADER Scenario;
+    IO_STATUS_BLOCK IoStatusBlock;
+    ULONG i, NumEntries, NamesSize, NameLength, Size, Offset;
+    HANDLE Handle;
+    NTSTATUS Status;
+
+    /* Sort the log by file and offset, and drop repeated faults */
+    qsort(Log->Entries, Log->NumEntries, sizeof(PF_LOG_ENTRY), CcPfCompareLogEntries);
+    NumEntries = 0;
+    for (i = 0; i < (ULONG)Log->NumEntries; i++)
+    {
+        if (NumEntries != 0 &&
+            CcPfCompareLogEntries(&Log->Entries[NumEntries - 1], &Log->Entries[i]) == 0)
+        {
+            continue;
+        }
+        Log->Entries[NumEntries++] = Log->Entries[i];
+    }
+
+    if (NumEntries < PFSN_MIN_SAVED_FAULTS)
+        return STATUS_SUCCESS;
+
+    Names = ExAllocatePoolWithTag(PagedPool, Trace->SectionCount * sizeof(*Names), TAG_PREFETCH);
+    if (Names == NULL)
+        return STATUS_INSUFFICIENT_RESOURCES;
+    RtlZeroMemory(Names, Trace->SectionCount * sizeof(*Names));
+
+    /* Replay reopens the files by their full name */
+    NamesSize = 0;
+    for (i = 0; i < Trace->SectionCount; i++)
+    {
+        Status = ObQueryNameString(Trace->Sections[i].FileObject, NULL, 0, &NameLength);
+        if (Status != STATUS_INFO_LENGTH_MISMATCH || NameLength == 0)
+            continue;
+
+        Names[i] = ExAllocatePoolWithTag(PagedPool, NameLength, TAG_PREFETCH);
+        if (Names[i] == NULL)
+            continue;
+
+        Status = ObQueryNameString(Trace->Sections[i].FileObject, Names[i], NameLength, &NameLength);
+        if (!NT_SUCCESS(Status))
+        {
+            ExFreePoolWithTag(Names[i], TAG_PREFETCH);
+            Names[i] = NULL;
+            continue;
+        }
+        NamesSize += Names[i]->Name.Length;
+    }
+
+    Size = sizeof(PF_TRACE_HEADER) +
+           Trace->SectionCount * sizeof(PF_SECTION_INFO) +
+           ALIGN_UP_BY(NamesSize, sizeof(ULONG)) +
+           NumEntries * sizeof(PF_LOG_ENTRY);
+    Scenario = ExAllocatePoolWithTag(PagedPool, Size, TAG_PREFETCH);
+    if (Scenario == NULL)
+    {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto Cleanup;
+    }
+    RtlZeroMemory(Scenario, Size);
+
+    Scenario->Version = PF_CURRENT_VERSION;
+    Scenario->MagicNumber = PF_TRACE_MAGIC_NUMBER;
+    Scenario->Size = Size;
+    Scenario->ScenarioId = Trace->ScenarioId;
+    Scenario->ScenarioType = Trace->ScenarioType;
+    Scenario->LaunchTime = Trace->LaunchTime;
+    RtlCopyMemory(Scenario->FaultsPerPeriod, Trace->FaultsPerPeriod, sizeof(Scenario->FaultsPerPeriod));
+
+    Scenario->SectionInfoOffset = sizeof(PF_TRACE_HEADER);
+    Scenario->NumSections = Trace->SectionCount;
+    SectionInfo = (PPF_SECTION_INFO)((ULONG_PTR)Scenario + Scenario->SectionInfoOffset);
+    Offset = Scenario->SectionInfoOffset + Trace->SectionCount * sizeof(PF_SECTION_INFO);
+    for (i = 0; i < Trace->SectionCount; i++)
+    {
+        SectionInfo[i].Flags = Trace->Sections[i].Image ? PF_LOG_ENTRY_IMAGE : PF_LOG_ENTRY_DATA;
+        if (Names[i] == NULL)
+            continue;
+
+        SectionInfo[i].FileNameOffset = Offset;
+        SectionInfo[i].FileNameLength = Names[i]->Name.Length;
+        RtlCopyMemory((PVOID)((ULONG_PTR)Scenario + Offset), Names[i]->Name.Buffer, Names[i]->Name.Length);
+        Offset += Names[i]->Name.Length;
+    }
+
+    Scenario->TraceBufferOffset = ALIGN_UP_BY(Offset, sizeof(ULONG));
+    Scenario->NumEntries = NumEntries;
+    RtlCopyMemory((PVOID)((ULONG_PTR)Scenario + Scenario->TraceBufferOffset),
+                  Log->Entries,
+                  NumEntries * sizeof(PF_LOG_ENTRY));
+
+    Status = CcPfOpenScenarioFile(&Trace->ScenarioId, TRUE, &Handle);
+    if (NT_SUCCESS(Status))
+    {
+        Status = ZwWriteFile(Handle, NULL, NULL, NULL, &IoStatusBlock, Scenario, Size, NULL, NULL);
+        ZwClose(Handle);
+    }
+
+    DPRINT("Saved scenario %S-%08lX: %lu files, %lu pages, Status %lx\n",
+           Trace->ScenarioId.ScenName, Trace->ScenarioId.HashId,
+           Trace->SectionCount, NumEntries, Status);
+
+    ExFreePoolWithTag(Scenario, TAG_PREFETCH);
+
+Cleanup:
+    for (i = 0; i < Trace->SectionCount; i++)
+    {
+        if (Names[i] != NULL)
+            ExFreePoolWithTag(Names[i], TAG_PREFETCH);
+    }
+    ExFreePoolWithTag(Names, TAG_PREFETCH);
+
+    return Status;
+}
+
+static
+VOID
+NTAPI
+CcPfEndTraceWorker (
+    PVOID Context)
+{
+    PPFSN_TRACE_HEADER Trace = Context;
+    KIRQL OldIrql;
+    ULONG i;
+
+    /* No period can be counted once we are here */
+    KeCancelTimer(&Trace->TraceTimer);
+    KeFlushQueuedDpcs();
+
+    KeAcquireSpinLock(&CcPfGlobals.ActiveTracesLock, &OldIrql);
+    RemoveEntryList(&Trace->ActiveTracesLink);
+    if (CcPfGlobals.SystemWideTrace == Trace)
+        CcPfGlobals.SystemWideTrace = NULL;
+    KeReleaseSpinLock(&CcPfGlobals.ActiveTracesLock, OldIrql);
+
+    /* Wait for the page faults still logging */
+    ExWaitForRundownProtectionRelease(&Trace->RefCount);
+
+    if (Trace->CurPeriod < RTL_NUMBER_OF(Trace->FaultsPerPeriod))
+        Trace->FaultsPerPeriod[Trace->CurPeriod] = Trace->NumFaults - Trace->LastNumFaults;
+
+    CcPfSaveTrace(Trace);
+
+    for (i = 0; i < Trace->SectionCount; i++)
+        ObDereferenceObject(Trace->Sections[i].FileObject);
+    if (Trace->Process != NULL)
+        ObDereferenceObject(Trace->Process);
+
+    ExFreePoolWithTag(Trace->Sections, TAG_PREFETCH);
+    ExFreePoolWithTag(Trace->CurrentTraceBuffer, TAG_PREFETCH);
+    ExFreePoolWithTag(Trace, TAG_PREFETCH);
+
+    InterlockedDecrement(&CcPfGlobals.NumActiveTraces);
+}
+
+static
+VOID
+CcPfEndTrace (
+    PPFSN_TRACE_HEADER Trace)
+{
+    /* Can be called from the timer DPC, the fault path or process exit */
+    if (InterlockedExchange(&Trace->EndTraceCalled, 1) == 0)
+    {
+        ExQueueWorkItem(&Trace->EndTraceWorkItem, DelayedWorkQueue);
+    }
+}
+
+static
+VOID
+NTAPI
+CcPfTraceTimerRoutine (
+    PKDPC Dpc,
+    PVOID DeferredContext,
+    PVOID SystemArgument1,
+    PVOID SystemArgument2)
+{
+    PPFSN_TRACE_HEADER Trace = DeferredContext;
+    LONG NumFaults;
+
+    UNREFERENCED_PARAMETER(Dpc);
+    UNREFERENCED_PARAMETER(SystemArgument1);
+    UNREFERENCED_PARAMETER(SystemArgument2);
+
+    if (Trace->CurPeriod >= RTL_NUMBER_OF(Trace->FaultsPerPeriod))
+        return;
+
+    NumFaults = Trace->NumFaults;
+    Trace->FaultsPerPeriod[Trace->CurPeriod++] = NumFaults - Trace->LastNumFaults;
+    Trace->LastNumFaults = NumFaults;
+
+    if (Trace->CurPeriod == RTL_NUMBER_OF(Trace->FaultsPerPeriod))
+        CcPfEndTrace(Trace);
+}
+
+static
+VOID
+CcPfBeginTrace (
+    PPF_SCENARIO_ID ScenarioId,
+    PF_SCENARIO_TYPE ScenarioType,
+    PEPROCESS Process)
+{
+    PPFSN_TRACE_HEADER Trace;
+    PLIST_ENTRY ListEntry;
+    LONG MaxFaults;
+    ULONG PeriodMs;
+    KIRQL OldIrql;
+
+    if (InterlockedIncrement(&CcPfGlobals.NumActiveTraces) > PFSN_MAX_ACTIVE_TRACES)
+    {
+        InterlockedDecrement(&CcPfGlobals.NumActiveTraces);
+        return;
+    }
+
+    Trace = ExAllocatePoolWithTag(NonPagedPool, sizeof(*Trace), TAG_PREFETCH);
+    if (Trace == NULL)
+    {
+        InterlockedDecrement(&CcPfGlobals.NumActiveTraces);
+        return;
+    }
+    RtlZeroMemory(Trace, sizeof(*Trace));
+
+    if (ScenarioType == PfSystemBootScenarioType)
+    {
+        MaxFaults = PFSN_BOOT_MAX_FAULTS;
+        Trace->MaxSections = PFSN_BOOT_MAX_FILES;
+        PeriodMs = PFSN_BOOT_PERIOD_MS;
+    }
+    else
+    {
+        MaxFaults = PFSN_APP_LAUNCH_MAX_FAULTS;
+        Trace->MaxSections = PFSN_APP_LAUNCH_MAX_FILES;
+        PeriodMs = PFSN_APP_LAUNCH_PERIOD_MS;
+    }
+
+    Trace->CurrentTraceBuffer = ExAllocatePoolWithTag(NonPagedPool,
+                                                      FIELD_OFFSET(PFSN_LOG_ENTRIES, Entries) +
+                                                      MaxFaults * sizeof(PF_LOG_ENTRY),
+                                                      TAG_PREFETCH);
+    Trace->Sections = ExAllocatePoolWithTag(NonPagedPool,
+                                            Trace->MaxSections * sizeof(PFSN_SECTION),
+                                            TAG_PREFETCH);
+    if (Trace->CurrentTraceBuffer == NULL || Trace->Sections == NULL)
+    {
+        if (Trace->CurrentTraceBuffer != NULL)
+            ExFreePoolWithTag(Trace->CurrentTraceBuffer, TAG_PREFETCH);
+        if (Trace->Sections != NULL)
+            ExFreePoolWithTag(Trace->Sections, TAG_PREFETCH);
+        ExFreePoolWithTag(Trace, TAG_PREFETCH);
+        InterlockedDecrement(&CcPfGlobals.NumActiveTraces);
+        return;
+    }
+
+    Trace->Magic = PFSN_TRACE_MAGIC;
+    Trace->ScenarioId = *ScenarioId;
+    Trace->ScenarioType = ScenarioType;
+    Trace->CurrentTraceBuffer->NumEntries = 0;
+    Trace->CurrentTraceBuffer->MaxEntries = MaxFaults;
+    Trace->MaxFaults = MaxFaults;
+    Trace->Process = Process;
+    KeInitializeSpinLock(&Trace->TraceBufferSpinLock);
+    ExInitializeRundownProtection(&Trace->RefCount);
+    ExInitializeWorkItem(&Trace->EndTraceWorkItem, CcPfEndTraceWorker, Trace);
+    KeQuerySystemTime(&Trace->LaunchTime);
+    if (Process != NULL)
+        ObReferenceObject(Process);
+
+    KeAcquireSpinLock(&CcPfGlobals.ActiveTracesLock, &OldIrql);
+
+    /* One trace per process, and one boot trace */
+    for (ListEntry = CcPfGlobals.ActiveTraces.Flink;
+         ListEntry != &CcPfGlobals.ActiveTraces;
+         ListEntry = ListEntry->Flink)
+    {
+        PPFSN_TRACE_HEADER Other = CONTAINING_RECORD(ListEntry, PFSN_TRACE_HEADER, ActiveTracesLink);
+
+        if (Other->Process == Process)
+        {
+            KeReleaseSpinLock(&CcPfGlobals.ActiveTracesLock, OldIrql);
+            if (Process != NULL)
+                ObDereferenceObject(Process);
+            ExFreePoolWithTag(Trace->Sections, TAG_PREFETCH);
+            ExFreePoolWithTag(Trace->CurrentTraceBuffer, TAG_PREFETCH);
+            ExFreePoolWithTag(Trace, TAG_PREFETCH);
+            InterlockedDecrement(&CcPfGlobals.NumActiveTraces);
+            return;
+        }
+    }
+
+    InsertTailList(&CcPfGlobals.ActiveTraces, &Trace->ActiveTracesLink);
+    if (Process == NULL)
+        CcPfGlobals.SystemWideTrace = Trace;
+
+    KeInitializeDpc(&Trace->TraceTimerDpc, CcPfTraceTimerRoutine, Trace);
+    KeInitializeTimerEx(&Trace->TraceTimer, NotificationTimer);
+    Trace->TraceTimerPeriod.QuadPart = -(LONGLONG)PeriodMs * 10 * 1000;
+    KeSetTimerEx(&Trace->TraceTimer, Trace->TraceTimerPeriod, PeriodMs, &Trace->TraceTimerDpc);
+
+    KeReleaseSpinLock(&CcPfGlobals.ActiveTracesLock, OldIrql);
+}
+
+static
+BOOLEAN
+CcPfVerifyScenario (
+    PPF_TRACE_HEADER Scenario,
+    ULONG Size,
+    PPF_SCENARIO_ID ScenarioId)
+{
+    PPF_SECTION_INFO SectionInfo;
+    PPF_LOG_ENTRY Entries;
+    ULONG i;
+
+    if (Size < sizeof(PF_TRACE_HEADER) ||
+        Scenario->Version != PF_CURRENT_VERSION ||
+        Scenario->MagicNumber != PF_TRACE_MAGIC_NUMBER ||
+        Scenario->Size != Size ||
+        Scenario->ScenarioId.HashId != ScenarioId->HashId)
+    {
+        return FALSE;
+    }
+
+    /* The counts are bounded first, so the products below can't overflow */
+    if (Scenario->NumSections > PFSN_BOOT_MAX_FILES ||
+        Scenario->NumEntries > PFSN_BOOT_MAX_FAULTS ||
+        Scenario->SectionInfoOffset > Size ||
+        Scenario->TraceBufferOffset > Size ||
+        Size - Scenario->SectionInfoOffset < Scenario->NumSections * sizeof(PF_SECTION_INFO) ||
+        Size - Scenario->TraceBufferOffset < Scenario->NumEntries * sizeof(PF_LOG_ENTRY) ||
+        Scenario->SectionInfoOffset % sizeof(ULONG) != 0 ||
+        Scenario->TraceBufferOffset % sizeof(ULONG) != 0)
+    {
+        return FALSE;
+    }
+
+    SectionInfo = (PPF_SECTION_INFO)((ULONG_PTR)Scenario + Scenario->SectionInfoOffset);
+    for (i = 0; i < Scenario->NumSections; i++)
+    {
+        if (SectionInfo[i].FileNameOffset > Size ||
+            Size - SectionInfo[i].FileNameOffset < SectionInfo[i].FileNameLength ||
+            SectionInfo[i].FileNameOffset % sizeof(WCHAR) != 0 ||
+            SectionInfo[i].FileNameLength % sizeof(WCHAR) != 0)
+        {
+            return FALSE;
+        }
+    }
+
+    Entries = (PPF_LOG_ENTRY)((ULONG_PTR)Scenario + Scenario->TraceBufferOffset);
+    for (i = 0; i < Scenario->NumEntries; i++)
+    {
+        if (Entries[i].FileKey >= Scenario->NumSections)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+static
+NTSTATUS
+CcPfReadScenario (
+    PPF_SCENARIO_ID ScenarioId,
+    PPF_TRACE_HEADER *Scenario)
+{
+    FILE_STANDARD_INFORMATION StandardInfo;
+    IO_STATUS_BLOCK IoStatusBlock;
+    PPF_TRACE_HEADER Buffer;
+    HANDLE Handle;
+    NTSTATUS Status;
+    ULONG Size;
+
+    Status = CcPfOpenScenarioFile(ScenarioId, FALSE, &Handle);
+    if (!NT_SUCCESS(Status))
+        return Status;
+
+    Status = ZwQueryInformationFile(Handle,
+                                    &IoStatusBlock,
+                                    &StandardInfo,
+                                    sizeof(StandardInfo),
+                                    FileStandardInformation);
+    if (!NT_SUCCESS(Status))
+        goto Quit;
+
+    if (StandardInfo.EndOfFile.QuadPart > PF_MAX_SCENARIO_SIZE)
+    {
+        Status = STATUS_INVALID_IMAGE_FORMAT;
+        goto Quit;
+    }
+    Size = StandardInfo.EndOfFile.LowPart;
+
+    Buffer = ExAllocatePoolWithTag(PagedPool, max(Size, 1), TAG_PREFETCH);
+    if (Buffer == NULL)
+    {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto Quit;
+    }
+
+    Status = ZwReadFile(Handle, NULL, NULL, NULL, &IoStatusBlock, Buffer, Size, NULL, NULL);
+    if (NT_SUCCESS(Status) &&
+        (IoStatusBlock.Information != Size || !CcPfVerifyScenario(Buffer, Size, ScenarioId)))
+    {
+        DPRINT1("Ignoring invalid scenario %S-%08lX\n", ScenarioId->ScenName, ScenarioId->HashId);
+        Status = STATUS_INVALID_IMAGE_FORMAT;
+    }
+
+    if (NT_SUCCESS(Status))
+        *Scenario = Buffer;
+    else
+        ExFreePoolWithTag(Buffer, TAG_PREFETCH);
+
+Quit:
+    ZwClose(Handle);
+    return Status;
+}
+
+static
+ULONG
+CcPfWaitForRead (
+    PPFSN_PENDING_READ Read)
+{
+    ULONG Pages = Read->Pages;
+
+    if (Pages == 0)
+        return 0;
+
+    KeWaitForSingleObject(&Read->Event, Executive, KernelMode, FALSE, NULL);
+    Read->Pages = 0;
+
+    return NT_SUCCESS(Read->IoStatusBlock.Status) ? Pages : 0;
+}
+
+static
+VOID
+NTAPI
+CcPfPrefetchWorker (
+    PVOID Context)
+{
+    PPFSN_PREFETCH_CONTEXT PrefetchContext = Context;
+    PFSN_PENDING_READ Reads[PF_MAX_PENDING_READS];
+    PPFSN_PENDING_READ Read;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK IoStatusBlock;
+    PPF_SECTION_INFO SectionInfo;
+    PPF_TRACE_HEADER Scenario;
+    PPF_LOG_ENTRY Entries;
+    LARGE_INTEGER Offset;
+    UNICODE_STRING FileName;
+    ULONG Entry, RunStart, RunEnd, ReadPages, Slot;
+    HANDLE Handle;
+    PVOID Buffer;
+    NTSTATUS Status;
+
+    InterlockedIncrement(&CcPfGlobals.ActivePrefetches);
+
+    Status = CcPfReadScenario(&PrefetchContext->ScenarioId, &Scenario);
+    if (!NT_SUCCESS(Status))
+        goto Quit;
+
+    Buffer = ExAllocatePoolWithTag(PagedPool, PF_MAX_RUN_PAGES * PAGE_SIZE, TAG_PREFETCH);
+    if (Buffer == NULL)
+    {
+        ExFreePoolWithTag(Scenario, TAG_PREFETCH);
+        goto Quit;
+    }
+
+    SectionInfo = (PPF_SECTION_INFO)((ULONG_PTR)Scenario + Scenario->SectionInfoOffset);
+    Entries = (PPF_LOG_ENTRY)((ULONG_PTR)Scenario + Scenario->TraceBufferOffset);
+    ReadPages = 0;
+
+    for (Slot = 0; Slot < PF_MAX_PENDING_READS; Slot++)
+    {
+        KeInitializeEvent(&Reads[Slot].Event, NotificationEvent, FALSE);
+        Reads[Slot].Pages = 0;
+    }
+    Slot = 0;
+
+    /* Entries are sorted by file then offset: walk each file's pages once */
+    Entry = 0;
+    while (Entry < Scenario->NumEntries)
+    {
+        PPF_SECTION_INFO Section = &SectionInfo[Entries[Entry].FileKey];
+        ULONG FileKey = Entries[Entry].FileKey;
+
+        Handle = NULL;
+        if (Section->FileNameLength != 0)
+        {
+            FileName.Buffer = (PWSTR)((ULONG_PTR)Scenario + Section->FileNameOffset);
+            FileName.Length = FileName.MaximumLength = Section->FileNameLength;
+            InitializeObjectAttributes(&ObjectAttributes,
+                                       &FileName,
+                                       OBJ_CASE_INSENSITIVE | OBJ_KERNEL_HANDLE,
+                                       NULL,
+                                       NULL);
+            /* Asynchronous, so that the runs of all files overlap */
+            Status = ZwOpenFile(&Handle,
+                                FILE_READ_DATA,
+                                &ObjectAttributes,
+                                &IoStatusBlock,
+                                FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                FILE_NON_DIRECTORY_FILE);
+            if (!NT_SUCCESS(Status))
+                Handle = NULL;
+        }
+
+        while (Entry < Scenario->NumEntries && Entries[Entry].FileKey == FileKey)
+        {
+            /* Merge the faults close to each other into one large read */
+            RunStart = Entries[Entry].FileOffset;
+            RunEnd = RunStart + 1;
+            for (Entry++; Entry < Scenario->NumEntries; Entry++)
+            {
+                if (Entries[Entry].FileKey != FileKey ||
+                    Entries[Entry].FileOffset > RunEnd + PF_MAX_GAP_PAGES ||
+                    Entries[Entry].FileOffset + 1 - RunStart > PF_MAX_RUN_PAGES)
+                {
+                    break;
+                }
+                RunEnd = Entries[Entry].FileOffset + 1;
+            }
+
+            if (Handle == NULL)
+                continue;
+
+            /* Reuse the oldest slot once its read is done */
+            Read = &Reads[Slot];
+            Slot = (Slot + 1) % PF_MAX_PENDING_READS;
+            ReadPages += CcPfWaitForRead(Read);
+
+            /* A cached read leaves the pages in the VACBs the faults will use.
+             * The data itself is thrown away, so all reads share the buffer */
+            Offset.QuadPart = (LONGLONG)RunStart << PAGE_SHIFT;
+            KeClearEvent(&Read->Event);
+            Status = ZwReadFile(Handle,
+                                &Read->Event,
+                                NULL,
+                                NULL,
+                                &Read->IoStatusBlock,
+                                Buffer,
+                                (RunEnd - RunStart) << PAGE_SHIFT,
+                                &Offset,
+                                NULL);
+
+            /* A read that failed right away never signals the event */
+            if (!NT_ERROR(Status))
+                Read->Pages = RunEnd - RunStart;
+        }
+
+        /* The reads in flight hold their own reference to the file object */
+        if (Handle != NULL)
+            ZwClose(Handle);
+    }
+
+    for (Slot = 0; Slot < PF_MAX_PENDING_READS; Slot++)
+        ReadPages += CcPfWaitForRead(&Reads[Slot]);
+
+    DPRINT("Prefetched %lu pages for %S-%08lX\n",
+           ReadPages, Scenario->ScenarioId.ScenName, Scenario->ScenarioId.HashId);
+
+    ExFreePoolWithTag(Buffer, TAG_PREFETCH);
+    ExFreePoolWithTag(Scenario, TAG_PREFETCH);
+
+Quit:
+    InterlockedDecrement(&CcPfGlobals.ActivePrefetches);
+    ExFreePoolWithTag(PrefetchContext, TAG_PREFETCH);
+}
+
+static
+VOID
+CcPfQueuePrefetch (
+    PPF_SCENARIO_ID ScenarioId)
+{
+    PPFSN_PREFETCH_CONTEXT PrefetchContext;
+
+    PrefetchContext = ExAllocatePoolWithTag(NonPagedPool, sizeof(*PrefetchContext), TAG_PREFETCH);
+    if (PrefetchContext == NULL)
+        return;
+
+    /* The launch goes on while the worker reads ahead of it */
+    PrefetchContext->ScenarioId = *ScenarioId;
+    ExInitializeWorkItem(&PrefetchContext->WorkItem, CcPfPrefetchWorker, PrefetchContext);
+    ExQueueWorkItem(&PrefetchContext->WorkItem, DelayedWorkQueue);
+}
+
+VOID
+NTAPI
+INIT_FUNCTION
+CcPfInitializePrefetcher(VOID)
+{
+    /* Notify debugger */
+    DbgPrintEx(DPFLTR_PREFETCHER_ID,
+               DPFLTR_TRACE_LEVEL,
+               "CCPF: InitializePrefetecher()\n");
+
+    /* Setup the Prefetcher Data */
+    InitializeListHead(&CcPfGlobals.ActiveTraces);
+    KeInitializeSpinLock(&CcPfGlobals.ActiveTracesLock);
+
+    /* Setup and live media can't keep scenario files */
+    if (ExpInTextModeSetup || InitIsWinPEMode)
+    {
+        CcPfEnablePrefetcherParameter = 0;
+    }
+
+    CcPfEnablePrefetcher = (CcPfEnablePrefetcherParameter &
+                            (PF_ENABLE_APP_LAUNCH_PREFETCH | PF_ENABLE_BOOT_PREFETCH)) != 0;
+}
+
+/*
+ * FUNCTION: Called as boot progresses. When the session manager is about to
+ * start, file systems are up: prefetch the last boot and trace this one.
+ */
+NTSTATUS
+NTAPI
+CcPfBeginBootPhase (
+    PF_BOOT_PHASE_ID Phase)
+{
+    PF_SCENARIO_ID ScenarioId = CcPfBootScenarioId;
+
+    if (!(CcPfEnablePrefetcherParameter & PF_ENABLE_BOOT_PREFETCH))
+        return STATUS_NOT_SUPPORTED;
+
+    if (Phase == PfSessionManagerInitPhase)
+    {
+        CcPfQueuePrefetch(&ScenarioId);
+        CcPfBeginTrace(&ScenarioId, PfSystemBootScenarioType, NULL);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/*
+ * FUNCTION: Called when the first thread of a process starts
+ */
+VOID
+NTAPI
+CcPfBeginAppLaunch (
+    PEPROCESS Process,
+    PVOID Section)
+{
+    POBJECT_NAME_INFORMATION ImageFileName;
+    PF_SCENARIO_ID ScenarioId;
+
+    UNREFERENCED_PARAMETER(Section);
+
+    if (!(CcPfEnablePrefetcherParameter & PF_ENABLE_APP_LAUNCH_PREFETCH))
+        return;
+
+    ImageFileName = Process->SeAuditProcessCreationInfo.ImageFileName;
+    if (ImageFileName == NULL || ImageFileName->Name.Length == 0)
+        return;
+
+    CcPfGetScenarioId(&ImageFileName->Name, &ScenarioId);
+    CcPfQueuePrefetch(&ScenarioId);
+    CcPfBeginTrace(&ScenarioId, PfApplicationLaunchScenarioType, Process);
+}
+
+/*
+ * FUNCTION: Ends the launch trace of an exiting process early
+ */
+VOID
+NTAPI
+CcPfProcessExitNotification (
+    PEPROCESS Process)
+{
+    PPFSN_TRACE_HEADER Trace = NULL;
+    PLIST_ENTRY ListEntry;
+    KIRQL OldIrql;
+
+    if (CcPfGlobals.NumActiveTraces == 0)
+        return;
+
+    KeAcquireSpinLock(&CcPfGlobals.ActiveTracesLock, &OldIrql);
+    for (ListEntry = CcPfGlobals.ActiveTraces.Flink;
+         ListEntry != &CcPfGlobals.ActiveTraces;
+         ListEntry = ListEntry->Flink)
+    {
+        Trace = CONTAINING_RECORD(ListEntry, PFSN_TRACE_HEADER, ActiveTracesLink);
+        if (Trace->Process == Process)
+        {
+            CcPfEndTrace(Trace);
+            break;
+        }
+    }
+    KeReleaseSpinLock(&CcPfGlobals.ActiveTracesLock, OldIrql);
+}
+
+/*
+ * FUNCTION: Records a page fault resolved from a file in the active trace of
+ * the current process, or in the boot trace.
+ */
+VOID
+NTAPI
+CcPfLogPageFault (
+    PFILE_OBJECT FileObject,
+    LONGLONG FileOffset,
+    BOOLEAN Image)
+{
+    PPFSN_TRACE_HEADER Trace = NULL;
+    PPFSN_LOG_ENTRIES Log;
+    PLIST_ENTRY ListEntry;
+    PEPROCESS Process;
+    ULONG FileKey;
+    BOOLEAN Full;
+    KIRQL OldIrql;
+
+    if (CcPfGlobals.NumActiveTraces == 0 ||
+        (ULONGLONG)FileOffset >> PAGE_SHIFT >= (1 << 30))
+    {
+        return;
+    }
+
+    Process = PsGetCurrentProcess();
+
+    KeAcquireSpinLock(&CcPfGlobals.ActiveTracesLock, &OldIrql);
+    for (ListEntry = CcPfGlobals.ActiveTraces.Flink;
+         ListEntry != &CcPfGlobals.ActiveTraces;
+         ListEntry = ListEntry->Flink)
+    {
+        Trace = CONTAINING_RECORD(ListEntry, PFSN_TRACE_HEADER, ActiveTracesLink);
+        if (Trace->Process == Process)
+            break;
+        Trace = NULL;
+    }
+    if (Trace == NULL)
+        Trace = CcPfGlobals.SystemWideTrace;
+    if (Trace != NULL && !ExAcquireRundownProtection(&Trace->RefCount))
+        Trace = NULL;
+    KeReleaseSpinLock(&CcPfGlobals.ActiveTracesLock, OldIrql);
+
+    if (Trace == NULL)
+        return;
+
+    KeAcquireSpinLock(&Trace->TraceBufferSpinLock, &OldIrql);
+
+    /* Faults come in runs on the same file, check the last one first */
+    FileKey = Trace->LastSection;
+    if (FileKey >= Trace->SectionCount ||
+        Trace->Sections[FileKey].SectionObjectPointer != FileObject->SectionObjectPointer)
+    {
+        for (FileKey = 0; FileKey < Trace->SectionCount; FileKey++)
+        {
+            if (Trace->Sections[FileKey].SectionObjectPointer == FileObject->SectionObjectPointer)
+                break;
+        }
+
+        if (FileKey == Trace->SectionCount && FileKey < Trace->MaxSections)
+        {
+            ObReferenceObject(FileObject);
+            Trace->Sections[FileKey].SectionObjectPointer = FileObject->SectionObjectPointer;
+            Trace->Sections[FileKey].FileObject = FileObject;
+            Trace->Sections[FileKey].Image = Image;
+            Trace->SectionCount++;
+        }
+    }
+
+    Log = Trace->CurrentTraceBuffer;
+    if (FileKey < Trace->SectionCount && Log->NumEntries < Log->MaxEntries)
+    {
+        Trace->LastSection = FileKey;
+        Log->Entries[Log->NumEntries].FileOffset = (ULONG)(FileOffset >> PAGE_SHIFT);
+        Log->Entries[Log->NumEntries].Type = Image ? PF_LOG_ENTRY_IMAGE : PF_LOG_ENTRY_DATA;
+        Log->Entries[Log->NumEntries].FileKey = FileKey;
+        Log->NumEntries++;
+        Trace->NumFaults++;
+    }
+    Full = (Log->NumEntries >= Log->MaxEntries);
+
+    KeReleaseSpinLock(&Trace->TraceBufferSpinLock, OldIrql);
+
+    if (Full)
+        CcPfEndTrace(Trace);
+
+    ExReleaseRundownProtection(&Trace->RefCount);
+}
+
+/* EOF */
@@ -49,6 +49,7 @@ KGUARDED_MUTEX ViewLock;
 
 NPAGED_LOOKASIDE_LIST iBcbLookasideList;
 static NPAGED_LOOKASIDE_LIST SharedCacheMapLookasideList;
+static NPAGED_LOOKASIDE_LIST PrivateCacheMapLookasideList;
 static NPAGED_LOOKASIDE_LIST VacbLookasideList;
 
 #if DBG
@@ -83,6 +84,19 @@ CcRosInternalFreeVacb(PROS_VACB Vacb);
 
 /* FUNCTIONS *****************************************************************/
 
+static
+VOID
+CcRosInitializePrivateCacheMap (
+    PROS_PRIVATE_CACHE_MAP PrivateCacheMap,
+    PFILE_OBJECT FileObject,
+    PROS_SHARED_CACHE_MAP SharedCacheMap)
+{
+    RtlZeroMemory(PrivateCacheMap, sizeof(*PrivateCacheMap));
+    PrivateCacheMap->FileObject = FileObject;
+    PrivateCacheMap->SharedCacheMap = SharedCacheMap;
+    PrivateCacheMap->ReadAheadMask = PAGE_SIZE - 1;
+}
+
 VOID
 NTAPI
 CcRosTraceCacheMap (
@@ -141,11 +155,14 @@ CcRosFlushVacb (
     if (NT_SUCCESS(Status))
     {
         KeAcquireGuardedMutex(&ViewLock);
-        KeAcquireSpinLock(&Vacb->SharedCacheMap->CacheMapLock, &oldIrql);
 
-        Vacb->Dirty = FALSE;
+        /* The dirty list and counts belong to the view lock */
         RemoveEntryList(&Vacb->DirtyVacbListEntry);
         DirtyPageCount -= VACB_MAPPING_GRANULARITY / PAGE_SIZE;
+        Vacb->SharedCacheMap->DirtyPages -= VACB_MAPPING_GRANULARITY / PAGE_SIZE;
+
+        KeAcquireSpinLock(&Vacb->SharedCacheMap->CacheMapLock, &oldIrql);
+        Vacb->Dirty = FALSE;
         CcRosVacbDecRefCount(Vacb);
 
         KeReleaseSpinLock(&Vacb->SharedCacheMap->CacheMapLock, oldIrql);
@@ -404,6 +421,7 @@ CcRosReleaseVacb (
     {
         InsertTailList(&DirtyVacbListHead, &Vacb->DirtyVacbListEntry);
         DirtyPageCount += VACB_MAPPING_GRANULARITY / PAGE_SIZE;
+        SharedCacheMap->DirtyPages += VACB_MAPPING_GRANULARITY / PAGE_SIZE;
     }
 
     if (Mapped)
@@ -500,6 +518,7 @@ CcRosMarkDirtyVacb (
     {
         InsertTailList(&DirtyVacbListHead, &Vacb->DirtyVacbListEntry);
         DirtyPageCount += VACB_MAPPING_GRANULARITY / PAGE_SIZE;
+        SharedCacheMap->DirtyPages += VACB_MAPPING_GRANULARITY / PAGE_SIZE;
     }
     else
     {
@@ -553,6 +572,7 @@ CcRosUnmapVacb (
     {
         InsertTailList(&DirtyVacbListHead, &Vacb->DirtyVacbListEntry);
         DirtyPageCount += VACB_MAPPING_GRANULARITY / PAGE_SIZE;
+        SharedCacheMap->DirtyPages += VACB_MAPPING_GRANULARITY / PAGE_SIZE;
     }
 
     CcRosVacbDecRefCount(Vacb);
@@ -1015,6 +1035,7 @@ CcRosDeleteFileCache (
             {
                 RemoveEntryList(&current->DirtyVacbListEntry);
                 DirtyPageCount -= VACB_MAPPING_GRANULARITY / PAGE_SIZE;
+                SharedCacheMap->DirtyPages -= VACB_MAPPING_GRANULARITY / PAGE_SIZE;
                 DPRINT1("Freeing dirty VACB\n");
             }
             InsertHeadList(&FreeList, &current->CacheMapVacbListEntry);
@@ -1070,6 +1091,35 @@ CcRosRemoveIfClosed (
 }
 
 
+VOID
+NTAPI
+CcRosReadAheadDone (
+    PROS_PRIVATE_CACHE_MAP PrivateCacheMap)
+/*
+ * FUNCTION: Called with the view lock held once a read ahead worker is done
+ * with a private cache map.
+ */
+{
+    PROS_SHARED_CACHE_MAP SharedCacheMap = PrivateCacheMap->SharedCacheMap;
+
+    PrivateCacheMap->ReadAheadActive = FALSE;
+
+    /* The file object was closed while we were reading */
+    if (PrivateCacheMap->FileObject == NULL)
+    {
+        ExFreeToNPagedLookasideList(&PrivateCacheMapLookasideList, PrivateCacheMap);
+    }
+
+    /* Drop the reference the read ahead held on the shared cache map */
+    ASSERT(SharedCacheMap->OpenCount != 0);
+    SharedCacheMap->OpenCount--;
+    if (SharedCacheMap->OpenCount == 0)
+    {
+        MmFreeSectionSegments(SharedCacheMap->FileObject);
+        CcRosDeleteFileCache(SharedCacheMap->FileObject, SharedCacheMap);
+    }
+}
+
 VOID
 NTAPI
 CcRosDereferenceCache (
@@ -1101,15 +1151,25 @@ CcRosReleaseFileCache (
  */
 {
     PROS_SHARED_CACHE_MAP SharedCacheMap;
+    PROS_PRIVATE_CACHE_MAP PrivateCacheMap;
 
     KeAcquireGuardedMutex(&ViewLock);
 
     if (FileObject->SectionObjectPointer->SharedCacheMap != NULL)
     {
         SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
-        if (FileObject->PrivateCacheMap != NULL)
+        PrivateCacheMap = FileObject->PrivateCacheMap;
+        if (PrivateCacheMap != NULL)
         {
             FileObject->PrivateCacheMap = NULL;
+
+            /* Waiting for a read ahead could deadlock with the caller's locks.
+             * Tell it to stop instead, it frees the private cache map when done */
+            if (PrivateCacheMap->ReadAheadActive)
+                PrivateCacheMap->FileObject = NULL;
+            else
+                ExFreeToNPagedLookasideList(&PrivateCacheMapLookasideList, PrivateCacheMap);
+
             if (SharedCacheMap->OpenCount > 0)
             {
                 SharedCacheMap->OpenCount--;
@@ -1131,8 +1191,15 @@ CcTryToInitializeFileCache (
     PFILE_OBJECT FileObject)
 {
     PROS_SHARED_CACHE_MAP SharedCacheMap;
+    PROS_PRIVATE_CACHE_MAP PrivateCacheMap;
     NTSTATUS Status;
 
+    PrivateCacheMap = ExAllocateFromNPagedLookasideList(&PrivateCacheMapLookasideList);
+    if (PrivateCacheMap == NULL)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
     KeAcquireGuardedMutex(&ViewLock);
 
     ASSERT(FileObject->SectionObjectPointer);
@@ -1145,13 +1212,20 @@ CcTryToInitializeFileCache (
     {
         if (FileObject->PrivateCacheMap == NULL)
         {
-            FileObject->PrivateCacheMap = SharedCacheMap;
+            CcRosInitializePrivateCacheMap(PrivateCacheMap, FileObject, SharedCacheMap);
+            FileObject->PrivateCacheMap = PrivateCacheMap;
+            PrivateCacheMap = NULL;
             SharedCacheMap->OpenCount++;
         }
         Status = STATUS_SUCCESS;
     }
     KeReleaseGuardedMutex(&ViewLock);
 
+    if (PrivateCacheMap != NULL)
+    {
+        ExFreeToNPagedLookasideList(&PrivateCacheMapLookasideList, PrivateCacheMap);
+    }
+
     return Status;
 }
 
@@ -1169,11 +1243,18 @@ CcRosInitializeFileCache (
  */
 {
     PROS_SHARED_CACHE_MAP SharedCacheMap;
+    PROS_PRIVATE_CACHE_MAP PrivateCacheMap;
 
     SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
     DPRINT("CcRosInitializeFileCache(FileObject 0x%p, SharedCacheMap 0x%p)\n",
            FileObject, SharedCacheMap);
 
+    PrivateCacheMap = ExAllocateFromNPagedLookasideList(&PrivateCacheMapLookasideList);
+    if (PrivateCacheMap == NULL)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
     KeAcquireGuardedMutex(&ViewLock);
     if (SharedCacheMap == NULL)
     {
@@ -1181,6 +1262,7 @@ CcRosInitializeFileCache (
         if (SharedCacheMap == NULL)
         {
             KeReleaseGuardedMutex(&ViewLock);
+            ExFreeToNPagedLookasideList(&PrivateCacheMapLookasideList, PrivateCacheMap);
             return STATUS_INSUFFICIENT_RESOURCES;
         }
         RtlZeroMemory(SharedCacheMap, sizeof(*SharedCacheMap));
@@ -1200,11 +1282,18 @@ CcRosInitializeFileCache (
     }
     if (FileObject->PrivateCacheMap == NULL)
     {
-        FileObject->PrivateCacheMap = SharedCacheMap;
+        CcRosInitializePrivateCacheMap(PrivateCacheMap, FileObject, SharedCacheMap);
+        FileObject->PrivateCacheMap = PrivateCacheMap;
+        PrivateCacheMap = NULL;
         SharedCacheMap->OpenCount++;
     }
     KeReleaseGuardedMutex(&ViewLock);
 
+    if (PrivateCacheMap != NULL)
+    {
+        ExFreeToNPagedLookasideList(&PrivateCacheMapLookasideList, PrivateCacheMap);
+    }
+
     return STATUS_SUCCESS;
 }
 
@@ -1254,6 +1343,13 @@ CcInitView (
                                     sizeof(ROS_SHARED_CACHE_MAP),
                                     TAG_SHARED_CACHE_MAP,
                                     20);
+    ExInitializeNPagedLookasideList(&PrivateCacheMapLookasideList,
+                                    NULL,
+                                    NULL,
+                                    0,
+                                    sizeof(ROS_PRIVATE_CACHE_MAP),
+                                    TAG_PRIVATE_CACHE_MAP,
+                                    20);
     ExInitializeNPagedLookasideList(&VacbLookasideList,
                                     NULL,
                                     NULL,
@@ -1265,6 +1361,7 @@ CcInitView (
     MmInitializeMemoryConsumer(MC_CACHE, CcRosTrimCache);
 
     CcInitCacheZeroPage();
+    CcInitDeferredWrites();
 }
 
 /* EOF */
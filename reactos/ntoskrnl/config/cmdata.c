@@ -530,6 +530,16 @@ INIT_FUNCTION CM_SYSTEM_CONTROL_VECTOR CmControlVector[] =
         NULL
     },
 
+#ifndef NEWCC
+    {
+        L"Session Manager\\Memory Management\\PrefetchParameters",
+        L"EnablePrefetcher",
+        &CcPfEnablePrefetcherParameter,
+        NULL,
+        NULL
+    },
+#endif
+
     {
         L"Session Manager\\Executive",
         L"AdditionalCriticalWorkerThreads",
@@ -27,6 +27,10 @@ LIST_ENTRY ExPoolLookasideListHead;
 GENERAL_LOOKASIDE ExpSmallNPagedPoolLookasideLists[MAXIMUM_PROCESSORS];
 GENERAL_LOOKASIDE ExpSmallPagedPoolLookasideLists[MAXIMUM_PROCESSORS];
 
+/* Depth tuning parameters, see ExAdjustLookasideDepth */
+#define MINIMUM_LOOKASIDE_DEPTH         4
+#define MINIMUM_ALLOCATION_THRESHOLD    75
+
 /* PRIVATE FUNCTIONS *********************************************************/
 
 VOID
@@ -123,6 +127,171 @@ ExpInitLookasideLists(VOID)
     }
 }
 
+static
+USHORT
+ExpComputeLookasideDepth(IN PGENERAL_LOOKASIDE Lookaside,
+                         IN ULONG Allocates,
+                         IN ULONG Misses)
+{
+    ULONG Depth, MaximumDepth, Ratio, Change;
+
+    Depth = Lookaside->Depth;
+    MaximumDepth = Lookaside->MaximumDepth;
+
+    /* Shrink lists that are barely used, down to the minimum depth */
+    if (Allocates < MINIMUM_ALLOCATION_THRESHOLD)
+    {
+        if (Depth > MINIMUM_LOOKASIDE_DEPTH + 10)
+            return (USHORT)(Depth - 10);
+        return min(MINIMUM_LOOKASIDE_DEPTH, MaximumDepth);
+    }
+
+    /* Miss ratio in tenths of a percent */
+    Ratio = (ULONG)(((ULONGLONG)Misses * 1000) / Allocates);
+
+    /* Below half a percent the list is deep enough, let it slowly shrink */
+    if (Ratio < 5)
+    {
+        if (Depth > MINIMUM_LOOKASIDE_DEPTH) Depth--;
+        return (USHORT)Depth;
+    }
+
+    /* Grow proportionally to the miss ratio and the remaining headroom */
+    Change = (((MaximumDepth - min(Depth, MaximumDepth)) * Ratio) / (1000 * 2)) + 5;
+    return (USHORT)min(Depth + Change, MaximumDepth);
+}
+
+static
+VOID
+ExpScanGeneralLookasideList(IN PLIST_ENTRY ListHead,
+                            IN BOOLEAN ListUsesMisses,
+                            IN BOOLEAN TrimList)
+{
+    PGENERAL_LOOKASIDE Lookaside;
+    PLIST_ENTRY ListEntry;
+    ULONG Allocates, Misses;
+    PVOID Entry;
+
+    for (ListEntry = ListHead->Flink;
+         ListEntry != ListHead;
+         ListEntry = ListEntry->Flink)
+    {
+        Lookaside = CONTAINING_RECORD(ListEntry, GENERAL_LOOKASIDE, ListEntry);
+
+        /* Compute the allocations and misses since the last scan */
+        Allocates = Lookaside->TotalAllocates - Lookaside->LastTotalAllocates;
+        Lookaside->LastTotalAllocates = Lookaside->TotalAllocates;
+        if (ListUsesMisses)
+        {
+            Misses = Lookaside->AllocateMisses - Lookaside->LastAllocateMisses;
+            Lookaside->LastAllocateMisses = Lookaside->AllocateMisses;
+        }
+        else
+        {
+            Misses = Allocates - (Lookaside->AllocateHits - Lookaside->LastAllocateHits);
+            Lookaside->LastAllocateHits = Lookaside->AllocateHits;
+        }
+
+        Lookaside->Depth = ExpComputeLookasideDepth(Lookaside, Allocates, Misses);
+
+        /* Give back what the list holds beyond its new depth */
+        if (TrimList)
+        {
+            while (ExQueryDepthSList(&Lookaside->ListHead) > Lookaside->Depth)
+            {
+                Entry = InterlockedPopEntrySList(&Lookaside->ListHead);
+                if (!Entry) break;
+                (Lookaside->Free)(Entry);
+            }
+        }
+    }
+}
+
+VOID
+NTAPI
+ExAdjustLookasideDepth(VOID)
+{
+    KIRQL OldIrql;
+
+    /*
+     * Pool lookaside entries were already untracked when they were pushed,
+     * so they cannot be handed back to ExFreePool and are only drained by
+     * the pool itself once their depth is lowered. The same goes for paged
+     * lists, whose free routines cannot run under the list spinlock.
+     */
+    ExpScanGeneralLookasideList(&ExPoolLookasideListHead, FALSE, FALSE);
+    ExpScanGeneralLookasideList(&ExSystemLookasideListHead, TRUE, FALSE);
+
+    KeAcquireSpinLock(&ExpNonPagedLookasideListLock, &OldIrql);
+    ExpScanGeneralLookasideList(&ExpNonPagedLookasideListHead, TRUE, TRUE);
+    KeReleaseSpinLock(&ExpNonPagedLookasideListLock, OldIrql);
+
+    KeAcquireSpinLock(&ExpPagedLookasideListLock, &OldIrql);
+    ExpScanGeneralLookasideList(&ExpPagedLookasideListHead, TRUE, FALSE);
+    KeReleaseSpinLock(&ExpPagedLookasideListLock, OldIrql);
+}
+
+#if DBG && defined(KDBG)
+
+static
+VOID
+ExpKdbgPrintLookasideList(IN PLIST_ENTRY ListHead,
+                          IN BOOLEAN ListUsesMisses)
+{
+    PGENERAL_LOOKASIDE Lookaside;
+    PLIST_ENTRY ListEntry;
+    ULONG AllocateMisses, FreeMisses;
+
+    for (ListEntry = ListHead->Flink;
+         ListEntry != ListHead;
+         ListEntry = ListEntry->Flink)
+    {
+        Lookaside = CONTAINING_RECORD(ListEntry, GENERAL_LOOKASIDE, ListEntry);
+
+        if (ListUsesMisses)
+        {
+            AllocateMisses = Lookaside->AllocateMisses;
+            FreeMisses = Lookaside->FreeMisses;
+        }
+        else
+        {
+            AllocateMisses = Lookaside->TotalAllocates - Lookaside->AllocateHits;
+            FreeMisses = Lookaside->TotalFrees - Lookaside->FreeHits;
+        }
+
+        KdbpPrint("%p %.4s %-8s %5lu %3u/%-3u %3u %10lu %10lu %10lu %10lu\n",
+                  Lookaside,
+                  (PCHAR)&Lookaside->Tag,
+                  (Lookaside->Type & BASE_POOL_TYPE_MASK) == PagedPool ? "Paged" : "NonPaged",
+                  Lookaside->Size,
+                  Lookaside->Depth,
+                  Lookaside->MaximumDepth,
+                  ExQueryDepthSList(&Lookaside->ListHead),
+                  Lookaside->TotalAllocates,
+                  AllocateMisses,
+                  Lookaside->TotalFrees,
+                  FreeMisses);
+    }
+}
+
+BOOLEAN
+ExpKdbgExtLookaside(
+    ULONG Argc,
+    PCHAR Argv[])
+{
+    KdbpPrint("Address  Tag  Type      Size Depth   Cur     Allocs  AllocMiss      Frees   FreeMiss\n");
+
+    /* The debugger runs with everything frozen, no need for the list locks */
+    ExpKdbgPrintLookasideList(&ExPoolLookasideListHead, FALSE);
+    ExpKdbgPrintLookasideList(&ExSystemLookasideListHead, TRUE);
+    ExpKdbgPrintLookasideList(&ExpNonPagedLookasideListHead, TRUE);
+    ExpKdbgPrintLookasideList(&ExpPagedLookasideListHead, TRUE);
+
+    return TRUE;
+}
+
+#endif // DBG && KDBG
+
 /* PUBLIC FUNCTIONS **********************************************************/
 
 /*
@@ -640,7 +640,8 @@ QSI_DEF(SystemPerformanceInformation)
     Spi->CopyOnWriteCount = 0; /* FIXME */
     Spi->TransitionCount = 0; /* FIXME */
     Spi->CacheTransitionCount = 0; /* FIXME */
-    Spi->DemandZeroCount = 0; /* FIXME */
+    /* Every zero page request, whether it found a zeroed page or not */
+    Spi->DemandZeroCount = MmZeroedPageListHits + MmZeroedPageListMisses;
     Spi->PageReadCount = 0; /* FIXME */
     Spi->PageReadIoCount = 0; /* FIXME */
     Spi->CacheReadCount = 0; /* FIXME */
@@ -40,6 +40,36 @@
 // Global Cc Data
 //
 extern ULONG CcRosTraceLevel;
+extern KGUARDED_MUTEX ViewLock;
+extern ULONG DirtyPageCount;
+extern ULONG CcDirtyPageThreshold;
+extern BOOLEAN CcPfEnablePrefetcher;
+extern ULONG CcPfEnablePrefetcherParameter;
+
+typedef enum _PF_SCENARIO_TYPE
+{
+    PfApplicationLaunchScenarioType,
+    PfSystemBootScenarioType,
+    PfMaxScenarioType
+} PF_SCENARIO_TYPE;
+
+typedef enum _PF_BOOT_PHASE_ID
+{
+    PfKernelInitPhase = 0,
+    PfBootDriverInitPhase = 90,
+    PfSystemDriverInitPhase = 120,
+    PfSessionManagerInitPhase = 150,
+    PfSMRegistryInitPhase = 180,
+    PfVideoInitPhase = 210,
+    PfPostVideoInitPhase = 240,
+    PfBootAcceptedRegistryInitPhase = 270,
+    PfUserShellReadyPhase = 300,
+    PfMaxBootPhaseId = 900
+} PF_BOOT_PHASE_ID;
+
+/* EnablePrefetcher registry value */
+#define PF_ENABLE_APP_LAUNCH_PREFETCH 0x1
+#define PF_ENABLE_BOOT_PREFETCH 0x2
 
 typedef struct _PF_SCENARIO_ID
 {
@@ -47,9 +77,12 @@ typedef struct _PF_SCENARIO_ID
     ULONG HashId;
 } PF_SCENARIO_ID, *PPF_SCENARIO_ID;
 
+#define PF_LOG_ENTRY_DATA 0
+#define PF_LOG_ENTRY_IMAGE 1
+
 typedef struct _PF_LOG_ENTRY
 {
-    ULONG FileOffset:30;
+    ULONG FileOffset:30; /* In pages */
     ULONG Type:2;
     union
     {
@@ -66,14 +99,18 @@ typedef struct _PFSN_LOG_ENTRIES
     PF_LOG_ENTRY Entries[ANYSIZE_ARRAY];
 } PFSN_LOG_ENTRIES, *PPFSN_LOG_ENTRIES;
 
+/* Scenario file layout: PF_TRACE_HEADER, PF_SECTION_INFO array, file names,
+ * then the PF_LOG_ENTRY array sorted by file and offset. */
 typedef struct _PF_SECTION_INFO
 {
-    ULONG FileKey;
-    ULONG FileSequenceNumber;
-    ULONG FileIdLow;
-    ULONG FileIdHigh;
+    ULONG FileNameOffset;
+    USHORT FileNameLength;
+    USHORT Flags;
 } PF_SECTION_INFO, *PPF_SECTION_INFO;
 
+#define PF_CURRENT_VERSION 1
+#define PF_TRACE_MAGIC_NUMBER 'ACCS'
+
 typedef struct _PF_TRACE_HEADER
 {
     ULONG Version;
@@ -92,11 +129,14 @@ typedef struct _PF_TRACE_HEADER
     ULONGLONG Reserved[5];
 } PF_TRACE_HEADER, *PPF_TRACE_HEADER;
 
-typedef struct _PFSN_TRACE_DUMP
+typedef struct _PFSN_SECTION
 {
-    LIST_ENTRY CompletedTracesLink;
-    PF_TRACE_HEADER Trace;
-} PFSN_TRACE_DUMP, *PPFSN_TRACE_DUMP;
+    PSECTION_OBJECT_POINTERS SectionObjectPointer;
+    PFILE_OBJECT FileObject;
+    BOOLEAN Image;
+} PFSN_SECTION, *PPFSN_SECTION;
+
+#define PFSN_TRACE_MAGIC 'TfPC'
 
 typedef struct _PFSN_TRACE_HEADER
 {
@@ -104,16 +144,11 @@ typedef struct _PFSN_TRACE_HEADER
     LIST_ENTRY ActiveTracesLink;
     PF_SCENARIO_ID ScenarioId;
     ULONG ScenarioType; // PF_SCENARIO_TYPE
-    ULONG EventEntryIdxs[8];
-    ULONG NumEventEntryIdxs;
     PPFSN_LOG_ENTRIES CurrentTraceBuffer;
-    LIST_ENTRY TraceBuffersList;
-    ULONG NumTraceBuffers;
     KSPIN_LOCK TraceBufferSpinLock;
     KTIMER TraceTimer;
     LARGE_INTEGER TraceTimerPeriod;
     KDPC TraceTimerDpc;
-    KSPIN_LOCK TraceTimerSpinLock;
     ULONG FaultsPerPeriod[10];
     LONG LastNumFaults;
     LONG CurPeriod;
@@ -123,11 +158,13 @@ typedef struct _PFSN_TRACE_HEADER
     EX_RUNDOWN_REF RefCount;
     WORK_QUEUE_ITEM EndTraceWorkItem;
     LONG EndTraceCalled;
-    PPFSN_TRACE_DUMP TraceDump;
-    NTSTATUS TraceDumpStatus;
     LARGE_INTEGER LaunchTime;
-    PPF_SECTION_INFO SectionInfo;
-    ULONG SectionInfoCount;
+    /* Files faulted on, a log entry's FileKey indexes this array */
+    _Guarded_by_(TraceBufferSpinLock)
+    PPFSN_SECTION Sections;
+    ULONG SectionCount;
+    ULONG MaxSections;
+    ULONG LastSection;
 } PFSN_TRACE_HEADER, *PPFSN_TRACE_HEADER;
 
 typedef struct _PFSN_PREFETCHER_GLOBALS
@@ -135,13 +172,13 @@ typedef struct _PFSN_PREFETCHER_GLOBALS
     LIST_ENTRY ActiveTraces;
     KSPIN_LOCK ActiveTracesLock;
     PPFSN_TRACE_HEADER SystemWideTrace;
-    LIST_ENTRY CompletedTraces;
-    FAST_MUTEX CompletedTracesLock;
-    LONG NumCompletedTraces;
-    PKEVENT CompletedTracesEvent;
+    LONG NumActiveTraces;
     LONG ActivePrefetches;
 } PFSN_PREFETCHER_GLOBALS, *PPFSN_PREFETCHER_GLOBALS;
 
+#define READAHEAD_DISABLED 0x1
+#define WRITEBEHIND_DISABLED 0x2
+
 typedef struct _ROS_SHARED_CACHE_MAP
 {
     LIST_ENTRY CacheMapVacbListHead;
@@ -150,15 +187,52 @@ typedef struct _ROS_SHARED_CACHE_MAP
     LARGE_INTEGER SectionSize;
     LARGE_INTEGER FileSize;
     BOOLEAN PinAccess;
+    ULONG Flags;
     PCACHE_MANAGER_CALLBACKS Callbacks;
     PVOID LazyWriteContext;
     KSPIN_LOCK CacheMapLock;
     ULONG OpenCount;
+    /* Dirty pages of this file, and the limit set by CcSetDirtyPageThreshold (0 if none). */
+    _Guarded_by_(ViewLock)
+    ULONG DirtyPages;
+    ULONG DirtyPageThreshold;
 #if DBG
     BOOLEAN Trace; /* enable extra trace output for this cache map and it's VACBs */
 #endif
 } ROS_SHARED_CACHE_MAP, *PROS_SHARED_CACHE_MAP;
 
+typedef struct _ROS_PRIVATE_CACHE_MAP
+{
+    PFILE_OBJECT FileObject;
+    PROS_SHARED_CACHE_MAP SharedCacheMap;
+    /* Last read through this file object, used to detect sequential access. */
+    LARGE_INTEGER LastReadOffset;
+    LARGE_INTEGER LastReadEnd;
+    /* End of the data already scheduled for read ahead. */
+    LARGE_INTEGER ReadAheadOffset;
+    ULONG ReadAheadMask;
+    /* Only one read ahead is in flight per private cache map. It holds the
+     * shared cache map open, and frees the private one if the file object
+     * was closed meanwhile (FileObject is NULL then). */
+    _Guarded_by_(ViewLock)
+    BOOLEAN ReadAheadActive;
+    WORK_QUEUE_ITEM ReadAheadWorkItem;
+    LARGE_INTEGER ReadAheadWorkOffset;
+    ULONG ReadAheadWorkLength;
+} ROS_PRIVATE_CACHE_MAP, *PROS_PRIVATE_CACHE_MAP;
+
+typedef struct _ROS_DEFERRED_WRITE
+{
+    LIST_ENTRY DeferredWriteLinks;
+    PFILE_OBJECT FileObject;
+    ULONG BytesToWrite;
+    /* Set for a CcCanIWrite caller waiting in place, PostRoutine is unused then. */
+    PKEVENT Event;
+    PCC_POST_DEFERRED_WRITE PostRoutine;
+    PVOID Context1;
+    PVOID Context2;
+} ROS_DEFERRED_WRITE, *PROS_DEFERRED_WRITE;
+
 typedef struct _ROS_VACB
 {
     /* Base address of the region where the view's data is mapped. */
@@ -209,6 +283,33 @@ CcPfInitializePrefetcher(
     VOID
 );
 
+NTSTATUS
+NTAPI
+CcPfBeginBootPhase(
+    PF_BOOT_PHASE_ID Phase
+);
+
+VOID
+NTAPI
+CcPfBeginAppLaunch(
+    PEPROCESS Process,
+    PVOID Section
+);
+
+VOID
+NTAPI
+CcPfProcessExitNotification(
+    PEPROCESS Process
+);
+
+VOID
+NTAPI
+CcPfLogPageFault(
+    PFILE_OBJECT FileObject,
+    LONGLONG FileOffset,
+    BOOLEAN Image
+);
+
 VOID
 NTAPI
 CcMdlReadComplete2(
@@ -274,6 +375,14 @@ VOID
 NTAPI
 CcInitCacheZeroPage(VOID);
 
+VOID
+NTAPI
+CcInitDeferredWrites(VOID);
+
+BOOLEAN
+NTAPI
+CcPostDeferredWrites(VOID);
+
 NTSTATUS
 NTAPI
 CcRosMarkDirtyVacb(
@@ -301,6 +410,10 @@ VOID
 NTAPI
 CcRosRemoveIfClosed(PSECTION_OBJECT_POINTERS SectionObjectPointer);
 
+VOID
+NTAPI
+CcRosReadAheadDone(PROS_PRIVATE_CACHE_MAP PrivateCacheMap);
+
 NTSTATUS
 NTAPI
 CcRosReleaseVacb(
@@ -206,6 +206,10 @@ ExInitializeSystemLookasideList(
     IN PLIST_ENTRY ListHead
 );
 
+VOID
+NTAPI
+ExAdjustLookasideDepth(VOID);
+
 BOOLEAN
 NTAPI
 ExpInitializeCallbacks(VOID);
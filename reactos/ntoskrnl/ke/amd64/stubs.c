@@ -82,8 +82,35 @@ FASTCALL
 KeZeroPages(IN PVOID Address,
             IN ULONG Size)
 {
-    /* Not using XMMI in this routine */
-    RtlZeroMemory(Address, Size);
+    PULONG64 Buffer = Address;
+    ULONG i;
+
+    /* Write the zeroes around the caches, SSE2 is always there on x64 */
+    for (i = 0; i < Size / sizeof(ULONG64); i += 4)
+    {
+#ifdef __GNUC__
+        __asm__ __volatile__
+        (
+            "movnti %4, %0\n\t"
+            "movnti %4, %1\n\t"
+            "movnti %4, %2\n\t"
+            "movnti %4, %3\n\t"
+            : "=m" (Buffer[i]),
+              "=m" (Buffer[i + 1]),
+              "=m" (Buffer[i + 2]),
+              "=m" (Buffer[i + 3])
+            : "r" (0ULL)
+        );
+#else
+        _mm_stream_si64x((__int64*)&Buffer[i], 0);
+        _mm_stream_si64x((__int64*)&Buffer[i + 1], 0);
+        _mm_stream_si64x((__int64*)&Buffer[i + 2], 0);
+        _mm_stream_si64x((__int64*)&Buffer[i + 3], 0);
+#endif
+    }
+
+    /* Make the stores visible before the pages are handed out */
+    _mm_sfence();
 }
 
 PVOID
@@ -136,6 +163,11 @@ KiIdleLoop(VOID)
             KiRetireDpcList(Prcb);
         }
 
+#ifdef CONFIG_SMP
+        /* Try to take over ready threads from busy processors */
+        if (Prcb->IdleSchedule) KiIdleSchedule(Prcb);
+#endif
+
         /* Check if a new thread is scheduled for execution */
         if (Prcb->NextThread)
         {
@@ -144,6 +144,11 @@ KiSwapContextResume(
     PKIPCR Pcr = (PKIPCR)KeGetPcr();
     PKPROCESS OldProcess, NewProcess;
 
+#ifdef CONFIG_SMP
+    /* The old thread's context is saved, other processors may run it now */
+    OldThread->SwapBusy = FALSE;
+#endif
+
     /* Setup ring 0 stack pointer */
     Pcr->TssBase->Rsp0 = (ULONG64)NewThread->InitialStack; // FIXME: NPX save area?
     Pcr->Prcb.RspBase = Pcr->TssBase->Rsp0;
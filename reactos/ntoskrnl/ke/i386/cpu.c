@@ -1134,8 +1134,46 @@ FASTCALL
 KeZeroPages(IN PVOID Address,
             IN ULONG Size)
 {
-    /* Not using XMMI in this routine */
-    RtlZeroMemory(Address, Size);
+    PULONG Buffer = Address;
+    ULONG i;
+
+    /* Non-temporal stores need SSE2 */
+    if (!(KeFeatureBits & KF_XMMI64))
+    {
+        RtlZeroMemory(Address, Size);
+        return;
+    }
+
+    /*
+     * Write the zeroes around the caches, so zeroing does not evict what
+     * everyone else is working on. movnti only uses general purpose
+     * registers, so there is no FPU state to save.
+     */
+    for (i = 0; i < Size / sizeof(ULONG); i += 4)
+    {
+#ifdef __GNUC__
+        __asm__ __volatile__
+        (
+            "movnti %4, %0\n\t"
+            "movnti %4, %1\n\t"
+            "movnti %4, %2\n\t"
+            "movnti %4, %3\n\t"
+            : "=m" (Buffer[i]),
+              "=m" (Buffer[i + 1]),
+              "=m" (Buffer[i + 2]),
+              "=m" (Buffer[i + 3])
+            : "r" (0)
+        );
+#else
+        _mm_stream_si32((int*)&Buffer[i], 0);
+        _mm_stream_si32((int*)&Buffer[i + 1], 0);
+        _mm_stream_si32((int*)&Buffer[i + 2], 0);
+        _mm_stream_si32((int*)&Buffer[i + 3], 0);
+#endif
+    }
+
+    /* Make the stores visible before the pages are handed out */
+    _mm_sfence();
 }
 
 VOID
@@ -291,6 +291,11 @@ KiIdleLoop(VOID)
             KiRetireDpcList(Prcb);
         }
 
+#ifdef CONFIG_SMP
+        /* Try to take over ready threads from busy processors */
+        if (Prcb->IdleSchedule) KiIdleSchedule(Prcb);
+#endif
+
         /* Check if a new thread is scheduled for execution */
         if (Prcb->NextThread)
         {
@@ -331,6 +336,11 @@ KiSwapContextExit(IN PKTHREAD OldThread,
     /* We are on the new thread stack now */
     NewThread = Pcr->PrcbData.CurrentThread;
 
+#ifdef CONFIG_SMP
+    /* The old thread's context is saved, other processors may run it now */
+    OldThread->SwapBusy = FALSE;
+#endif
+
     /* Now we are the new thread. Check if it's in a new process */
     OldProcess = OldThread->ApcState.Process;
     NewProcess = NewThread->ApcState.Process;
@@ -435,6 +445,16 @@ KiSwapContextEntry(IN PKSWITCHFRAME SwitchFrame,
     /* Get the old thread and set its kernel stack */
     OldThread->KernelStack = SwitchFrame;
 
+#ifdef CONFIG_SMP
+    /* The new thread may still be switching out on another processor. If we
+       are switching back to the old thread, its SwapBusy flag is ours and is
+       only cleared in KiSwapContextExit, so don't wait for it */
+    if (NewThread != OldThread)
+    {
+        while (NewThread->SwapBusy) YieldProcessor();
+    }
+#endif
+
     /* ISRs can change FPU state, so disable interrupts while checking */
     _disable();
 
@@ -15,9 +15,13 @@
 #ifdef _WIN64
 # define InterlockedOrSetMember(Destination, SetMember) \
     InterlockedOr64((PLONG64)Destination, SetMember);
+# define InterlockedAndSetMember(Destination, SetMember) \
+    InterlockedAnd64((PLONG64)Destination, SetMember);
 #else
 # define InterlockedOrSetMember(Destination, SetMember) \
     InterlockedOr((PLONG)Destination, SetMember);
+# define InterlockedAndSetMember(Destination, SetMember) \
+    InterlockedAnd((PLONG)Destination, SetMember);
 #endif
 
 /* GLOBALS *******************************************************************/
@@ -27,13 +31,144 @@ ULONG_PTR KiIdleSMTSummary;
 
 /* FUNCTIONS *****************************************************************/
 
+#ifdef CONFIG_SMP
+static
+VOID
+KiAcquireTwoPrcbLocks(IN PKPRCB FirstPrcb,
+                      IN PKPRCB SecondPrcb)
+{
+    /* Always lock the lower numbered processor first to avoid deadlocks */
+    if (FirstPrcb->Number < SecondPrcb->Number)
+    {
+        KiAcquirePrcbLock(FirstPrcb);
+        KiAcquirePrcbLock(SecondPrcb);
+    }
+    else
+    {
+        KiAcquirePrcbLock(SecondPrcb);
+        KiAcquirePrcbLock(FirstPrcb);
+    }
+}
+
+static
+VOID
+KiReleaseTwoPrcbLocks(IN PKPRCB FirstPrcb,
+                      IN PKPRCB SecondPrcb)
+{
+    KiReleasePrcbLock(FirstPrcb);
+    KiReleasePrcbLock(SecondPrcb);
+}
+
+static
+PKTHREAD
+KiStealReadyThread(IN PKPRCB Prcb,
+                   IN PKPRCB TargetPrcb)
+{
+    ULONG Summary;
+    ULONG Priority;
+    PLIST_ENTRY ListHead, ListEntry;
+    PKTHREAD Thread, Candidate;
+
+    /* Scan the target's ready lists from the highest priority down */
+    Summary = TargetPrcb->ReadySummary;
+    while (Summary)
+    {
+        BitScanReverse(&Priority, Summary);
+        Summary &= ~PRIORITY_MASK(Priority);
+
+        Candidate = NULL;
+        ListHead = &TargetPrcb->DispatcherReadyListHead[Priority];
+        for (ListEntry = ListHead->Flink;
+             ListEntry != ListHead;
+             ListEntry = ListEntry->Flink)
+        {
+            Thread = CONTAINING_RECORD(ListEntry, KTHREAD, WaitListEntry);
+
+            /* It must be allowed to run here and be completely switched out */
+            if (!(Thread->Affinity & Prcb->SetMember) || (Thread->SwapBusy)) continue;
+
+            /* Prefer threads that would rather run on this processor */
+            if (Thread->IdealProcessor == Prcb->Number)
+            {
+                Candidate = Thread;
+                break;
+            }
+
+            /* Otherwise take the oldest eligible one */
+            if (!Candidate) Candidate = Thread;
+        }
+
+        if (Candidate)
+        {
+            /* Remove it and update the target's ready summary */
+            ASSERT(Candidate->State == Ready);
+            if (RemoveEntryList(&Candidate->WaitListEntry))
+            {
+                TargetPrcb->ReadySummary ^= PRIORITY_MASK(Priority);
+            }
+
+            return Candidate;
+        }
+    }
+
+    /* Nothing we are allowed to run */
+    return NULL;
+}
+#endif
+
 PKTHREAD
 FASTCALL
 KiIdleSchedule(IN PKPRCB Prcb)
 {
-    /* FIXME: TODO */
-    ASSERTMSG("SMP: Not yet implemented\n", FALSE);
+#ifdef CONFIG_SMP
+    PKPRCB TargetPrcb;
+    PKTHREAD Thread = NULL;
+    ULONG i, Number;
+
+    /* Only look once each time we go idle, new work is sent to idle processors directly */
+    Prcb->IdleSchedule = FALSE;
+
+    /* Scan the other processors, starting with our neighbour */
+    for (i = 1; i < (ULONG)KeNumberProcessors; i++)
+    {
+        Number = (Prcb->Number + i) % KeNumberProcessors;
+        TargetPrcb = KiProcessorBlock[Number];
+
+        /* Skip processors that have nothing queued */
+        if (!(TargetPrcb) || !(TargetPrcb->ReadySummary)) continue;
+
+        /* Lock both processors */
+        KiAcquireTwoPrcbLocks(Prcb, TargetPrcb);
+
+        /* Somebody might have given us a thread in the meantime */
+        Thread = Prcb->NextThread;
+        if (!Thread)
+        {
+            /* Try to take one of the target's ready threads */
+            Thread = KiStealReadyThread(Prcb, TargetPrcb);
+            if (Thread)
+            {
+                /* We're not idle anymore */
+                InterlockedAndSetMember(&KiIdleSummary, ~Prcb->SetMember);
+
+                /* Move the thread to this processor */
+                Thread->NextProcessor = Prcb->Number;
+                Thread->State = Standby;
+                Prcb->NextThread = Thread;
+            }
+        }
+
+        /* Release the locks and stop once we have something to run */
+        KiReleaseTwoPrcbLocks(Prcb, TargetPrcb);
+        if (Thread) break;
+    }
+
+    return Thread;
+#else
+    /* There is nobody to steal from on UP */
+    Prcb->IdleSchedule = FALSE;
     return NULL;
+#endif
 }
 
 VOID
@@ -83,6 +218,9 @@ KiDeferredReadyThread(IN PKTHREAD Thread)
     ULONG Processor = 0;
     KPRIORITY OldPriority;
     PKTHREAD NextThread;
+#ifdef CONFIG_SMP
+    KAFFINITY IdleSet;
+#endif
 
     /* Sanity checks */
     ASSERT(Thread->State == DeferredReady);
@@ -228,6 +366,64 @@ KiDeferredReadyThread(IN PKTHREAD Thread)
     OldPriority = Thread->Priority;
     Thread->Preempted = FALSE;
 
+#ifdef CONFIG_SMP
+    /* Check if any processor this thread may run on is idle */
+    IdleSet = KiIdleSummary & Thread->Affinity;
+    if (IdleSet)
+    {
+        /* Prefer the ideal processor, then the last one it ran on for cache warmth */
+        if (IdleSet & AFFINITY_MASK(Thread->IdealProcessor))
+        {
+            Processor = Thread->IdealProcessor;
+        }
+        else if (IdleSet & AFFINITY_MASK(Thread->NextProcessor))
+        {
+            Processor = Thread->NextProcessor;
+        }
+        else
+        {
+            Processor = RtlFindLeastSignificantBit(IdleSet);
+        }
+
+        /* Lock it and make sure it is still idle */
+        Prcb = KiProcessorBlock[Processor];
+        KiAcquirePrcbLock(Prcb);
+        if ((KiIdleSummary & Prcb->SetMember) && !(Prcb->NextThread))
+        {
+            /* Clear its idle bit and set this thread as the next one */
+            InterlockedAndSetMember(&KiIdleSummary, ~Prcb->SetMember);
+            Thread->NextProcessor = (UCHAR)Processor;
+            Thread->State = Standby;
+            Prcb->NextThread = Thread;
+
+            /* Unlock the PRCB and wake up the processor if it's not us */
+            KiReleasePrcbLock(Prcb);
+            if (KeGetCurrentProcessorNumber() != Processor)
+            {
+                KiIpiSend(AFFINITY_MASK(Processor), IPI_DPC);
+            }
+            return;
+        }
+
+        /* Somebody beat us to it */
+        KiReleasePrcbLock(Prcb);
+    }
+
+    /* Queue the thread where it last ran, or on its ideal processor if it can't run there anymore */
+    Processor = Thread->NextProcessor;
+    if (!(Thread->Affinity & AFFINITY_MASK(Processor)))
+    {
+        Processor = Thread->IdealProcessor;
+        if (!(Thread->Affinity & AFFINITY_MASK(Processor)))
+        {
+            Processor = RtlFindLeastSignificantBit(Thread->Affinity);
+        }
+    }
+
+    /* Get the PRCB and lock it */
+    Prcb = KiProcessorBlock[Processor];
+    KiAcquirePrcbLock(Prcb);
+#else
     /* Queue the thread on CPU 0 and get the PRCB and lock it */
     Thread->NextProcessor = 0;
     Prcb = KiProcessorBlock[0];
@@ -245,6 +441,7 @@ KiDeferredReadyThread(IN PKTHREAD Thread)
         KiReleasePrcbLock(Prcb);
         return;
     }
+#endif
 
     /* Set the CPU number */
     Thread->NextProcessor = (UCHAR)Processor;
@@ -341,7 +538,6 @@ KiSelectNextThread(IN PKPRCB Prcb)
         Prcb->IdleSchedule = TRUE;
 
         /* FIXME: SMT support */
-        ASSERTMSG("SMP: Not yet implemented\n", FALSE);
     }
 
     /* Sanity checks and return the thread */
@@ -385,8 +581,9 @@ KiSwapThread(IN PKTHREAD CurrentThread,
         }
         else
         {
-            /* Set the idle summary */
+            /* Set the idle summary and look for work elsewhere once idle */
             InterlockedOrSetMember(&KiIdleSummary, Prcb->SetMember);
+            Prcb->IdleSchedule = TRUE;
 
             /* Schedule the idle thread */
             NextThread = Prcb->IdleThread;
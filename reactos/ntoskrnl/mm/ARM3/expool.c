@@ -30,9 +30,24 @@ typedef struct _POOL_DPC_CONTEXT
     SIZE_T PoolTrackTableSizeExpansion;
 } POOL_DPC_CONTEXT, *PPOOL_DPC_CONTEXT;
 
+//
+// On SMP systems, small paged pool allocations are spread over several
+// descriptors (1 to ExpNumberOfPagedPools), selected by processor, so that
+// they don't all serialize on the same guarded mutex. Descriptor 0 keeps the
+// big page allocations. Each NUMA node also gets its own nonpaged descriptor.
+//
+#ifdef CONFIG_SMP
+#define EXP_DEFAULT_PAGED_POOLS 4
+#else
+#define EXP_DEFAULT_PAGED_POOLS 0
+#endif
+#define EXP_MAXIMUM_POOL_NODES  16
+
 ULONG ExpNumberOfPagedPools;
+ULONG ExpNumberOfNonPagedPools = 1;
 POOL_DESCRIPTOR NonPagedPoolDescriptor;
 PPOOL_DESCRIPTOR ExpPagedPoolDescriptor[16 + 1];
+PPOOL_DESCRIPTOR ExpNonPagedPoolDescriptor[EXP_MAXIMUM_POOL_NODES];
 PPOOL_DESCRIPTOR PoolVector[2];
 PKGUARDED_MUTEX ExpPagedPoolMutex;
 SIZE_T PoolTrackTableSize, PoolTrackTableMask;
@@ -850,6 +865,8 @@ InitializePool(IN POOL_TYPE PoolType,
                IN ULONG Threshold)
 {
     PPOOL_DESCRIPTOR Descriptor;
+    PKGUARDED_MUTEX PagedPoolMutex;
+    PKSPIN_LOCK NonPagedPoolLock;
     SIZE_T TableSize;
     ULONG i;
 
@@ -1026,64 +1043,105 @@ InitializePool(IN POOL_TYPE PoolType,
                                             sizeof(POOL_TRACKER_BIG_PAGES)),
                              NonPagedPool);
 
-        //
-        // No support for NUMA systems at this time
-        //
-        ASSERT(KeNumberNodes == 1);
-
         //
         // Initialize the tag spinlock
         //
         KeInitializeSpinLock(&ExpTaggedPoolLock);
 
         //
-        // Initialize the nonpaged pool descriptor
+        // Initialize the nonpaged pool descriptor. The first node uses the
+        // well-known descriptor and the nonpaged pool queued spinlock
         //
         PoolVector[NonPagedPool] = &NonPagedPoolDescriptor;
+        ExpNonPagedPoolDescriptor[0] = &NonPagedPoolDescriptor;
         ExInitializePoolDescriptor(PoolVector[NonPagedPool],
                                    NonPagedPool,
                                    0,
                                    Threshold,
                                    NULL);
-    }
-    else
-    {
+
         //
-        // No support for NUMA systems at this time
+        // Every other NUMA node gets its own descriptor and spinlock
         //
-        ASSERT(KeNumberNodes == 1);
+        ASSERT(KeNumberNodes <= EXP_MAXIMUM_POOL_NODES);
+        for (i = 1; i < KeNumberNodes; i++)
+        {
+            Descriptor = ExAllocatePoolWithTag(NonPagedPool,
+                                               sizeof(KSPIN_LOCK) +
+                                               sizeof(POOL_DESCRIPTOR),
+                                               'looP');
+            if (!Descriptor)
+            {
+                //
+                // This is really bad...
+                //
+                KeBugCheckEx(MUST_SUCCEED_POOL_EMPTY,
+                             0,
+                             -1,
+                             -1,
+                             -1);
+            }
 
+            NonPagedPoolLock = (PKSPIN_LOCK)(Descriptor + 1);
+            KeInitializeSpinLock(NonPagedPoolLock);
+            ExInitializePoolDescriptor(Descriptor,
+                                       NonPagedPool,
+                                       i,
+                                       Threshold,
+                                       NonPagedPoolLock);
+            ExpNonPagedPoolDescriptor[i] = Descriptor;
+        }
+
+        //
+        // Only start using them once they're all set up
+        //
+        ExpNumberOfNonPagedPools = KeNumberNodes;
+    }
+    else
+    {
         //
-        // Allocate the pool descriptor
+        // Allocate the main descriptor, followed by one per extra paged pool
         //
-        Descriptor = ExAllocatePoolWithTag(NonPagedPool,
-                                           sizeof(KGUARDED_MUTEX) +
-                                           sizeof(POOL_DESCRIPTOR),
-                                           'looP');
-        if (!Descriptor)
+        for (i = 0; i <= EXP_DEFAULT_PAGED_POOLS; i++)
         {
             //
-            // This is really bad...
+            // Allocate the pool descriptor
             //
-            KeBugCheckEx(MUST_SUCCEED_POOL_EMPTY,
-                         0,
-                         -1,
-                         -1,
-                         -1);
+            Descriptor = ExAllocatePoolWithTag(NonPagedPool,
+                                               sizeof(KGUARDED_MUTEX) +
+                                               sizeof(POOL_DESCRIPTOR),
+                                               'looP');
+            if (!Descriptor)
+            {
+                //
+                // This is really bad...
+                //
+                KeBugCheckEx(MUST_SUCCEED_POOL_EMPTY,
+                             0,
+                             -1,
+                             -1,
+                             -1);
+            }
+
+            //
+            // Setup the descriptor with its own guarded mutex
+            //
+            PagedPoolMutex = (PKGUARDED_MUTEX)(Descriptor + 1);
+            KeInitializeGuardedMutex(PagedPoolMutex);
+            ExInitializePoolDescriptor(Descriptor,
+                                       PagedPool,
+                                       i,
+                                       Threshold,
+                                       PagedPoolMutex);
+            ExpPagedPoolDescriptor[i] = Descriptor;
         }
 
         //
         // Setup the vector and guarded mutex for paged pool
         //
-        PoolVector[PagedPool] = Descriptor;
-        ExpPagedPoolMutex = (PKGUARDED_MUTEX)(Descriptor + 1);
-        ExpPagedPoolDescriptor[0] = Descriptor;
-        KeInitializeGuardedMutex(ExpPagedPoolMutex);
-        ExInitializePoolDescriptor(Descriptor,
-                                   PagedPool,
-                                   0,
-                                   Threshold,
-                                   ExpPagedPoolMutex);
+        PoolVector[PagedPool] = ExpPagedPoolDescriptor[0];
+        ExpPagedPoolMutex = (PKGUARDED_MUTEX)(ExpPagedPoolDescriptor[0] + 1);
+        ExpNumberOfPagedPools = EXP_DEFAULT_PAGED_POOLS;
 
         //
         // Insert the generic tracker for all of nonpaged pool
@@ -1103,6 +1161,16 @@ ExLockPool(IN PPOOL_DESCRIPTOR Descriptor)
     //
     if ((Descriptor->PoolType & BASE_POOL_TYPE_MASK) == NonPagedPool)
     {
+        //
+        // Per-node descriptors have their own spin lock
+        //
+        if (Descriptor->LockAddress)
+        {
+            KIRQL OldIrql;
+            KeAcquireSpinLock(Descriptor->LockAddress, &OldIrql);
+            return OldIrql;
+        }
+
         //
         // Use the queued spin lock
         //
@@ -1128,6 +1196,15 @@ ExUnlockPool(IN PPOOL_DESCRIPTOR Descriptor,
     //
     if ((Descriptor->PoolType & BASE_POOL_TYPE_MASK) == NonPagedPool)
     {
+        //
+        // Per-node descriptors have their own spin lock
+        //
+        if (Descriptor->LockAddress)
+        {
+            KeReleaseSpinLock(Descriptor->LockAddress, OldIrql);
+            return;
+        }
+
         //
         // Use the queued spin lock
         //
@@ -1142,6 +1219,48 @@ ExUnlockPool(IN PPOOL_DESCRIPTOR Descriptor,
     }
 }
 
+FORCEINLINE
+PPOOL_DESCRIPTOR
+ExpSelectPoolDescriptor(IN POOL_TYPE PoolType)
+{
+    PKPRCB Prcb;
+
+    //
+    // Spread paged pool allocations over the extra paged pools by processor
+    //
+    if (PoolType == PagedPool)
+    {
+        if (ExpNumberOfPagedPools == 0) return PoolVector[PagedPool];
+        return ExpPagedPoolDescriptor[(KeGetCurrentProcessorNumber() %
+                                       ExpNumberOfPagedPools) + 1];
+    }
+
+    //
+    // And nonpaged pool allocations to the current node's descriptor
+    //
+    if (ExpNumberOfNonPagedPools == 1) return PoolVector[NonPagedPool];
+    Prcb = KeGetCurrentPrcb();
+    return ExpNonPagedPoolDescriptor[Prcb->ParentNode->NodeNumber];
+}
+
+FORCEINLINE
+PPOOL_DESCRIPTOR
+ExpGetPoolDescriptor(IN POOL_TYPE PoolType,
+                     IN ULONG PoolIndex)
+{
+    //
+    // Blocks go back to the descriptor that carved them, as saved in the header
+    //
+    if (PoolType == PagedPool)
+    {
+        ASSERT(PoolIndex <= ExpNumberOfPagedPools);
+        return ExpPagedPoolDescriptor[PoolIndex];
+    }
+
+    ASSERT(PoolIndex < ExpNumberOfNonPagedPools);
+    return ExpNonPagedPoolDescriptor[PoolIndex];
+}
+
 VOID
 NTAPI
 ExpGetPoolTagInfoTarget(IN PKDPC Dpc,
@@ -1458,6 +1577,8 @@ ExQueryPoolUsage(OUT PULONG PagedPoolPages,
 {
     ULONG i;
     PPOOL_DESCRIPTOR PoolDesc;
+    PGENERAL_LOOKASIDE LookasideList;
+    PLIST_ENTRY ListEntry;
 
     //
     // Assume all failures
@@ -1489,10 +1610,9 @@ ExQueryPoolUsage(OUT PULONG PagedPoolPages,
     // If the system has more than one non-paged pool, copy the other descriptor
     // totals as well
     //
-#if 0
     if (ExpNumberOfNonPagedPools > 1)
     {
-        for (i = 0; i < ExpNumberOfNonPagedPools; i++)
+        for (i = 1; i < ExpNumberOfNonPagedPools; i++)
         {
             PoolDesc = ExpNonPagedPoolDescriptor[i];
             *NonPagedPoolPages += PoolDesc->TotalPages + PoolDesc->TotalBigPages;
@@ -1500,13 +1620,24 @@ ExQueryPoolUsage(OUT PULONG PagedPoolPages,
             *NonPagedPoolFrees += PoolDesc->RunningDeAllocs;
         }
     }
-#endif
 
     //
-    // FIXME: Not yet supported
+    // Add up the hits of the small pool lookaside lists
     //
-    *NonPagedPoolLookasideHits += 0;
-    *PagedPoolLookasideHits += 0;
+    for (ListEntry = ExPoolLookasideListHead.Flink;
+         ListEntry != &ExPoolLookasideListHead;
+         ListEntry = ListEntry->Flink)
+    {
+        LookasideList = CONTAINING_RECORD(ListEntry, GENERAL_LOOKASIDE, ListEntry);
+        if (LookasideList->Type == PagedPool)
+        {
+            *PagedPoolLookasideHits += LookasideList->AllocateHits;
+        }
+        else
+        {
+            *NonPagedPoolLookasideHits += LookasideList->AllocateHits;
+        }
+    }
 }
 
 VOID
@@ -1706,6 +1837,12 @@ ExAllocatePoolWithTag(IN POOL_TYPE PoolType,
         return Entry;
     }
 
+    //
+    // Small allocations come from the descriptor for this processor or node
+    //
+    PoolDesc = ExpSelectPoolDescriptor(PoolType);
+    ASSERT(PoolDesc != NULL);
+
     //
     // Should never request 0 bytes from the pool, but since so many drivers do
     // it, we'll just assume they want 1 byte, based on NT's similar behavior
@@ -1841,6 +1978,7 @@ ExAllocatePoolWithTag(IN POOL_TYPE PoolType,
                     //
                     FragmentEntry = POOL_BLOCK(Entry, i);
                     FragmentEntry->BlockSize = Entry->BlockSize - i;
+                    FragmentEntry->PoolIndex = Entry->PoolIndex;
 
                     //
                     // And make it point back to us
@@ -1885,6 +2023,7 @@ ExAllocatePoolWithTag(IN POOL_TYPE PoolType,
                     //
                     Entry = POOL_NEXT_BLOCK(Entry);
                     Entry->PreviousSize = FragmentEntry->BlockSize;
+                    Entry->PoolIndex = FragmentEntry->PoolIndex;
 
                     //
                     // And now let's go to the entry after that one and check if
@@ -2017,6 +2156,7 @@ ExAllocatePoolWithTag(IN POOL_TYPE PoolType,
     //
     Entry->Ulong1 = 0;
     Entry->BlockSize = i;
+    Entry->PoolIndex = PoolDesc->PoolIndex;
     Entry->PoolType = OriginalType + 1;
 
     //
@@ -2029,6 +2169,7 @@ ExAllocatePoolWithTag(IN POOL_TYPE PoolType,
     FragmentEntry = POOL_BLOCK(Entry, i);
     FragmentEntry->Ulong1 = 0;
     FragmentEntry->BlockSize = BlockSize;
+    FragmentEntry->PoolIndex = PoolDesc->PoolIndex;
     FragmentEntry->PreviousSize = i;
 
     //
@@ -2297,7 +2438,7 @@ ExFreePoolWithTag(IN PVOID P,
     //
     BlockSize = Entry->BlockSize;
     PoolType = (Entry->PoolType - 1) & BASE_POOL_TYPE_MASK;
-    PoolDesc = PoolVector[PoolType];
+    PoolDesc = ExpGetPoolDescriptor(PoolType, Entry->PoolIndex);
 
     //
     // Make sure that the IRQL makes sense
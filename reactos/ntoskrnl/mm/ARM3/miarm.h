@@ -361,8 +361,10 @@ typedef struct _POOL_TRACKER_BIG_PAGES
 } POOL_TRACKER_BIG_PAGES, *PPOOL_TRACKER_BIG_PAGES;
 
 extern ULONG ExpNumberOfPagedPools;
+extern ULONG ExpNumberOfNonPagedPools;
 extern POOL_DESCRIPTOR NonPagedPoolDescriptor;
 extern PPOOL_DESCRIPTOR ExpPagedPoolDescriptor[16 + 1];
+extern PPOOL_DESCRIPTOR ExpNonPagedPoolDescriptor[];
 extern PPOOL_TRACKER_TABLE PoolTrackTable;
 
 //
@@ -610,8 +612,9 @@ extern PMMPDE MiHighestUserPde;
 extern PFN_NUMBER MmSystemPageDirectory[PD_COUNT];
 extern PMMPTE MmSharedUserDataPte;
 extern LIST_ENTRY MmProcessList;
-extern BOOLEAN MmZeroingPageThreadActive;
+extern ULONG MmZeroingPageThreadsActive;
 extern KEVENT MmZeroingPageEvent;
+extern PFN_NUMBER MmZeroedPageTarget;
 extern ULONG MmSystemPageColor;
 extern ULONG MmProcessColorSeed;
 extern PMMWSL MmWorkingSetList;
@@ -2255,6 +2258,7 @@ PFN_NUMBER
 MiRemoveZeroPageSafe(IN ULONG Color)
 {
     if (MmFreePagesByColor[ZeroedPageList][Color].Flink != LIST_HEAD) return MiRemoveZeroPage(Color);
+    MmZeroedPageListMisses++;
     return 0;
 }
 
@@ -1564,6 +1564,8 @@ MmDumpArmPfnDatabase(IN BOOLEAN StatusOnly)
     DbgPrint("Active:               %5d pages\t[%6d KB]\n", ActivePages,  (ActivePages    << PAGE_SHIFT) / 1024);
     DbgPrint("Free:                 %5d pages\t[%6d KB]\n", FreePages,    (FreePages      << PAGE_SHIFT) / 1024);
     DbgPrint("Other:                %5d pages\t[%6d KB]\n", OtherPages,   (OtherPages     << PAGE_SHIFT) / 1024);
+    DbgPrint("Zeroed list hits:     %5lu\n", MmZeroedPageListHits);
+    DbgPrint("Zeroed list misses:   %5lu\n", MmZeroedPageListMisses);
     DbgPrint("-----------------------------------------\n");
 #if MI_TRACE_PFNS
     OtherPages = UsageBucket[MI_USAGE_BOOT_DRIVER];
@@ -2160,8 +2162,8 @@ MmArmInitSystem(IN ULONG Phase,
         KeInitializeMutant(&MmSystemLoadLock, FALSE);
 
         /* Set the zero page event */
-        KeInitializeEvent(&MmZeroingPageEvent, SynchronizationEvent, FALSE);
-        MmZeroingPageThreadActive = FALSE;
+        KeInitializeEvent(&MmZeroingPageEvent, NotificationEvent, FALSE);
+        MmZeroingPageThreadsActive = 0;
 
         /* Initialize the dead stack S-LIST */
         InitializeSListHead(&MmDeadStackSListHead);
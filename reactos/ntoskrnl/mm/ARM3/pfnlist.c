@@ -584,7 +584,23 @@ MiRemoveZeroPage(IN ULONG Color)
     ASSERT(Pfn1 == MI_PFN_ELEMENT(PageIndex));
 
     /* Zero it, if needed */
-    if (Zero) MiZeroPhysicalPage(PageIndex);
+    if (Zero)
+    {
+        MmZeroedPageListMisses++;
+        MiZeroPhysicalPage(PageIndex);
+    }
+    else
+    {
+        MmZeroedPageListHits++;
+    }
+
+    /* Wake up the zeroing threads when we are running low on zeroed pages */
+    if ((MmZeroedPageListHead.Total < MmZeroedPageTarget) &&
+        (MmFreePageListHead.Total != 0) &&
+        (MmZeroingPageThreadsActive == 0))
+    {
+        KeSetEvent(&MmZeroingPageEvent, IO_NO_INCREMENT, FALSE);
+    }
 
     /* Sanity checks */
     ASSERT(Pfn1->u3.e2.ReferenceCount == 0);
@@ -701,7 +717,7 @@ MiInsertPageInFreeList(IN PFN_NUMBER PageFrameIndex)
     ColorTable->Count++;
 
     /* Notify zero page thread if enough pages are on the free list now */
-    if ((ListHead->Total >= 8) && !(MmZeroingPageThreadActive))
+    if ((ListHead->Total >= 8) && (MmZeroingPageThreadsActive == 0))
     {
         /* Set the event */
         KeSetEvent(&MmZeroingPageEvent, IO_NO_INCREMENT, FALSE);
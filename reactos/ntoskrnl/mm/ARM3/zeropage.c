@@ -17,8 +17,18 @@
 
 /* GLOBALS ********************************************************************/
 
-BOOLEAN MmZeroingPageThreadActive;
+/* Number of free pages a zeroing thread maps and zeroes at once */
+#define MI_ZERO_BATCH_PAGES             16
+
+/* Upper bound of the zeroed page watermark, 16 MB */
+#define MI_MAXIMUM_ZEROED_PAGE_TARGET   ((16 * _1MB) >> PAGE_SHIFT)
+
+/* Number of zeroing threads between a wake up and finding the free list empty */
+ULONG MmZeroingPageThreadsActive;
 KEVENT MmZeroingPageEvent;
+PFN_NUMBER MmZeroedPageTarget;
+ULONG MmZeroedPageListHits;
+ULONG MmZeroedPageListMisses;
 
 /* PRIVATE FUNCTIONS **********************************************************/
 
@@ -32,83 +42,156 @@ NTAPI
 MiFreeInitializationCode(IN PVOID StartVa,
 IN PVOID EndVa);
 
+static
 VOID
-NTAPI
-MmZeroPageThread(VOID)
+MiZeroPageWorker(IN ULONG Processor)
 {
     PKTHREAD Thread = KeGetCurrentThread();
-    PVOID StartAddress, EndAddress;
-    PVOID WaitObjects[2];
-    KIRQL OldIrql;
+    PFN_NUMBER Pages[MI_ZERO_BATCH_PAGES];
+    PFN_NUMBER PageIndex;
+    PMMPTE ZeroPtes, PointerPte;
     PVOID ZeroAddress;
-    PFN_NUMBER PageIndex, FreePage;
-    PMMPFN Pfn1;
+    MMPTE TempPte;
+    KIRQL OldIrql;
+    ULONG Count, i;
 
-    /* Get the discardable sections to free them */
-    MiFindInitializationCode(&StartAddress, &EndAddress);
-    if (StartAddress) MiFreeInitializationCode(StartAddress, EndAddress);
-    DPRINT("Free non-cache pages: %lx\n", MmAvailablePages + MiMemoryConsumers[MC_CACHE].PagesUsed);
+    /* Stay on our processor, so our zeroing window only needs local TB flushes */
+    KeSetSystemAffinityThread(AFFINITY_MASK(Processor));
 
     /* Set our priority to 0 */
     Thread->BasePriority = 0;
     KeSetPriorityThread(Thread, 0);
 
-    /* Setup the wait objects */
-    WaitObjects[0] = &MmZeroingPageEvent;
-//    WaitObjects[1] = &PoSystemIdleTimer; FIXME: Implement idle timer
+    /* Get a private window to map the pages we zero */
+    ZeroPtes = MiReserveSystemPtes(MI_ZERO_BATCH_PAGES, SystemPteSpace);
+    if (!ZeroPtes)
+    {
+        DPRINT1("No system PTEs for the zero page thread of processor %lu\n", Processor);
+        if (Processor == 0) KeBugCheckEx(NO_MORE_SYSTEM_PTES, SystemPteSpace, MI_ZERO_BATCH_PAGES, 0, 0);
+        return;
+    }
+    ZeroAddress = MiPteToAddress(ZeroPtes);
+    TempPte = ValidKernelPte;
 
     while (TRUE)
     {
-        KeWaitForMultipleObjects(1, // 2
-                                 WaitObjects,
-                                 WaitAny,
-                                 WrFreePage,
-                                 KernelMode,
-                                 FALSE,
-                                 NULL,
-                                 NULL);
+        KeWaitForSingleObject(&MmZeroingPageEvent,
+                              WrFreePage,
+                              KernelMode,
+                              FALSE,
+                              NULL);
         OldIrql = KeAcquireQueuedSpinLock(LockQueuePfnLock);
-        MmZeroingPageThreadActive = TRUE;
+        MmZeroingPageThreadsActive++;
 
         while (TRUE)
         {
-            if (!MmFreePageListHead.Total)
+            /* Take a batch of pages off the free list */
+            for (Count = 0; (Count < MI_ZERO_BATCH_PAGES) && MmFreePageListHead.Total; Count++)
+            {
+                PageIndex = MmFreePageListHead.Flink;
+                ASSERT(PageIndex != LIST_HEAD);
+                MI_SET_USAGE(MI_USAGE_ZERO_LOOP);
+                MI_SET_PROCESS2("Kernel 0 Loop");
+                Pages[Count] = MiRemoveAnyPage(MI_GET_PAGE_COLOR(PageIndex));
+
+                /* The first global free page should also be the first on its own list */
+                if (Pages[Count] != PageIndex)
+                {
+                    KeBugCheckEx(PFN_LIST_CORRUPT,
+                                 0x8F,
+                                 Pages[Count],
+                                 PageIndex,
+                                 0);
+                }
+
+                MI_PFN_ELEMENT(PageIndex)->u1.Flink = LIST_HEAD;
+            }
+
+            if (Count == 0)
             {
-                MmZeroingPageThreadActive = FALSE;
+                /*
+                 * The free list is empty. We hold the PFN lock, so nobody
+                 * can insert a free page and set the event behind our back.
+                 */
+                KeClearEvent(&MmZeroingPageEvent);
+                ASSERT(MmZeroingPageThreadsActive != 0);
+                MmZeroingPageThreadsActive--;
                 KeReleaseQueuedSpinLock(LockQueuePfnLock, OldIrql);
                 break;
             }
 
-            PageIndex = MmFreePageListHead.Flink;
-            ASSERT(PageIndex != LIST_HEAD);
-            Pfn1 = MiGetPfnEntry(PageIndex);
-            MI_SET_USAGE(MI_USAGE_ZERO_LOOP);
-            MI_SET_PROCESS2("Kernel 0 Loop");
-            FreePage = MiRemoveAnyPage(MI_GET_PAGE_COLOR(PageIndex));
+            KeReleaseQueuedSpinLock(LockQueuePfnLock, OldIrql);
 
-            /* The first global free page should also be the first on its own list */
-            if (FreePage != PageIndex)
+            /* Map the whole batch and zero it in one go */
+            for (i = 0, PointerPte = ZeroPtes; i < Count; i++, PointerPte++)
             {
-                KeBugCheckEx(PFN_LIST_CORRUPT,
-                             0x8F,
-                             FreePage,
-                             PageIndex,
-                             0);
+                TempPte.u.Hard.PageFrameNumber = Pages[i];
+                MI_WRITE_VALID_PTE(PointerPte, TempPte);
             }
 
-            Pfn1->u1.Flink = LIST_HEAD;
-            KeReleaseQueuedSpinLock(LockQueuePfnLock, OldIrql);
+            KeZeroPages(ZeroAddress, Count * PAGE_SIZE);
 
-            ZeroAddress = MiMapPagesInZeroSpace(Pfn1, 1);
-            ASSERT(ZeroAddress);
-            RtlZeroMemory(ZeroAddress, PAGE_SIZE);
-            MiUnmapPagesInZeroSpace(ZeroAddress, 1);
+            for (i = 0, PointerPte = ZeroPtes; i < Count; i++, PointerPte++)
+            {
+                MI_ERASE_PTE(PointerPte);
+                KeInvalidateTlbEntry((PVOID)((ULONG_PTR)ZeroAddress + i * PAGE_SIZE));
+            }
 
             OldIrql = KeAcquireQueuedSpinLock(LockQueuePfnLock);
 
-            MiInsertPageInList(&MmZeroedPageListHead, PageIndex);
+            for (i = 0; i < Count; i++)
+            {
+                MiInsertPageInList(&MmZeroedPageListHead, Pages[i]);
+            }
+        }
+    }
+}
+
+static
+VOID
+NTAPI
+MiZeroPageWorkerThread(IN PVOID Context)
+{
+    MiZeroPageWorker((ULONG)(ULONG_PTR)Context);
+}
+
+VOID
+NTAPI
+MmZeroPageThread(VOID)
+{
+    PVOID StartAddress, EndAddress;
+    HANDLE ThreadHandle;
+    NTSTATUS Status;
+    ULONG i;
+
+    /* Get the discardable sections to free them */
+    MiFindInitializationCode(&StartAddress, &EndAddress);
+    if (StartAddress) MiFreeInitializationCode(StartAddress, EndAddress);
+    DPRINT("Free non-cache pages: %lx\n", MmAvailablePages + MiMemoryConsumers[MC_CACHE].PagesUsed);
+
+    /* Keep a share of memory zeroed ahead for demand zero faults */
+    MmZeroedPageTarget = min(MmNumberOfPhysicalPages / 256, MI_MAXIMUM_ZEROED_PAGE_TARGET);
+
+    /* Every other processor gets its own zeroing thread */
+    for (i = 1; i < (ULONG)KeNumberProcessors; i++)
+    {
+        Status = PsCreateSystemThread(&ThreadHandle,
+                                      THREAD_ALL_ACCESS,
+                                      NULL,
+                                      NULL,
+                                      NULL,
+                                      MiZeroPageWorkerThread,
+                                      (PVOID)(ULONG_PTR)i);
+        if (!NT_SUCCESS(Status))
+        {
+            DPRINT1("Failed to create the zero page thread of processor %lu: 0x%lx\n", i, Status);
+            continue;
         }
+        ObCloseHandle(ThreadHandle, KernelMode);
     }
+
+    /* And this one zeroes pages on the boot processor */
+    MiZeroPageWorker(0);
 }
 
 /* EOF */
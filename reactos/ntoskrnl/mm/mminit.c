@@ -203,6 +203,13 @@ MmMpwThreadMain(PVOID Parameter)
         // XXX arty -- we flush when evicting pages or destorying cache
         // sections.
         CcRosFlushDirtyPages(128, &PagesWritten, FALSE);
+
+        /* We are the lazy writer: let throttled writers in, and keep
+         * flushing while they wait */
+        if (CcPostDeferredWrites() && PagesWritten != 0)
+        {
+            KeSetEvent(&MpwThreadEvent, IO_NO_INCREMENT, FALSE);
+        }
 #endif
     }
 }
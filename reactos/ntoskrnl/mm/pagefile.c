@@ -53,6 +53,7 @@ typedef struct _PAGINGFILE
     PULONG AllocMap;
     KSPIN_LOCK AllocMapLock;
     ULONG AllocMapSize;
+    ULONG AllocMapHint;
     PRETRIEVAL_POINTERS_BUFFER RetrievalPointers;
 }
 PAGINGFILE, *PPAGINGFILE;
@@ -217,20 +218,100 @@ MmGetOffsetPageFile(PRETRIEVAL_POINTERS_BUFFER RetrievalPointers, LARGE_INTEGER
 #endif
 }
 
+static
+NTSTATUS
+MiPagingFileIo(
+    _In_ PPAGINGFILE PagingFile,
+    _In_ PPFN_NUMBER Pages,
+    _In_ ULONG PageCount,
+    _In_ ULONG_PTR PageFileOffset,
+    _In_ BOOLEAN Write)
+{
+    LARGE_INTEGER file_offset, next_offset;
+    IO_STATUS_BLOCK Iosb;
+    NTSTATUS Status = STATUS_SUCCESS;
+    KEVENT Event;
+    UCHAR MdlBase[sizeof(MDL) + MI_PAGING_FILE_CLUSTER_SIZE * sizeof(PFN_NUMBER)];
+    PMDL Mdl = (PMDL)MdlBase;
+    ULONG Count;
+
+    ASSERT(PageCount != 0 && PageCount <= MI_PAGING_FILE_CLUSTER_SIZE);
+
+    while (PageCount != 0)
+    {
+        file_offset.QuadPart = PageFileOffset * PAGE_SIZE;
+        file_offset = MmGetOffsetPageFile(PagingFile->RetrievalPointers, file_offset);
+
+        /* Transfer as many pages as are contiguous on the disk in one go */
+        for (Count = 1; Count < PageCount; Count++)
+        {
+            next_offset.QuadPart = (PageFileOffset + Count) * PAGE_SIZE;
+            next_offset = MmGetOffsetPageFile(PagingFile->RetrievalPointers, next_offset);
+            if (next_offset.QuadPart != file_offset.QuadPart + Count * PAGE_SIZE)
+                break;
+        }
+
+        MmInitializeMdl(Mdl, NULL, Count * PAGE_SIZE);
+        MmBuildMdlFromPages(Mdl, Pages);
+        Mdl->MdlFlags |= MDL_PAGES_LOCKED;
+
+        KeInitializeEvent(&Event, NotificationEvent, FALSE);
+        if (Write)
+        {
+            Status = IoSynchronousPageWrite(PagingFile->FileObject,
+                                            Mdl,
+                                            &file_offset,
+                                            &Event,
+                                            &Iosb);
+        }
+        else
+        {
+            Status = IoPageRead(PagingFile->FileObject,
+                                Mdl,
+                                &file_offset,
+                                &Event,
+                                &Iosb);
+        }
+        if (Status == STATUS_PENDING)
+        {
+            KeWaitForSingleObject(&Event, Executive, KernelMode, FALSE, NULL);
+            Status = Iosb.Status;
+        }
+        if (Mdl->MdlFlags & MDL_MAPPED_TO_SYSTEM_VA)
+        {
+            MmUnmapLockedPages (Mdl->MappedSystemVa, Mdl);
+        }
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        Pages += Count;
+        PageCount -= Count;
+        PageFileOffset += Count;
+    }
+
+    return Status;
+}
+
 NTSTATUS
 NTAPI
 MmWriteToSwapPage(SWAPENTRY SwapEntry, PFN_NUMBER Page)
+{
+    return MmWriteToSwapPages(SwapEntry, &Page, 1);
+}
+
+NTSTATUS
+NTAPI
+MmWriteToSwapPages(
+    _In_ SWAPENTRY SwapEntry,
+    _In_ PPFN_NUMBER Pages,
+    _In_ ULONG PageCount)
 {
     ULONG i;
     ULONG_PTR offset;
-    LARGE_INTEGER file_offset;
-    IO_STATUS_BLOCK Iosb;
-    NTSTATUS Status;
-    KEVENT Event;
-    UCHAR MdlBase[sizeof(MDL) + sizeof(ULONG)];
-    PMDL Mdl = (PMDL)MdlBase;
 
-    DPRINT("MmWriteToSwapPage\n");
+    DPRINT("MmWriteToSwapPages\n");
 
     if (SwapEntry == 0)
     {
@@ -248,30 +329,7 @@ MmWriteToSwapPage(SWAPENTRY SwapEntry, PFN_NUMBER Page)
         KeBugCheck(MEMORY_MANAGEMENT);
     }
 
-    MmInitializeMdl(Mdl, NULL, PAGE_SIZE);
-    MmBuildMdlFromPages(Mdl, &Page);
-    Mdl->MdlFlags |= MDL_PAGES_LOCKED;
-
-    file_offset.QuadPart = offset * PAGE_SIZE;
-    file_offset = MmGetOffsetPageFile(PagingFileList[i]->RetrievalPointers, file_offset);
-
-    KeInitializeEvent(&Event, NotificationEvent, FALSE);
-    Status = IoSynchronousPageWrite(PagingFileList[i]->FileObject,
-                                    Mdl,
-                                    &file_offset,
-                                    &Event,
-                                    &Iosb);
-    if (Status == STATUS_PENDING)
-    {
-        KeWaitForSingleObject(&Event, Executive, KernelMode, FALSE, NULL);
-        Status = Iosb.Status;
-    }
-
-    if (Mdl->MdlFlags & MDL_MAPPED_TO_SYSTEM_VA)
-    {
-        MmUnmapLockedPages (Mdl->MappedSystemVa, Mdl);
-    }
-    return(Status);
+    return MiPagingFileIo(PagingFileList[i], Pages, PageCount, offset, TRUE);
 }
 
 
@@ -279,7 +337,25 @@ NTSTATUS
 NTAPI
 MmReadFromSwapPage(SWAPENTRY SwapEntry, PFN_NUMBER Page)
 {
-    return MiReadPageFile(Page, FILE_FROM_ENTRY(SwapEntry), OFFSET_FROM_ENTRY(SwapEntry) - 1);
+    return MmReadFromSwapPages(SwapEntry, &Page, 1);
+}
+
+NTSTATUS
+NTAPI
+MmReadFromSwapPages(
+    _In_ SWAPENTRY SwapEntry,
+    _In_ PPFN_NUMBER Pages,
+    _In_ ULONG PageCount)
+{
+    return MiReadPageFileCluster(Pages, PageCount, FILE_FROM_ENTRY(SwapEntry), OFFSET_FROM_ENTRY(SwapEntry) - 1);
+}
+
+SWAPENTRY
+NTAPI
+MmGetNextSwapEntry(SWAPENTRY SwapEntry)
+{
+    /* The slot right after this one in the same paging file */
+    return ENTRY_FROM_FILE_OFFSET(FILE_FROM_ENTRY(SwapEntry), OFFSET_FROM_ENTRY(SwapEntry) + 1);
 }
 
 NTSTATUS
@@ -289,12 +365,17 @@ MiReadPageFile(
     _In_ ULONG PageFileIndex,
     _In_ ULONG_PTR PageFileOffset)
 {
-    LARGE_INTEGER file_offset;
-    IO_STATUS_BLOCK Iosb;
-    NTSTATUS Status;
-    KEVENT Event;
-    UCHAR MdlBase[sizeof(MDL) + sizeof(ULONG)];
-    PMDL Mdl = (PMDL)MdlBase;
+    return MiReadPageFileCluster(&Page, 1, PageFileIndex, PageFileOffset);
+}
+
+NTSTATUS
+NTAPI
+MiReadPageFileCluster(
+    _In_ PPFN_NUMBER Pages,
+    _In_ ULONG PageCount,
+    _In_ ULONG PageFileIndex,
+    _In_ ULONG_PTR PageFileOffset)
+{
     PPAGINGFILE PagingFile;
 
     DPRINT("MiReadSwapFile\n");
@@ -315,29 +396,7 @@ MiReadPageFile(
         KeBugCheck(MEMORY_MANAGEMENT);
     }
 
-    MmInitializeMdl(Mdl, NULL, PAGE_SIZE);
-    MmBuildMdlFromPages(Mdl, &Page);
-    Mdl->MdlFlags |= MDL_PAGES_LOCKED;
-
-    file_offset.QuadPart = PageFileOffset * PAGE_SIZE;
-    file_offset = MmGetOffsetPageFile(PagingFile->RetrievalPointers, file_offset);
-
-    KeInitializeEvent(&Event, NotificationEvent, FALSE);
-    Status = IoPageRead(PagingFile->FileObject,
-                        Mdl,
-                        &file_offset,
-                        &Event,
-                        &Iosb);
-    if (Status == STATUS_PENDING)
-    {
-        KeWaitForSingleObject(&Event, Executive, KernelMode, FALSE, NULL);
-        Status = Iosb.Status;
-    }
-    if (Mdl->MdlFlags & MDL_MAPPED_TO_SYSTEM_VA)
-    {
-        MmUnmapLockedPages (Mdl->MappedSystemVa, Mdl);
-    }
-    return(Status);
+    return MiPagingFileIo(PagingFile, Pages, PageCount, PageFileOffset, FALSE);
 }
 
 VOID
@@ -361,26 +420,55 @@ MmInitPagingFile(VOID)
 }
 
 static ULONG
-MiAllocPageFromPagingFile(PPAGINGFILE PagingFile)
+MiAllocPagesFromPagingFile(PPAGINGFILE PagingFile, ULONG PageCount)
 {
     KIRQL oldIrql;
-    ULONG i, j;
+    ULONG TotalPages, Start, Run, i, Pass;
 
     KeAcquireSpinLock(&PagingFile->AllocMapLock, &oldIrql);
 
-    for (i = 0; i < PagingFile->AllocMapSize; i++)
+    /*
+     * Search for a run of free slots starting where the last allocation
+     * ended, so that pages swapped out one after the other end up next to
+     * each other in the paging file and can be read back in clusters.
+     */
+    TotalPages = (ULONG)(PagingFile->FreePages + PagingFile->UsedPages);
+    Start = (PagingFile->AllocMapHint < TotalPages) ? PagingFile->AllocMapHint : 0;
+    for (Pass = 0; Pass < 2; Pass++)
     {
-        for (j = 0; j < 32; j++)
+        Run = 0;
+        for (i = Start; i < TotalPages; i++)
         {
-            if (!(PagingFile->AllocMap[i] & (1 << j)))
+            if (PagingFile->AllocMap[i / 32] == 0xFFFFFFFF)
             {
-                PagingFile->AllocMap[i] |= (1 << j);
-                PagingFile->UsedPages++;
-                PagingFile->FreePages--;
+                /* Skip full words */
+                Run = 0;
+                i |= 31;
+                continue;
+            }
+            if (PagingFile->AllocMap[i / 32] & (1 << (i % 32)))
+            {
+                Run = 0;
+                continue;
+            }
+            if (++Run == PageCount)
+            {
+                Start = i + 1 - PageCount;
+                for (i = Start; i < Start + PageCount; i++)
+                {
+                    PagingFile->AllocMap[i / 32] |= (1 << (i % 32));
+                }
+                PagingFile->UsedPages += PageCount;
+                PagingFile->FreePages -= PageCount;
+                PagingFile->AllocMapHint = Start + PageCount;
                 KeReleaseSpinLock(&PagingFile->AllocMapLock, oldIrql);
-                return((i * 32) + j);
+                return(Start);
             }
         }
+
+        /* Wrap around once */
+        if (Start == 0) break;
+        Start = 0;
     }
 
     KeReleaseSpinLock(&PagingFile->AllocMapLock, oldIrql);
@@ -420,15 +508,24 @@ MmFreeSwapPage(SWAPENTRY Entry)
 SWAPENTRY
 NTAPI
 MmAllocSwapPage(VOID)
+{
+    return MmAllocSwapPages(1);
+}
+
+SWAPENTRY
+NTAPI
+MmAllocSwapPages(ULONG PageCount)
 {
     KIRQL oldIrql;
     ULONG i;
     ULONG off;
     SWAPENTRY entry;
 
+    ASSERT(PageCount != 0 && PageCount <= MI_PAGING_FILE_CLUSTER_SIZE);
+
     KeAcquireSpinLock(&PagingFileListLock, &oldIrql);
 
-    if (MiFreeSwapPages == 0)
+    if (MiFreeSwapPages < PageCount)
     {
         KeReleaseSpinLock(&PagingFileListLock, oldIrql);
         return(0);
@@ -437,17 +534,16 @@ MmAllocSwapPage(VOID)
     for (i = 0; i < MAX_PAGING_FILES; i++)
     {
         if (PagingFileList[i] != NULL &&
-                PagingFileList[i]->FreePages >= 1)
+                PagingFileList[i]->FreePages >= PageCount)
         {
-            off = MiAllocPageFromPagingFile(PagingFileList[i]);
+            off = MiAllocPagesFromPagingFile(PagingFileList[i], PageCount);
             if (off == 0xFFFFFFFF)
             {
-                KeBugCheck(MEMORY_MANAGEMENT);
-                KeReleaseSpinLock(&PagingFileListLock, oldIrql);
-                return(STATUS_UNSUCCESSFUL);
+                /* Too fragmented for this run, try the next file */
+                continue;
             }
-            MiUsedSwapPages++;
-            MiFreeSwapPages--;
+            MiUsedSwapPages += PageCount;
+            MiFreeSwapPages -= PageCount;
             KeReleaseSpinLock(&PagingFileListLock, oldIrql);
 
             entry = ENTRY_FROM_FILE_OFFSET(i, off + 1);
@@ -456,7 +552,6 @@ MmAllocSwapPage(VOID)
     }
 
     KeReleaseSpinLock(&PagingFileListLock, oldIrql);
-    KeBugCheck(MEMORY_MANAGEMENT);
     return(0);
 }
 
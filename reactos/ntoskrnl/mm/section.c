@@ -1277,6 +1277,227 @@ MiReadPage(PMEMORY_AREA MemoryArea,
 }
 #endif
 
+/*
+ * Claims the pages that follow PAddress in the view and were written to the
+ * paging file slots that follow SwapEntry, so that they can be read along
+ * with the faulting page. Called with the address space and the segment
+ * locked, returns the number of neighbours claimed.
+ */
+static ULONG
+MmClaimSwapCluster(PMMSUPPORT AddressSpace,
+                   PMEMORY_AREA MemoryArea,
+                   PVOID PAddress,
+                   SWAPENTRY SwapEntry,
+                   BOOLEAN Private)
+{
+    PMM_SECTION_SEGMENT Segment = MemoryArea->Data.SectionData.Segment;
+    PEPROCESS Process = MmGetAddressSpaceOwner(AddressSpace);
+    SWAPENTRY NextSwapEntry, PteSwapEntry;
+    LARGE_INTEGER Offset;
+    PVOID RegionBase;
+    PMM_REGION Region;
+    ULONG_PTR Entry;
+    PCHAR NextAddress;
+    PCHAR EndAddress;
+    ULONG Count;
+
+    /* Stay within the region, so the neighbours share the protection */
+    Region = MmFindRegion((PVOID)MA_GetStartingAddress(MemoryArea),
+                          &MemoryArea->Data.SectionData.RegionListHead,
+                          PAddress, &RegionBase);
+    EndAddress = (PCHAR)RegionBase + Region->Length;
+    if ((ULONG_PTR)EndAddress > MA_GetEndingAddress(MemoryArea))
+        EndAddress = (PCHAR)MA_GetEndingAddress(MemoryArea);
+
+    NextSwapEntry = SwapEntry;
+    NextAddress = (PCHAR)PAddress + PAGE_SIZE;
+    for (Count = 0; Count < MI_PAGING_FILE_CLUSTER_SIZE - 1; Count++)
+    {
+        if (NextAddress >= EndAddress)
+            break;
+
+        NextSwapEntry = MmGetNextSwapEntry(NextSwapEntry);
+        if (NextSwapEntry == MM_WAIT_ENTRY)
+            break;
+
+        Offset.QuadPart = NextAddress - (PCHAR)MA_GetStartingAddress(MemoryArea)
+                          + MemoryArea->Data.SectionData.ViewOffset.QuadPart;
+        Entry = MmGetPageEntrySectionSegment(Segment, &Offset);
+        if (Entry && MM_IS_WAIT_PTE(Entry))
+            break;
+
+        if (Private)
+        {
+            if (!MmIsPageSwapEntry(Process, NextAddress))
+                break;
+            MmGetPageFileMapping(Process, NextAddress, &PteSwapEntry);
+            if (PteSwapEntry != NextSwapEntry)
+                break;
+
+            /* Tell everyone else we are serving the fault. */
+            MmDeletePageFileMapping(Process, NextAddress, &PteSwapEntry);
+            MmCreatePageFileMapping(Process, NextAddress, MM_WAIT_ENTRY);
+        }
+        else
+        {
+            if (Entry != MAKE_SWAP_SSE(NextSwapEntry) ||
+                    MmIsPagePresent(Process, NextAddress) ||
+                    MmIsPageSwapEntry(Process, NextAddress) ||
+                    MmIsDisabledPage(Process, NextAddress))
+            {
+                break;
+            }
+
+            MmSetPageEntrySectionSegment(Segment, &Offset, MAKE_SWAP_SSE(MM_WAIT_ENTRY));
+        }
+
+        NextAddress += PAGE_SIZE;
+    }
+
+    return Count;
+}
+
+/*
+ * Gives the neighbours claimed by MmClaimSwapCluster, starting with the
+ * First one, back to the paging file.
+ */
+static VOID
+MmUnclaimSwapCluster(PMMSUPPORT AddressSpace,
+                     PMEMORY_AREA MemoryArea,
+                     PVOID PAddress,
+                     SWAPENTRY SwapEntry,
+                     BOOLEAN Private,
+                     ULONG First,
+                     ULONG Count)
+{
+    PMM_SECTION_SEGMENT Segment = MemoryArea->Data.SectionData.Segment;
+    PEPROCESS Process = MmGetAddressSpaceOwner(AddressSpace);
+    SWAPENTRY DummyEntry;
+    LARGE_INTEGER Offset;
+    PCHAR NextAddress;
+    ULONG i;
+
+    for (i = 0; i <= First; i++)
+        SwapEntry = MmGetNextSwapEntry(SwapEntry);
+
+    MmLockAddressSpace(AddressSpace);
+    MmLockSectionSegment(Segment);
+    for (i = First; i < Count; i++)
+    {
+        NextAddress = (PCHAR)PAddress + (i + 1) * PAGE_SIZE;
+        if (Private)
+        {
+            MmDeletePageFileMapping(Process, NextAddress, &DummyEntry);
+            MmCreatePageFileMapping(Process, NextAddress, SwapEntry);
+        }
+        else
+        {
+            Offset.QuadPart = NextAddress - (PCHAR)MA_GetStartingAddress(MemoryArea)
+                              + MemoryArea->Data.SectionData.ViewOffset.QuadPart;
+            MmSetPageEntrySectionSegment(Segment, &Offset, MAKE_SWAP_SSE(SwapEntry));
+        }
+        SwapEntry = MmGetNextSwapEntry(SwapEntry);
+    }
+    MmUnlockSectionSegment(Segment);
+    MmUnlockAddressSpace(AddressSpace);
+    MiSetPageEvent(NULL, NULL);
+}
+
+/*
+ * Reads the faulting page from SwapEntry along with the Count neighbours
+ * claimed by MmClaimSwapCluster, and maps the neighbours. Called without
+ * any lock held.
+ */
+static NTSTATUS
+MmPageInSwapCluster(PMMSUPPORT AddressSpace,
+                    PMEMORY_AREA MemoryArea,
+                    PVOID PAddress,
+                    SWAPENTRY SwapEntry,
+                    BOOLEAN Private,
+                    PFN_NUMBER Page,
+                    ULONG Count)
+{
+    PMM_SECTION_SEGMENT Segment = MemoryArea->Data.SectionData.Segment;
+    PEPROCESS Process = MmGetAddressSpaceOwner(AddressSpace);
+    PFN_NUMBER Pages[MI_PAGING_FILE_CLUSTER_SIZE];
+    SWAPENTRY NextSwapEntry, DummyEntry;
+    LARGE_INTEGER Offset;
+    PMM_REGION Region;
+    PCHAR NextAddress;
+    NTSTATUS Status;
+    ULONG i;
+
+    if (Count == 0)
+        return MmReadFromSwapPage(SwapEntry, Page);
+
+    /* The neighbours are a bonus, don't wait for memory to hold them */
+    Pages[0] = Page;
+    for (i = 0; i < Count; i++)
+    {
+        Status = MmRequestPageMemoryConsumer(MC_USER, FALSE, &Pages[i + 1]);
+        if (!NT_SUCCESS(Status))
+        {
+            MmUnclaimSwapCluster(AddressSpace, MemoryArea, PAddress, SwapEntry, Private, i, Count);
+            Count = i;
+            break;
+        }
+    }
+
+    Status = MmReadFromSwapPages(SwapEntry, Pages, Count + 1);
+    if (!NT_SUCCESS(Status))
+    {
+        /* Let the faults on the neighbours read them on their own */
+        for (i = 0; i < Count; i++)
+            MmReleasePageMemoryConsumer(MC_USER, Pages[i + 1]);
+        MmUnclaimSwapCluster(AddressSpace, MemoryArea, PAddress, SwapEntry, Private, 0, Count);
+        return MmReadFromSwapPage(SwapEntry, Page);
+    }
+
+    MmLockAddressSpace(AddressSpace);
+    MmLockSectionSegment(Segment);
+    Region = MmFindRegion((PVOID)MA_GetStartingAddress(MemoryArea),
+                          &MemoryArea->Data.SectionData.RegionListHead,
+                          PAddress, NULL);
+    NextSwapEntry = SwapEntry;
+    for (i = 0; i < Count; i++)
+    {
+        NextSwapEntry = MmGetNextSwapEntry(NextSwapEntry);
+        NextAddress = (PCHAR)PAddress + (i + 1) * PAGE_SIZE;
+
+        if (Private)
+            MmDeletePageFileMapping(Process, NextAddress, &DummyEntry);
+
+        Status = MmCreateVirtualMapping(Process,
+                                        NextAddress,
+                                        Region->Protect,
+                                        &Pages[i + 1],
+                                        1);
+        if (!NT_SUCCESS(Status))
+        {
+            DPRINT1("Unable to create virtual mapping\n");
+            KeBugCheck(MEMORY_MANAGEMENT);
+        }
+
+        /*
+         * Store the swap entry for later use.
+         */
+        MmSetSavedSwapEntryPage(Pages[i + 1], NextSwapEntry);
+        MmInsertRmap(Pages[i + 1], Process, NextAddress);
+
+        if (!Private)
+        {
+            Offset.QuadPart = NextAddress - (PCHAR)MA_GetStartingAddress(MemoryArea)
+                              + MemoryArea->Data.SectionData.ViewOffset.QuadPart;
+            MmSetPageEntrySectionSegment(Segment, &Offset, MAKE_SSE(Pages[i + 1] << PAGE_SHIFT, 1));
+        }
+    }
+    MmUnlockSectionSegment(Segment);
+    MmUnlockAddressSpace(AddressSpace);
+    MiSetPageEvent(NULL, NULL);
+
+    return STATUS_SUCCESS;
+}
+
 NTSTATUS
 NTAPI
 MmNotPresentFaultSectionView(PMMSUPPORT AddressSpace,
@@ -1370,6 +1591,7 @@ MmNotPresentFaultSectionView(PMMSUPPORT AddressSpace,
     if ((HasSwapEntry) || (Segment->Image.Characteristics & IMAGE_SCN_CNT_UNINITIALIZED_DATA))
     {
         SWAPENTRY DummyEntry;
+        ULONG ClusterCount = 0;
 
         /*
          * Is it a wait entry?
@@ -1400,6 +1622,7 @@ MmNotPresentFaultSectionView(PMMSUPPORT AddressSpace,
                 KeBugCheck(MEMORY_MANAGEMENT);
             }
             MmDeletePageFileMapping(Process, Address, &SwapEntry);
+            ClusterCount = MmClaimSwapCluster(AddressSpace, MemoryArea, PAddress, SwapEntry, TRUE);
         }
 
         MmUnlockSectionSegment(Segment);
@@ -1419,7 +1642,7 @@ MmNotPresentFaultSectionView(PMMSUPPORT AddressSpace,
 
         if (HasSwapEntry)
         {
-            Status = MmReadFromSwapPage(SwapEntry, Page);
+            Status = MmPageInSwapCluster(AddressSpace, MemoryArea, PAddress, SwapEntry, TRUE, Page, ClusterCount);
             if (!NT_SUCCESS(Status))
             {
                 DPRINT1("MmReadFromSwapPage failed, status = %x\n", Status);
@@ -1527,6 +1750,11 @@ MmNotPresentFaultSectionView(PMMSUPPORT AddressSpace,
         }
         else
         {
+#ifndef NEWCC
+            CcPfLogPageFault(Section->FileObject,
+                             Offset.QuadPart + Segment->Image.FileOffset,
+                             BooleanFlagOn(Section->AllocationAttributes, SEC_IMAGE));
+#endif
             Status = MiReadPage(MemoryArea, Offset.QuadPart, &Page);
             if (!NT_SUCCESS(Status))
             {
@@ -1579,6 +1807,7 @@ MmNotPresentFaultSectionView(PMMSUPPORT AddressSpace,
     else if (IS_SWAP_FROM_SSE(Entry))
     {
         SWAPENTRY SwapEntry;
+        ULONG ClusterCount;
 
         SwapEntry = SWAPENTRY_FROM_SSE(Entry);
 
@@ -1592,6 +1821,8 @@ MmNotPresentFaultSectionView(PMMSUPPORT AddressSpace,
             return STATUS_MM_RESTART_OPERATION;
         }
 
+        ClusterCount = MmClaimSwapCluster(AddressSpace, MemoryArea, PAddress, SwapEntry, FALSE);
+
         /*
         * Release all our locks and read in the page from disk
         */
@@ -1607,7 +1838,7 @@ MmNotPresentFaultSectionView(PMMSUPPORT AddressSpace,
             KeBugCheck(MEMORY_MANAGEMENT);
         }
 
-        Status = MmReadFromSwapPage(SwapEntry, Page);
+        Status = MmPageInSwapCluster(AddressSpace, MemoryArea, PAddress, SwapEntry, FALSE, Page, ClusterCount);
         if (!NT_SUCCESS(Status))
         {
             KeBugCheck(MEMORY_MANAGEMENT);
@@ -1856,6 +2087,246 @@ MmPageOutDeleteMapping(PVOID Context, PEPROCESS Process, PVOID Address)
     }
 }
 
+/*
+ * Undoes the page out of a page whose write to the paging file failed, by
+ * mapping it back where it was.
+ */
+static VOID
+MmPageOutRestoreMapping(PMMSUPPORT AddressSpace,
+                        PMEMORY_AREA MemoryArea,
+                        PVOID Address,
+                        PFN_NUMBER Page,
+                        MM_SECTION_PAGEOUT_CONTEXT *Context)
+{
+    PEPROCESS Process = MmGetAddressSpaceOwner(AddressSpace);
+    ULONG_PTR Entry;
+
+    MmLockAddressSpace(AddressSpace);
+    MmLockSectionSegment(Context->Segment);
+    MmCreateVirtualMapping(Process,
+                           Address,
+                           MemoryArea->Protect,
+                           &Page,
+                           1);
+    MmSetDirtyPage(Process, Address);
+    MmInsertRmap(Page,
+                 Process,
+                 Address);
+    if (Context->Private)
+    {
+        /* We had placed a wait entry upon entry ... replace it before leaving */
+        Entry = Context->SectionEntry;
+    }
+    else
+    {
+        Entry = MAKE_SSE(Page << PAGE_SHIFT, 1);
+    }
+    MmSetPageEntrySectionSegment(Context->Segment, &Context->Offset, Entry);
+    MmUnlockSectionSegment(Context->Segment);
+    MmUnlockAddressSpace(AddressSpace);
+}
+
+/*
+ * Points the page table or the section segment at the paging file slot a
+ * page was written to, and lets go of the page.
+ */
+static VOID
+MmPageOutFinish(PMMSUPPORT AddressSpace,
+                PVOID Address,
+                PFN_NUMBER Page,
+                SWAPENTRY SwapEntry,
+                MM_SECTION_PAGEOUT_CONTEXT *Context)
+{
+    PEPROCESS Process = MmGetAddressSpaceOwner(AddressSpace);
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    MmSetSavedSwapEntryPage(Page, 0);
+    if (Context->Segment->Flags & MM_PAGEFILE_SEGMENT ||
+            Context->Segment->Image.Characteristics & IMAGE_SCN_MEM_SHARED)
+    {
+        MmLockSectionSegment(Context->Segment);
+        MmSetPageEntrySectionSegment(Context->Segment, &Context->Offset, MAKE_SWAP_SSE(SwapEntry));
+        MmUnlockSectionSegment(Context->Segment);
+    }
+    else
+    {
+        MmReleasePageMemoryConsumer(MC_USER, Page);
+    }
+
+    MmLockAddressSpace(AddressSpace);
+    MmLockSectionSegment(Context->Segment);
+    if (Context->Private)
+    {
+        Status = MmCreatePageFileMapping(Process,
+                                         Address,
+                                         SwapEntry);
+        /* We had placed a wait entry upon entry ... replace it before leaving */
+        MmSetPageEntrySectionSegment(Context->Segment, &Context->Offset, Context->SectionEntry);
+    }
+    else
+    {
+        /* We had placed a wait entry upon entry ... replace it before leaving */
+        MmSetPageEntrySectionSegment(Context->Segment, &Context->Offset, MAKE_SWAP_SSE(SwapEntry));
+    }
+    MmUnlockSectionSegment(Context->Segment);
+    MmUnlockAddressSpace(AddressSpace);
+
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("Status %x Creating page file mapping for %p:%p\n", Status, Process, Address);
+        KeBugCheckEx(MEMORY_MANAGEMENT, Status, (ULONG_PTR)Process, (ULONG_PTR)Address, SwapEntry);
+    }
+}
+
+/*
+ * Pages out the pages that follow Address in the view along with the one at
+ * Address, which has already been unmapped. Only pages that need a new slot
+ * in the paging file qualify, and they are written with one I/O to a run of
+ * adjacent slots, so that a fault can read them back the same way. Returns
+ * FALSE if there was nothing to cluster, the caller then writes its page on
+ * its own.
+ */
+static BOOLEAN
+MmPageOutCluster(PMMSUPPORT AddressSpace,
+                 PMEMORY_AREA MemoryArea,
+                 PVOID Address,
+                 PFN_NUMBER Page,
+                 MM_SECTION_PAGEOUT_CONTEXT *Context,
+                 PSWAPENTRY SwapEntry,
+                 PNTSTATUS Status)
+{
+    MM_SECTION_PAGEOUT_CONTEXT Neighbours[MI_PAGING_FILE_CLUSTER_SIZE - 1];
+    PFN_NUMBER Pages[MI_PAGING_FILE_CLUSTER_SIZE];
+    PMM_SECTION_SEGMENT Segment = Context->Segment;
+    PEPROCESS Process = MmGetAddressSpaceOwner(AddressSpace);
+    SWAPENTRY NextSwapEntry;
+    PFN_NUMBER NextPage;
+    ULONG_PTR Entry;
+    PCHAR NextAddress;
+    ULONG Count, i;
+    BOOLEAN Private;
+    KIRQL OldIrql;
+
+    /*
+     * Private pages of shared segments and shared pages of file backed
+     * segments don't always end up in the paging file.
+     */
+    if (Context->Private)
+    {
+        if ((Segment->Flags & MM_PAGEFILE_SEGMENT) ||
+                (Segment->Image.Characteristics & IMAGE_SCN_MEM_SHARED))
+        {
+            return FALSE;
+        }
+    }
+    else if (!(Segment->Flags & MM_PAGEFILE_SEGMENT))
+    {
+        return FALSE;
+    }
+
+    /*
+     * Claim the neighbours the way MmPageOutPhysicalAddress claims a page,
+     * stopping at the first one that can't go with this one.
+     */
+    Pages[0] = Page;
+    Count = 1;
+    NextAddress = (PCHAR)Address + PAGE_SIZE;
+
+    MmLockAddressSpace(AddressSpace);
+    MmLockSectionSegment(Segment);
+    while (Count < MI_PAGING_FILE_CLUSTER_SIZE &&
+           (ULONG_PTR)NextAddress < MA_GetEndingAddress(MemoryArea) &&
+           !MemoryArea->DeleteInProgress &&
+           MmIsPagePresent(Process, NextAddress))
+    {
+        Neighbours[Count - 1] = *Context;
+        Neighbours[Count - 1].Offset.QuadPart += NextAddress - (PCHAR)Address;
+        Neighbours[Count - 1].WasDirty = FALSE;
+
+        Entry = MmGetPageEntrySectionSegment(Segment, &Neighbours[Count - 1].Offset);
+        if (Entry && MM_IS_WAIT_PTE(Entry))
+            break;
+
+        NextPage = MmGetPfnForProcess(Process, NextAddress);
+        if (MmGetReferenceCountPage(NextPage) != 1 ||
+                MmGetSavedSwapEntryPage(NextPage) != 0)
+        {
+            break;
+        }
+
+        Private = (Segment->Image.Characteristics & IMAGE_SCN_CNT_UNINITIALIZED_DATA ||
+                   IS_SWAP_FROM_SSE(Entry) ||
+                   PFN_FROM_SSE(Entry) != NextPage);
+        if (Private != Context->Private)
+            break;
+
+        Neighbours[Count - 1].SectionEntry = Entry;
+        MmSetPageEntrySectionSegment(Segment, &Neighbours[Count - 1].Offset, MAKE_SWAP_SSE(MM_WAIT_ENTRY));
+
+        Pages[Count++] = NextPage;
+        NextAddress += PAGE_SIZE;
+    }
+    MmUnlockSectionSegment(Segment);
+    MmUnlockAddressSpace(AddressSpace);
+
+    if (Count == 1)
+        return FALSE;
+
+    *SwapEntry = MmAllocSwapPages(Count);
+    if (*SwapEntry == 0)
+    {
+        /* No run of free slots that long, leave the neighbours alone */
+        MmLockSectionSegment(Segment);
+        for (i = 1; i < Count; i++)
+        {
+            MmSetPageEntrySectionSegment(Segment, &Neighbours[i - 1].Offset, Neighbours[i - 1].SectionEntry);
+        }
+        MmUnlockSectionSegment(Segment);
+        MiSetPageEvent(NULL, NULL);
+        return FALSE;
+    }
+
+    /* Unmap the neighbours everywhere, as MmPageOutSectionView does */
+    for (i = 1; i < Count; i++)
+    {
+        OldIrql = KeAcquireQueuedSpinLock(LockQueuePfnLock);
+        MmReferencePage(Pages[i]);
+        KeReleaseQueuedSpinLock(LockQueuePfnLock, OldIrql);
+
+        MmDeleteAllRmaps(Pages[i], (PVOID)&Neighbours[i - 1], MmPageOutDeleteMapping);
+    }
+
+    *Status = MmWriteToSwapPages(*SwapEntry, Pages, Count);
+    if (!NT_SUCCESS(*Status))
+    {
+        DPRINT1("MM: Failed to write %lu pages to swap (Status was 0x%.8X)\n",
+                Count, *Status);
+    }
+
+    NextSwapEntry = *SwapEntry;
+    for (i = 1; i < Count; i++)
+    {
+        NextSwapEntry = MmGetNextSwapEntry(NextSwapEntry);
+        NextAddress = (PCHAR)Address + i * PAGE_SIZE;
+
+        if (NT_SUCCESS(*Status))
+        {
+            MmPageOutFinish(AddressSpace, NextAddress, Pages[i], NextSwapEntry, &Neighbours[i - 1]);
+        }
+        else
+        {
+            MmFreeSwapPage(NextSwapEntry);
+            MmPageOutRestoreMapping(AddressSpace, MemoryArea, NextAddress, Pages[i], &Neighbours[i - 1]);
+        }
+    }
+
+    /* The caller puts its own page back */
+    if (!NT_SUCCESS(*Status))
+        MmFreeSwapPage(*SwapEntry);
+
+    return TRUE;
+}
+
 NTSTATUS
 NTAPI
 MmPageOutSectionView(PMMSUPPORT AddressSpace,
@@ -1873,6 +2344,7 @@ MmPageOutSectionView(PMMSUPPORT AddressSpace,
     BOOLEAN IsImageSection;
 #endif
     BOOLEAN DirectMapped;
+    BOOLEAN Clustered = FALSE;
     PEPROCESS Process = MmGetAddressSpaceOwner(AddressSpace);
     KIRQL OldIrql;
 
@@ -2112,11 +2584,15 @@ MmPageOutSectionView(PMMSUPPORT AddressSpace,
     }
 
     /*
-     * If necessary, allocate an entry in the paging file for this page
+     * If necessary, allocate an entry in the paging file for this page,
+     * preferably together with its neighbours.
      */
     if (SwapEntry == 0)
     {
-        SwapEntry = MmAllocSwapPage();
+        Clustered = MmPageOutCluster(AddressSpace, MemoryArea, Address, Page,
+                                     &Context, &SwapEntry, &Status);
+        if (!Clustered)
+            SwapEntry = MmAllocSwapPage();
         if (SwapEntry == 0)
         {
             MmShowOutOfSpaceMessagePagingFile();
@@ -2172,7 +2648,8 @@ MmPageOutSectionView(PMMSUPPORT AddressSpace,
     /*
      * Write the page to the pagefile
      */
-    Status = MmWriteToSwapPage(SwapEntry, Page);
+    if (!Clustered)
+        Status = MmWriteToSwapPage(SwapEntry, Page);
     if (!NT_SUCCESS(Status))
     {
         DPRINT1("MM: Failed to write to swap page (Status was 0x%.8X)\n",
@@ -2181,36 +2658,7 @@ MmPageOutSectionView(PMMSUPPORT AddressSpace,
          * As above: undo our actions.
          * FIXME: Also free the swap page.
          */
-        MmLockAddressSpace(AddressSpace);
-        if (Context.Private)
-        {
-            Status = MmCreateVirtualMapping(Process,
-                                            Address,
-                                            MemoryArea->Protect,
-                                            &Page,
-                                            1);
-            MmSetDirtyPage(Process, Address);
-            MmInsertRmap(Page,
-                         Process,
-                         Address);
-        }
-        else
-        {
-            MmLockSectionSegment(Context.Segment);
-            Status = MmCreateVirtualMapping(Process,
-                                            Address,
-                                            MemoryArea->Protect,
-                                            &Page,
-                                            1);
-            MmSetDirtyPage(Process, Address);
-            MmInsertRmap(Page,
-                         Process,
-                         Address);
-            Entry = MAKE_SSE(Page << PAGE_SHIFT, 1);
-            MmSetPageEntrySectionSegment(Context.Segment, &Context.Offset, Entry);
-            MmUnlockSectionSegment(Context.Segment);
-        }
-        MmUnlockAddressSpace(AddressSpace);
+        MmPageOutRestoreMapping(AddressSpace, MemoryArea, Address, Page, &Context);
         MiSetPageEvent(NULL, NULL);
         return(STATUS_UNSUCCESSFUL);
     }
@@ -2219,46 +2667,7 @@ MmPageOutSectionView(PMMSUPPORT AddressSpace,
      * Otherwise we have succeeded.
      */
     DPRINT("MM: Wrote section page 0x%.8X to swap!\n", Page << PAGE_SHIFT);
-    MmSetSavedSwapEntryPage(Page, 0);
-    if (Context.Segment->Flags & MM_PAGEFILE_SEGMENT ||
-            Context.Segment->Image.Characteristics & IMAGE_SCN_MEM_SHARED)
-    {
-        MmLockSectionSegment(Context.Segment);
-        MmSetPageEntrySectionSegment(Context.Segment, &Context.Offset, MAKE_SWAP_SSE(SwapEntry));
-        MmUnlockSectionSegment(Context.Segment);
-    }
-    else
-    {
-        MmReleasePageMemoryConsumer(MC_USER, Page);
-    }
-
-    if (Context.Private)
-    {
-        MmLockAddressSpace(AddressSpace);
-        MmLockSectionSegment(Context.Segment);
-        Status = MmCreatePageFileMapping(Process,
-                                         Address,
-                                         SwapEntry);
-        /* We had placed a wait entry upon entry ... replace it before leaving */
-        MmSetPageEntrySectionSegment(Context.Segment, &Context.Offset, Entry);
-        MmUnlockSectionSegment(Context.Segment);
-        MmUnlockAddressSpace(AddressSpace);
-        if (!NT_SUCCESS(Status))
-        {
-            DPRINT1("Status %x Creating page file mapping for %p:%p\n", Status, Process, Address);
-            KeBugCheckEx(MEMORY_MANAGEMENT, Status, (ULONG_PTR)Process, (ULONG_PTR)Address, SwapEntry);
-        }
-    }
-    else
-    {
-        MmLockAddressSpace(AddressSpace);
-        MmLockSectionSegment(Context.Segment);
-        Entry = MAKE_SWAP_SSE(SwapEntry);
-        /* We had placed a wait entry upon entry ... replace it before leaving */
-        MmSetPageEntrySectionSegment(Context.Segment, &Context.Offset, Entry);
-        MmUnlockSectionSegment(Context.Segment);
-        MmUnlockAddressSpace(AddressSpace);
-    }
+    MmPageOutFinish(AddressSpace, Address, Page, SwapEntry, &Context);
 
     MiSetPageEvent(NULL, NULL);
     return(STATUS_SUCCESS);
@@ -1125,7 +1125,10 @@ PspExitProcess(IN BOOLEAN LastThread,
             /* FIXME: Check job status code and do I/O completion if needed */
         }
 
-        /* FIXME: Notify the Prefetcher */
+#ifndef NEWCC
+        /* Notify the Prefetcher */
+        CcPfProcessExitNotification(Process);
+#endif
     }
     else
     {
@@ -65,7 +65,15 @@ PspUserThreadStartup(IN PKSTART_ROUTINE StartRoutine,
         /* Check if the Prefetcher is enabled */
         if (CcPfEnablePrefetcher)
         {
-            /* FIXME: Prepare to prefetch this process */
+#ifndef NEWCC
+            /* Prepare to prefetch this process, on its first thread only */
+            if (!(PspSetProcessFlag(Thread->ThreadsProcess, PSF_LAUNCH_PREFETCHED_BIT) &
+                  PSF_LAUNCH_PREFETCHED_BIT))
+            {
+                CcPfBeginAppLaunch(Thread->ThreadsProcess,
+                                   Thread->ThreadsProcess->SectionObject);
+            }
+#endif
         }
 
         /* Raise to APC */
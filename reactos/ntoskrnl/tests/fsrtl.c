@@ -529,6 +529,9 @@ BOOLEAN FsRtlTest_StartTest() {
     FcbHeader->IsFastIoPossible = FastIoIsNotPossible;
     FSRTL_TEST("FsRtlMdlReadDev() - FastIo is not possible flag. Wait = TRUE",!FsRtlMdlReadDev(Pfo,&Offset,Length,0,&MdlChain,&IoStatus,NULL));
 
+    /* The FCB outlives this handle, let the next test reopen it as the driver set it up */
+    FcbHeader->IsFastIoPossible = FastIoIsQuestionable;
+
     Return = TRUE;
 
     if (Pfo)
@@ -585,6 +588,10 @@ BOOLEAN FsRtlTest_StartTest() {
     MdlChain = NULL;
     Return = FsRtlMdlRead(Pfo,&Offset,Length,0,&MdlChain,&IoStatus);
     FSRTL_TEST("FsRtlMdlRead() - Testing 64k IO",(NT_SUCCESS(Return) && NT_SUCCESS(IoStatus.Status ) && IoStatus.Information == Length));
+    /* The MDL describes the cached pages of the file, not a copy */
+    FSRTL_TEST("FsRtlMdlRead() - Got an MDL chain",(MdlChain != NULL && MmGetMdlByteCount(MdlChain) > 0));
+    FSRTL_TEST("FsRtlMdlRead() - MDL holds the file data",(MdlChain != NULL &&
+        RtlCompareMemory(MmGetSystemAddressForMdlSafe(MdlChain,NormalPagePriority),Buffer,MmGetMdlByteCount(MdlChain)) == MmGetMdlByteCount(MdlChain)));
     FSRTL_TEST("FsRtlMdlRead() - Releasing the MDL",FsRtlMdlReadComplete(Pfo,MdlChain));
 
 
@@ -187,6 +187,11 @@ extern "C" {
 C_ASSERT(HEAP_CREATE_VALID_MASK == 0x0007F0FF);
 #endif
 
+//
+// ReactOS-specific Heap Information Class for the lookaside front end statistics
+//
+#define HeapLookasideInformation ((HEAP_INFORMATION_CLASS)0x80)
+
 //
 // Native image architecture
 //
@@ -1107,6 +1112,14 @@ typedef struct _RTL_HEAP_INFORMATION
     PRTL_HEAP_ENTRY Entries;
 } RTL_HEAP_INFORMATION, *PRTL_HEAP_INFORMATION;
 
+typedef struct _RTL_HEAP_LOOKASIDE_INFORMATION
+{
+    ULONG AllocateHits;
+    ULONG AllocateMisses;
+    ULONG FreeHits;
+    ULONG FreeMisses;
+} RTL_HEAP_LOOKASIDE_INFORMATION, *PRTL_HEAP_LOOKASIDE_INFORMATION;
+
 typedef struct _RTL_PROCESS_HEAPS
 {
     ULONG NumberOfHeaps;
@@ -114,6 +114,16 @@ typedef struct _AFD_SEND_INFO_UDP {
 
 C_ASSERT(sizeof(AFD_RECV_INFO) == sizeof(AFD_SEND_INFO));
 
+typedef struct _AFD_TRANSMIT_FILE_INFO {
+    HANDLE				FileHandle;
+    LARGE_INTEGER			Offset;
+    ULONG				WriteLength;
+    ULONG				SendPerRequest;
+    AFD_WSABUF				Head;
+    AFD_WSABUF				Tail;
+    ULONG				Flags;
+} AFD_TRANSMIT_FILE_INFO, *PAFD_TRANSMIT_FILE_INFO;
+
 typedef struct  _AFD_CONNECT_INFO {
     BOOLEAN				UseSAN;
     ULONG				Root;
@@ -199,6 +209,10 @@ typedef struct _AFD_TDI_HANDLE_DATA
 #define AFD_DISCONNECT_ABORT		0x04L
 #define AFD_DISCONNECT_DATAGRAM		0x08L
 
+/* AFD Transmit File Flags (same values as the TF_* flags) */
+#define AFD_TF_DISCONNECT		0x01L
+#define AFD_TF_REUSE_SOCKET		0x02L
+
 /* AFD Event Flags */
 #define AFD_EVENT_RECEIVE                   (1 << AFD_EVENT_RECEIVE_BIT)
 #define AFD_EVENT_OOB_RECEIVE               (1 << AFD_EVENT_OOB_RECEIVE_BIT)
@@ -256,6 +270,7 @@ typedef struct _AFD_TDI_HANDLE_DATA
 #define AFD_SET_DISCONNECT_DATA_SIZE    28
 #define AFD_SET_DISCONNECT_OPTIONS_SIZE 29
 #define AFD_GET_INFO			30
+#define AFD_TRANSMIT_FILE		31
 #define AFD_EVENT_SELECT		33
 #define AFD_ENUM_NETWORK_EVENTS         34
 #define AFD_DEFER_ACCEPT		35
@@ -326,6 +341,8 @@ typedef struct _AFD_TDI_HANDLE_DATA
   _AFD_CONTROL_CODE(AFD_SET_DISCONNECT_OPTIONS_SIZE, METHOD_NEITHER)
 #define IOCTL_AFD_GET_INFO \
   _AFD_CONTROL_CODE(AFD_GET_INFO, METHOD_NEITHER)
+#define IOCTL_AFD_TRANSMIT_FILE \
+  _AFD_CONTROL_CODE(AFD_TRANSMIT_FILE, METHOD_NEITHER)
 #define IOCTL_AFD_EVENT_SELECT \
   _AFD_CONTROL_CODE(AFD_EVENT_SELECT, METHOD_NEITHER)
 #define IOCTL_AFD_DEFER_ACCEPT \
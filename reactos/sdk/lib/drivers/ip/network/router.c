@@ -14,8 +14,50 @@
 
 #include "precomp.h"
 
+#define ROUTE_NONE          0xFFFFFFFF  /* No route or node */
+#define ROUTE_EMPTY         0xFFFFFFFE  /* Unused route cache slot */
+#define ROUTE_CACHE_SIZE    64          /* Cache slots per processor, power of two */
+
+/* Node of the path compressed longest prefix match trie */
+typedef struct _ROUTE_NODE {
+    ULONG Prefix;                 /* Network address in host order */
+    ULONG Length;                 /* Number of significant bits in Prefix */
+    ULONG Route;                  /* First route for this prefix or ROUTE_NONE */
+    ULONG Shorter;                /* Closest ancestor with routes or ROUTE_NONE */
+    ULONG Child[2];               /* Node to follow for the next bit, 0 if none */
+} ROUTE_NODE, *PROUTE_NODE;
+
+/* Route attached to a trie node */
+typedef struct _ROUTE_INFO {
+    PNEIGHBOR_CACHE_ENTRY Router; /* Pointer to NCE of router to use */
+    UINT Metric;                  /* Cost of this route */
+    ULONG Next;                   /* Next route for the same prefix or ROUTE_NONE */
+} ROUTE_INFO, *PROUTE_INFO;
+
+/* Per-destination route cache slot */
+typedef struct _ROUTE_CACHE_ENTRY {
+    ULONG Destination;            /* Destination in host order */
+    ULONG Node;                   /* Result of the trie lookup */
+} ROUTE_CACHE_ENTRY, *PROUTE_CACHE_ENTRY;
+
+/* Read-only snapshot of the FIB used by RouterGetRoute.
+ * A new snapshot is built whenever the FIB changes; readers walk it at
+ * DISPATCH_LEVEL without taking the FIB lock, so a replaced snapshot is
+ * only freed once every processor has been through a quiescent state.
+ * The route cache is per processor and lives in the snapshot, which makes
+ * it both lock free and implicitly invalidated on every FIB change */
+typedef struct _ROUTE_TABLE {
+    WORK_QUEUE_ITEM WorkItem;     /* Used to free the snapshot at PASSIVE_LEVEL */
+    PROUTE_INFO Routes;
+    PROUTE_NODE Nodes;
+    PROUTE_CACHE_ENTRY Cache;     /* ROUTE_CACHE_SIZE slots per processor */
+    ULONG RouteCount;
+    ULONG NodeCount;
+} ROUTE_TABLE, *PROUTE_TABLE;
+
 LIST_ENTRY FIBListHead;
 KSPIN_LOCK FIBLock;
+PROUTE_TABLE volatile RouteTable;
 
 void RouterDumpRoutes() {
     PLIST_ENTRY CurrentEntry;
@@ -186,6 +228,373 @@ UINT CommonPrefixLength(
 }
 
 
+static
+ULONG
+RouteMask(
+    ULONG Length)
+{
+    return Length ? 0xFFFFFFFF << (32 - Length) : 0;
+}
+
+
+static
+ULONG
+RouteBit(
+    ULONG Address,
+    ULONG Index)
+{
+    return (Address >> (31 - Index)) & 1;
+}
+
+
+static
+ULONG
+RouteCacheHash(
+    ULONG Address)
+{
+    /* Fibonacci hashing, keeps the high bits which mix in the whole address */
+    return ((Address * 0x9E3779B1) >> 26) & (ROUTE_CACHE_SIZE - 1);
+}
+
+
+static
+ULONG
+RouteNewNode(
+    PROUTE_TABLE Table,
+    ULONG Prefix,
+    ULONG Length)
+{
+    PROUTE_NODE Node = &Table->Nodes[Table->NodeCount];
+
+    Node->Prefix   = Prefix & RouteMask(Length);
+    Node->Length   = Length;
+    Node->Route    = ROUTE_NONE;
+    Node->Shorter  = ROUTE_NONE;
+    Node->Child[0] = 0;
+    Node->Child[1] = 0;
+
+    return Table->NodeCount++;
+}
+
+
+static
+VOID
+RouteInsert(
+    PROUTE_TABLE Table,
+    ULONG Prefix,
+    ULONG Length,
+    PNEIGHBOR_CACHE_ENTRY Router,
+    UINT Metric)
+/*
+ * FUNCTION: Adds a route to a snapshot being built
+ * ARGUMENTS:
+ *     Table  = Pointer to the snapshot
+ *     Prefix = Network address in host order
+ *     Length = Length of the network prefix
+ *     Router = Pointer to NCE of router to use
+ *     Metric = Cost of this route
+ * NOTES:
+ *     Every insertion creates at most two nodes, the snapshot is
+ *     sized accordingly by RouteBuildTable
+ */
+{
+    PROUTE_NODE Node, ChildNode;
+    PROUTE_INFO Info;
+    ULONG Index = 0, Child, Bit, Common, Diff;
+    PULONG Link;
+
+    Prefix &= RouteMask(Length);
+
+    /* Walk down to the node for this prefix, creating it if needed */
+    for (;;) {
+        Node = &Table->Nodes[Index];
+        if (Node->Length == Length)
+            break;
+
+        Bit = RouteBit(Prefix, Node->Length);
+        Child = Node->Child[Bit];
+        if (!Child) {
+            Index = RouteNewNode(Table, Prefix, Length);
+            Node->Child[Bit] = Index;
+            break;
+        }
+
+        /* Count the bits shared with the child, up to the shorter prefix */
+        ChildNode = &Table->Nodes[Child];
+        Common = min(Length, ChildNode->Length);
+        Diff = (Prefix ^ ChildNode->Prefix) & RouteMask(Common);
+        if (Diff) {
+            for (Common = 0; !(Diff & 0x80000000); Common++)
+                Diff <<= 1;
+        }
+
+        if (Common == ChildNode->Length) {
+            Index = Child;
+            continue;
+        }
+
+        /* The child is more specific than what we share with it, so put
+         * an intermediate node on the edge and continue from there */
+        Index = RouteNewNode(Table, Prefix, Common);
+        Table->Nodes[Index].Child[RouteBit(ChildNode->Prefix, Common)] = Child;
+        Node->Child[Bit] = Index;
+    }
+
+    Info = &Table->Routes[Table->RouteCount];
+    Info->Router = Router;
+    Info->Metric = Metric;
+
+    /* Keep the routes for a prefix sorted by metric */
+    Link = &Table->Nodes[Index].Route;
+    while (*Link != ROUTE_NONE && Table->Routes[*Link].Metric <= Metric)
+        Link = &Table->Routes[*Link].Next;
+
+    Info->Next = *Link;
+    *Link = Table->RouteCount++;
+}
+
+
+static
+ULONG
+RouteLookup(
+    PROUTE_TABLE Table,
+    ULONG Address)
+/*
+ * FUNCTION: Finds the longest prefix matching an address
+ * ARGUMENTS:
+ *     Table   = Pointer to the snapshot
+ *     Address = Destination address in host order
+ * RETURNS:
+ *     Node of the longest matching prefix with routes, ROUTE_NONE if
+ *     none matched. Shorter matching prefixes follow through its
+ *     Shorter links
+ */
+{
+    PROUTE_NODE Node = &Table->Nodes[0];
+    ULONG Best = ROUTE_NONE;
+    ULONG Child;
+
+    for (;;) {
+        if ((Address & RouteMask(Node->Length)) != Node->Prefix)
+            break;
+
+        if (Node->Route != ROUTE_NONE)
+            Best = (ULONG)(Node - Table->Nodes);
+
+        if (Node->Length == 32)
+            break;
+
+        Child = Node->Child[RouteBit(Address, Node->Length)];
+        if (!Child)
+            break;
+
+        Node = &Table->Nodes[Child];
+    }
+
+    return Best;
+}
+
+
+static
+PNEIGHBOR_CACHE_ENTRY
+RouteSelectRouter(
+    PROUTE_TABLE Table,
+    ULONG Node)
+/*
+ * FUNCTION: Picks the router for a lookup result
+ * ARGUMENTS:
+ *     Table = Pointer to the snapshot
+ *     Node  = Node returned by RouteLookup
+ * RETURNS:
+ *     Cheapest router of the longest matching prefix that is not known
+ *     to be unreachable. If every such router is, a shorter matching
+ *     prefix is tried, and only if none has a usable router is the
+ *     cheapest router of the longest prefix returned
+ */
+{
+    ULONG Current, Route;
+    UCHAR State;
+
+    if (Node == ROUTE_NONE)
+        return NULL;
+
+    for (Current = Node; Current != ROUTE_NONE; Current = Table->Nodes[Current].Shorter) {
+        for (Route = Table->Nodes[Current].Route; Route != ROUTE_NONE; Route = Table->Routes[Route].Next) {
+            State = Table->Routes[Route].Router->State;
+            if (!(State & NUD_STALE) && !(State & NUD_INCOMPLETE))
+                return Table->Routes[Route].Router;
+        }
+    }
+
+    return Table->Routes[Table->Nodes[Node].Route].Router;
+}
+
+
+static
+VOID
+RouteLinkShorter(
+    PROUTE_TABLE Table,
+    ULONG Index,
+    ULONG Shorter)
+/*
+ * FUNCTION: Links every node to the closest ancestor that has routes
+ * ARGUMENTS:
+ *     Table   = Pointer to the snapshot
+ *     Index   = Node to start from
+ *     Shorter = Closest ancestor of Index with routes or ROUTE_NONE
+ * NOTES:
+ *     Prefix lengths grow along every path, so this recurses at most
+ *     33 levels deep
+ */
+{
+    PROUTE_NODE Node = &Table->Nodes[Index];
+    ULONG Bit;
+
+    Node->Shorter = Shorter;
+    if (Node->Route != ROUTE_NONE)
+        Shorter = Index;
+
+    for (Bit = 0; Bit < 2; Bit++) {
+        if (Node->Child[Bit])
+            RouteLinkShorter(Table, Node->Child[Bit], Shorter);
+    }
+}
+
+
+static
+PROUTE_TABLE
+RouteBuildTable(
+    VOID)
+/*
+ * FUNCTION: Builds a lookup snapshot of the forward information base
+ * RETURNS:
+ *     Pointer to the snapshot, NULL if there wasn't enough memory
+ * NOTES:
+ *     The forward information base lock must be held when called
+ */
+{
+    PLIST_ENTRY CurrentEntry;
+    PFIB_ENTRY Current;
+    PROUTE_TABLE Table;
+    ULONG Count = 0, CacheSize, i;
+
+    for (CurrentEntry = FIBListHead.Flink;
+         CurrentEntry != &FIBListHead;
+         CurrentEntry = CurrentEntry->Flink) {
+        Current = CONTAINING_RECORD(CurrentEntry, FIB_ENTRY, ListEntry);
+        if (Current->NetworkAddress.Type == IP_ADDRESS_V4)
+            Count++;
+    }
+
+    CacheSize = KeNumberProcessors * ROUTE_CACHE_SIZE;
+    Table = ExAllocatePoolWithTag(NonPagedPool,
+                                  sizeof(ROUTE_TABLE) +
+                                  Count * sizeof(ROUTE_INFO) +
+                                  (2 * Count + 1) * sizeof(ROUTE_NODE) +
+                                  CacheSize * sizeof(ROUTE_CACHE_ENTRY),
+                                  ROUTE_TABLE_TAG);
+    if (!Table) {
+        TI_DbgPrint(MIN_TRACE, ("Insufficient resources.\n"));
+        return NULL;
+    }
+
+    Table->Routes     = (PROUTE_INFO)(Table + 1);
+    Table->Nodes      = (PROUTE_NODE)(Table->Routes + Count);
+    Table->Cache      = (PROUTE_CACHE_ENTRY)(Table->Nodes + 2 * Count + 1);
+    Table->RouteCount = 0;
+    Table->NodeCount  = 0;
+
+    for (i = 0; i < CacheSize; i++)
+        Table->Cache[i].Node = ROUTE_EMPTY;
+
+    /* The root covers 0.0.0.0/0 */
+    RouteNewNode(Table, 0, 0);
+
+    for (CurrentEntry = FIBListHead.Flink;
+         CurrentEntry != &FIBListHead;
+         CurrentEntry = CurrentEntry->Flink) {
+        Current = CONTAINING_RECORD(CurrentEntry, FIB_ENTRY, ListEntry);
+        if (Current->NetworkAddress.Type != IP_ADDRESS_V4)
+            continue;
+
+        RouteInsert(Table,
+                    IPv4NToHl(Current->NetworkAddress.Address.IPv4Address),
+                    AddrCountPrefixBits(&Current->Netmask),
+                    Current->Router,
+                    Current->Metric);
+    }
+
+    RouteLinkShorter(Table, 0, ROUTE_NONE);
+
+    TI_DbgPrint(DEBUG_ROUTER, ("Built route table with %d routes, %d nodes\n",
+                               Table->RouteCount, Table->NodeCount));
+
+    return Table;
+}
+
+
+static
+PROUTE_TABLE
+RouteUpdateTable(
+    VOID)
+/*
+ * FUNCTION: Publishes a new lookup snapshot after the FIB changed
+ * RETURNS:
+ *     The snapshot that was replaced, to be released with RouteFreeTable
+ * NOTES:
+ *     The forward information base lock must be held when called.
+ *     If no snapshot can be built, lookups fall back to the FIB list.
+ *     The FIB only changes on route and interface configuration, and
+ *     a snapshot is a single allocation linear in the number of routes,
+ *     so it is rebuilt in full rather than patched
+ */
+{
+    return InterlockedExchangePointer((PVOID volatile *)&RouteTable,
+                                      RouteBuildTable());
+}
+
+
+static
+VOID
+NTAPI
+RouteFreeTableWorker(
+    PVOID Context)
+{
+    CCHAR i;
+
+    /* Lookups run at DISPATCH_LEVEL, so once this thread has been scheduled
+     * on a processor no lookup that could see the old snapshot is left there */
+    for (i = 0; i < KeNumberProcessors; i++)
+        KeSetSystemAffinityThread((KAFFINITY)1 << i);
+    KeRevertToUserAffinityThread();
+
+    ExFreePoolWithTag(Context, ROUTE_TABLE_TAG);
+}
+
+
+static
+VOID
+RouteFreeTable(
+    PROUTE_TABLE Table)
+/*
+ * FUNCTION: Frees a replaced snapshot once no lookup can be using it
+ * ARGUMENTS:
+ *     Table = Pointer to the snapshot, may be NULL
+ */
+{
+    if (!Table)
+        return;
+
+    if (KeGetCurrentIrql() == PASSIVE_LEVEL) {
+        RouteFreeTableWorker(Table);
+        return;
+    }
+
+    ExInitializeWorkItem(&Table->WorkItem, RouteFreeTableWorker, Table);
+    ExQueueWorkItem(&Table->WorkItem, DelayedWorkQueue);
+}
+
+
 PFIB_ENTRY RouterAddRoute(
     PIP_ADDRESS NetworkAddress,
     PIP_ADDRESS Netmask,
@@ -206,7 +615,9 @@ PFIB_ENTRY RouterAddRoute(
  *     these references
  */
 {
+    KIRQL OldIrql;
     PFIB_ENTRY FIBE;
+    PROUTE_TABLE OldTable;
 
     TI_DbgPrint(DEBUG_ROUTER, ("Called. NetworkAddress (0x%X)  Netmask (0x%X) "
         "Router (0x%X)  Metric (%d).\n", NetworkAddress, Netmask, Router, Metric));
@@ -230,21 +641,29 @@ PFIB_ENTRY RouterAddRoute(
     FIBE->Metric         = Metric;
 
     /* Add FIB to the forward information base */
-    TcpipInterlockedInsertTailList(&FIBListHead, &FIBE->ListEntry, &FIBLock);
+    TcpipAcquireSpinLock(&FIBLock, &OldIrql);
+    InsertTailList(&FIBListHead, &FIBE->ListEntry);
+    OldTable = RouteUpdateTable();
+    TcpipReleaseSpinLock(&FIBLock, OldIrql);
+
+    RouteFreeTable(OldTable);
 
     return FIBE;
 }
 
 
-PNEIGHBOR_CACHE_ENTRY RouterGetRoute(PIP_ADDRESS Destination)
+static
+PNEIGHBOR_CACHE_ENTRY
+RouterSearchFIB(
+    PIP_ADDRESS Destination)
 /*
- * FUNCTION: Finds a router to use to get to Destination
+ * FUNCTION: Finds a router by walking the forward information base
  * ARGUMENTS:
- *     Destination = Pointer to destination address (NULL means don't care)
+ *     Destination = Pointer to destination address
  * RETURNS:
  *     Pointer to NCE for router, NULL if none was found
  * NOTES:
- *     If found the NCE is referenced
+ *     Only used when there is no lookup snapshot
  */
 {
     KIRQL OldIrql;
@@ -255,10 +674,6 @@ PNEIGHBOR_CACHE_ENTRY RouterGetRoute(PIP_ADDRESS Destination)
     UINT Length, BestLength = 0, MaskLength;
     PNEIGHBOR_CACHE_ENTRY NCE, BestNCE = NULL;
 
-    TI_DbgPrint(DEBUG_ROUTER, ("Called. Destination (0x%X)\n", Destination));
-
-    TI_DbgPrint(DEBUG_ROUTER, ("Destination (%s)\n", A2S(Destination)));
-
     TcpipAcquireSpinLock(&FIBLock, &OldIrql);
 
     CurrentEntry = FIBListHead.Flink;
@@ -288,6 +703,53 @@ PNEIGHBOR_CACHE_ENTRY RouterGetRoute(PIP_ADDRESS Destination)
 
     TcpipReleaseSpinLock(&FIBLock, OldIrql);
 
+    return BestNCE;
+}
+
+
+PNEIGHBOR_CACHE_ENTRY RouterGetRoute(PIP_ADDRESS Destination)
+/*
+ * FUNCTION: Finds a router to use to get to Destination
+ * ARGUMENTS:
+ *     Destination = Pointer to destination address (NULL means don't care)
+ * RETURNS:
+ *     Pointer to NCE for router, NULL if none was found
+ * NOTES:
+ *     If found the NCE is referenced
+ */
+{
+    KIRQL OldIrql;
+    PROUTE_TABLE Table;
+    PROUTE_CACHE_ENTRY Entry;
+    ULONG Address;
+    PNEIGHBOR_CACHE_ENTRY BestNCE;
+
+    TI_DbgPrint(DEBUG_ROUTER, ("Called. Destination (0x%X)\n", Destination));
+
+    TI_DbgPrint(DEBUG_ROUTER, ("Destination (%s)\n", A2S(Destination)));
+
+    /* Stay at DISPATCH_LEVEL while we look at the snapshot, see RouteFreeTable */
+    KeRaiseIrql(DISPATCH_LEVEL, &OldIrql);
+
+    Table = RouteTable;
+    if (Table && Destination->Type == IP_ADDRESS_V4) {
+        Address = IPv4NToHl(Destination->Address.IPv4Address);
+
+        /* Nothing else runs on this processor's part of the cache */
+        Entry = &Table->Cache[KeGetCurrentProcessorNumber() * ROUTE_CACHE_SIZE +
+                              RouteCacheHash(Address)];
+        if (Entry->Node == ROUTE_EMPTY || Entry->Destination != Address) {
+            Entry->Destination = Address;
+            Entry->Node        = RouteLookup(Table, Address);
+        }
+
+        BestNCE = RouteSelectRouter(Table, Entry->Node);
+        KeLowerIrql(OldIrql);
+    } else {
+        KeLowerIrql(OldIrql);
+        BestNCE = RouterSearchFIB(Destination);
+    }
+
     if( BestNCE ) {
 	TI_DbgPrint(DEBUG_ROUTER,("Routing to %s\n", A2S(&BestNCE->Address)));
     } else {
@@ -344,6 +806,8 @@ VOID RouterRemoveRoutesForInterface(PIP_INTERFACE Interface)
     PLIST_ENTRY CurrentEntry;
     PLIST_ENTRY NextEntry;
     PFIB_ENTRY Current;
+    PROUTE_TABLE OldTable = NULL;
+    BOOLEAN Removed = FALSE;
     
     TcpipAcquireSpinLock(&FIBLock, &OldIrql);
     
@@ -352,13 +816,20 @@ VOID RouterRemoveRoutesForInterface(PIP_INTERFACE Interface)
         NextEntry = CurrentEntry->Flink;
         Current = CONTAINING_RECORD(CurrentEntry, FIB_ENTRY, ListEntry);
 
-        if (Interface == Current->Router->Interface)
+        if (Interface == Current->Router->Interface) {
             DestroyFIBE(Current);
+            Removed = TRUE;
+        }
 
         CurrentEntry = NextEntry;
     }
+
+    if (Removed)
+        OldTable = RouteUpdateTable();
     
     TcpipReleaseSpinLock(&FIBLock, OldIrql);
+
+    RouteFreeTable(OldTable);
 }
 
 NTSTATUS RouterRemoveRoute(PIP_ADDRESS Target, PIP_ADDRESS Router)
@@ -377,6 +848,7 @@ NTSTATUS RouterRemoveRoute(PIP_ADDRESS Target, PIP_ADDRESS Router)
     PFIB_ENTRY Current;
     BOOLEAN Found = FALSE;
     PNEIGHBOR_CACHE_ENTRY NCE;
+    PROUTE_TABLE OldTable = NULL;
 
     TI_DbgPrint(DEBUG_ROUTER, ("Called\n"));
     TI_DbgPrint(DEBUG_ROUTER, ("Deleting Route From: %s\n", A2S(Router)));
@@ -406,12 +878,15 @@ NTSTATUS RouterRemoveRoute(PIP_ADDRESS Target, PIP_ADDRESS Router)
     if( Found ) {
         TI_DbgPrint(DEBUG_ROUTER, ("Deleting route\n"));
         DestroyFIBE( Current );
+        OldTable = RouteUpdateTable();
     }
 
     RouterDumpRoutes();
 
     TcpipReleaseSpinLock(&FIBLock, OldIrql);
 
+    RouteFreeTable(OldTable);
+
     TI_DbgPrint(DEBUG_ROUTER, ("Leaving\n"));
 
     return Found ? STATUS_SUCCESS : STATUS_UNSUCCESSFUL;
@@ -493,6 +968,9 @@ NTSTATUS RouterStartup(
     InitializeListHead(&FIBListHead);
     TcpipInitializeSpinLock(&FIBLock);
 
+    /* And its empty lookup snapshot */
+    RouteTable = RouteBuildTable();
+
     return STATUS_SUCCESS;
 }
 
@@ -506,14 +984,18 @@ NTSTATUS RouterShutdown(
  */
 {
     KIRQL OldIrql;
+    PROUTE_TABLE OldTable;
 
     TI_DbgPrint(DEBUG_ROUTER, ("Called.\n"));
 
     /* Clear Forward Information Base */
     TcpipAcquireSpinLock(&FIBLock, &OldIrql);
     DestroyFIBEs();
+    OldTable = InterlockedExchangePointer((PVOID volatile *)&RouteTable, NULL);
     TcpipReleaseSpinLock(&FIBLock, OldIrql);
 
+    RouteFreeTable(OldTable);
+
     return STATUS_SUCCESS;
 }
 
@@ -347,7 +347,7 @@ NTSTATUS TCPConnect
             if (NT_SUCCESS(Status))
             {
                 /* Allocate the port in the port bitmap */
-                Connection->AddressFile->Port = TCPAllocatePort(LocalAddress.Address[0].Address[0].sin_port);
+                AddrFileSetPort(Connection->AddressFile, TCPAllocatePort(LocalAddress.Address[0].Address[0].sin_port));
                     
                 /* This should never fail */
                 ASSERT(Connection->AddressFile->Port != 0xFFFF);
@@ -691,5 +691,19 @@ TCPSetNoDelay(
     return STATUS_SUCCESS;
 }
 
+NTSTATUS
+TCPSetWindow(
+    PCONNECTION_ENDPOINT Connection,
+    ULONG Size)
+{
+    if (!Connection)
+        return STATUS_UNSUCCESSFUL;
+
+    if (Connection->SocketContext == NULL)
+        return STATUS_UNSUCCESSFUL;
+
+    return TCPTranslateError(LibTCPSetWindow(Connection, Size));
+}
+
 
 /* EOF */
@@ -112,9 +112,24 @@
   #error "MEMP_NUM_REASSDATA > IP_REASS_MAX_PBUFS doesn't make sense since each struct ip_reassdata must hold 2 pbufs at least!"
 #endif
 #endif /* !MEMP_MEM_MALLOC */
-#if (LWIP_TCP && (TCP_WND > 0xffff))
+#if (LWIP_TCP && !LWIP_WND_SCALE && (TCP_WND > 0xffff))
   #error "If you want to use TCP, TCP_WND must fit in an u16_t, so, you have to reduce it in your lwipopts.h"
 #endif
+#if (LWIP_TCP && !LWIP_WND_SCALE && ((TCP_SND_BUF > 0xffff) || (TCP_WND_MAX > 0xffff)))
+  #error "TCP_SND_BUF and TCP_WND_MAX must fit in an u16_t without LWIP_WND_SCALE, so, you have to reduce them in your lwipopts.h"
+#endif
+#if (LWIP_TCP && LWIP_WND_SCALE && ((TCP_RCV_SCALE > 14) || (TCP_WND_MAX > (0xffffUL << TCP_RCV_SCALE))))
+  #error "TCP_RCV_SCALE must be 14 at most and TCP_WND_MAX must fit in (0xffff << TCP_RCV_SCALE), so, you have to reduce them in your lwipopts.h"
+#endif
+#if (LWIP_TCP && (TCP_WND_MAX < TCP_WND))
+  #error "TCP_WND_MAX must be at least TCP_WND, so, you have to change it in your lwipopts.h"
+#endif
+#if (LWIP_TCP && LWIP_TCP_RCV_AUTOTUNE && !LWIP_TCP_TIMESTAMPS)
+  #error "LWIP_TCP_RCV_AUTOTUNE needs LWIP_TCP_TIMESTAMPS to measure the round-trip time, so, you have to enable it in your lwipopts.h"
+#endif
+#if (LWIP_TCP && LWIP_TCP_SACK_OUT && !TCP_QUEUE_OOSEQ)
+  #error "LWIP_TCP_SACK_OUT needs TCP_QUEUE_OOSEQ to know what to acknowledge selectively, so, you have to enable it in your lwipopts.h"
+#endif
 #if (LWIP_TCP && (TCP_SND_QUEUELEN > 0xffff))
   #error "If you want to use TCP, TCP_SND_QUEUELEN must fit in an u16_t, so, you have to reduce it in your lwipopts.h"
 #endif
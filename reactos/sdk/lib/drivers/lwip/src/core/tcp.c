@@ -172,7 +172,7 @@ tcp_close_shutdown(struct tcp_pcb *pcb, u8_t rst_on_unacked_data)
   err_t err;
 
   if (rst_on_unacked_data && ((pcb->state == ESTABLISHED) || (pcb->state == CLOSE_WAIT))) {
-    if ((pcb->refused_data != NULL) || (pcb->rcv_wnd != TCP_WND)) {
+    if ((pcb->refused_data != NULL) || (pcb->rcv_wnd != pcb->rcv_wnd_max)) {
       /* Not all data received by application, send RST to tell the remote
          side about this. */
       LWIP_ASSERT("pcb->flags & TF_RXCLOSED", pcb->flags & TF_RXCLOSED);
@@ -580,7 +580,7 @@ u32_t tcp_update_rcv_ann_wnd(struct tcp_pcb *pcb)
 {
   u32_t new_right_edge = pcb->rcv_nxt + pcb->rcv_wnd;
 
-  if (TCP_SEQ_GEQ(new_right_edge, pcb->rcv_ann_right_edge + LWIP_MIN((TCP_WND / 2), pcb->mss))) {
+  if (TCP_SEQ_GEQ(new_right_edge, pcb->rcv_ann_right_edge + LWIP_MIN((pcb->rcv_wnd_max / 2), pcb->mss))) {
     /* we can advertise more window */
     pcb->rcv_ann_wnd = pcb->rcv_wnd;
     return new_right_edge - pcb->rcv_ann_right_edge;
@@ -592,8 +592,10 @@ u32_t tcp_update_rcv_ann_wnd(struct tcp_pcb *pcb)
     } else {
       /* keep the right edge of window constant */
       u32_t new_rcv_ann_wnd = pcb->rcv_ann_right_edge - pcb->rcv_nxt;
+#if !LWIP_WND_SCALE
       LWIP_ASSERT("new_rcv_ann_wnd <= 0xffff", new_rcv_ann_wnd <= 0xffff);
-      pcb->rcv_ann_wnd = (u16_t)new_rcv_ann_wnd;
+#endif /* !LWIP_WND_SCALE */
+      pcb->rcv_ann_wnd = (tcpwnd_size_t)new_rcv_ann_wnd;
     }
     return 0;
   }
@@ -611,16 +613,19 @@ void
 tcp_recved(struct tcp_pcb *pcb, u16_t len)
 {
   int wnd_inflation;
+  tcpwnd_size_t rcv_wnd;
 
   /* pcb->state LISTEN not allowed here */
   LWIP_ASSERT("don't call tcp_recved for listen-pcbs",
     pcb->state != LISTEN);
-  LWIP_ASSERT("tcp_recved: len would wrap rcv_wnd\n",
-              len <= 0xffff - pcb->rcv_wnd );
 
-  pcb->rcv_wnd += len;
-  if (pcb->rcv_wnd > TCP_WND) {
-    pcb->rcv_wnd = TCP_WND;
+  /* The window may have been made smaller by tcp_set_rcv_wnd() since the
+     data was received, so clamp instead of asserting */
+  rcv_wnd = pcb->rcv_wnd + len;
+  if ((rcv_wnd > pcb->rcv_wnd_max) || (rcv_wnd < pcb->rcv_wnd)) {
+    pcb->rcv_wnd = pcb->rcv_wnd_max;
+  } else {
+    pcb->rcv_wnd = rcv_wnd;
   }
 
   wnd_inflation = tcp_update_rcv_ann_wnd(pcb);
@@ -634,8 +639,52 @@ tcp_recved(struct tcp_pcb *pcb, u16_t len)
     tcp_output(pcb);
   }
 
-  LWIP_DEBUGF(TCP_DEBUG, ("tcp_recved: recveived %"U16_F" bytes, wnd %"U16_F" (%"U16_F").\n",
-         len, pcb->rcv_wnd, TCP_WND - pcb->rcv_wnd));
+  LWIP_DEBUGF(TCP_DEBUG, ("tcp_recved: recveived %"U16_F" bytes, wnd %"U32_F" (%"U32_F").\n",
+         len, (u32_t)pcb->rcv_wnd, (u32_t)(pcb->rcv_wnd_max - pcb->rcv_wnd)));
+}
+
+/**
+ * Sets the size of the receive window of a connection, which also stops
+ * it from being auto-tuned. A bigger window is announced right away, a
+ * smaller one takes effect as the window is used up (the announced right
+ * edge of the window is never moved back).
+ *
+ * @param pcb the tcp_pcb to set the receive window of
+ * @param wnd the new size of the receive window in bytes
+ */
+void
+tcp_set_rcv_wnd(struct tcp_pcb *pcb, u32_t wnd)
+{
+  LWIP_ASSERT("don't call tcp_set_rcv_wnd for listen-pcbs",
+    pcb->state != LISTEN);
+
+  /* Keep at least one full segment, and within what the header can carry */
+  wnd = LWIP_MAX(wnd, TCP_MSS);
+  wnd = LWIP_MIN(wnd, TCP_WND_MAX);
+#if LWIP_WND_SCALE
+  if ((pcb->state != CLOSED) && (pcb->state != SYN_SENT) &&
+      !(pcb->flags & TF_WND_SCALE)) {
+    /* The remote host did not agree to window scaling */
+    wnd = TCPWND16(wnd);
+  }
+#endif /* LWIP_WND_SCALE */
+
+  pcb->rcv_wnd_limit = (tcpwnd_size_t)wnd;
+  if (pcb->rcv_wnd_limit > pcb->rcv_wnd_max) {
+    pcb->rcv_wnd += pcb->rcv_wnd_limit - pcb->rcv_wnd_max;
+    pcb->rcv_wnd_max = pcb->rcv_wnd_limit;
+    if ((pcb->state == CLOSED) || (pcb->state == SYN_SENT)) {
+      /* Nothing announced yet, the SYN carries the new window */
+      pcb->rcv_ann_wnd = pcb->rcv_wnd;
+    } else if (tcp_update_rcv_ann_wnd(pcb) >= TCP_WND_UPDATE_THRESHOLD) {
+      tcp_ack_now(pcb);
+      tcp_output(pcb);
+    }
+  } else {
+    pcb->rcv_wnd_max = pcb->rcv_wnd_limit;
+  }
+
+  LWIP_DEBUGF(TCP_DEBUG, ("tcp_set_rcv_wnd: wnd %"U32_F"\n", (u32_t)pcb->rcv_wnd_max));
 }
 
 /**
@@ -743,8 +792,9 @@ tcp_connect(struct tcp_pcb *pcb, ip_addr_t *ipaddr, u16_t port,
   pcb->snd_nxt = iss;
   pcb->lastack = iss - 1;
   pcb->snd_lbb = iss - 1;
-  pcb->rcv_wnd = TCP_WND;
-  pcb->rcv_ann_wnd = TCP_WND;
+  /* Keep a receive window set before connecting */
+  pcb->rcv_wnd = pcb->rcv_wnd_max;
+  pcb->rcv_ann_wnd = pcb->rcv_wnd_max;
   pcb->rcv_ann_right_edge = pcb->rcv_nxt;
   pcb->snd_wnd = TCP_WND;
   /* As initial send MSS, we use TCP_MSS but limit it to 536.
@@ -788,7 +838,7 @@ void
 tcp_slowtmr(void)
 {
   struct tcp_pcb *pcb, *prev;
-  u16_t eff_wnd;
+  tcpwnd_size_t eff_wnd;
   u8_t pcb_remove;      /* flag if a PCB should be removed */
   u8_t pcb_reset;       /* flag if a RST should be sent when removing */
   err_t err;
@@ -1098,7 +1148,7 @@ tcp_process_refused_data(struct tcp_pcb *pcb)
     if (refused_flags & PBUF_FLAG_TCP_FIN) {
       /* correct rcv_wnd as the application won't call tcp_recved()
          for the FIN's seqno */
-      if (pcb->rcv_wnd != TCP_WND) {
+      if (pcb->rcv_wnd != pcb->rcv_wnd_max) {
         pcb->rcv_wnd++;
       }
       TCP_EVENT_CLOSED(pcb, err);
@@ -1310,6 +1360,8 @@ tcp_alloc(u8_t prio)
     pcb->snd_queuelen = 0;
     pcb->rcv_wnd = TCP_WND;
     pcb->rcv_ann_wnd = TCP_WND;
+    pcb->rcv_wnd_max = TCP_WND;
+    pcb->rcv_wnd_limit = TCP_WND_MAX;
     pcb->tos = 0;
     pcb->ttl = TCP_TTL;
     /* As initial send MSS, we use TCP_MSS but limit it to 536.
@@ -54,6 +54,9 @@
 #include "lwip/inet_chksum.h"
 #include "lwip/stats.h"
 #include "lwip/snmp.h"
+#if LWIP_TCP_RCV_AUTOTUNE
+#include "lwip/sys.h"
+#endif
 #include "arch/perf.h"
 
 /* These variables are global to all functions involved in the input
@@ -78,6 +81,13 @@ static void tcp_parseopt(struct tcp_pcb *pcb);
 
 static err_t tcp_listen_input(struct tcp_pcb_listen *pcb);
 static err_t tcp_timewait_input(struct tcp_pcb *pcb);
+#if LWIP_WND_SCALE
+static void tcp_wnd_scale_negotiated(struct tcp_pcb *pcb);
+#endif /* LWIP_WND_SCALE */
+#if LWIP_TCP_RCV_AUTOTUNE
+static void tcp_rcv_rtt_sample(struct tcp_pcb *pcb, u32_t tsecr);
+static void tcp_rcv_autotune(struct tcp_pcb *pcb);
+#endif /* LWIP_TCP_RCV_AUTOTUNE */
 
 /**
  * The initial input processing of TCP. It verifies the TCP header, demultiplexes
@@ -330,9 +340,16 @@ tcp_input(struct pbuf *p, struct netif *inp)
            called when new send buffer space is available, we call it
            now. */
         if (pcb->acked > 0) {
-          TCP_EVENT_SENT(pcb, pcb->acked, err);
-          if (err == ERR_ABRT) {
-            goto aborted;
+          tcpwnd_size_t acked = pcb->acked;
+          u16_t acked16;
+          /* The sent callback takes an u16_t, so report big ACKs in pieces */
+          while (acked > 0) {
+            acked16 = TCPWND16(acked);
+            acked -= acked16;
+            TCP_EVENT_SENT(pcb, acked16, err);
+            if (err == ERR_ABRT) {
+              goto aborted;
+            }
           }
         }
 
@@ -368,7 +385,7 @@ tcp_input(struct pbuf *p, struct netif *inp)
           } else {
             /* correct rcv_wnd as the application won't call tcp_recved()
                for the FIN's seqno */
-            if (pcb->rcv_wnd != TCP_WND) {
+            if (pcb->rcv_wnd != pcb->rcv_wnd_max) {
               pcb->rcv_wnd++;
             }
             TCP_EVENT_CLOSED(pcb, err);
@@ -499,6 +516,9 @@ tcp_listen_input(struct tcp_pcb_listen *pcb)
 
     /* Parse any options in the SYN. */
     tcp_parseopt(npcb);
+#if LWIP_WND_SCALE
+    tcp_wnd_scale_negotiated(npcb);
+#endif /* LWIP_WND_SCALE */
 #if TCP_CALCULATE_EFF_SEND_MSS
     npcb->mss = tcp_eff_send_mss(npcb->mss, &(npcb->remote_ip));
 #endif /* TCP_CALCULATE_EFF_SEND_MSS */
@@ -639,6 +659,9 @@ tcp_process(struct tcp_pcb *pcb)
       pcb->snd_wnd_max = tcphdr->wnd;
       pcb->snd_wl1 = seqno - 1; /* initialise to seqno - 1 to force window update */
       pcb->state = ESTABLISHED;
+#if LWIP_WND_SCALE
+      tcp_wnd_scale_negotiated(pcb);
+#endif /* LWIP_WND_SCALE */
 
 #if TCP_CALCULATE_EFF_SEND_MSS
       pcb->mss = tcp_eff_send_mss(pcb->mss, &(pcb->remote_ip));
@@ -684,7 +707,7 @@ tcp_process(struct tcp_pcb *pcb)
     if (flags & TCP_ACK) {
       /* expected ACK number? */
       if (TCP_SEQ_BETWEEN(ackno, pcb->lastack+1, pcb->snd_nxt)) {
-        u16_t old_cwnd;
+        tcpwnd_size_t old_cwnd;
         pcb->state = ESTABLISHED;
         LWIP_DEBUGF(TCP_DEBUG, ("TCP connection established %"U16_F" -> %"U16_F".\n", inseg.tcphdr->src, inseg.tcphdr->dest));
 #if LWIP_CALLBACK_API
@@ -856,6 +879,7 @@ tcp_receive(struct tcp_pcb *pcb)
   u32_t right_wnd_edge;
   u16_t new_tot_len;
   int found_dupack = 0;
+  tcpwnd_size_t wnd;
 #if TCP_OOSEQ_MAX_BYTES || TCP_OOSEQ_MAX_PBUFS
   u32_t ooseq_blen;
   u16_t ooseq_qlen;
@@ -866,15 +890,18 @@ tcp_receive(struct tcp_pcb *pcb)
   if (flags & TCP_ACK) {
     right_wnd_edge = pcb->snd_wnd + pcb->snd_wl2;
 
+    /* The window field of segments other than SYNs is scaled */
+    wnd = (flags & TCP_SYN) ? tcphdr->wnd : SND_WND_SCALE(pcb, tcphdr->wnd);
+
     /* Update window. */
     if (TCP_SEQ_LT(pcb->snd_wl1, seqno) ||
        (pcb->snd_wl1 == seqno && TCP_SEQ_LT(pcb->snd_wl2, ackno)) ||
-       (pcb->snd_wl2 == ackno && tcphdr->wnd > pcb->snd_wnd)) {
-      pcb->snd_wnd = tcphdr->wnd;
+       (pcb->snd_wl2 == ackno && wnd > pcb->snd_wnd)) {
+      pcb->snd_wnd = wnd;
       /* keep track of the biggest window announced by the remote host to calculate
          the maximum segment size */
-      if (pcb->snd_wnd_max < tcphdr->wnd) {
-        pcb->snd_wnd_max = tcphdr->wnd;
+      if (pcb->snd_wnd_max < wnd) {
+        pcb->snd_wnd_max = wnd;
       }
       pcb->snd_wl1 = seqno;
       pcb->snd_wl2 = ackno;
@@ -891,7 +918,7 @@ tcp_receive(struct tcp_pcb *pcb)
       LWIP_DEBUGF(TCP_WND_DEBUG, ("tcp_receive: window update %"U16_F"\n", pcb->snd_wnd));
 #if TCP_WND_DEBUG
     } else {
-      if (pcb->snd_wnd != tcphdr->wnd) {
+      if (pcb->snd_wnd != wnd) {
         LWIP_DEBUGF(TCP_WND_DEBUG, 
                     ("tcp_receive: no window update lastack %"U32_F" ackno %"
                      U32_F" wl1 %"U32_F" seqno %"U32_F" wl2 %"U32_F"\n",
@@ -938,7 +965,7 @@ tcp_receive(struct tcp_pcb *pcb)
               if (pcb->dupacks > 3) {
                 /* Inflate the congestion window, but not if it means that
                    the value overflows. */
-                if ((u16_t)(pcb->cwnd + pcb->mss) > pcb->cwnd) {
+                if ((tcpwnd_size_t)(pcb->cwnd + pcb->mss) > pcb->cwnd) {
                   pcb->cwnd += pcb->mss;
                 }
               } else if (pcb->dupacks == 3) {
@@ -971,8 +998,9 @@ tcp_receive(struct tcp_pcb *pcb)
       /* Reset the retransmission time-out. */
       pcb->rto = (pcb->sa >> 3) + pcb->sv;
 
-      /* Update the send buffer space. Diff between the two can never exceed 64K? */
-      pcb->acked = (u16_t)(ackno - pcb->lastack);
+      /* Update the send buffer space. Diff between the two can never exceed
+         the send window. */
+      pcb->acked = (tcpwnd_size_t)(ackno - pcb->lastack);
 
       pcb->snd_buf += pcb->acked;
 
@@ -984,12 +1012,12 @@ tcp_receive(struct tcp_pcb *pcb)
          ssthresh). */
       if (pcb->state >= ESTABLISHED) {
         if (pcb->cwnd < pcb->ssthresh) {
-          if ((u16_t)(pcb->cwnd + pcb->mss) > pcb->cwnd) {
+          if ((tcpwnd_size_t)(pcb->cwnd + pcb->mss) > pcb->cwnd) {
             pcb->cwnd += pcb->mss;
           }
           LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: slow start cwnd %"U16_F"\n", pcb->cwnd));
         } else {
-          u16_t new_cwnd = (pcb->cwnd + pcb->mss * pcb->mss / pcb->cwnd);
+          tcpwnd_size_t new_cwnd = (pcb->cwnd + pcb->mss * pcb->mss / pcb->cwnd);
           if (new_cwnd > pcb->cwnd) {
             pcb->cwnd = new_cwnd;
           }
@@ -1230,7 +1258,7 @@ tcp_receive(struct tcp_pcb *pcb)
             TCPH_FLAGS_SET(inseg.tcphdr, TCPH_FLAGS(inseg.tcphdr) &~ TCP_FIN);
           }
           /* Adjust length of segment to fit in the window. */
-          inseg.len = pcb->rcv_wnd;
+          inseg.len = (u16_t)pcb->rcv_wnd;
           if (TCPH_FLAGS(inseg.tcphdr) & TCP_SYN) {
             inseg.len -= 1;
           }
@@ -1360,13 +1388,15 @@ tcp_receive(struct tcp_pcb *pcb)
         }
 #endif /* TCP_QUEUE_OOSEQ */
 
+#if LWIP_TCP_RCV_AUTOTUNE
+        tcp_rcv_autotune(pcb);
+#endif /* LWIP_TCP_RCV_AUTOTUNE */
 
         /* Acknowledge the segment(s). */
         tcp_ack(pcb);
 
       } else {
         /* We get here if the incoming segment is out-of-sequence. */
-        tcp_send_empty_ack(pcb);
 #if TCP_QUEUE_OOSEQ
         /* We queue the segment on the ->ooseq queue. */
         if (pcb->ooseq == NULL) {
@@ -1475,7 +1505,7 @@ tcp_receive(struct tcp_pcb *pcb)
                       TCPH_FLAGS_SET(next->next->tcphdr, TCPH_FLAGS(next->next->tcphdr) &~ TCP_FIN);
                     }
                     /* Adjust length of segment to fit in the window. */
-                    next->next->len = pcb->rcv_nxt + pcb->rcv_wnd - seqno;
+                    next->next->len = (u16_t)(pcb->rcv_nxt + pcb->rcv_wnd - seqno);
                     pbuf_realloc(next->next->p, next->next->len);
                     tcplen = TCP_TCPLEN(next->next);
                     LWIP_ASSERT("tcp_receive: segment not trimmed correctly to rcv_wnd\n",
@@ -1513,7 +1543,13 @@ tcp_receive(struct tcp_pcb *pcb)
           }
         }
 #endif /* TCP_OOSEQ_MAX_BYTES || TCP_OOSEQ_MAX_PBUFS */
+#if LWIP_TCP_SACK_OUT
+        /* The first SACK block has to cover the segment that triggered the ACK */
+        pcb->rcv_sack_seq = seqno;
+#endif /* LWIP_TCP_SACK_OUT */
 #endif /* TCP_QUEUE_OOSEQ */
+        /* The ACK is sent after queueing so its SACK blocks include this segment */
+        tcp_send_empty_ack(pcb);
       }
     } else {
       /* The incoming segment is not withing the window. */
@@ -1534,7 +1570,7 @@ tcp_receive(struct tcp_pcb *pcb)
  * Parses the options contained in the incoming segment. 
  *
  * Called from tcp_listen_input() and tcp_process().
- * Currently, only the MSS option is supported!
+ * Supports the MSS, window scale, SACK-permitted and timestamp options.
  *
  * @param pcb the tcp_pcb for which a segment arrived
  */
@@ -1546,6 +1582,9 @@ tcp_parseopt(struct tcp_pcb *pcb)
   u8_t *opts, opt;
 #if LWIP_TCP_TIMESTAMPS
   u32_t tsval;
+#if LWIP_TCP_RCV_AUTOTUNE
+  u32_t tsecr;
+#endif /* LWIP_TCP_RCV_AUTOTUNE */
 #endif
 
   opts = (u8_t *)tcphdr + TCP_HLEN;
@@ -1579,6 +1618,38 @@ tcp_parseopt(struct tcp_pcb *pcb)
         /* Advance to next option */
         c += 0x04;
         break;
+#if LWIP_WND_SCALE
+      case 0x03:
+        LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: WND_SCALE\n"));
+        if (opts[c + 1] != 0x03 || c + 0x03 > max_c) {
+          /* Bad length */
+          LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: bad length\n"));
+          return;
+        }
+        /* Only valid in SYNs, shift counts above 14 are treated as 14 (RFC 7323) */
+        if (flags & TCP_SYN) {
+          pcb->snd_scale = LWIP_MIN(opts[c + 2], 14);
+          pcb->flags |= TF_WND_SCALE;
+        }
+        /* Advance to next option */
+        c += 0x03;
+        break;
+#endif /* LWIP_WND_SCALE */
+#if LWIP_TCP_SACK_OUT
+      case 0x04:
+        LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: SACK_PERM\n"));
+        if (opts[c + 1] != 0x02 || c + 0x02 > max_c) {
+          /* Bad length */
+          LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: bad length\n"));
+          return;
+        }
+        if (flags & TCP_SYN) {
+          pcb->flags |= TF_SACK;
+        }
+        /* Advance to next option */
+        c += 0x02;
+        break;
+#endif /* LWIP_TCP_SACK_OUT */
 #if LWIP_TCP_TIMESTAMPS
       case 0x08:
         LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: TS\n"));
@@ -1596,6 +1667,14 @@ tcp_parseopt(struct tcp_pcb *pcb)
         } else if (TCP_SEQ_BETWEEN(pcb->ts_lastacksent, seqno, seqno+tcplen)) {
           pcb->ts_recent = ntohl(tsval);
         }
+#if LWIP_TCP_RCV_AUTOTUNE
+        /* Data segments echo the time of one of our ACKs */
+        tsecr = (opts[c+6]) | (opts[c+7] << 8) |
+          (opts[c+8] << 16) | (opts[c+9] << 24);
+        if (!(flags & TCP_SYN) && tcplen > 0 && tsecr != 0) {
+          tcp_rcv_rtt_sample(pcb, ntohl(tsecr));
+        }
+#endif /* LWIP_TCP_RCV_AUTOTUNE */
         /* Advance to next option */
         c += 0x0A;
         break;
@@ -1616,4 +1695,101 @@ tcp_parseopt(struct tcp_pcb *pcb)
   }
 }
 
+#if LWIP_WND_SCALE
+/**
+ * Settles the window scaling of a connection once the SYN of the remote
+ * host has been parsed. Scaling is only used when both sides offered it,
+ * otherwise our windows have to fit in the 16 bit header field again.
+ *
+ * @param pcb the tcp_pcb that got its SYN or SYN|ACK
+ */
+static void
+tcp_wnd_scale_negotiated(struct tcp_pcb *pcb)
+{
+  if (pcb->flags & TF_WND_SCALE) {
+    pcb->rcv_scale = TCP_RCV_SCALE;
+  } else {
+    pcb->snd_scale = 0;
+    pcb->rcv_scale = 0;
+    pcb->rcv_wnd_limit = TCPWND16(pcb->rcv_wnd_limit);
+    pcb->rcv_wnd_max = TCPWND16(pcb->rcv_wnd_max);
+    pcb->rcv_wnd = TCPWND16(pcb->rcv_wnd);
+    pcb->rcv_ann_wnd = TCPWND16(pcb->rcv_ann_wnd);
+  }
+}
+#endif /* LWIP_WND_SCALE */
+
+#if LWIP_TCP_RCV_AUTOTUNE
+/**
+ * Updates the receiver side round-trip time estimate from the echoed
+ * timestamp of an incoming data segment. Smaller samples are taken at
+ * once since a sender that idled in between only makes them larger.
+ *
+ * @param pcb the tcp_pcb for which a segment arrived
+ * @param tsecr the echoed timestamp (our sys_now() when we sent it)
+ */
+static void
+tcp_rcv_rtt_sample(struct tcp_pcb *pcb, u32_t tsecr)
+{
+  u32_t rtt = sys_now() - tsecr;
+
+  if (rtt == 0) {
+    rtt = 1;
+  } else if (rtt > 0x7FFFFFFF) {
+    /* tsecr from the future, ignore it */
+    return;
+  }
+
+  if (pcb->rcv_rtt == 0 || rtt < pcb->rcv_rtt) {
+    pcb->rcv_rtt = rtt;
+  } else {
+    pcb->rcv_rtt = (7 * pcb->rcv_rtt + rtt) / 8;
+  }
+}
+
+/**
+ * Receive window auto-tuning (dynamic right-sizing). Once per round-trip
+ * the amount of data received in it is compared to the best so far; if
+ * the peer sent more, the window is grown to twice that amount (up to
+ * rcv_wnd_limit) so that it never becomes the limiting factor.
+ *
+ * Called from tcp_receive() when in-sequence data has arrived.
+ *
+ * @param pcb the tcp_pcb that received data
+ */
+static void
+tcp_rcv_autotune(struct tcp_pcb *pcb)
+{
+  u32_t now = sys_now();
+  u32_t received;
+  tcpwnd_size_t wnd;
+
+  if (pcb->rcv_rtt == 0) {
+    /* No round-trip time measured yet, start the first period */
+    pcb->rcv_space_seq = pcb->rcv_nxt;
+    pcb->rcv_space_time = now;
+    return;
+  }
+  if ((u32_t)(now - pcb->rcv_space_time) < pcb->rcv_rtt) {
+    return;
+  }
+
+  received = pcb->rcv_nxt - pcb->rcv_space_seq;
+  if (received > pcb->rcv_space) {
+    pcb->rcv_space = received;
+    wnd = (tcpwnd_size_t)LWIP_MIN((u32_t)2 * received, (u32_t)pcb->rcv_wnd_limit);
+    if (wnd > pcb->rcv_wnd_max) {
+      LWIP_DEBUGF(TCP_WND_DEBUG, ("tcp_rcv_autotune: window %"U32_F" -> %"U32_F"\n",
+                                  (u32_t)pcb->rcv_wnd_max, (u32_t)wnd));
+      pcb->rcv_wnd += wnd - pcb->rcv_wnd_max;
+      pcb->rcv_wnd_max = wnd;
+      tcp_update_rcv_ann_wnd(pcb);
+    }
+  }
+
+  pcb->rcv_space_seq = pcb->rcv_nxt;
+  pcb->rcv_space_time = now;
+}
+#endif /* LWIP_TCP_RCV_AUTOTUNE */
+
 #endif /* LWIP_TCP */
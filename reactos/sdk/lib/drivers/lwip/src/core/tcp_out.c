@@ -105,7 +105,7 @@ tcp_output_alloc_header(struct tcp_pcb *pcb, u16_t optlen, u16_t datalen,
     tcphdr->seqno = seqno_be;
     tcphdr->ackno = htonl(pcb->rcv_nxt);
     TCPH_HDRLEN_FLAGS_SET(tcphdr, (5 + optlen / 4), TCP_ACK);
-    tcphdr->wnd = htons(pcb->rcv_ann_wnd);
+    tcphdr->wnd = htons(TCPWND16(RCV_WND_SCALE(pcb, pcb->rcv_ann_wnd)));
     tcphdr->chksum = 0;
     tcphdr->urgp = 0;
 
@@ -370,7 +370,7 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
 #endif /* TCP_CHECKSUM_ON_COPY */
   err_t err;
   /* don't allocate segments bigger than half the maximum window we ever received */
-  u16_t mss_local = LWIP_MIN(pcb->mss, pcb->snd_wnd_max/2);
+  u16_t mss_local = (u16_t)LWIP_MIN(pcb->mss, pcb->snd_wnd_max/2);
 
 #if LWIP_NETIF_TX_SINGLE_PBUF
   /* Always copy to try to create single pbufs for TX */
@@ -742,6 +742,22 @@ tcp_enqueue_flags(struct tcp_pcb *pcb, u8_t flags)
 
   if (flags & TCP_SYN) {
     optflags = TF_SEG_OPTS_MSS;
+    /* A SYN offers the options, a SYN|ACK only answers those offered */
+#if LWIP_TCP_TIMESTAMPS
+    if (pcb->state != SYN_RCVD) {
+      optflags |= TF_SEG_OPTS_TS;
+    }
+#endif /* LWIP_TCP_TIMESTAMPS */
+#if LWIP_WND_SCALE
+    if ((pcb->state != SYN_RCVD) || (pcb->flags & TF_WND_SCALE)) {
+      optflags |= TF_SEG_OPTS_WND_SCALE;
+    }
+#endif /* LWIP_WND_SCALE */
+#if LWIP_TCP_SACK_OUT
+    if ((pcb->state != SYN_RCVD) || (pcb->flags & TF_SACK)) {
+      optflags |= TF_SEG_OPTS_SACK_PERM;
+    }
+#endif /* LWIP_TCP_SACK_OUT */
   }
 #if LWIP_TCP_TIMESTAMPS
   if ((pcb->flags & TF_TIMESTAMP)) {
@@ -834,6 +850,49 @@ tcp_build_timestamp_option(struct tcp_pcb *pcb, u32_t *opts)
 }
 #endif
 
+#if LWIP_TCP_SACK_OUT && TCP_QUEUE_OOSEQ
+/**
+ * Collects the SACK blocks describing the data queued on ooseq. The block
+ * holding the segment that triggered the ACK has to come first (RFC 2018),
+ * the others follow in sequence order as far as they fit.
+ *
+ * @param pcb tcp_pcb
+ * @param edges where to store the left and right edge of each block
+ * @return number of blocks stored
+ */
+static u8_t
+tcp_build_sack_blocks(struct tcp_pcb *pcb, u32_t *edges)
+{
+  struct tcp_seg *seg;
+  u32_t left, right;
+  u8_t num = 0, max = LWIP_TCP_SACK_BLOCKS(pcb);
+  int pass, first;
+
+  for (pass = 0; pass < 2; pass++) {
+    seg = pcb->ooseq;
+    while ((seg != NULL) && (num < max)) {
+      /* ooseq is sorted, merge adjacent segments into one block */
+      left = seg->tcphdr->seqno;
+      right = left + TCP_TCPLEN(seg);
+      for (seg = seg->next;
+           (seg != NULL) && TCP_SEQ_LEQ(seg->tcphdr->seqno, right);
+           seg = seg->next) {
+        if (TCP_SEQ_GT(seg->tcphdr->seqno + TCP_TCPLEN(seg), right)) {
+          right = seg->tcphdr->seqno + TCP_TCPLEN(seg);
+        }
+      }
+      first = TCP_SEQ_BETWEEN(pcb->rcv_sack_seq, left, right - 1);
+      if (first == (pass == 0)) {
+        edges[2 * num] = htonl(left);
+        edges[2 * num + 1] = htonl(right);
+        num++;
+      }
+    }
+  }
+  return num;
+}
+#endif /* LWIP_TCP_SACK_OUT && TCP_QUEUE_OOSEQ */
+
 /** Send an ACK without data.
  *
  * @param pcb Protocol control block for the TCP connection to send the ACK
@@ -844,12 +903,23 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
   struct pbuf *p;
   struct tcp_hdr *tcphdr;
   u8_t optlen = 0;
+  u32_t *opts;
+#if LWIP_TCP_SACK_OUT && TCP_QUEUE_OOSEQ
+  u32_t sack_edges[2 * LWIP_TCP_MAX_SACK_NUM];
+  u8_t num_sacks = 0;
+#endif /* LWIP_TCP_SACK_OUT && TCP_QUEUE_OOSEQ */
 
 #if LWIP_TCP_TIMESTAMPS
   if (pcb->flags & TF_TIMESTAMP) {
     optlen = LWIP_TCP_OPT_LENGTH(TF_SEG_OPTS_TS);
   }
 #endif
+#if LWIP_TCP_SACK_OUT && TCP_QUEUE_OOSEQ
+  if ((pcb->flags & TF_SACK) && (pcb->ooseq != NULL)) {
+    num_sacks = tcp_build_sack_blocks(pcb, sack_edges);
+    optlen += LWIP_TCP_SACK_LENGTH(num_sacks);
+  }
+#endif /* LWIP_TCP_SACK_OUT && TCP_QUEUE_OOSEQ */
 
   p = tcp_output_alloc_header(pcb, optlen, 0, htonl(pcb->snd_nxt));
   if (p == NULL) {
@@ -863,13 +933,23 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
   pcb->flags &= ~(TF_ACK_DELAY | TF_ACK_NOW);
 
   /* NB. MSS option is only sent on SYNs, so ignore it here */
+  opts = (u32_t *)(void *)(tcphdr + 1);
 #if LWIP_TCP_TIMESTAMPS
   pcb->ts_lastacksent = pcb->rcv_nxt;
 
   if (pcb->flags & TF_TIMESTAMP) {
-    tcp_build_timestamp_option(pcb, (u32_t *)(tcphdr + 1));
+    tcp_build_timestamp_option(pcb, opts);
+    opts += 3;
   }
 #endif 
+#if LWIP_TCP_SACK_OUT && TCP_QUEUE_OOSEQ
+  if (num_sacks > 0) {
+    /* Two NOPs to align the blocks, then kind 5 */
+    *opts++ = htonl(0x01010500 | (2 + 8 * num_sacks));
+    MEMCPY(opts, sack_edges, 8 * num_sacks);
+  }
+#endif /* LWIP_TCP_SACK_OUT && TCP_QUEUE_OOSEQ */
+  LWIP_UNUSED_ARG(opts);
 
 #if CHECKSUM_GEN_TCP
   tcphdr->chksum = inet_chksum_pseudo(p, &(pcb->local_ip), &(pcb->remote_ip),
@@ -1059,10 +1139,15 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb)
    wnd fields remain. */
   seg->tcphdr->ackno = htonl(pcb->rcv_nxt);
 
-  /* advertise our receive window size in this TCP segment */
-  seg->tcphdr->wnd = htons(pcb->rcv_ann_wnd);
-
-  pcb->rcv_ann_right_edge = pcb->rcv_nxt + pcb->rcv_ann_wnd;
+  /* advertise our receive window size in this TCP segment,
+     the window in a SYN is never scaled */
+  if (TCPH_FLAGS(seg->tcphdr) & TCP_SYN) {
+    seg->tcphdr->wnd = htons(TCPWND16(pcb->rcv_ann_wnd));
+    pcb->rcv_ann_right_edge = pcb->rcv_nxt + TCPWND16(pcb->rcv_ann_wnd);
+  } else {
+    seg->tcphdr->wnd = htons(TCPWND16(RCV_WND_SCALE(pcb, pcb->rcv_ann_wnd)));
+    pcb->rcv_ann_right_edge = pcb->rcv_nxt + pcb->rcv_ann_wnd;
+  }
 
   /* Add any requested options.  NB MSS option is only set on SYN
      packets, so ignore it here */
@@ -1085,6 +1170,20 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb)
     opts += 3;
   }
 #endif
+#if LWIP_WND_SCALE
+  if (seg->flags & TF_SEG_OPTS_WND_SCALE) {
+    /* NOP, then kind 3 with our shift count */
+    *opts = PP_HTONL(0x01030300 | TCP_RCV_SCALE);
+    opts += 1;
+  }
+#endif /* LWIP_WND_SCALE */
+#if LWIP_TCP_SACK_OUT
+  if (seg->flags & TF_SEG_OPTS_SACK_PERM) {
+    /* Two NOPs, then kind 4 */
+    *opts = PP_HTONL(0x01010402);
+    opts += 1;
+  }
+#endif /* LWIP_TCP_SACK_OUT */
 
   /* Set retransmission timer running if it is not currently enabled 
      This must be set before checking the route. */
@@ -1212,7 +1311,7 @@ tcp_rst(u32_t seqno, u32_t ackno,
   tcphdr->seqno = htonl(seqno);
   tcphdr->ackno = htonl(ackno);
   TCPH_HDRLEN_FLAGS_SET(tcphdr, TCP_HLEN/4, TCP_RST | TCP_ACK);
-  tcphdr->wnd = PP_HTONS(TCP_WND);
+  tcphdr->wnd = PP_HTONS(TCPWND16(TCP_WND));
   tcphdr->chksum = 0;
   tcphdr->urgp = 0;
 
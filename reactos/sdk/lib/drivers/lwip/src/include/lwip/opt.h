@@ -1060,6 +1060,44 @@
 #define LWIP_TCP_TIMESTAMPS             0
 #endif
 
+/**
+ * LWIP_WND_SCALE==1: support the TCP window scale option (RFC 7323).
+ * TCP_RCV_SCALE is the shift count announced for our receive window, so
+ * TCP_WND and TCP_WND_MAX may then be up to (0xFFFF << TCP_RCV_SCALE).
+ */
+#ifndef LWIP_WND_SCALE
+#define LWIP_WND_SCALE                  0
+#endif
+
+#ifndef TCP_RCV_SCALE
+#define TCP_RCV_SCALE                   0
+#endif
+
+/**
+ * TCP_WND_MAX: The largest receive window a connection may grow to,
+ * either through receive window auto-tuning or on request of the user.
+ */
+#ifndef TCP_WND_MAX
+#define TCP_WND_MAX                     TCP_WND
+#endif
+
+/**
+ * LWIP_TCP_RCV_AUTOTUNE==1: grow the receive window of a connection from
+ * TCP_WND up to TCP_WND_MAX when the peer fills it within one round-trip.
+ * The round-trip time is taken from the timestamp option.
+ */
+#ifndef LWIP_TCP_RCV_AUTOTUNE
+#define LWIP_TCP_RCV_AUTOTUNE           0
+#endif
+
+/**
+ * LWIP_TCP_SACK_OUT==1: announce SACK-permitted (RFC 2018) and report the
+ * out-of-sequence data queued on ooseq in SACK blocks of outgoing ACKs.
+ */
+#ifndef LWIP_TCP_SACK_OUT
+#define LWIP_TCP_SACK_OUT               0
+#endif
+
 /**
  * TCP_WND_UPDATE_THRESHOLD: difference in window to trigger an
  * explicit window update
@@ -292,12 +292,23 @@ struct tcp_seg {
 #define TF_SEG_OPTS_TS          (u8_t)0x02U /* Include timestamp option. */
 #define TF_SEG_DATA_CHECKSUMMED (u8_t)0x04U /* ALL data (not the header) is
                                                checksummed into 'chksum' */
+#define TF_SEG_OPTS_WND_SCALE   (u8_t)0x08U /* Include window scale option. */
+#define TF_SEG_OPTS_SACK_PERM   (u8_t)0x10U /* Include SACK-permitted option. */
   struct tcp_hdr *tcphdr;  /* the TCP header */
 };
 
 #define LWIP_TCP_OPT_LENGTH(flags)              \
   (flags & TF_SEG_OPTS_MSS ? 4  : 0) +          \
-  (flags & TF_SEG_OPTS_TS  ? 12 : 0)
+  (flags & TF_SEG_OPTS_TS  ? 12 : 0) +          \
+  (flags & TF_SEG_OPTS_WND_SCALE ? 4 : 0) +     \
+  (flags & TF_SEG_OPTS_SACK_PERM ? 4 : 0)
+
+#if LWIP_TCP_SACK_OUT
+/** SACK blocks fitting in the 40 option bytes next to a timestamp or alone */
+#define LWIP_TCP_MAX_SACK_NUM       4
+#define LWIP_TCP_SACK_BLOCKS(pcb)   (((pcb)->flags & TF_TIMESTAMP) ? 3 : LWIP_TCP_MAX_SACK_NUM)
+#define LWIP_TCP_SACK_LENGTH(n)     ((n) ? (4 + 8 * (n)) : 0)
+#endif /* LWIP_TCP_SACK_OUT */
 
 /** This returns a TCP header option for MSS in an u32_t */
 #define TCP_BUILD_MSS_OPTION(mss) htonl(0x02040000 | ((mss) & 0xFFFF))
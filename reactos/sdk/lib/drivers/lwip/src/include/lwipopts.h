@@ -64,9 +64,21 @@
  * add support for other transport mediums */
 #define TCP_MSS                         1460
 
+/* Connections start with a 64 KB receive window that auto-tuning grows
+ * up to 2 MB, which needs a window scale shift count of 5 */
 #define TCP_WND                         0xFFFF
 
-#define TCP_SND_BUF                     TCP_WND
+#define LWIP_WND_SCALE                  1
+
+#define TCP_RCV_SCALE                   5
+
+#define TCP_WND_MAX                     (0xFFFFUL << TCP_RCV_SCALE)
+
+#define LWIP_TCP_RCV_AUTOTUNE           1
+
+#define LWIP_TCP_SACK_OUT               1
+
+#define TCP_SND_BUF                     (256 * 1024)
 
 #define TCP_MAXRTX                      8
 
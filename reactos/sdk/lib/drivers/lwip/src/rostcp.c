@@ -497,6 +497,13 @@ LibTCPSendCallback(void *arg)
 
     SendFlags = TCP_WRITE_FLAG_COPY;
     SendLength = msg->Input.Send.DataLength;
+    if (SendLength > 0xFFFF)
+    {
+        /* tcp_write() takes at most 64 KB, the caller sends the rest later */
+        SendLength = 0xFFFF;
+        SendFlags |= TCP_WRITE_FLAG_MORE;
+    }
+
     if (tcp_sndbuf(pcb) == 0)
     {
         /* No buffer space so return pending */
@@ -533,7 +540,7 @@ done:
 }
 
 err_t
-LibTCPSend(PCONNECTION_ENDPOINT Connection, void *const dataptr, const u16_t len, u32_t *sent, const int safe)
+LibTCPSend(PCONNECTION_ENDPOINT Connection, void *const dataptr, const u32_t len, u32_t *sent, const int safe)
 {
     err_t ret;
     struct lwip_callback_msg *msg;
@@ -840,3 +847,56 @@ LibTCPSetNoDelay(
     else
         pcb->flags &= ~TF_NODELAY;
 }
+
+static
+void
+LibTCPSetWindowCallback(void *arg)
+{
+    struct lwip_callback_msg *msg = arg;
+    PTCP_PCB pcb = msg->Input.Window.Connection->SocketContext;
+
+    ASSERT(msg);
+
+    if (!pcb)
+    {
+        msg->Output.Window.Error = ERR_CLSD;
+        goto done;
+    }
+
+    /* Listening PCBs have no receive window, the connections accepted on them auto-tune theirs */
+    if (pcb->state != LISTEN)
+        tcp_set_rcv_wnd(pcb, msg->Input.Window.Size);
+
+    msg->Output.Window.Error = ERR_OK;
+
+done:
+    KeSetEvent(&msg->Event, IO_NO_INCREMENT, FALSE);
+}
+
+err_t
+LibTCPSetWindow(PCONNECTION_ENDPOINT Connection, const u32_t size)
+{
+    struct lwip_callback_msg *msg;
+    err_t ret;
+
+    msg = ExAllocateFromNPagedLookasideList(&MessageLookasideList);
+    if (msg)
+    {
+        KeInitializeEvent(&msg->Event, NotificationEvent, FALSE);
+        msg->Input.Window.Connection = Connection;
+        msg->Input.Window.Size = size;
+
+        tcpip_callback_with_block(LibTCPSetWindowCallback, msg, 1);
+
+        if (WaitForEventSafely(&msg->Event))
+            ret = msg->Output.Window.Error;
+        else
+            ret = ERR_CLSD;
+
+        ExFreeToNPagedLookasideList(&MessageLookasideList, msg);
+
+        return ret;
+    }
+
+    return ERR_MEM;
+}
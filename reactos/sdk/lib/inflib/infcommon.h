@@ -10,6 +10,11 @@
 
 #define MAX_INF_STRING_LENGTH  512
 
+/* Flags for opening INF files */
+#define INF_OPEN_ARENA  0x00000001  /* allocate the parsed file from one arena;
+                                       the returned strings are shared and must
+                                       not be modified */
+
 typedef void *HINF, **PHINF;
 typedef struct _INFCONTEXT *PINFCONTEXT;
 
@@ -82,6 +82,279 @@ static const parser_state_func parser_funcs[NB_PARSER_STATES] =
 
 /* PRIVATE FUNCTIONS ********************************************************/
 
+/*
+ * Case insensitive hash of a section name or key. Only ASCII letters are
+ * folded and other non-ASCII characters are left out, so two names that
+ * strcmpiW() considers equal always get the same hash.
+ */
+static ULONG
+InfpHashName(PCWSTR Name)
+{
+  ULONG Hash = 2166136261U;
+  WCHAR Char;
+
+  for (; *Name != 0; Name++)
+    {
+      Char = *Name;
+      if (Char >= 0x80)
+        continue;
+      if (Char >= 'A' && Char <= 'Z')
+        Char += 'a' - 'A';
+
+      Hash = (Hash ^ Char) * 16777619U;
+    }
+
+  return Hash;
+}
+
+
+/* Rehash all sections of the cache into a table of twice the size */
+static BOOLEAN
+InfpGrowSectionTable(PINFCACHE Cache)
+{
+  PINFCACHESECTION *Table;
+  PINFCACHESECTION Section;
+  ULONG Size;
+  ULONG Index;
+
+  Size = Cache->SectionTableSize ? Cache->SectionTableSize * 2 : INF_SECTION_TABLE_SIZE;
+  Table = (PINFCACHESECTION *)MALLOC(Size * sizeof(PINFCACHESECTION));
+  if (Table == NULL)
+    {
+      /* Keep using the old table, lookups are just slower */
+      DPRINT("MALLOC() failed\n");
+      return FALSE;
+    }
+  ZEROMEMORY(Table,
+             Size * sizeof(PINFCACHESECTION));
+
+  for (Section = Cache->FirstSection; Section != NULL; Section = Section->Next)
+    {
+      Index = Section->Hash & (Size - 1);
+      Section->HashNext = Table[Index];
+      Table[Index] = Section;
+    }
+
+  if (Cache->SectionTable != NULL)
+    FREE(Cache->SectionTable);
+
+  Cache->SectionTable = Table;
+  Cache->SectionTableSize = Size;
+
+  return TRUE;
+}
+
+
+/* Add a line to the key table of its section, unless an earlier line has the same key */
+static VOID
+InfpInsertKeyLine(PINFCACHESECTION Section,
+                  PINFCACHELINE Line)
+{
+  PINFCACHELINE Other;
+  ULONG Index;
+
+  Index = Line->KeyHash & (Section->KeyTableSize - 1);
+  for (Other = Section->KeyTable[Index]; Other != NULL; Other = Other->HashNext)
+    {
+      if (Other->KeyHash == Line->KeyHash && strcmpiW(Other->Key, Line->Key) == 0)
+        return;
+    }
+
+  Line->HashNext = Section->KeyTable[Index];
+  Section->KeyTable[Index] = Line;
+}
+
+
+/* Rebuild the key table of a section with room for all of its keys */
+static BOOLEAN
+InfpGrowKeyTable(PINFCACHESECTION Section)
+{
+  PINFCACHELINE *Table;
+  PINFCACHELINE Line;
+  ULONG Size;
+
+  Size = Section->KeyTableSize ? Section->KeyTableSize * 2 : 2 * INF_KEY_INDEX_THRESHOLD;
+  while (Size < Section->KeyCount)
+    Size *= 2;
+
+  Table = (PINFCACHELINE *)MALLOC(Size * sizeof(PINFCACHELINE));
+  if (Table == NULL)
+    {
+      DPRINT("MALLOC() failed\n");
+      return FALSE;
+    }
+  ZEROMEMORY(Table,
+             Size * sizeof(PINFCACHELINE));
+
+  if (Section->KeyTable != NULL)
+    FREE(Section->KeyTable);
+
+  Section->KeyTable = Table;
+  Section->KeyTableSize = Size;
+
+  /* Lines are inserted in file order, so the first line of each key wins */
+  for (Line = Section->FirstLine; Line != NULL; Line = Line->Next)
+    {
+      if (Line->Key != NULL)
+        InfpInsertKeyLine(Section, Line);
+    }
+
+  return TRUE;
+}
+
+
+/* Allocate memory for a part of the cache, from its arena if it has one */
+static PVOID
+InfpAllocate(PINFCACHE Cache,
+             ULONG Size)
+{
+  PINFARENABLOCK Block;
+  ULONG BlockSize;
+  PVOID Memory;
+
+  if (!(Cache->Flags & INF_OPEN_ARENA))
+    return MALLOC(Size);
+
+  /* Keep the parts aligned for their pointers */
+  Size = (Size + sizeof(PVOID) - 1) & ~(ULONG)(sizeof(PVOID) - 1);
+
+  Block = Cache->ArenaBlocks;
+  if (Block == NULL || Block->Size - Block->Used < Size)
+    {
+      BlockSize = (Size > INF_ARENA_BLOCK_SIZE) ? Size : INF_ARENA_BLOCK_SIZE;
+
+      Block = (PINFARENABLOCK)MALLOC(sizeof(INFARENABLOCK) + BlockSize);
+      if (Block == NULL)
+        {
+          DPRINT("MALLOC() failed\n");
+          return NULL;
+        }
+
+      Block->Next = Cache->ArenaBlocks;
+      Block->Size = BlockSize;
+      Block->Used = 0;
+      Cache->ArenaBlocks = Block;
+    }
+
+  Memory = (PUCHAR)(Block + 1) + Block->Used;
+  Block->Used += Size;
+
+  return Memory;
+}
+
+
+/* Case sensitive hash of an interned string */
+static ULONG
+InfpHashString(PCWSTR String)
+{
+  ULONG Hash = 2166136261U;
+
+  for (; *String != 0; String++)
+    Hash = (Hash ^ *String) * 16777619U;
+
+  return Hash;
+}
+
+
+/* Rehash the interned strings into a table of twice the size */
+static BOOLEAN
+InfpGrowStringTable(PINFCACHE Cache)
+{
+  PINFSTRING *Table;
+  PINFSTRING String;
+  PINFSTRING Next;
+  ULONG Size;
+  ULONG Index;
+  ULONG i;
+
+  Size = Cache->StringTableSize ? Cache->StringTableSize * 2 : 256;
+  Table = (PINFSTRING *)MALLOC(Size * sizeof(PINFSTRING));
+  if (Table == NULL)
+    {
+      DPRINT("MALLOC() failed\n");
+      return FALSE;
+    }
+  ZEROMEMORY(Table,
+             Size * sizeof(PINFSTRING));
+
+  for (i = 0; i < Cache->StringTableSize; i++)
+    {
+      for (String = Cache->StringTable[i]; String != NULL; String = Next)
+        {
+          Next = String->Next;
+          Index = String->Hash & (Size - 1);
+          String->Next = Table[Index];
+          Table[Index] = String;
+        }
+    }
+
+  if (Cache->StringTable != NULL)
+    FREE(Cache->StringTable);
+
+  Cache->StringTable = Table;
+  Cache->StringTableSize = Size;
+
+  return TRUE;
+}
+
+
+/*
+ * Copy a key or field into the arena. Short strings like directory ids,
+ * registry roots and flags repeat a lot, so they are stored only once.
+ */
+static PWCHAR
+InfpStoreString(PINFCACHE Cache,
+                PCWSTR String)
+{
+  PINFSTRING Entry;
+  PWCHAR Data;
+  ULONG Length;
+  ULONG Hash;
+  ULONG Index;
+
+  Length = (ULONG)strlenW(String);
+  if (Length > INF_INTERN_MAX_LENGTH)
+    {
+      Data = (PWCHAR)InfpAllocate(Cache, (Length + 1) * sizeof(WCHAR));
+      if (Data != NULL)
+        strcpyW(Data, String);
+      return Data;
+    }
+
+  Hash = InfpHashString(String);
+  if (Cache->StringTable != NULL)
+    {
+      Entry = Cache->StringTable[Hash & (Cache->StringTableSize - 1)];
+      while (Entry != NULL)
+        {
+          if (Entry->Hash == Hash && strcmpW(Entry->Data, String) == 0)
+            return Entry->Data;
+
+          Entry = Entry->Next;
+        }
+    }
+
+  Entry = (PINFSTRING)InfpAllocate(Cache, (ULONG)FIELD_OFFSET(INFSTRING, Data[Length + 1]));
+  if (Entry == NULL)
+    return NULL;
+
+  Entry->Hash = Hash;
+  strcpyW(Entry->Data, String);
+
+  /* Without a table the string is just not shared */
+  Cache->StringCount++;
+  if ((Cache->StringCount <= Cache->StringTableSize || InfpGrowStringTable(Cache)) &&
+      Cache->StringTable != NULL)
+    {
+      Index = Hash & (Cache->StringTableSize - 1);
+      Entry->Next = Cache->StringTable[Index];
+      Cache->StringTable[Index] = Entry;
+    }
+
+  return Entry->Data;
+}
+
+
 static PINFCACHELINE
 InfpFreeLine (PINFCACHELINE Line)
 {
@@ -133,23 +406,98 @@ InfpFreeSection (PINFCACHESECTION Section)
     }
   Section->LastLine = NULL;
 
+  if (Section->KeyTable != NULL)
+    {
+      FREE (Section->KeyTable);
+      Section->KeyTable = NULL;
+    }
+
   FREE (Section);
 
   return Next;
 }
 
 
+VOID
+InfpFreeCache(PINFCACHE Cache)
+{
+  PINFCACHESECTION Section;
+  PINFARENABLOCK Block;
+
+  if (Cache == NULL)
+    {
+      return;
+    }
+
+  if (Cache->Flags & INF_OPEN_ARENA)
+    {
+      /* Only the hash tables are outside of the arena */
+      for (Section = Cache->FirstSection; Section != NULL; Section = Section->Next)
+        {
+          if (Section->KeyTable != NULL)
+            FREE(Section->KeyTable);
+        }
+      Cache->FirstSection = NULL;
+
+      while (Cache->ArenaBlocks != NULL)
+        {
+          Block = Cache->ArenaBlocks->Next;
+          FREE(Cache->ArenaBlocks);
+          Cache->ArenaBlocks = Block;
+        }
+
+      if (Cache->StringTable != NULL)
+        {
+          FREE(Cache->StringTable);
+          Cache->StringTable = NULL;
+        }
+    }
+
+  while (Cache->FirstSection != NULL)
+    {
+      Cache->FirstSection = InfpFreeSection(Cache->FirstSection);
+    }
+  Cache->LastSection = NULL;
+
+  if (Cache->SectionTable != NULL)
+    {
+      FREE(Cache->SectionTable);
+      Cache->SectionTable = NULL;
+    }
+
+  FREE(Cache);
+}
+
+
 PINFCACHESECTION
 InfpFindSection(PINFCACHE Cache,
                 PCWSTR Name)
 {
   PINFCACHESECTION Section = NULL;
+  ULONG Hash;
 
   if (Cache == NULL || Name == NULL)
     {
       return NULL;
     }
 
+  if (Cache->SectionTable != NULL)
+    {
+      Hash = InfpHashName(Name);
+      Section = Cache->SectionTable[Hash & (Cache->SectionTableSize - 1)];
+      while (Section != NULL)
+        {
+          if (Section->Hash == Hash && strcmpiW(Section->Name, Name) == 0)
+            {
+              return Section;
+            }
+
+          Section = Section->HashNext;
+        }
+
+      return NULL;
+    }
+
   /* iterate through list of sections */
   Section = Cache->FirstSection;
   while (Section != NULL)
@@ -173,6 +521,7 @@ InfpAddSection(PINFCACHE Cache,
 {
   PINFCACHESECTION Section = NULL;
   ULONG Size;
+  ULONG Index;
 
   if (Cache == NULL || Name == NULL)
     {
@@ -183,10 +532,10 @@ InfpAddSection(PINFCACHE Cache,
   /* Allocate and initialize the new section */
   Size = (ULONG)FIELD_OFFSET(INFCACHESECTION,
                              Name[strlenW(Name) + 1]);
-  Section = (PINFCACHESECTION)MALLOC(Size);
+  Section = (PINFCACHESECTION)InfpAllocate(Cache, Size);
   if (Section == NULL)
     {
-      DPRINT("MALLOC() failed\n");
+      DPRINT("InfpAllocate() failed\n");
       return NULL;
     }
   ZEROMEMORY (Section,
@@ -194,6 +543,7 @@ InfpAddSection(PINFCACHE Cache,
 
   /* Copy section name */
   strcpyW(Section->Name, Name);
+  Section->Hash = InfpHashName(Name);
 
   /* Append section */
   if (Cache->FirstSection == NULL)
@@ -208,25 +558,42 @@ InfpAddSection(PINFCACHE Cache,
       Cache->LastSection = Section;
     }
 
+  /* Hash the section */
+  Cache->SectionCount++;
+  if (Cache->SectionCount > Cache->SectionTableSize)
+    {
+      /* The new table holds this section as well */
+      if (InfpGrowSectionTable(Cache))
+        return Section;
+    }
+
+  if (Cache->SectionTable != NULL)
+    {
+      Index = Section->Hash & (Cache->SectionTableSize - 1);
+      Section->HashNext = Cache->SectionTable[Index];
+      Cache->SectionTable[Index] = Section;
+    }
+
   return Section;
 }
 
 
 PINFCACHELINE
-InfpAddLine(PINFCACHESECTION Section)
+InfpAddLine(PINFCACHE Cache,
+            PINFCACHESECTION Section)
 {
   PINFCACHELINE Line;
 
-  if (Section == NULL)
+  if (Cache == NULL || Section == NULL)
     {
       DPRINT("Invalid parameter\n");
       return NULL;
     }
 
-  Line = (PINFCACHELINE)MALLOC(sizeof(INFCACHELINE));
+  Line = (PINFCACHELINE)InfpAllocate(Cache, sizeof(INFCACHELINE));
   if (Line == NULL)
     {
-      DPRINT("MALLOC() failed\n");
+      DPRINT("InfpAllocate() failed\n");
       return NULL;
     }
   ZEROMEMORY(Line,
@@ -251,10 +618,12 @@ InfpAddLine(PINFCACHESECTION Section)
 
 
 PVOID
-InfpAddKeyToLine(PINFCACHELINE Line,
+InfpAddKeyToLine(PINFCACHE Cache,
+                 PINFCACHESECTION Section,
+                 PINFCACHELINE Line,
                  PCWSTR Key)
 {
-  if (Line == NULL)
+  if (Cache == NULL || Section == NULL || Line == NULL)
     {
       DPRINT1("Invalid Line\n");
       return NULL;
@@ -266,37 +635,88 @@ InfpAddKeyToLine(PINFCACHELINE Line,
       return NULL;
     }
 
-  Line->Key = (PWCHAR)MALLOC((strlenW(Key) + 1) * sizeof(WCHAR));
-  if (Line->Key == NULL)
+  if (Cache->Flags & INF_OPEN_ARENA)
     {
-      DPRINT1("MALLOC() failed\n");
-      return NULL;
+      Line->Key = InfpStoreString(Cache, Key);
+      if (Line->Key == NULL)
+        {
+          DPRINT1("InfpStoreString() failed\n");
+          return NULL;
+        }
+    }
+  else
+    {
+      Line->Key = (PWCHAR)MALLOC((strlenW(Key) + 1) * sizeof(WCHAR));
+      if (Line->Key == NULL)
+        {
+          DPRINT1("MALLOC() failed\n");
+          return NULL;
+        }
+
+      strcpyW(Line->Key, Key);
+    }
+  Line->KeyHash = InfpHashName(Key);
+
+  /* Index the key */
+  Section->KeyCount++;
+  if (Section->KeyCount >= INF_KEY_INDEX_THRESHOLD &&
+      Section->KeyCount > Section->KeyTableSize)
+    {
+      /* The new table holds this line as well */
+      if (InfpGrowKeyTable(Section))
+        return (PVOID)Line->Key;
     }
 
-  strcpyW(Line->Key, Key);
+  if (Section->KeyTable != NULL)
+    {
+      InfpInsertKeyLine(Section, Line);
+    }
 
   return (PVOID)Line->Key;
 }
 
 
 PVOID
-InfpAddFieldToLine(PINFCACHELINE Line,
+InfpAddFieldToLine(PINFCACHE Cache,
+                   PINFCACHELINE Line,
                    PCWSTR Data)
 {
   PINFCACHEFIELD Field;
   ULONG Size;
 
-  Size = (ULONG)FIELD_OFFSET(INFCACHEFIELD,
-                             Data[strlenW(Data) + 1]);
-  Field = (PINFCACHEFIELD)MALLOC(Size);
-  if (Field == NULL)
+  if (Cache->Flags & INF_OPEN_ARENA)
     {
-      DPRINT1("MALLOC() failed\n");
-      return NULL;
+      Field = (PINFCACHEFIELD)InfpAllocate(Cache, sizeof(INFCACHEFIELD));
+      if (Field == NULL)
+        {
+          DPRINT1("InfpAllocate() failed\n");
+          return NULL;
+        }
+      ZEROMEMORY (Field,
+                  sizeof(INFCACHEFIELD));
+
+      Field->Data = InfpStoreString(Cache, Data);
+      if (Field->Data == NULL)
+        {
+          DPRINT1("InfpStoreString() failed\n");
+          return NULL;
+        }
+    }
+  else
+    {
+      /* The data follows the field in the same allocation */
+      Size = sizeof(INFCACHEFIELD) + ((ULONG)strlenW(Data) + 1) * sizeof(WCHAR);
+      Field = (PINFCACHEFIELD)MALLOC(Size);
+      if (Field == NULL)
+        {
+          DPRINT1("MALLOC() failed\n");
+          return NULL;
+        }
+      ZEROMEMORY (Field,
+                  Size);
+      Field->Data = (PWCHAR)(Field + 1);
+      strcpyW(Field->Data, Data);
     }
-  ZEROMEMORY (Field,
-              Size);
-  strcpyW(Field->Data, Data);
 
   /* Append key */
   if (Line->FirstField == NULL)
@@ -307,7 +727,6 @@ InfpAddFieldToLine(PINFCACHELINE Line,
   else
     {
       Line->LastField->Next = Field;
-      Field->Prev = Line->LastField;
       Line->LastField = Field;
     }
   Line->FieldCount++;
@@ -321,6 +740,24 @@ InfpFindKeyLine(PINFCACHESECTION Section,
                 PCWSTR Key)
 {
   PINFCACHELINE Line;
+  ULONG Hash;
+
+  if (Section->KeyTable != NULL)
+    {
+      Hash = InfpHashName(Key);
+      Line = Section->KeyTable[Hash & (Section->KeyTableSize - 1)];
+      while (Line != NULL)
+        {
+          if (Line->KeyHash == Hash && strcmpiW(Line->Key, Key) == 0)
+            {
+              return Line;
+            }
+
+          Line = Line->HashNext;
+        }
+
+      return NULL;
+    }
 
   Line = Section->FirstLine;
   while (Line != NULL)
@@ -375,7 +812,7 @@ __inline static int is_eol( struct parser *parser, const WCHAR *ptr )
   return (ptr >= parser->end ||
           *ptr == CONTROL_Z ||
           *ptr == '\n' ||
-          (*ptr == '\r' && *(ptr + 1) == '\n') ||
+          (*ptr == '\r' && ptr + 1 < parser->end && *(ptr + 1) == '\n') ||
           *ptr == 0);
 }
 
@@ -456,7 +893,7 @@ static struct field *add_field_from_token( struct parser *parser, int is_key )
           return NULL;
         }
 
-      parser->line = InfpAddLine(parser->cur_section);
+      parser->line = InfpAddLine(parser->file, parser->cur_section);
       if (parser->line == NULL)
         goto error;
     }
@@ -467,11 +904,11 @@ static struct field *add_field_from_token( struct parser *parser, int is_key )
 
   if (is_key)
     {
-      field = InfpAddKeyToLine(parser->line, parser->token);
+      field = InfpAddKeyToLine(parser->file, parser->cur_section, parser->line, parser->token);
     }
   else
     {
-      field = InfpAddFieldToLine(parser->line, parser->token);
+      field = InfpAddFieldToLine(parser->file, parser->line, parser->token);
     }
 
   if (field != NULL)
@@ -23,6 +23,11 @@ extern int InfHostOpenFile(PHINF InfHandle,
                            const CHAR *FileName,
                            LANGID LanguageId,
                            ULONG *ErrorLine);
+extern int InfHostOpenFileEx(PHINF InfHandle,
+                             const CHAR *FileName,
+                             LANGID LanguageId,
+                             ULONG Flags,
+                             ULONG *ErrorLine);
 extern int InfHostWriteFile(HINF InfHandle,
                             const CHAR *FileName,
                             const CHAR *HeaderComment);
@@ -111,7 +111,7 @@ InfHostOpenBufferedFile(PHINF InfHandle,
 
   if (!INF_SUCCESS(Status))
     {
-      FREE(Cache);
+      InfpFreeCache(Cache);
       Cache = NULL;
     }
 
@@ -125,10 +125,11 @@ InfHostOpenBufferedFile(PHINF InfHandle,
 
 
 int
-InfHostOpenFile(PHINF InfHandle,
-                const CHAR *FileName,
-                LANGID LanguageId,
-                ULONG *ErrorLine)
+InfHostOpenFileEx(PHINF InfHandle,
+                  const CHAR *FileName,
+                  LANGID LanguageId,
+                  ULONG Flags,
+                  ULONG *ErrorLine)
 {
   FILE *File;
   CHAR *FileBuffer;
@@ -214,6 +215,7 @@ InfHostOpenFile(PHINF InfHandle,
              sizeof(INFCACHE));
 
     Cache->LanguageId = LanguageId;
+    Cache->Flags = Flags;
 
   /* Parse the inf buffer */
     if (!RtlIsTextUnicode(FileBuffer, (INT)FileBufferLength, NULL))
@@ -239,6 +241,10 @@ InfHostOpenFile(PHINF InfHandle,
                                             (char *)FileBuffer + offset,
                                             FileBufferLength - offset);
 
+            /* The converted copy is all the parser needs */
+            FREE(FileBuffer);
+            FileBuffer = NULL;
+
             Status = InfpParseBuffer(Cache,
                                      new_buff,
                                      new_buff + len / sizeof(WCHAR),
@@ -266,12 +272,13 @@ InfHostOpenFile(PHINF InfHandle,
 
   if (!INF_SUCCESS(Status))
     {
-      FREE(Cache);
+      InfpFreeCache(Cache);
       Cache = NULL;
     }
 
   /* Free file buffer */
-  FREE(FileBuffer);
+  if (FileBuffer != NULL)
+    FREE(FileBuffer);
 
   *InfHandle = (HINF)Cache;
 
@@ -279,6 +286,16 @@ InfHostOpenFile(PHINF InfHandle,
 }
 
 
+int
+InfHostOpenFile(PHINF InfHandle,
+                const CHAR *FileName,
+                LANGID LanguageId,
+                ULONG *ErrorLine)
+{
+  return InfHostOpenFileEx(InfHandle, FileName, LanguageId, 0, ErrorLine);
+}
+
+
 void
 InfHostCloseFile(HINF InfHandle)
 {
@@ -291,13 +308,7 @@ InfHostCloseFile(HINF InfHandle)
       return;
     }
 
-  while (Cache->FirstSection != NULL)
-    {
-      Cache->FirstSection = InfpFreeSection(Cache->FirstSection);
-    }
-  Cache->LastSection = NULL;
-
-  FREE(Cache);
+  InfpFreeCache(Cache);
 }
 
 /* EOF */
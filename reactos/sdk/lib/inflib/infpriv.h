@@ -18,12 +18,20 @@
 #define INF_STATUS_WRONG_INF_STYLE         ((INFSTATUS)0xC0700003)
 #define INF_STATUS_NOT_ENOUGH_MEMORY       ((INFSTATUS)0xC0700004)
 
+/* Initial size of the section hash table, must be a power of 2 */
+#define INF_SECTION_TABLE_SIZE   64
+/* Sections with fewer keys are searched linearly */
+#define INF_KEY_INDEX_THRESHOLD  8
+/* Size of the blocks of an arena */
+#define INF_ARENA_BLOCK_SIZE     (8 * 1024)
+/* Longer strings are not interned */
+#define INF_INTERN_MAX_LENGTH    32
+
 typedef struct _INFCACHEFIELD
 {
   struct _INFCACHEFIELD *Next;
-  struct _INFCACHEFIELD *Prev;
 
-  WCHAR Data[1];
+  PWCHAR Data;      /* follows the field, or is an arena string */
 } INFCACHEFIELD, *PINFCACHEFIELD;
 
 typedef struct _INFCACHELINE
@@ -31,6 +39,9 @@ typedef struct _INFCACHELINE
   struct _INFCACHELINE *Next;
   struct _INFCACHELINE *Prev;
 
+  struct _INFCACHELINE *HashNext;   /* next line in the same key bucket */
+  ULONG KeyHash;
+
   LONG FieldCount;
 
   PWCHAR Key;
@@ -45,20 +56,57 @@ typedef struct _INFCACHESECTION
   struct _INFCACHESECTION *Next;
   struct _INFCACHESECTION *Prev;
 
+  struct _INFCACHESECTION *HashNext;    /* next section in the same bucket */
+  ULONG Hash;
+
   PINFCACHELINE FirstLine;
   PINFCACHELINE LastLine;
 
   LONG LineCount;
 
+  /* Index of the first line of each key, built once the section has
+     INF_KEY_INDEX_THRESHOLD keys */
+  PINFCACHELINE *KeyTable;
+  ULONG KeyTableSize;
+  ULONG KeyCount;
+
   WCHAR Name[1];
 } INFCACHESECTION, *PINFCACHESECTION;
 
+/* Chunk of memory that the parts of an INF_OPEN_ARENA cache are carved from */
+typedef struct _INFARENABLOCK
+{
+  struct _INFARENABLOCK *Next;
+  ULONG Size;
+  ULONG Used;
+} INFARENABLOCK, *PINFARENABLOCK;
+
+/* Interned string of an INF_OPEN_ARENA cache */
+typedef struct _INFSTRING
+{
+  struct _INFSTRING *Next;
+  ULONG Hash;
+  WCHAR Data[1];
+} INFSTRING, *PINFSTRING;
+
 typedef struct _INFCACHE
 {
   LANGID LanguageId;
+  ULONG Flags;                      /* INF_OPEN_* flags */
   PINFCACHESECTION FirstSection;
   PINFCACHESECTION LastSection;
 
+  PINFCACHESECTION *SectionTable;   /* sections hashed by name */
+  ULONG SectionTableSize;
+  ULONG SectionCount;
+
+  /* Arena of an INF_OPEN_ARENA cache. Sections, lines, keys and fields
+     are allocated from it and released together */
+  PINFARENABLOCK ArenaBlocks;
+  PINFSTRING *StringTable;          /* short strings, shared by all lines */
+  ULONG StringTableSize;
+  ULONG StringCount;
+
   PINFCACHESECTION StringsSection;
 } INFCACHE, *PINFCACHE;
 
@@ -79,12 +127,17 @@ extern INFSTATUS InfpParseBuffer(PINFCACHE file,
                                  const WCHAR *end,
                                  PULONG error_line);
 extern PINFCACHESECTION InfpFreeSection(PINFCACHESECTION Section);
+extern VOID InfpFreeCache(PINFCACHE Cache);
 extern PINFCACHESECTION InfpAddSection(PINFCACHE Cache,
                                        PCWSTR Name);
-extern PINFCACHELINE InfpAddLine(PINFCACHESECTION Section);
-extern PVOID InfpAddKeyToLine(PINFCACHELINE Line,
+extern PINFCACHELINE InfpAddLine(PINFCACHE Cache,
+                                 PINFCACHESECTION Section);
+extern PVOID InfpAddKeyToLine(PINFCACHE Cache,
+                              PINFCACHESECTION Section,
+                              PINFCACHELINE Line,
                               PCWSTR Key);
-extern PVOID InfpAddFieldToLine(PINFCACHELINE Line,
+extern PVOID InfpAddFieldToLine(PINFCACHE Cache,
+                                PINFCACHELINE Line,
                                 PCWSTR Data);
 extern PINFCACHELINE InfpFindKeyLine(PINFCACHESECTION Section,
                                      PCWSTR Key);
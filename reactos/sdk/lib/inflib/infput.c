@@ -227,14 +227,14 @@ InfpAddLineWithKey(PINFCONTEXT Context, PCWSTR Key)
       return INF_STATUS_INVALID_PARAMETER;
     }
 
-  Context->Line = InfpAddLine(Context->Section);
+  Context->Line = InfpAddLine(Context->Inf, Context->Section);
   if (NULL == Context->Line)
     {
       DPRINT("Failed to create line\n");
       return INF_STATUS_NO_MEMORY;
     }
 
-  if (NULL != Key && NULL == InfpAddKeyToLine(Context->Line, Key))
+  if (NULL != Key && NULL == InfpAddKeyToLine(Context->Inf, Context->Section, Context->Line, Key))
     {
       DPRINT("Failed to add key\n");
       return INF_STATUS_NO_MEMORY;
@@ -252,7 +252,7 @@ InfpAddField(PINFCONTEXT Context, PCWSTR Data)
       return INF_STATUS_INVALID_PARAMETER;
     }
 
-  if (NULL == InfpAddFieldToLine(Context->Line, Data))
+  if (NULL == InfpAddFieldToLine(Context->Inf, Context->Line, Data))
     {
       DPRINT("Failed to add field\n");
       return INF_STATUS_NO_MEMORY;
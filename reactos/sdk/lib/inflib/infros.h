@@ -24,6 +24,11 @@ extern NTSTATUS InfOpenFile(PHINF InfHandle,
                             PUNICODE_STRING FileName,
                             LANGID LanguageId,
                             PULONG ErrorLine);
+extern NTSTATUS InfOpenFileEx(PHINF InfHandle,
+                              PUNICODE_STRING FileName,
+                              LANGID LanguageId,
+                              ULONG Flags,
+                              PULONG ErrorLine);
 extern NTSTATUS InfWriteFile(HINF InfHandle,
                              PUNICODE_STRING FileName,
                              PUNICODE_STRING HeaderComment);
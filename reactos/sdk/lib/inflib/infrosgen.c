@@ -144,7 +144,7 @@ InfOpenBufferedFile(PHINF InfHandle,
 
   if (!INF_SUCCESS(Status))
     {
-      FREE(Cache);
+      InfpFreeCache(Cache);
       Cache = NULL;
     }
 
@@ -158,20 +158,23 @@ InfOpenBufferedFile(PHINF InfHandle,
 
 
 NTSTATUS
-InfOpenFile(PHINF InfHandle,
-	    PUNICODE_STRING FileName,
-	    LANGID LanguageId,
-	    PULONG ErrorLine)
+InfOpenFileEx(PHINF InfHandle,
+	      PUNICODE_STRING FileName,
+	      LANGID LanguageId,
+	      ULONG Flags,
+	      PULONG ErrorLine)
 {
   OBJECT_ATTRIBUTES ObjectAttributes;
   FILE_STANDARD_INFORMATION FileInfo;
   IO_STATUS_BLOCK IoStatusBlock;
   HANDLE FileHandle;
+  HANDLE SectionHandle = NULL;
   NTSTATUS Status;
-  PCHAR FileBuffer;
+  PCHAR FileBuffer = NULL;
   ULONG FileLength;
   ULONG FileBufferLength;
   LARGE_INTEGER FileOffset;
+  SIZE_T ViewSize = 0;
   PINFCACHE Cache;
 
   CheckHeap();
@@ -217,39 +220,83 @@ InfOpenFile(PHINF InfHandle,
 
   DPRINT("File size: %lu\n", FileLength);
 
-  /* Allocate file buffer */
-  FileBufferLength = FileLength + 2;
-  FileBuffer = MALLOC(FileBufferLength);
-  if (FileBuffer == NULL)
+  /*
+   * In arena mode the file is parsed straight from a read-only view.
+   * The parser stops at the end of the buffer, so no terminator is needed.
+   */
+  if ((Flags & INF_OPEN_ARENA) && FileLength >= sizeof(WCHAR))
     {
-      DPRINT1("MALLOC() failed\n");
-      NtClose(FileHandle);
-      return(INF_STATUS_INSUFFICIENT_RESOURCES);
+      Status = NtCreateSection(&SectionHandle,
+                               SECTION_MAP_READ,
+                               NULL,
+                               NULL,
+                               PAGE_READONLY,
+                               SEC_COMMIT,
+                               FileHandle);
+      if (INF_SUCCESS(Status))
+        {
+          Status = NtMapViewOfSection(SectionHandle,
+                                      NtCurrentProcess(),
+                                      (PVOID *)&FileBuffer,
+                                      0,
+                                      0,
+                                      NULL,
+                                      &ViewSize,
+                                      ViewUnmap,
+                                      0,
+                                      PAGE_READONLY);
+          NtClose(SectionHandle);
+        }
+
+      if (!INF_SUCCESS(Status))
+        {
+          DPRINT("Mapping the file failed (Status %lx)\n", Status);
+          FileBuffer = NULL;
+          ViewSize = 0;
+        }
     }
 
-  /* Read file */
-  FileOffset.QuadPart = 0ULL;
-  Status = NtReadFile(FileHandle,
-		      NULL,
-		      NULL,
-		      NULL,
-		      &IoStatusBlock,
-		      FileBuffer,
-		      FileLength,
-		      &FileOffset,
-		      NULL);
+  if (FileBuffer != NULL)
+    {
+      FileBufferLength = FileLength;
+      NtClose(FileHandle);
+    }
+  else
+    {
+      /* Allocate file buffer */
+      FileBufferLength = FileLength + 2;
+      FileBuffer = MALLOC(FileBufferLength);
+      if (FileBuffer == NULL)
+        {
+          DPRINT1("MALLOC() failed\n");
+          NtClose(FileHandle);
+          return(INF_STATUS_INSUFFICIENT_RESOURCES);
+        }
 
-  /* Append string terminator */
-  FileBuffer[FileLength] = 0;
-  FileBuffer[FileLength + 1] = 0;
+      /* Read file */
+      FileOffset.QuadPart = 0ULL;
+      Status = NtReadFile(FileHandle,
+                          NULL,
+                          NULL,
+                          NULL,
+                          &IoStatusBlock,
+                          FileBuffer,
+                          FileLength,
+                          &FileOffset,
+                          NULL);
+
+      /* Append string terminator */
+      FileBuffer[FileLength] = 0;
+      FileBuffer[FileLength + 1] = 0;
 
-  NtClose(FileHandle);
+      NtClose(FileHandle);
 
-  if (!INF_SUCCESS(Status))
-    {
-      DPRINT("NtReadFile() failed (Status %lx)\n", Status);
-      FREE(FileBuffer);
-      return(Status);
+      if (!INF_SUCCESS(Status))
+        {
+          DPRINT("NtReadFile() failed (Status %lx)\n", Status);
+          FREE(FileBuffer);
+          return(Status);
+        }
     }
 
   /* Allocate infcache header */
@@ -257,8 +304,8 @@ InfOpenFile(PHINF InfHandle,
   if (Cache == NULL)
     {
       DPRINT("MALLOC() failed\n");
-      FREE(FileBuffer);
-      return(INF_STATUS_INSUFFICIENT_RESOURCES);
+      Status = INF_STATUS_INSUFFICIENT_RESOURCES;
+      goto done;
     }
 
   /* Initialize inicache header */
@@ -266,6 +313,7 @@ InfOpenFile(PHINF InfHandle,
              sizeof(INFCACHE));
 
     Cache->LanguageId = LanguageId;
+    Cache->Flags = Flags;
 
     /* Parse the inf buffer */
     if (!RtlIsTextUnicode(FileBuffer, FileBufferLength, NULL))
@@ -291,6 +339,14 @@ InfOpenFile(PHINF InfHandle,
                                             (char *)FileBuffer + offset,
                                             FileBufferLength - offset);
 
+            /* The converted copy is all the parser needs */
+            if (ViewSize != 0)
+              NtUnmapViewOfSection(NtCurrentProcess(), FileBuffer);
+            else
+              FREE(FileBuffer);
+            FileBuffer = NULL;
+            ViewSize = 0;
+
             Status = InfpParseBuffer(Cache,
                                      new_buff,
                                      new_buff + len / sizeof(WCHAR),
@@ -317,19 +373,33 @@ InfOpenFile(PHINF InfHandle,
 
   if (!INF_SUCCESS(Status))
     {
-      FREE(Cache);
+      InfpFreeCache(Cache);
       Cache = NULL;
     }
 
-  /* Free file buffer */
-  FREE(FileBuffer);
-
   *InfHandle = (HINF)Cache;
 
+done:
+  /* Free file buffer */
+  if (ViewSize != 0)
+    NtUnmapViewOfSection(NtCurrentProcess(), FileBuffer);
+  else if (FileBuffer != NULL)
+    FREE(FileBuffer);
+
   return(Status);
 }
 
 
+NTSTATUS
+InfOpenFile(PHINF InfHandle,
+	    PUNICODE_STRING FileName,
+	    LANGID LanguageId,
+	    PULONG ErrorLine)
+{
+  return InfOpenFileEx(InfHandle, FileName, LanguageId, 0, ErrorLine);
+}
+
+
 VOID
 InfCloseFile(HINF InfHandle)
 {
@@ -342,13 +412,7 @@ InfCloseFile(HINF InfHandle)
       return;
     }
 
-  while (Cache->FirstSection != NULL)
-    {
-      Cache->FirstSection = InfpFreeSection(Cache->FirstSection);
-    }
-  Cache->LastSection = NULL;
-
-  FREE(Cache);
+  InfpFreeCache(Cache);
 
   if (0 < InfpHeapRefCount)
     {
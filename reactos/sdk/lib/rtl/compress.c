@@ -216,28 +216,240 @@ out:
 }
 
 
+/* LZNT1 compressor */
+
+#define LZNT1_CHUNK_SIZE        0x1000
+#define LZNT1_MIN_MATCH         3
+#define LZNT1_HASH_BITS         12
+#define LZNT1_HASH_SIZE         (1 << LZNT1_HASH_BITS)
+#define LZNT1_STANDARD_DEPTH    16
+#define LZNT1_MAXIMUM_DEPTH     1024
+#define LZNT1_WORKSPACE_SIZE    0x8010
+
+typedef struct _RTLP_LZNT1_WORKSPACE
+{
+    /* Most recent chunk position (+ 1) for each hash of three bytes, 0 if none */
+    USHORT HashHead[LZNT1_HASH_SIZE];
+    /* Previous chunk position (+ 1) with the same hash, indexed by position */
+    USHORT HashChain[LZNT1_CHUNK_SIZE];
+} RTLP_LZNT1_WORKSPACE, *PRTLP_LZNT1_WORKSPACE;
+
+C_ASSERT(sizeof(RTLP_LZNT1_WORKSPACE) <= LZNT1_WORKSPACE_SIZE);
+
+FORCEINLINE
+ULONG
+RtlpLznt1Hash(PUCHAR Data)
+{
+    ULONG Value = (Data[0] << 16) | (Data[1] << 8) | Data[2];
+    return (Value * 0x9E3779B1) >> (32 - LZNT1_HASH_BITS);
+}
+
+/* Number of displacement bits the decoder uses at a given chunk position */
+FORCEINLINE
+ULONG
+RtlpLznt1DisplacementBits(ULONG Position)
+{
+    ULONG Bits = 4;
+
+    while (Position > (1UL << Bits))
+        Bits++;
+
+    return Bits;
+}
+
+FORCEINLINE
+VOID
+RtlpLznt1Insert(PRTLP_LZNT1_WORKSPACE WorkSpace,
+                PUCHAR Chunk,
+                ULONG ChunkSize,
+                ULONG Position)
+{
+    ULONG Hash;
+
+    if (Position + LZNT1_MIN_MATCH > ChunkSize)
+        return;
+
+    Hash = RtlpLznt1Hash(Chunk + Position);
+    WorkSpace->HashChain[Position] = WorkSpace->HashHead[Hash];
+    WorkSpace->HashHead[Hash] = (USHORT)(Position + 1);
+}
+
+/* Walk the hash chain for Position, which must not be inserted yet */
+static ULONG
+RtlpLznt1FindMatch(PRTLP_LZNT1_WORKSPACE WorkSpace,
+                   PUCHAR Chunk,
+                   ULONG ChunkSize,
+                   ULONG Position,
+                   ULONG MaxDepth,
+                   PULONG Displacement)
+{
+    ULONG Candidate, Length, Limit, BestLength = 0;
+
+    /* Every earlier position of the chunk is reachable, only the length is limited */
+    Limit = (1 << (16 - RtlpLznt1DisplacementBits(Position))) + LZNT1_MIN_MATCH - 1;
+    Limit = min(Limit, ChunkSize - Position);
+    if (Limit < LZNT1_MIN_MATCH)
+        return 0;
+
+    Candidate = WorkSpace->HashHead[RtlpLznt1Hash(Chunk + Position)];
+    while (Candidate && MaxDepth--)
+    {
+        Candidate--;
+
+        /* Cheap rejection: the candidate must at least beat the current best */
+        if (Chunk[Candidate + BestLength] == Chunk[Position + BestLength])
+        {
+            for (Length = 0; Length < Limit; Length++)
+            {
+                if (Chunk[Candidate + Length] != Chunk[Position + Length])
+                    break;
+            }
+
+            if (Length > BestLength)
+            {
+                BestLength = Length;
+                *Displacement = Position - Candidate;
+                if (Length == Limit)
+                    break;
+            }
+        }
+
+        Candidate = WorkSpace->HashChain[Candidate];
+    }
+
+    return (BestLength >= LZNT1_MIN_MATCH) ? BestLength : 0;
+}
+
+/* Compress a single chunk, returns NULL if the output does not fit before DestEnd */
+static PUCHAR
+RtlpCompressChunkLZNT1(PUCHAR Chunk,
+                       ULONG ChunkSize,
+                       PUCHAR Dest,
+                       PUCHAR DestEnd,
+                       USHORT Engine,
+                       PRTLP_LZNT1_WORKSPACE WorkSpace)
+{
+    PUCHAR Flags = NULL;
+    ULONG FlagBit = 8;
+    ULONG Position = 0;
+    ULONG Length, Displacement = 0;
+    ULONG NextLength, NextDisplacement = 0;
+    ULONG MaxDepth, Code, i;
+    BOOLEAN Lazy, HaveMatch = FALSE;
+
+    Lazy = (Engine == COMPRESSION_ENGINE_MAXIMUM);
+    MaxDepth = Lazy ? LZNT1_MAXIMUM_DEPTH : LZNT1_STANDARD_DEPTH;
+
+    RtlZeroMemory(WorkSpace->HashHead, sizeof(WorkSpace->HashHead));
+
+    while (Position < ChunkSize)
+    {
+        /* Start a new group of eight tokens */
+        if (FlagBit == 8)
+        {
+            if (Dest >= DestEnd)
+                return NULL;
+            Flags = Dest++;
+            *Flags = 0;
+            FlagBit = 0;
+        }
+
+        if (!HaveMatch)
+            Length = RtlpLznt1FindMatch(WorkSpace, Chunk, ChunkSize, Position, MaxDepth, &Displacement);
+        HaveMatch = FALSE;
+
+        RtlpLznt1Insert(WorkSpace, Chunk, ChunkSize, Position);
+
+        /* Maximum engine: emit a literal if the next position matches longer */
+        if (Lazy && Length && Position + 1 < ChunkSize)
+        {
+            NextLength = RtlpLznt1FindMatch(WorkSpace, Chunk, ChunkSize, Position + 1,
+                                            MaxDepth, &NextDisplacement);
+            if (NextLength > Length)
+            {
+                Length = NextLength;
+                Displacement = NextDisplacement;
+                HaveMatch = TRUE;
+            }
+        }
+
+        if (Length && !HaveMatch)
+        {
+            /* Back reference, split depends on the current position */
+            if (Dest + sizeof(USHORT) > DestEnd)
+                return NULL;
+
+            Code = ((Displacement - 1) << (16 - RtlpLznt1DisplacementBits(Position))) |
+                   (Length - LZNT1_MIN_MATCH);
+            Dest[0] = (UCHAR)Code;
+            Dest[1] = (UCHAR)(Code >> 8);
+            Dest += sizeof(USHORT);
+            *Flags |= (1 << FlagBit);
+
+            for (i = Position + 1; i < Position + Length; i++)
+                RtlpLznt1Insert(WorkSpace, Chunk, ChunkSize, i);
+
+            Position += Length;
+        }
+        else
+        {
+            /* Literal */
+            if (Dest >= DestEnd)
+                return NULL;
+            *Dest++ = Chunk[Position++];
+        }
+
+        FlagBit++;
+    }
+
+    return Dest;
+}
+
 static NTSTATUS
 RtlpCompressBufferLZNT1(UCHAR *src, ULONG src_size, UCHAR *dst, ULONG dst_size,
-                        ULONG chunk_size, ULONG *final_size, UCHAR *workspace)
+                        ULONG chunk_size, ULONG *final_size, UCHAR *workspace,
+                        USHORT engine)
 {
         UCHAR *src_cur = src, *src_end = src + src_size;
         UCHAR *dst_cur = dst, *dst_end = dst + dst_size;
-        ULONG block_size;
+        UCHAR *chunk_end;
+        ULONG block_size, avail;
+
+        if (!workspace)
+            return STATUS_INVALID_PARAMETER;
 
         while (src_cur < src_end)
         {
             /* determine size of current chunk */
-            block_size = min(0x1000, src_end - src_cur);
-            if (dst_cur + sizeof(WORD) + block_size > dst_end)
+            block_size = min(LZNT1_CHUNK_SIZE, src_end - src_cur);
+            if (dst_cur + sizeof(WORD) > dst_end)
                 return STATUS_BUFFER_TOO_SMALL;
+            avail = dst_end - dst_cur - sizeof(WORD);
+
+            /* a compressed chunk is only kept if it is smaller than the stored one */
+            chunk_end = RtlpCompressChunkLZNT1(src_cur, block_size, dst_cur + sizeof(WORD),
+                                               dst_cur + sizeof(WORD) + min(avail, block_size - 1),
+                                               engine, (PRTLP_LZNT1_WORKSPACE)workspace);
+            if (chunk_end)
+            {
+                /* write compressed chunk header */
+                *(WORD *)dst_cur = 0xB000 | (chunk_end - dst_cur - sizeof(WORD) - 1);
+                dst_cur = chunk_end;
+            }
+            else
+            {
+                if (avail < block_size)
+                    return STATUS_BUFFER_TOO_SMALL;
 
-            /* write (uncompressed) chunk header */
-            *(WORD *)dst_cur = 0x3000 | (block_size - 1);
-            dst_cur += sizeof(WORD);
+                /* write (uncompressed) chunk header */
+                *(WORD *)dst_cur = 0x3000 | (block_size - 1);
+                dst_cur += sizeof(WORD);
+
+                /* write chunk content */
+                memcpy(dst_cur, src_cur, block_size);
+                dst_cur += block_size;
+            }
 
-            /* write chunk content */
-            memcpy(dst_cur, src_cur, block_size);
-            dst_cur += block_size;
             src_cur += block_size;
         }
 
@@ -253,15 +465,11 @@ RtlpWorkSpaceSizeLZNT1(USHORT Engine,
                        PULONG BufferAndWorkSpaceSize,
                        PULONG FragmentWorkSpaceSize)
 {
-   if (Engine == COMPRESSION_ENGINE_STANDARD)
-   {
-      *BufferAndWorkSpaceSize = 0x8010;
-      *FragmentWorkSpaceSize = 0x1000;
-      return(STATUS_SUCCESS);
-   }
-   else if (Engine == COMPRESSION_ENGINE_MAXIMUM)
+   if (Engine == COMPRESSION_ENGINE_STANDARD ||
+       Engine == COMPRESSION_ENGINE_MAXIMUM)
    {
-      *BufferAndWorkSpaceSize = 0x10;
+      /* Both engines share the hash chain tables, they only differ in search depth */
+      *BufferAndWorkSpaceSize = LZNT1_WORKSPACE_SIZE;
       *FragmentWorkSpaceSize = 0x1000;
       return(STATUS_SUCCESS);
    }
@@ -270,6 +478,932 @@ RtlpWorkSpaceSizeLZNT1(USHORT Engine,
 }
 
 
+/* Xpress (plain LZ77 and LZ77+Huffman) */
+
+#define XPRESS_MIN_MATCH            3
+#define XPRESS_MAX_MATCH            0xFFFF
+#define XPRESS_MAX_OFFSET           0x2000
+#define XPRESS_HASH_BITS            15
+#define XPRESS_HASH_SIZE            (1 << XPRESS_HASH_BITS)
+#define XPRESS_WINDOW_SIZE          0x10000
+#define XPRESS_STANDARD_DEPTH       16
+#define XPRESS_MAXIMUM_DEPTH        256
+
+#define XPRESS_HUFF_MAX_OFFSET      0xFFFF
+#define XPRESS_HUFF_BLOCK_SIZE      0x10000
+#define XPRESS_HUFF_SYMBOLS         512
+#define XPRESS_HUFF_TABLE_SIZE      (XPRESS_HUFF_SYMBOLS / 2)
+#define XPRESS_HUFF_MAX_CODE_LENGTH 15
+#define XPRESS_HUFF_END_OF_DATA     256
+#define XPRESS_HUFF_LOOKUP_BITS     9
+
+typedef struct _RTLP_XPRESS_WORKSPACE
+{
+    /* Most recent input position (+ 1) for each hash of three bytes, 0 if none */
+    ULONG HashHead[XPRESS_HASH_SIZE];
+    /* Previous input position (+ 1) with the same hash, indexed by position modulo the window */
+    ULONG HashChain[XPRESS_WINDOW_SIZE];
+} RTLP_XPRESS_WORKSPACE, *PRTLP_XPRESS_WORKSPACE;
+
+typedef struct _RTLP_XPRESS_TOKEN
+{
+    USHORT Length;  /* 0 for a literal */
+    USHORT Value;   /* Literal byte or match offset */
+} RTLP_XPRESS_TOKEN, *PRTLP_XPRESS_TOKEN;
+
+typedef struct _RTLP_XPRESS_HUFF_WORKSPACE
+{
+    RTLP_XPRESS_WORKSPACE Matcher;
+    RTLP_XPRESS_TOKEN Tokens[XPRESS_HUFF_BLOCK_SIZE];
+    ULONG Frequency[XPRESS_HUFF_SYMBOLS];
+    UCHAR CodeLength[XPRESS_HUFF_SYMBOLS];
+    USHORT Code[XPRESS_HUFF_SYMBOLS];
+    /* Scratch space to build the Huffman tree: leaves first, then internal nodes */
+    ULONG NodeWeight[2 * XPRESS_HUFF_SYMBOLS];
+    USHORT NodeParent[2 * XPRESS_HUFF_SYMBOLS];
+    USHORT Heap[XPRESS_HUFF_SYMBOLS + 1];
+} RTLP_XPRESS_HUFF_WORKSPACE, *PRTLP_XPRESS_HUFF_WORKSPACE;
+
+typedef struct _RTLP_XPRESS_BITSTREAM
+{
+    ULONG BitBuffer;
+    ULONG BitCount;
+    PUCHAR NextBits;    /* Where the current 16-bit unit goes */
+    PUCHAR NextBits2;   /* Where the following 16-bit unit goes */
+    PUCHAR NextByte;    /* Where extra length bytes go */
+    PUCHAR End;
+    BOOLEAN Overflow;
+} RTLP_XPRESS_BITSTREAM, *PRTLP_XPRESS_BITSTREAM;
+
+typedef struct _RTLP_XPRESS_HUFF_DECODER
+{
+    /* (Symbol << 4) | Length for codes up to XPRESS_HUFF_LOOKUP_BITS, 0 for longer ones */
+    USHORT Lookup[1 << XPRESS_HUFF_LOOKUP_BITS];
+    USHORT Count[XPRESS_HUFF_MAX_CODE_LENGTH + 1];
+    USHORT Symbols[XPRESS_HUFF_SYMBOLS];
+} RTLP_XPRESS_HUFF_DECODER, *PRTLP_XPRESS_HUFF_DECODER;
+
+FORCEINLINE
+ULONG
+RtlpXpressHash(PUCHAR Data)
+{
+    ULONG Value = (Data[0] << 16) | (Data[1] << 8) | Data[2];
+    return (Value * 0x9E3779B1) >> (32 - XPRESS_HASH_BITS);
+}
+
+FORCEINLINE
+VOID
+RtlpXpressInsert(PRTLP_XPRESS_WORKSPACE WorkSpace,
+                 PUCHAR Buffer,
+                 ULONG Size,
+                 ULONG Position)
+{
+    ULONG Hash;
+
+    if (Position + XPRESS_MIN_MATCH > Size)
+        return;
+
+    Hash = RtlpXpressHash(Buffer + Position);
+    WorkSpace->HashChain[Position & (XPRESS_WINDOW_SIZE - 1)] = WorkSpace->HashHead[Hash];
+    WorkSpace->HashHead[Hash] = Position + 1;
+}
+
+/* Walk the hash chain for Position, which must not be inserted yet */
+static ULONG
+RtlpXpressFindMatch(PRTLP_XPRESS_WORKSPACE WorkSpace,
+                    PUCHAR Buffer,
+                    ULONG Position,
+                    ULONG End,
+                    ULONG MaxOffset,
+                    ULONG MaxDepth,
+                    PULONG Offset)
+{
+    ULONG Candidate, Length, Limit, BestLength = 0;
+
+    Limit = min(XPRESS_MAX_MATCH, End - Position);
+    if (Limit < XPRESS_MIN_MATCH)
+        return 0;
+
+    Candidate = WorkSpace->HashHead[RtlpXpressHash(Buffer + Position)];
+    while (Candidate && MaxDepth--)
+    {
+        Candidate--;
+
+        /* Chains only get older, and older slots of the window may be reused */
+        if (Position - Candidate > MaxOffset)
+            break;
+
+        if (Buffer[Candidate + BestLength] == Buffer[Position + BestLength])
+        {
+            for (Length = 0; Length < Limit; Length++)
+            {
+                if (Buffer[Candidate + Length] != Buffer[Position + Length])
+                    break;
+            }
+
+            if (Length > BestLength)
+            {
+                BestLength = Length;
+                *Offset = Position - Candidate;
+                if (Length == Limit)
+                    break;
+            }
+        }
+
+        Candidate = WorkSpace->HashChain[Candidate & (XPRESS_WINDOW_SIZE - 1)];
+    }
+
+    return (BestLength >= XPRESS_MIN_MATCH) ? BestLength : 0;
+}
+
+/*
+ * Find the match to emit at Position, inserting every position it consumes.
+ * Returns 0 for a literal. The maximum engine defers a match by one byte when
+ * the next position matches longer.
+ */
+static ULONG
+RtlpXpressNextMatch(PRTLP_XPRESS_WORKSPACE WorkSpace,
+                    PUCHAR Buffer,
+                    ULONG Position,
+                    ULONG End,
+                    ULONG MaxOffset,
+                    USHORT Engine,
+                    PULONG Offset)
+{
+    ULONG Length, NextLength, NextOffset = 0, MaxDepth, i;
+
+    MaxDepth = (Engine == COMPRESSION_ENGINE_MAXIMUM) ? XPRESS_MAXIMUM_DEPTH : XPRESS_STANDARD_DEPTH;
+
+    Length = RtlpXpressFindMatch(WorkSpace, Buffer, Position, End, MaxOffset, MaxDepth, Offset);
+    RtlpXpressInsert(WorkSpace, Buffer, End, Position);
+
+    if (Length && Engine == COMPRESSION_ENGINE_MAXIMUM && Position + 1 < End)
+    {
+        NextLength = RtlpXpressFindMatch(WorkSpace, Buffer, Position + 1, End,
+                                         MaxOffset, MaxDepth, &NextOffset);
+        if (NextLength > Length)
+            return 0;
+    }
+
+    for (i = Position + 1; i < Position + Length; i++)
+        RtlpXpressInsert(WorkSpace, Buffer, End, i);
+
+    return Length;
+}
+
+static NTSTATUS
+RtlpCompressBufferXpress(PUCHAR Source,
+                         ULONG SourceSize,
+                         PUCHAR Dest,
+                         ULONG DestSize,
+                         PULONG FinalSize,
+                         USHORT Engine,
+                         PRTLP_XPRESS_WORKSPACE WorkSpace)
+{
+    PUCHAR DestCur = Dest, DestEnd = Dest + DestSize;
+    PUCHAR FlagsOutput, LastLengthHalfByte = NULL;
+    ULONG Position = 0, Flags = 0, FlagCount = 0;
+    ULONG Length, Offset = 0, Code;
+
+    if (!WorkSpace)
+        return STATUS_INVALID_PARAMETER;
+
+    RtlZeroMemory(WorkSpace->HashHead, sizeof(WorkSpace->HashHead));
+
+    if (DestSize < sizeof(ULONG))
+        return STATUS_BUFFER_TOO_SMALL;
+    FlagsOutput = DestCur;
+    DestCur += sizeof(ULONG);
+
+    while (Position < SourceSize)
+    {
+        Length = RtlpXpressNextMatch(WorkSpace, Source, Position, SourceSize,
+                                     XPRESS_MAX_OFFSET, Engine, &Offset);
+        if (!Length)
+        {
+            if (DestCur >= DestEnd)
+                return STATUS_BUFFER_TOO_SMALL;
+            *DestCur++ = Source[Position++];
+            Flags <<= 1;
+        }
+        else
+        {
+            Position += Length;
+            Length -= XPRESS_MIN_MATCH;
+            Code = (Offset - 1) << 3;
+
+            if (DestCur + sizeof(USHORT) > DestEnd)
+                return STATUS_BUFFER_TOO_SMALL;
+            *(PUSHORT)DestCur = (USHORT)(Code | min(Length, 7));
+            DestCur += sizeof(USHORT);
+
+            if (Length >= 7)
+            {
+                Length -= 7;
+
+                /* Two consecutive long matches share one byte for their first length nibble */
+                if (!LastLengthHalfByte)
+                {
+                    if (DestCur >= DestEnd)
+                        return STATUS_BUFFER_TOO_SMALL;
+                    LastLengthHalfByte = DestCur;
+                    *DestCur++ = (UCHAR)min(Length, 15);
+                }
+                else
+                {
+                    *LastLengthHalfByte |= (UCHAR)(min(Length, 15) << 4);
+                    LastLengthHalfByte = NULL;
+                }
+
+                if (Length >= 15)
+                {
+                    Length -= 15;
+                    if (Length < 255)
+                    {
+                        if (DestCur >= DestEnd)
+                            return STATUS_BUFFER_TOO_SMALL;
+                        *DestCur++ = (UCHAR)Length;
+                    }
+                    else
+                    {
+                        if (DestCur + 1 + sizeof(USHORT) > DestEnd)
+                            return STATUS_BUFFER_TOO_SMALL;
+                        *DestCur++ = 255;
+                        *(PUSHORT)DestCur = (USHORT)(Length + 15 + 7);
+                        DestCur += sizeof(USHORT);
+                    }
+                }
+            }
+
+            Flags = (Flags << 1) | 1;
+        }
+
+        if (++FlagCount == 32)
+        {
+            *(PULONG)FlagsOutput = Flags;
+            FlagCount = 0;
+
+            if (DestCur + sizeof(ULONG) > DestEnd)
+                return STATUS_BUFFER_TOO_SMALL;
+            FlagsOutput = DestCur;
+            DestCur += sizeof(ULONG);
+        }
+    }
+
+    /* Pad the last flags with ones, the decoder stops at a match past the end */
+    if (FlagCount)
+        Flags = (Flags << (32 - FlagCount)) | ((1UL << (32 - FlagCount)) - 1);
+    else
+        Flags = 0xFFFFFFFF;
+    *(PULONG)FlagsOutput = Flags;
+
+    if (FinalSize)
+        *FinalSize = DestCur - Dest;
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS
+RtlpDecompressBufferXpress(PUCHAR Dest,
+                           ULONG DestSize,
+                           PUCHAR Source,
+                           ULONG SourceSize,
+                           PULONG FinalSize)
+{
+    PUCHAR SourceCur = Source, SourceEnd = Source + SourceSize;
+    PUCHAR DestCur = Dest, DestEnd = Dest + DestSize;
+    PUCHAR LastLengthHalfByte = NULL;
+    ULONG Flags = 0, FlagCount = 0;
+    ULONG Length, Offset;
+
+    while (DestCur < DestEnd)
+    {
+        if (!FlagCount)
+        {
+            if (SourceCur + sizeof(ULONG) > SourceEnd)
+                break;
+            Flags = *(PULONG)SourceCur;
+            SourceCur += sizeof(ULONG);
+            FlagCount = 32;
+        }
+        FlagCount--;
+
+        if (!(Flags & (1UL << FlagCount)))
+        {
+            /* Literal */
+            if (SourceCur >= SourceEnd)
+                break;
+            *DestCur++ = *SourceCur++;
+            continue;
+        }
+
+        /* A match flag past the end of the input terminates the stream */
+        if (SourceCur == SourceEnd)
+            break;
+        if (SourceCur + sizeof(USHORT) > SourceEnd)
+            return STATUS_BAD_COMPRESSION_BUFFER;
+        Length = *(PUSHORT)SourceCur;
+        SourceCur += sizeof(USHORT);
+        Offset = (Length >> 3) + 1;
+        Length &= 7;
+
+        if (Length == 7)
+        {
+            if (!LastLengthHalfByte)
+            {
+                if (SourceCur >= SourceEnd)
+                    return STATUS_BAD_COMPRESSION_BUFFER;
+                LastLengthHalfByte = SourceCur;
+                Length = *SourceCur++ & 0xF;
+            }
+            else
+            {
+                Length = *LastLengthHalfByte >> 4;
+                LastLengthHalfByte = NULL;
+            }
+
+            if (Length == 15)
+            {
+                if (SourceCur >= SourceEnd)
+                    return STATUS_BAD_COMPRESSION_BUFFER;
+                Length = *SourceCur++;
+                if (Length == 255)
+                {
+                    if (SourceCur + sizeof(USHORT) > SourceEnd)
+                        return STATUS_BAD_COMPRESSION_BUFFER;
+                    Length = *(PUSHORT)SourceCur;
+                    SourceCur += sizeof(USHORT);
+                    if (!Length)
+                    {
+                        if (SourceCur + sizeof(ULONG) > SourceEnd)
+                            return STATUS_BAD_COMPRESSION_BUFFER;
+                        Length = *(PULONG)SourceCur;
+                        SourceCur += sizeof(ULONG);
+                    }
+                    if (Length < 15 + 7)
+                        return STATUS_BAD_COMPRESSION_BUFFER;
+                    Length -= 15 + 7;
+                }
+                Length += 15;
+            }
+            Length += 7;
+        }
+        Length += XPRESS_MIN_MATCH;
+
+        if (Offset > (ULONG)(DestCur - Dest))
+            return STATUS_BAD_COMPRESSION_BUFFER;
+
+        /* Source and destination may overlap, copy byte per byte */
+        while (Length-- && DestCur < DestEnd)
+        {
+            *DestCur = *(DestCur - Offset);
+            DestCur++;
+        }
+    }
+
+    if (FinalSize)
+        *FinalSize = DestCur - Dest;
+
+    return STATUS_SUCCESS;
+}
+
+static VOID
+RtlpXpressWriteBits(PRTLP_XPRESS_BITSTREAM Stream,
+                    ULONG Bits,
+                    ULONG Count)
+{
+    Stream->BitBuffer = (Stream->BitBuffer << Count) | Bits;
+    Stream->BitCount += Count;
+
+    /* Keep up to 16 pending bits, the decoder refills once it has consumed more */
+    if (Stream->BitCount > 16)
+    {
+        Stream->BitCount -= 16;
+        if (Stream->NextByte + sizeof(USHORT) > Stream->End)
+        {
+            Stream->Overflow = TRUE;
+            return;
+        }
+        *(PUSHORT)Stream->NextBits = (USHORT)(Stream->BitBuffer >> Stream->BitCount);
+        Stream->NextBits = Stream->NextBits2;
+        Stream->NextBits2 = Stream->NextByte;
+        Stream->NextByte += sizeof(USHORT);
+    }
+}
+
+static VOID
+RtlpXpressWriteByte(PRTLP_XPRESS_BITSTREAM Stream,
+                    UCHAR Byte)
+{
+    if (Stream->NextByte >= Stream->End)
+    {
+        Stream->Overflow = TRUE;
+        return;
+    }
+    *Stream->NextByte++ = Byte;
+}
+
+static VOID
+RtlpXpressWriteUShort(PRTLP_XPRESS_BITSTREAM Stream,
+                      USHORT Value)
+{
+    if (Stream->NextByte + sizeof(USHORT) > Stream->End)
+    {
+        Stream->Overflow = TRUE;
+        return;
+    }
+    *(PUSHORT)Stream->NextByte = Value;
+    Stream->NextByte += sizeof(USHORT);
+}
+
+static VOID
+RtlpXpressHuffSiftDown(PRTLP_XPRESS_HUFF_WORKSPACE WorkSpace,
+                       ULONG HeapSize,
+                       ULONG Index)
+{
+    PUSHORT Heap = WorkSpace->Heap;
+    PULONG Weight = WorkSpace->NodeWeight;
+    ULONG Child;
+    USHORT Node = Heap[Index];
+
+    while ((Child = 2 * Index) <= HeapSize)
+    {
+        if (Child < HeapSize && Weight[Heap[Child + 1]] < Weight[Heap[Child]])
+            Child++;
+        if (Weight[Node] <= Weight[Heap[Child]])
+            break;
+        Heap[Index] = Heap[Child];
+        Index = Child;
+    }
+    Heap[Index] = Node;
+}
+
+/* Compute code lengths limited to 15 bits and the canonical codes for one block */
+static VOID
+RtlpXpressHuffBuildCodes(PRTLP_XPRESS_HUFF_WORKSPACE WorkSpace)
+{
+    USHORT NextCode[XPRESS_HUFF_MAX_CODE_LENGTH + 2];
+    USHORT LengthCount[XPRESS_HUFF_MAX_CODE_LENGTH + 1];
+    ULONG HeapSize, NodeCount, Symbol, Length, MaxLength, Shift = 0;
+    USHORT First, Second;
+
+    /* A valid code needs at least two symbols */
+    if (!WorkSpace->Frequency[0])
+        WorkSpace->Frequency[0] = 1;
+    if (!WorkSpace->Frequency[1])
+        WorkSpace->Frequency[1] = 1;
+
+    for (;;)
+    {
+        /* Build the Huffman tree with a min-heap, scaling the weights on overflow */
+        HeapSize = 0;
+        for (Symbol = 0; Symbol < XPRESS_HUFF_SYMBOLS; Symbol++)
+        {
+            if (WorkSpace->Frequency[Symbol])
+            {
+                WorkSpace->NodeWeight[Symbol] = max(WorkSpace->Frequency[Symbol] >> Shift, 1);
+                WorkSpace->Heap[++HeapSize] = (USHORT)Symbol;
+            }
+        }
+
+        for (Symbol = HeapSize / 2; Symbol > 0; Symbol--)
+            RtlpXpressHuffSiftDown(WorkSpace, HeapSize, Symbol);
+
+        NodeCount = XPRESS_HUFF_SYMBOLS;
+        while (HeapSize > 1)
+        {
+            First = WorkSpace->Heap[1];
+            WorkSpace->Heap[1] = WorkSpace->Heap[HeapSize--];
+            RtlpXpressHuffSiftDown(WorkSpace, HeapSize, 1);
+            Second = WorkSpace->Heap[1];
+
+            WorkSpace->NodeWeight[NodeCount] = WorkSpace->NodeWeight[First] +
+                                               WorkSpace->NodeWeight[Second];
+            WorkSpace->NodeParent[First] = (USHORT)NodeCount;
+            WorkSpace->NodeParent[Second] = (USHORT)NodeCount;
+            WorkSpace->Heap[1] = (USHORT)NodeCount++;
+            RtlpXpressHuffSiftDown(WorkSpace, HeapSize, 1);
+        }
+
+        /* The root is the last node, parents always have higher indices */
+        MaxLength = 0;
+        WorkSpace->NodeWeight[NodeCount - 1] = 0;
+        for (Symbol = NodeCount - 1; Symbol-- > XPRESS_HUFF_SYMBOLS; )
+            WorkSpace->NodeWeight[Symbol] = WorkSpace->NodeWeight[WorkSpace->NodeParent[Symbol]] + 1;
+
+        for (Symbol = 0; Symbol < XPRESS_HUFF_SYMBOLS; Symbol++)
+        {
+            Length = 0;
+            if (WorkSpace->Frequency[Symbol])
+                Length = WorkSpace->NodeWeight[WorkSpace->NodeParent[Symbol]] + 1;
+            WorkSpace->CodeLength[Symbol] = (UCHAR)min(Length, 0xFF);
+            MaxLength = max(MaxLength, Length);
+        }
+
+        if (MaxLength <= XPRESS_HUFF_MAX_CODE_LENGTH)
+            break;
+
+        Shift++;
+    }
+
+    /* Canonical codes, ordered by length and then by symbol value */
+    RtlZeroMemory(LengthCount, sizeof(LengthCount));
+    for (Symbol = 0; Symbol < XPRESS_HUFF_SYMBOLS; Symbol++)
+        LengthCount[WorkSpace->CodeLength[Symbol]]++;
+    LengthCount[0] = 0;
+
+    NextCode[1] = 0;
+    for (Length = 1; Length <= XPRESS_HUFF_MAX_CODE_LENGTH; Length++)
+        NextCode[Length + 1] = (NextCode[Length] + LengthCount[Length]) << 1;
+
+    for (Symbol = 0; Symbol < XPRESS_HUFF_SYMBOLS; Symbol++)
+    {
+        Length = WorkSpace->CodeLength[Symbol];
+        if (Length)
+            WorkSpace->Code[Symbol] = NextCode[Length]++;
+    }
+}
+
+static VOID
+RtlpXpressHuffWriteSymbol(PRTLP_XPRESS_BITSTREAM Stream,
+                          PRTLP_XPRESS_HUFF_WORKSPACE WorkSpace,
+                          ULONG Symbol)
+{
+    RtlpXpressWriteBits(Stream, WorkSpace->Code[Symbol], WorkSpace->CodeLength[Symbol]);
+}
+
+static NTSTATUS
+RtlpCompressBufferXpressHuff(PUCHAR Source,
+                             ULONG SourceSize,
+                             PUCHAR Dest,
+                             ULONG DestSize,
+                             PULONG FinalSize,
+                             USHORT Engine,
+                             PRTLP_XPRESS_HUFF_WORKSPACE WorkSpace)
+{
+    PUCHAR DestCur = Dest, DestEnd = Dest + DestSize;
+    RTLP_XPRESS_BITSTREAM Stream;
+    ULONG Position = 0, BlockEnd, TokenCount, Length, Offset = 0;
+    ULONG Symbol, OffsetBits, i;
+    BOOLEAN LastBlock;
+
+    if (!WorkSpace)
+        return STATUS_INVALID_PARAMETER;
+
+    RtlZeroMemory(WorkSpace->Matcher.HashHead, sizeof(WorkSpace->Matcher.HashHead));
+
+    do
+    {
+        /* An input ending on a block boundary gets an extra block with only the end marker */
+        BlockEnd = min(Position + XPRESS_HUFF_BLOCK_SIZE, SourceSize);
+        LastBlock = (BlockEnd - Position < XPRESS_HUFF_BLOCK_SIZE);
+
+        /* Collect the tokens of this block and their symbol frequencies */
+        RtlZeroMemory(WorkSpace->Frequency, sizeof(WorkSpace->Frequency));
+        TokenCount = 0;
+        while (Position < BlockEnd)
+        {
+            Length = RtlpXpressNextMatch(&WorkSpace->Matcher, Source, Position, BlockEnd,
+                                         XPRESS_HUFF_MAX_OFFSET, Engine, &Offset);
+
+            /* Symbol 256 doubles as the end marker, emit such a match as literals */
+            if (Length == XPRESS_MIN_MATCH && Offset == 1)
+            {
+                for (i = 0; i < XPRESS_MIN_MATCH; i++)
+                {
+                    WorkSpace->Tokens[TokenCount].Length = 0;
+                    WorkSpace->Tokens[TokenCount].Value = Source[Position];
+                    WorkSpace->Frequency[Source[Position]]++;
+                    TokenCount++;
+                    Position++;
+                }
+                continue;
+            }
+
+            if (!Length)
+            {
+                WorkSpace->Tokens[TokenCount].Length = 0;
+                WorkSpace->Tokens[TokenCount].Value = Source[Position];
+                WorkSpace->Frequency[Source[Position]]++;
+                Position++;
+            }
+            else
+            {
+                OffsetBits = 0;
+                while ((Offset >> (OffsetBits + 1)) != 0)
+                    OffsetBits++;
+
+                WorkSpace->Tokens[TokenCount].Length = (USHORT)Length;
+                WorkSpace->Tokens[TokenCount].Value = (USHORT)Offset;
+                WorkSpace->Frequency[256 + (OffsetBits << 4) +
+                                     min(Length - XPRESS_MIN_MATCH, 15)]++;
+                Position += Length;
+            }
+            TokenCount++;
+        }
+
+        if (LastBlock)
+            WorkSpace->Frequency[XPRESS_HUFF_END_OF_DATA]++;
+
+        RtlpXpressHuffBuildCodes(WorkSpace);
+
+        /* Code length table: two 4-bit lengths per byte, even symbols in the low nibble */
+        if (DestCur + XPRESS_HUFF_TABLE_SIZE + 2 * sizeof(USHORT) > DestEnd)
+            return STATUS_BUFFER_TOO_SMALL;
+        for (i = 0; i < XPRESS_HUFF_TABLE_SIZE; i++)
+            DestCur[i] = WorkSpace->CodeLength[2 * i] | (WorkSpace->CodeLength[2 * i + 1] << 4);
+        DestCur += XPRESS_HUFF_TABLE_SIZE;
+
+        Stream.BitBuffer = 0;
+        Stream.BitCount = 0;
+        Stream.NextBits = DestCur;
+        Stream.NextBits2 = DestCur + sizeof(USHORT);
+        Stream.NextByte = DestCur + 2 * sizeof(USHORT);
+        Stream.End = DestEnd;
+        Stream.Overflow = FALSE;
+
+        for (i = 0; i < TokenCount && !Stream.Overflow; i++)
+        {
+            Length = WorkSpace->Tokens[i].Length;
+            if (!Length)
+            {
+                RtlpXpressHuffWriteSymbol(&Stream, WorkSpace, WorkSpace->Tokens[i].Value);
+                continue;
+            }
+
+            Offset = WorkSpace->Tokens[i].Value;
+            OffsetBits = 0;
+            while ((Offset >> (OffsetBits + 1)) != 0)
+                OffsetBits++;
+
+            Length -= XPRESS_MIN_MATCH;
+            Symbol = 256 + (OffsetBits << 4) + min(Length, 15);
+            RtlpXpressHuffWriteSymbol(&Stream, WorkSpace, Symbol);
+
+            if (Length >= 15)
+            {
+                if (Length - 15 < 255)
+                {
+                    RtlpXpressWriteByte(&Stream, (UCHAR)(Length - 15));
+                }
+                else
+                {
+                    RtlpXpressWriteByte(&Stream, 255);
+                    RtlpXpressWriteUShort(&Stream, (USHORT)Length);
+                }
+            }
+
+            RtlpXpressWriteBits(&Stream, Offset - (1 << OffsetBits), OffsetBits);
+        }
+
+        if (LastBlock)
+            RtlpXpressHuffWriteSymbol(&Stream, WorkSpace, XPRESS_HUFF_END_OF_DATA);
+
+        if (Stream.Overflow)
+            return STATUS_BUFFER_TOO_SMALL;
+
+        /* Flush the pending bits, the decoder has already read both reserved units */
+        *(PUSHORT)Stream.NextBits = (USHORT)(Stream.BitBuffer << (16 - Stream.BitCount));
+        *(PUSHORT)Stream.NextBits2 = 0;
+        DestCur = Stream.NextByte;
+    } while (!LastBlock);
+
+    if (FinalSize)
+        *FinalSize = DestCur - Dest;
+
+    return STATUS_SUCCESS;
+}
+
+static BOOLEAN
+RtlpXpressHuffBuildDecoder(PRTLP_XPRESS_HUFF_DECODER Decoder,
+                           PUCHAR Table)
+{
+    USHORT Offset[XPRESS_HUFF_MAX_CODE_LENGTH + 1];
+    ULONG Symbol, Length, Code, Fill, Entry, Left;
+
+    RtlZeroMemory(Decoder->Count, sizeof(Decoder->Count));
+    for (Symbol = 0; Symbol < XPRESS_HUFF_SYMBOLS; Symbol++)
+        Decoder->Count[(Table[Symbol / 2] >> (4 * (Symbol % 2))) & 0xF]++;
+    Decoder->Count[0] = 0;
+
+    /* Reject over-subscribed code sets */
+    Left = 1;
+    for (Length = 1; Length <= XPRESS_HUFF_MAX_CODE_LENGTH; Length++)
+    {
+        Left <<= 1;
+        if (Decoder->Count[Length] > Left)
+            return FALSE;
+        Left -= Decoder->Count[Length];
+    }
+
+    /* Sort the symbols canonically */
+    Offset[1] = 0;
+    for (Length = 1; Length < XPRESS_HUFF_MAX_CODE_LENGTH; Length++)
+        Offset[Length + 1] = Offset[Length] + Decoder->Count[Length];
+    for (Symbol = 0; Symbol < XPRESS_HUFF_SYMBOLS; Symbol++)
+    {
+        Length = (Table[Symbol / 2] >> (4 * (Symbol % 2))) & 0xF;
+        if (Length)
+            Decoder->Symbols[Offset[Length]++] = (USHORT)Symbol;
+    }
+
+    /* Fill the direct lookup table with all the short codes */
+    RtlZeroMemory(Decoder->Lookup, sizeof(Decoder->Lookup));
+    Code = 0;
+    Entry = 0;
+    for (Length = 1; Length <= XPRESS_HUFF_LOOKUP_BITS; Length++)
+    {
+        for (Symbol = 0; Symbol < Decoder->Count[Length]; Symbol++, Entry++, Code++)
+        {
+            for (Fill = 0; Fill < (1UL << (XPRESS_HUFF_LOOKUP_BITS - Length)); Fill++)
+            {
+                Decoder->Lookup[(Code << (XPRESS_HUFF_LOOKUP_BITS - Length)) + Fill] =
+                    (USHORT)((Decoder->Symbols[Entry] << 4) | Length);
+            }
+        }
+        Code <<= 1;
+    }
+
+    return TRUE;
+}
+
+/* Decode one symbol from the top 15 bits of the bit buffer, 0 length if invalid */
+static ULONG
+RtlpXpressHuffDecodeSymbol(PRTLP_XPRESS_HUFF_DECODER Decoder,
+                           ULONG Next15Bits,
+                           PULONG SymbolLength)
+{
+    ULONG Entry, Length, Code = 0, First = 0, Index = 0, Count;
+
+    Entry = Decoder->Lookup[Next15Bits >> (XPRESS_HUFF_MAX_CODE_LENGTH - XPRESS_HUFF_LOOKUP_BITS)];
+    if (Entry)
+    {
+        *SymbolLength = Entry & 0xF;
+        return Entry >> 4;
+    }
+
+    /* Long code: canonical decoding one bit at a time */
+    for (Length = 1; Length <= XPRESS_HUFF_MAX_CODE_LENGTH; Length++)
+    {
+        Code |= (Next15Bits >> (XPRESS_HUFF_MAX_CODE_LENGTH - Length)) & 1;
+        Count = Decoder->Count[Length];
+        if (Code - First < Count)
+        {
+            *SymbolLength = Length;
+            return Decoder->Symbols[Index + Code - First];
+        }
+        Index += Count;
+        First = (First + Count) << 1;
+        Code <<= 1;
+    }
+
+    *SymbolLength = 0;
+    return 0;
+}
+
+static NTSTATUS
+RtlpDecompressBufferXpressHuff(PUCHAR Dest,
+                               ULONG DestSize,
+                               PUCHAR Source,
+                               ULONG SourceSize,
+                               PULONG FinalSize)
+{
+    PUCHAR SourceCur = Source, SourceEnd = Source + SourceSize;
+    PUCHAR DestCur = Dest, DestEnd = Dest + DestSize, BlockEnd;
+    RTLP_XPRESS_HUFF_DECODER Decoder;
+    ULONG NextBits, Symbol, SymbolLength, Length, Offset, OffsetBits;
+    LONG ExtraBitCount;
+
+#define XPRESS_HUFF_CONSUME(n)                                              \
+    do {                                                                    \
+        NextBits <<= (n);                                                   \
+        ExtraBitCount -= (n);                                               \
+        if (ExtraBitCount < 0)                                              \
+        {                                                                   \
+            if (SourceCur + sizeof(USHORT) > SourceEnd)                     \
+                return STATUS_BAD_COMPRESSION_BUFFER;                       \
+            NextBits |= (ULONG)*(PUSHORT)SourceCur << (-ExtraBitCount);     \
+            SourceCur += sizeof(USHORT);                                    \
+            ExtraBitCount += 16;                                            \
+        }                                                                   \
+    } while (0)
+
+    while (DestCur < DestEnd)
+    {
+        if (SourceCur + XPRESS_HUFF_TABLE_SIZE + 2 * sizeof(USHORT) > SourceEnd)
+        {
+            /* Nothing left but padding: done */
+            if (SourceCur == SourceEnd)
+                break;
+            return STATUS_BAD_COMPRESSION_BUFFER;
+        }
+
+        if (!RtlpXpressHuffBuildDecoder(&Decoder, SourceCur))
+            return STATUS_BAD_COMPRESSION_BUFFER;
+        SourceCur += XPRESS_HUFF_TABLE_SIZE;
+
+        NextBits = ((ULONG)((PUSHORT)SourceCur)[0] << 16) | ((PUSHORT)SourceCur)[1];
+        SourceCur += 2 * sizeof(USHORT);
+        ExtraBitCount = 16;
+
+        BlockEnd = (DestEnd - DestCur > XPRESS_HUFF_BLOCK_SIZE) ?
+                   DestCur + XPRESS_HUFF_BLOCK_SIZE : DestEnd;
+        while (DestCur < BlockEnd)
+        {
+            Symbol = RtlpXpressHuffDecodeSymbol(&Decoder, NextBits >> (32 - 15), &SymbolLength);
+            if (!SymbolLength)
+                return STATUS_BAD_COMPRESSION_BUFFER;
+            XPRESS_HUFF_CONSUME(SymbolLength);
+
+            if (Symbol < 256)
+            {
+                *DestCur++ = (UCHAR)Symbol;
+                continue;
+            }
+
+            if (Symbol == XPRESS_HUFF_END_OF_DATA && SourceCur == SourceEnd)
+                goto out;
+
+            Symbol -= 256;
+            Length = Symbol & 0xF;
+            OffsetBits = Symbol >> 4;
+            if (Length == 15)
+            {
+                if (SourceCur >= SourceEnd)
+                    return STATUS_BAD_COMPRESSION_BUFFER;
+                Length = *SourceCur++;
+                if (Length == 255)
+                {
+                    if (SourceCur + sizeof(USHORT) > SourceEnd)
+                        return STATUS_BAD_COMPRESSION_BUFFER;
+                    Length = *(PUSHORT)SourceCur;
+                    SourceCur += sizeof(USHORT);
+                    if (!Length)
+                    {
+                        if (SourceCur + sizeof(ULONG) > SourceEnd)
+                            return STATUS_BAD_COMPRESSION_BUFFER;
+                        Length = *(PULONG)SourceCur;
+                        SourceCur += sizeof(ULONG);
+                    }
+                    if (Length < 15)
+                        return STATUS_BAD_COMPRESSION_BUFFER;
+                    Length -= 15;
+                }
+                Length += 15;
+            }
+            Length += XPRESS_MIN_MATCH;
+
+            Offset = 1 << OffsetBits;
+            if (OffsetBits)
+            {
+                Offset += NextBits >> (32 - OffsetBits);
+                XPRESS_HUFF_CONSUME(OffsetBits);
+            }
+
+            if (Offset > (ULONG)(DestCur - Dest))
+                return STATUS_BAD_COMPRESSION_BUFFER;
+
+            /* Matches may run past the block end, only the output size limits them */
+            while (Length-- && DestCur < DestEnd)
+            {
+                *DestCur = *(DestCur - Offset);
+                DestCur++;
+            }
+        }
+    }
+
+#undef XPRESS_HUFF_CONSUME
+
+out:
+    if (FinalSize)
+        *FinalSize = DestCur - Dest;
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS
+RtlpWorkSpaceSizeXpress(USHORT Format,
+                        USHORT Engine,
+                        PULONG BufferAndWorkSpaceSize,
+                        PULONG FragmentWorkSpaceSize)
+{
+    if (Engine != COMPRESSION_ENGINE_STANDARD &&
+        Engine != COMPRESSION_ENGINE_MAXIMUM)
+    {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    if (Format == COMPRESSION_FORMAT_XPRESS_HUFF)
+        *BufferAndWorkSpaceSize = sizeof(RTLP_XPRESS_HUFF_WORKSPACE);
+    else
+        *BufferAndWorkSpaceSize = sizeof(RTLP_XPRESS_WORKSPACE);
+
+    /* Decompression needs no workspace */
+    *FragmentWorkSpaceSize = 0;
+    return STATUS_SUCCESS;
+}
+
+
 /*
  * @implemented
  */
@@ -284,7 +1418,7 @@ RtlCompressBuffer(IN USHORT CompressionFormatAndEngine,
                   IN PVOID WorkSpace)
 {
    USHORT Format = CompressionFormatAndEngine & COMPRESSION_FORMAT_MASK;
-   /* USHORT Engine = CompressionFormatAndEngine & COMPRESSION_ENGINE_MASK; */
+   USHORT Engine = CompressionFormatAndEngine & COMPRESSION_ENGINE_MASK;
 
    if ((Format == COMPRESSION_FORMAT_NONE) ||
          (Format == COMPRESSION_FORMAT_DEFAULT))
@@ -297,7 +1431,26 @@ RtlCompressBuffer(IN USHORT CompressionFormatAndEngine,
                                      CompressedBufferSize,
                                      UncompressedChunkSize,
                                      FinalCompressedSize,
-                                     WorkSpace));
+                                     WorkSpace,
+                                     Engine));
+
+   if (Format == COMPRESSION_FORMAT_XPRESS)
+      return(RtlpCompressBufferXpress(UncompressedBuffer,
+                                      UncompressedBufferSize,
+                                      CompressedBuffer,
+                                      CompressedBufferSize,
+                                      FinalCompressedSize,
+                                      Engine,
+                                      WorkSpace));
+
+   if (Format == COMPRESSION_FORMAT_XPRESS_HUFF)
+      return(RtlpCompressBufferXpressHuff(UncompressedBuffer,
+                                          UncompressedBufferSize,
+                                          CompressedBuffer,
+                                          CompressedBufferSize,
+                                          FinalCompressedSize,
+                                          Engine,
+                                          WorkSpace));
 
    return(STATUS_UNSUPPORTED_COMPRESSION);
 }
@@ -357,6 +1510,22 @@ RtlDecompressFragment(IN USHORT format,
             return lznt1_decompress(uncompressed, uncompressed_size, compressed,
                                     compressed_size, offset, final_size, workspace);
 
+        case COMPRESSION_FORMAT_XPRESS:
+        case COMPRESSION_FORMAT_XPRESS_HUFF:
+            /* Xpress streams have no chunk structure to seek into */
+            if (offset)
+            {
+                DPRINT1("offset %u not supported for format %d\n", offset, format);
+                return STATUS_UNSUPPORTED_COMPRESSION;
+            }
+
+            if ((format & ~COMPRESSION_ENGINE_MAXIMUM) == COMPRESSION_FORMAT_XPRESS)
+                return RtlpDecompressBufferXpress(uncompressed, uncompressed_size, compressed,
+                                                  compressed_size, final_size);
+
+            return RtlpDecompressBufferXpressHuff(uncompressed, uncompressed_size, compressed,
+                                                  compressed_size, final_size);
+
         case COMPRESSION_FORMAT_NONE:
         case COMPRESSION_FORMAT_DEFAULT:
             return STATUS_INVALID_PARAMETER;
@@ -417,6 +1586,13 @@ RtlGetCompressionWorkSpaceSize(IN USHORT CompressionFormatAndEngine,
                                     CompressBufferAndWorkSpaceSize,
                                     CompressFragmentWorkSpaceSize));
 
+   if ((Format == COMPRESSION_FORMAT_XPRESS) ||
+         (Format == COMPRESSION_FORMAT_XPRESS_HUFF))
+      return(RtlpWorkSpaceSizeXpress(Format,
+                                     Engine,
+                                     CompressBufferAndWorkSpaceSize,
+                                     CompressFragmentWorkSpaceSize));
+
    return(STATUS_UNSUPPORTED_COMPRESSION);
 }
 
@@ -1563,6 +1563,10 @@ RtlDestroyHeap(HANDLE HeapPtr) /* [in] Handle of heap */
     if (RtlpGetMode() == UserMode &&
         HeapPtr == NtCurrentPeb()->ProcessHeap) return HeapPtr;
 
+    /* Release the front end, its blocks live in the segments */
+    RtlpDestroyHeapLookaside(Heap);
+    RtlpDestroyLowFragmentationHeap(Heap);
+
     /* Free up all big allocations */
     Current = Heap->VirtualAllocdBlocks.Flink;
     while (Current != &Heap->VirtualAllocdBlocks)
@@ -1902,6 +1906,145 @@ RtlpAllocateNonDedicated(PHEAP Heap,
     return NULL;
 }
 
+NTSTATUS NTAPI
+RtlpActivateHeapLookaside(PHEAP Heap)
+{
+    PHEAP_LOOKASIDE Lookaside = NULL;
+    SIZE_T Size = HEAP_LOOKASIDE_LISTS * sizeof(HEAP_LOOKASIDE);
+    NTSTATUS Status;
+    ULONG i;
+
+    if (Heap->FrontEndHeapType == HEAP_FRONT_LOOKASIDE)
+        return STATUS_SUCCESS;
+
+    /* Cached blocks must look like any other busy block */
+    if (RtlpGetMode() != UserMode ||
+        (Heap->ForceFlags & HEAP_FLAG_PAGE_ALLOCS) ||
+        RtlpHeapIsSpecial(Heap->Flags) ||
+        (Heap->Flags & (HEAP_NO_SERIALIZE |
+                        HEAP_TAIL_CHECKING_ENABLED |
+                        HEAP_FREE_CHECKING_ENABLED)))
+    {
+        DPRINT1("HEAP: Cannot enable lookasides on heap %p with flags 0x%lx\n", Heap, Heap->Flags);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    Status = ZwAllocateVirtualMemory(NtCurrentProcess(),
+                                     (PVOID *)&Lookaside,
+                                     0,
+                                     &Size,
+                                     MEM_RESERVE | MEM_COMMIT,
+                                     PAGE_READWRITE);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("HEAP: Failed to allocate the lookaside lists (Status 0x%08x)\n", Status);
+        return Status;
+    }
+
+    for (i = 0; i < HEAP_LOOKASIDE_LISTS; i++)
+    {
+        RtlInitializeSListHead(&Lookaside[i].ListHead);
+        Lookaside[i].MaximumDepth = HEAP_LOOKASIDE_DEPTH;
+    }
+
+    /* Publish it, unless another front end was enabled meanwhile */
+    RtlEnterHeapLock(Heap->LockVariable, TRUE);
+    if (Heap->FrontEndHeapType == HEAP_FRONT_NONE)
+    {
+        InterlockedExchangePointer(&Heap->FrontEndHeap, Lookaside);
+        Heap->FrontEndHeapType = HEAP_FRONT_LOOKASIDE;
+        Lookaside = NULL;
+    }
+    else if (Heap->FrontEndHeapType != HEAP_FRONT_LOOKASIDE)
+    {
+        Status = STATUS_UNSUCCESSFUL;
+    }
+    RtlLeaveHeapLock(Heap->LockVariable);
+
+    if (Lookaside)
+    {
+        Size = 0;
+        ZwFreeVirtualMemory(NtCurrentProcess(), (PVOID *)&Lookaside, &Size, MEM_RELEASE);
+    }
+
+    return Status;
+}
+
+VOID NTAPI
+RtlpDestroyHeapLookaside(PHEAP Heap)
+{
+    PVOID Lookaside = Heap->FrontEndHeap;
+    SIZE_T Size = 0;
+
+    if (Heap->FrontEndHeapType != HEAP_FRONT_LOOKASIDE)
+        return;
+
+    Heap->FrontEndHeapType = HEAP_FRONT_NONE;
+    Heap->FrontEndHeap = NULL;
+
+    /* Cached blocks are busy blocks of the segments and go away with them */
+    ZwFreeVirtualMemory(NtCurrentProcess(), &Lookaside, &Size, MEM_RELEASE);
+}
+
+PVOID NTAPI
+RtlpAllocateFromHeapLookaside(PHEAP Heap,
+                              ULONG Flags,
+                              SIZE_T Size,
+                              SIZE_T Index,
+                              UCHAR EntryFlags)
+{
+    PHEAP_LOOKASIDE Lookaside = &((PHEAP_LOOKASIDE)Heap->FrontEndHeap)[Index];
+    PHEAP_ENTRY InUseEntry;
+
+    /* The counters are statistics only, they are not updated atomically */
+    Lookaside->TotalAllocates++;
+
+    InUseEntry = (PHEAP_ENTRY)RtlInterlockedPopEntrySList(&Lookaside->ListHead);
+    if (!InUseEntry)
+    {
+        Lookaside->AllocateMisses++;
+        return NULL;
+    }
+
+    /* The list links live in the user area, get the header back */
+    InUseEntry--;
+    InUseEntry->Flags = EntryFlags | (InUseEntry->Flags & HEAP_ENTRY_LAST_ENTRY);
+    InUseEntry->UnusedBytes = (UCHAR)((Index << HEAP_ENTRY_SHIFT) - Size);
+
+    if (Flags & HEAP_ZERO_MEMORY)
+        RtlZeroMemory(InUseEntry + 1, Size);
+
+    return InUseEntry + 1;
+}
+
+BOOLEAN NTAPI
+RtlpFreeToHeapLookaside(PHEAP Heap,
+                        PHEAP_ENTRY HeapEntry)
+{
+    PHEAP_LOOKASIDE Lookaside;
+
+    /* Only plain busy blocks of the segments are cached */
+    if (((ULONG_PTR)HeapEntry & (HEAP_ENTRY_SIZE - 1)) ||
+        (HeapEntry->Flags & (HEAP_ENTRY_BUSY | HEAP_ENTRY_VIRTUAL_ALLOC | HEAP_ENTRY_EXTRA_PRESENT)) != HEAP_ENTRY_BUSY ||
+        HeapEntry->SegmentOffset >= HEAP_SEGMENTS ||
+        HeapEntry->Size >= HEAP_LOOKASIDE_LISTS)
+    {
+        return FALSE;
+    }
+
+    Lookaside = &((PHEAP_LOOKASIDE)Heap->FrontEndHeap)[HeapEntry->Size];
+    Lookaside->TotalFrees++;
+
+    if (RtlQueryDepthSList(&Lookaside->ListHead) >= Lookaside->MaximumDepth)
+    {
+        Lookaside->FreeMisses++;
+        return FALSE;
+    }
+
+    RtlInterlockedPushEntrySList(&Lookaside->ListHead, (PSLIST_ENTRY)(HeapEntry + 1));
+    return TRUE;
+}
+
 /***********************************************************************
  *           HeapAlloc   (KERNEL32.334)
  * RETURNS
@@ -1928,6 +2071,7 @@ RtlAllocateHeap(IN PVOID HeapPtr,
     BOOLEAN HeapLocked = FALSE;
     PHEAP_VIRTUAL_ALLOC_ENTRY VirtualBlock = NULL;
     PHEAP_ENTRY_EXTRA Extra;
+    PVOID FrontEndBlock;
     NTSTATUS Status;
 
     /* Force flags */
@@ -1977,6 +2121,24 @@ RtlAllocateHeap(IN PVOID HeapPtr,
 
     Index = AllocationSize >> HEAP_ENTRY_SHIFT;
 
+    /* Recently freed blocks of the same size are cached in the lookaside lists */
+    if (Heap->FrontEndHeapType == HEAP_FRONT_LOOKASIDE &&
+        Index < HEAP_LOOKASIDE_LISTS &&
+        !(EntryFlags & HEAP_ENTRY_EXTRA_PRESENT))
+    {
+        FrontEndBlock = RtlpAllocateFromHeapLookaside(Heap, Flags, Size, Index, EntryFlags);
+        if (FrontEndBlock) return FrontEndBlock;
+    }
+
+    /* Small blocks come from the low fragmentation heap if it is enabled */
+    if (Heap->FrontEndHeapType == HEAP_FRONT_LOWFRAGHEAP &&
+        Index <= HEAP_LFH_MAX_BLOCK_UNITS &&
+        !(EntryFlags & HEAP_ENTRY_EXTRA_PRESENT))
+    {
+        FrontEndBlock = RtlpLowFragHeapAllocate(Heap, Flags, Size, AllocationSize, EntryFlags);
+        if (FrontEndBlock) return FrontEndBlock;
+    }
+
     /* Acquire the lock if necessary */
     if (!(Flags & HEAP_NO_SERIALIZE))
     {
@@ -2180,6 +2342,23 @@ BOOLEAN NTAPI RtlFreeHeap(
     if (RtlpHeapIsSpecial(Flags))
         return RtlDebugFreeHeap(Heap, Flags, Ptr);
 
+    /* Get pointer to the heap entry */
+    HeapEntry = (PHEAP_ENTRY)Ptr - 1;
+
+    /* Low fragmentation heap blocks do not need the heap lock */
+    if (HeapEntry->SegmentOffset == HEAP_LFH_SEGMENT_OFFSET &&
+        Heap->FrontEndHeapType == HEAP_FRONT_LOWFRAGHEAP)
+    {
+        return RtlpLowFragHeapFree(Heap, HeapEntry);
+    }
+
+    /* Small blocks go to the lookaside lists without taking the heap lock */
+    if (Heap->FrontEndHeapType == HEAP_FRONT_LOOKASIDE &&
+        RtlpFreeToHeapLookaside(Heap, HeapEntry))
+    {
+        return TRUE;
+    }
+
     /* Lock if necessary */
     if (!(Flags & HEAP_NO_SERIALIZE))
     {
@@ -2187,9 +2366,6 @@ BOOLEAN NTAPI RtlFreeHeap(
         Locked = TRUE;
     }
 
-    /* Get pointer to the heap entry */
-    HeapEntry = (PHEAP_ENTRY)Ptr - 1;
-
     /* Check this entry, fail if it's invalid */
     if (!(HeapEntry->Flags & HEAP_ENTRY_BUSY) ||
         (((ULONG_PTR)Ptr & 0x7) != 0) ||
@@ -2590,6 +2766,13 @@ RtlReAllocateHeap(HANDLE HeapPtr,
         return NULL;
     }
 
+    /* Low fragmentation heap blocks are handled by the front end */
+    if (((PHEAP_ENTRY)Ptr - 1)->SegmentOffset == HEAP_LFH_SEGMENT_OFFSET &&
+        Heap->FrontEndHeapType == HEAP_FRONT_LOWFRAGHEAP)
+    {
+        return RtlpLowFragHeapReAllocate(Heap, Flags, Ptr, Size);
+    }
+
     /* Calculate allocation size and index */
     if (Size)
         AllocationSize = Size;
@@ -3154,7 +3337,15 @@ RtlpValidateHeapEntry(
     if ((ULONG_PTR)HeapEntry & (HEAP_ENTRY_SIZE - 1)) goto invalid_entry;
     if (!(HeapEntry->Flags & HEAP_ENTRY_BUSY)) goto invalid_entry;
 
+    /* Low fragmentation heap blocks live inside busy blocks of the segments */
+    if (HeapEntry->SegmentOffset == HEAP_LFH_SEGMENT_OFFSET &&
+        Heap->FrontEndHeapType == HEAP_FRONT_LOWFRAGHEAP)
+    {
+        return RtlpLowFragHeapValidateEntry(Heap, HeapEntry);
+    }
+
     BigAllocation = HeapEntry->Flags & HEAP_ENTRY_VIRTUAL_ALLOC;
+    if (HeapEntry->SegmentOffset >= HEAP_SEGMENTS) goto invalid_entry;
     Segment = Heap->Segments[HeapEntry->SegmentOffset];
 
     if (BigAllocation &&
@@ -3907,7 +4098,7 @@ RtlSetHeapInformation(IN HANDLE HeapHandle OPTIONAL,
                       IN PVOID HeapInformation,
                       IN SIZE_T HeapInformationLength)
 {
-    /* Setting heap information is not really supported except for enabling LFH */
+    /* Setting heap information is not really supported except for enabling a front end */
     if (HeapInformationClass == HeapCompatibilityInformation)
     {
         /* Check buffer length */
@@ -3917,14 +4108,20 @@ RtlSetHeapInformation(IN HANDLE HeapHandle OPTIONAL,
             return STATUS_BUFFER_TOO_SMALL;
         }
 
-        /* Check for a special magic value for enabling LFH */
-        if (*(PULONG)HeapInformation != 2)
+        if (!HeapHandle) return STATUS_INVALID_PARAMETER;
+
+        /* Enable the requested front end */
+        switch (*(PULONG)HeapInformation)
         {
-            return STATUS_UNSUCCESSFUL;
-        }
+            case HEAP_FRONT_LOOKASIDE:
+                return RtlpActivateHeapLookaside((PHEAP)HeapHandle);
 
-        DPRINT1("RtlSetHeapInformation() needs to enable LFH\n");
-        return STATUS_SUCCESS;
+            case HEAP_FRONT_LOWFRAGHEAP:
+                return RtlpActivateLowFragmentationHeap((PHEAP)HeapHandle);
+
+            default:
+                return STATUS_UNSUCCESSFUL;
+        }
     }
 
     return STATUS_SUCCESS;
@@ -3960,6 +4157,35 @@ RtlQueryHeapInformation(HANDLE HeapHandle,
         return STATUS_SUCCESS;
     }
 
+    /* Lookaside front end statistics */
+    if (HeapInformationClass == HeapLookasideInformation)
+    {
+        PRTL_HEAP_LOOKASIDE_INFORMATION Information = HeapInformation;
+        PHEAP_LOOKASIDE Lookaside;
+        ULONG i;
+
+        if (ReturnLength)
+            *ReturnLength = sizeof(RTL_HEAP_LOOKASIDE_INFORMATION);
+
+        if (HeapInformationLength < sizeof(RTL_HEAP_LOOKASIDE_INFORMATION))
+            return STATUS_BUFFER_TOO_SMALL;
+
+        if (Heap->FrontEndHeapType != HEAP_FRONT_LOOKASIDE)
+            return STATUS_UNSUCCESSFUL;
+
+        RtlZeroMemory(Information, sizeof(*Information));
+        Lookaside = Heap->FrontEndHeap;
+        for (i = 0; i < HEAP_LOOKASIDE_LISTS; i++)
+        {
+            Information->AllocateHits += Lookaside[i].TotalAllocates - Lookaside[i].AllocateMisses;
+            Information->AllocateMisses += Lookaside[i].AllocateMisses;
+            Information->FreeHits += Lookaside[i].TotalFrees - Lookaside[i].FreeMisses;
+            Information->FreeMisses += Lookaside[i].FreeMisses;
+        }
+
+        return STATUS_SUCCESS;
+    }
+
     return STATUS_UNSUCCESSFUL;
 }
 
@@ -75,6 +75,22 @@ RtlpHeapIsSpecial(ULONG Flags)
     return FALSE;
 }
 
+/* Front end heap types */
+#define HEAP_FRONT_NONE          0
+#define HEAP_FRONT_LOOKASIDE     1
+#define HEAP_FRONT_LOWFRAGHEAP   2
+
+/* Lookaside front end */
+#define HEAP_LOOKASIDE_LISTS     128
+#define HEAP_LOOKASIDE_DEPTH     32
+
+/* Low fragmentation heap */
+#define HEAP_LFH_BUCKETS          128
+#define HEAP_LFH_AFFINITY_SLOTS   8
+#define HEAP_LFH_MAX_BLOCK_UNITS  (0x4000 >> HEAP_ENTRY_SHIFT)
+#define HEAP_LFH_SEGMENT_OFFSET   0xFE     /* SegmentOffset of blocks owned by the LFH */
+#define HEAP_LFH_SIGNATURE        0x48464C /* "LFH" */
+
 /* Heap structures */
 struct _HEAP_COMMON_ENTRY
 {
@@ -327,6 +343,55 @@ typedef struct _HEAP_VIRTUAL_ALLOC_ENTRY
     HEAP_ENTRY BusyBlock;
 } HEAP_VIRTUAL_ALLOC_ENTRY, *PHEAP_VIRTUAL_ALLOC_ENTRY;
 
+/* One per block size in units, blocks stay busy while they are cached */
+typedef struct _HEAP_LOOKASIDE
+{
+    SLIST_HEADER ListHead;
+    USHORT MaximumDepth;
+    USHORT Reserved;
+    ULONG TotalAllocates;
+    ULONG AllocateMisses;
+    ULONG TotalFrees;
+    ULONG FreeMisses;
+} HEAP_LOOKASIDE, *PHEAP_LOOKASIDE;
+
+typedef struct _HEAP_LFH_SUBSEGMENT
+{
+    LIST_ENTRY ListEntry;
+    struct _HEAP_LFH_SLOT *Slot;
+    ULONG Signature;
+    USHORT BlockUnits;
+    USHORT BlockCount;
+    USHORT FreeCount;
+    USHORT FreeHead;
+    BOOLEAN Listed;
+} HEAP_LFH_SUBSEGMENT, *PHEAP_LFH_SUBSEGMENT;
+
+#define HEAP_LFH_SUBSEGMENT_HEADER ROUND_UP(sizeof(HEAP_LFH_SUBSEGMENT), HEAP_ENTRY_SIZE)
+#define HEAP_LFH_NO_FREE_BLOCK     0xFFFF
+
+/* One per bucket and affinity slot, padded so that slots do not share cache lines */
+typedef struct _HEAP_LFH_SLOT
+{
+    union
+    {
+        struct
+        {
+            LONG Lock;
+            PHEAP_LFH_SUBSEGMENT ActiveSubSegment;
+            LIST_ENTRY SubSegments; /* Partially free, non-active subsegments */
+        };
+        UCHAR CacheLine[64];
+    };
+} HEAP_LFH_SLOT, *PHEAP_LFH_SLOT;
+
+typedef struct _HEAP_LFH
+{
+    PHEAP Heap;
+    ULONG SlotCount;
+    HEAP_LFH_SLOT Slots[HEAP_LFH_BUCKETS][HEAP_LFH_AFFINITY_SLOTS];
+} HEAP_LFH, *PHEAP_LFH;
+
 /* Global variables */
 extern RTL_CRITICAL_SECTION RtlpProcessHeapsListLock;
 extern BOOLEAN RtlpPageHeapEnabled;
@@ -473,6 +538,35 @@ RtlpPageHeapSize(HANDLE HeapPtr,
                  ULONG Flags,
                  PVOID Ptr);
 
+/* heaplfh.c */
+
+NTSTATUS NTAPI
+RtlpActivateLowFragmentationHeap(PHEAP Heap);
+
+VOID NTAPI
+RtlpDestroyLowFragmentationHeap(PHEAP Heap);
+
+PVOID NTAPI
+RtlpLowFragHeapAllocate(PHEAP Heap,
+                        ULONG Flags,
+                        SIZE_T Size,
+                        SIZE_T AllocationSize,
+                        UCHAR EntryFlags);
+
+BOOLEAN NTAPI
+RtlpLowFragHeapFree(PHEAP Heap,
+                    PHEAP_ENTRY HeapEntry);
+
+PVOID NTAPI
+RtlpLowFragHeapReAllocate(PHEAP Heap,
+                          ULONG Flags,
+                          PVOID Ptr,
+                          SIZE_T Size);
+
+BOOLEAN NTAPI
+RtlpLowFragHeapValidateEntry(PHEAP Heap,
+                             PHEAP_ENTRY HeapEntry);
+
 VOID
 NTAPI
 RtlpAddHeapToProcessList(PHEAP Heap);
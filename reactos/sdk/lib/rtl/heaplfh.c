@@ -0,0 +1,452 @@
+/*
+ * COPYRIGHT:       See COPYING in the top level directory
+ * PROJECT:         ReactOS system libraries
+ * FILE:            lib/rtl/heaplfh.c
+ * PURPOSE:         RTL Heap low fragmentation front end
+ */
+
+/* Overview:
+   Small requests are rounded up to one of HEAP_LFH_BUCKETS size classes.
+   Each bucket has up to HEAP_LFH_AFFINITY_SLOTS slots, a thread always uses
+   the same slot, so that threads on different processors mostly do not share
+   a lock. A slot carves equally sized blocks out of subsegments which are
+   regular busy blocks of the back end heap.
+
+   LFH blocks keep a normal HEAP_ENTRY header: Size and UnusedBytes have their
+   usual meaning (RtlSizeHeap works unchanged), SegmentOffset is set to
+   HEAP_LFH_SEGMENT_OFFSET, SmallTagIndex holds the bucket index and
+   PreviousSize the block index inside its subsegment. That is enough to get
+   back to the subsegment on free without taking the heap lock. */
+
+/* INCLUDES *****************************************************************/
+
+#include <rtl.h>
+#include <heap.h>
+
+#define NDEBUG
+#include <debug.h>
+
+/* FUNCTIONS *****************************************************************/
+
+/* 32 buckets of one unit, then groups of 16 buckets doubling their step */
+FORCEINLINE
+ULONG
+RtlpLfhBucketIndex(SIZE_T Units)
+{
+    ULONG Group = 0;
+
+    if (Units <= 32) return (ULONG)Units - 1;
+
+    while ((Units - 1) >> (Group + 6)) Group++;
+
+    return 32 + Group * 16 + (ULONG)(((Units - 1) - (32 << Group)) >> (Group + 1));
+}
+
+FORCEINLINE
+ULONG
+RtlpLfhBucketUnits(ULONG BucketIndex)
+{
+    ULONG Group, Step;
+
+    if (BucketIndex < 32) return BucketIndex + 1;
+
+    Group = (BucketIndex - 32) / 16;
+    Step = (BucketIndex - 32) % 16;
+
+    return (32 << Group) + ((Step + 1) << (Group + 1));
+}
+
+FORCEINLINE
+ULONG
+RtlpLfhAffinitySlot(PHEAP_LFH Lfh)
+{
+    /* Thread IDs are multiples of 4, spread them over the slots */
+    return (ULONG)(((ULONG_PTR)NtCurrentTeb()->ClientId.UniqueThread >> 2) % Lfh->SlotCount);
+}
+
+FORCEINLINE
+VOID
+RtlpLfhAcquireSlot(PHEAP_LFH_SLOT Slot)
+{
+    ULONG Spins = 0;
+
+    while (InterlockedCompareExchange(&Slot->Lock, 1, 0) != 0)
+    {
+        /* Slots are held for a few instructions only, spin before yielding */
+        if (++Spins < 64)
+        {
+            YieldProcessor();
+        }
+        else
+        {
+            ZwYieldExecution();
+            Spins = 0;
+        }
+    }
+}
+
+FORCEINLINE
+VOID
+RtlpLfhReleaseSlot(PHEAP_LFH_SLOT Slot)
+{
+    InterlockedExchange(&Slot->Lock, 0);
+}
+
+FORCEINLINE
+PHEAP_ENTRY
+RtlpLfhGetBlock(PHEAP_LFH_SUBSEGMENT SubSegment,
+                ULONG Index)
+{
+    return (PHEAP_ENTRY)((PUCHAR)SubSegment + HEAP_LFH_SUBSEGMENT_HEADER) +
+           (SIZE_T)Index * SubSegment->BlockUnits;
+}
+
+/* Get the subsegment owning an LFH block, NULL if the block does not look like one */
+static
+PHEAP_LFH_SUBSEGMENT
+RtlpLfhGetSubSegment(PHEAP Heap,
+                     PHEAP_ENTRY HeapEntry)
+{
+    PHEAP_LFH Lfh = Heap->FrontEndHeap;
+    PHEAP_LFH_SUBSEGMENT SubSegment;
+    ULONG BucketIndex, BlockUnits;
+
+    if (Heap->FrontEndHeapType != HEAP_FRONT_LOWFRAGHEAP ||
+        HeapEntry->SegmentOffset != HEAP_LFH_SEGMENT_OFFSET ||
+        HeapEntry->SmallTagIndex >= HEAP_LFH_BUCKETS)
+    {
+        return NULL;
+    }
+
+    BucketIndex = HeapEntry->SmallTagIndex;
+    BlockUnits = RtlpLfhBucketUnits(BucketIndex);
+    SubSegment = (PHEAP_LFH_SUBSEGMENT)((PUCHAR)(HeapEntry - (SIZE_T)HeapEntry->PreviousSize * BlockUnits) -
+                                        HEAP_LFH_SUBSEGMENT_HEADER);
+
+    if (SubSegment->Signature != HEAP_LFH_SIGNATURE ||
+        SubSegment->BlockUnits != BlockUnits ||
+        HeapEntry->PreviousSize >= SubSegment->BlockCount ||
+        SubSegment->Slot < &Lfh->Slots[BucketIndex][0] ||
+        SubSegment->Slot >= &Lfh->Slots[BucketIndex][Lfh->SlotCount])
+    {
+        return NULL;
+    }
+
+    return SubSegment;
+}
+
+/* Called with the slot held */
+static
+PHEAP_LFH_SUBSEGMENT
+RtlpLfhCreateSubSegment(PHEAP Heap,
+                        PHEAP_LFH_SLOT Slot,
+                        ULONG BucketIndex)
+{
+    PHEAP_LFH_SUBSEGMENT SubSegment;
+    PHEAP_ENTRY Block;
+    ULONG BlockUnits, BlockCount, i;
+    SIZE_T BlockBytes;
+
+    BlockUnits = RtlpLfhBucketUnits(BucketIndex);
+    BlockBytes = (SIZE_T)BlockUnits << HEAP_ENTRY_SHIFT;
+
+    /* Always more than the largest LFH block, so that the back end serves it */
+    BlockCount = max(4, 0x4000 / BlockBytes + 1);
+
+    SubSegment = RtlAllocateHeap(Heap, 0, HEAP_LFH_SUBSEGMENT_HEADER + BlockCount * BlockBytes);
+    if (!SubSegment) return NULL;
+
+    SubSegment->Slot = Slot;
+    SubSegment->Signature = HEAP_LFH_SIGNATURE;
+    SubSegment->BlockUnits = (USHORT)BlockUnits;
+    SubSegment->BlockCount = (USHORT)BlockCount;
+    SubSegment->FreeCount = (USHORT)BlockCount;
+    SubSegment->FreeHead = 0;
+    SubSegment->Listed = FALSE;
+
+    /* Prepare the block headers and chain all blocks in the free list */
+    for (i = 0; i < BlockCount; i++)
+    {
+        Block = RtlpLfhGetBlock(SubSegment, i);
+        Block->Size = (USHORT)BlockUnits;
+        Block->Flags = 0;
+        Block->SmallTagIndex = (UCHAR)BucketIndex;
+        Block->PreviousSize = (USHORT)i;
+        Block->SegmentOffset = HEAP_LFH_SEGMENT_OFFSET;
+        Block->UnusedBytes = 0;
+        *(PUSHORT)(Block + 1) = (i + 1 < BlockCount) ? (USHORT)(i + 1) : HEAP_LFH_NO_FREE_BLOCK;
+    }
+
+    return SubSegment;
+}
+
+NTSTATUS NTAPI
+RtlpActivateLowFragmentationHeap(PHEAP Heap)
+{
+    PHEAP_LFH Lfh = NULL;
+    SIZE_T Size = sizeof(HEAP_LFH);
+    ULONG Bucket, Slot;
+    NTSTATUS Status;
+
+    if (Heap->FrontEndHeapType == HEAP_FRONT_LOWFRAGHEAP)
+        return STATUS_SUCCESS;
+
+    /* The LFH needs serialized heaps with the regular block layout */
+    if (RtlpGetMode() != UserMode ||
+        (Heap->ForceFlags & HEAP_FLAG_PAGE_ALLOCS) ||
+        RtlpHeapIsSpecial(Heap->Flags) ||
+        (Heap->Flags & (HEAP_NO_SERIALIZE |
+                        HEAP_CREATE_ALIGN_16 |
+                        HEAP_TAIL_CHECKING_ENABLED |
+                        HEAP_FREE_CHECKING_ENABLED)))
+    {
+        DPRINT1("HEAP: Cannot enable the LFH on heap %p with flags 0x%lx\n", Heap, Heap->Flags);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    Status = ZwAllocateVirtualMemory(NtCurrentProcess(),
+                                     (PVOID *)&Lfh,
+                                     0,
+                                     &Size,
+                                     MEM_RESERVE | MEM_COMMIT,
+                                     PAGE_READWRITE);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("HEAP: Failed to allocate the LFH (Status 0x%08x)\n", Status);
+        return Status;
+    }
+
+    /* One slot per processor, the memory is already zeroed */
+    Lfh->Heap = Heap;
+    Lfh->SlotCount = min(max(NtCurrentPeb()->NumberOfProcessors, 1), HEAP_LFH_AFFINITY_SLOTS);
+    for (Bucket = 0; Bucket < HEAP_LFH_BUCKETS; Bucket++)
+    {
+        for (Slot = 0; Slot < HEAP_LFH_AFFINITY_SLOTS; Slot++)
+            InitializeListHead(&Lfh->Slots[Bucket][Slot].SubSegments);
+    }
+
+    /* Publish it, unless another front end was enabled meanwhile */
+    RtlEnterHeapLock(Heap->LockVariable, TRUE);
+    if (Heap->FrontEndHeapType == HEAP_FRONT_NONE)
+    {
+        InterlockedExchangePointer(&Heap->FrontEndHeap, Lfh);
+        Heap->FrontEndHeapType = HEAP_FRONT_LOWFRAGHEAP;
+        Lfh = NULL;
+    }
+    else if (Heap->FrontEndHeapType != HEAP_FRONT_LOWFRAGHEAP)
+    {
+        /* Blocks cached by the lookaside front end cannot be handed over */
+        Status = STATUS_UNSUCCESSFUL;
+    }
+    RtlLeaveHeapLock(Heap->LockVariable);
+
+    if (Lfh)
+    {
+        Size = 0;
+        ZwFreeVirtualMemory(NtCurrentProcess(), (PVOID *)&Lfh, &Size, MEM_RELEASE);
+    }
+
+    return Status;
+}
+
+VOID NTAPI
+RtlpDestroyLowFragmentationHeap(PHEAP Heap)
+{
+    PVOID Lfh = Heap->FrontEndHeap;
+    SIZE_T Size = 0;
+
+    if (Heap->FrontEndHeapType != HEAP_FRONT_LOWFRAGHEAP)
+        return;
+
+    Heap->FrontEndHeapType = HEAP_FRONT_NONE;
+    Heap->FrontEndHeap = NULL;
+
+    /* Subsegments live in the heap segments and go away with them */
+    ZwFreeVirtualMemory(NtCurrentProcess(), &Lfh, &Size, MEM_RELEASE);
+}
+
+PVOID NTAPI
+RtlpLowFragHeapAllocate(PHEAP Heap,
+                        ULONG Flags,
+                        SIZE_T Size,
+                        SIZE_T AllocationSize,
+                        UCHAR EntryFlags)
+{
+    PHEAP_LFH Lfh = Heap->FrontEndHeap;
+    PHEAP_LFH_SUBSEGMENT SubSegment;
+    PHEAP_LFH_SLOT Slot;
+    PHEAP_ENTRY Block;
+    ULONG BucketIndex;
+
+    BucketIndex = RtlpLfhBucketIndex(AllocationSize >> HEAP_ENTRY_SHIFT);
+    Slot = &Lfh->Slots[BucketIndex][RtlpLfhAffinitySlot(Lfh)];
+
+    RtlpLfhAcquireSlot(Slot);
+
+    SubSegment = Slot->ActiveSubSegment;
+    if (!SubSegment || !SubSegment->FreeCount)
+    {
+        /* A full subsegment stays unlisted until one of its blocks is freed */
+        if (!IsListEmpty(&Slot->SubSegments))
+        {
+            SubSegment = CONTAINING_RECORD(RemoveHeadList(&Slot->SubSegments),
+                                           HEAP_LFH_SUBSEGMENT,
+                                           ListEntry);
+            SubSegment->Listed = FALSE;
+        }
+        else
+        {
+            SubSegment = RtlpLfhCreateSubSegment(Heap, Slot, BucketIndex);
+            if (!SubSegment)
+            {
+                /* Let the back end try */
+                RtlpLfhReleaseSlot(Slot);
+                return NULL;
+            }
+        }
+
+        Slot->ActiveSubSegment = SubSegment;
+    }
+
+    /* Pop a block */
+    Block = RtlpLfhGetBlock(SubSegment, SubSegment->FreeHead);
+    SubSegment->FreeHead = *(PUSHORT)(Block + 1);
+    SubSegment->FreeCount--;
+    Block->Flags = EntryFlags;
+
+    RtlpLfhReleaseSlot(Slot);
+
+    Block->Size = (USHORT)(AllocationSize >> HEAP_ENTRY_SHIFT);
+    Block->UnusedBytes = (UCHAR)(AllocationSize - Size);
+
+    if (Flags & HEAP_ZERO_MEMORY)
+        RtlZeroMemory(Block + 1, Size);
+
+    return Block + 1;
+}
+
+BOOLEAN NTAPI
+RtlpLowFragHeapFree(PHEAP Heap,
+                    PHEAP_ENTRY HeapEntry)
+{
+    PHEAP_LFH_SUBSEGMENT SubSegment;
+    PHEAP_LFH_SLOT Slot;
+    BOOLEAN Release = FALSE;
+
+    SubSegment = RtlpLfhGetSubSegment(Heap, HeapEntry);
+    if (!SubSegment)
+        goto invalid_entry;
+
+    Slot = SubSegment->Slot;
+    RtlpLfhAcquireSlot(Slot);
+
+    if (!(HeapEntry->Flags & HEAP_ENTRY_BUSY))
+    {
+        RtlpLfhReleaseSlot(Slot);
+        goto invalid_entry;
+    }
+
+    /* Push the block back */
+    HeapEntry->Flags = 0;
+    *(PUSHORT)(HeapEntry + 1) = SubSegment->FreeHead;
+    SubSegment->FreeHead = HeapEntry->PreviousSize;
+    SubSegment->FreeCount++;
+
+    if (SubSegment != Slot->ActiveSubSegment)
+    {
+        if (SubSegment->FreeCount == SubSegment->BlockCount)
+        {
+            /* Completely free, give it back to the back end */
+            if (SubSegment->Listed)
+                RemoveEntryList(&SubSegment->ListEntry);
+            SubSegment->Signature = 0;
+            Release = TRUE;
+        }
+        else if (!SubSegment->Listed)
+        {
+            /* It was full, make it available again */
+            InsertTailList(&Slot->SubSegments, &SubSegment->ListEntry);
+            SubSegment->Listed = TRUE;
+        }
+    }
+
+    RtlpLfhReleaseSlot(Slot);
+
+    if (Release)
+        RtlFreeHeap(Heap, 0, SubSegment);
+
+    return TRUE;
+
+invalid_entry:
+    DPRINT1("HEAP: Trying to free an invalid LFH address %p!\n", HeapEntry + 1);
+    RtlSetLastWin32ErrorAndNtStatusFromNtStatus(STATUS_INVALID_PARAMETER);
+    return FALSE;
+}
+
+PVOID NTAPI
+RtlpLowFragHeapReAllocate(PHEAP Heap,
+                          ULONG Flags,
+                          PVOID Ptr,
+                          SIZE_T Size)
+{
+    PHEAP_ENTRY HeapEntry = (PHEAP_ENTRY)Ptr - 1;
+    PHEAP_LFH_SUBSEGMENT SubSegment;
+    SIZE_T OldSize, AllocationSize;
+    PVOID NewPtr;
+
+    SubSegment = RtlpLfhGetSubSegment(Heap, HeapEntry);
+    if (!SubSegment || !(HeapEntry->Flags & HEAP_ENTRY_BUSY))
+    {
+        DPRINT1("HEAP: Trying to reallocate an invalid LFH address %p!\n", Ptr);
+        RtlSetLastWin32ErrorAndNtStatusFromNtStatus(STATUS_INVALID_PARAMETER);
+        return NULL;
+    }
+
+    OldSize = ((SIZE_T)HeapEntry->Size << HEAP_ENTRY_SHIFT) - HeapEntry->UnusedBytes;
+    AllocationSize = ((Size ? Size : 1) + Heap->AlignRound) & Heap->AlignMask;
+
+    /* Stay in the same block if it is large enough */
+    if (AllocationSize <= ((SIZE_T)SubSegment->BlockUnits << HEAP_ENTRY_SHIFT))
+    {
+        if ((Flags & HEAP_ZERO_MEMORY) && Size > OldSize)
+            RtlZeroMemory((PUCHAR)Ptr + OldSize, Size - OldSize);
+
+        HeapEntry->Size = (USHORT)(AllocationSize >> HEAP_ENTRY_SHIFT);
+        HeapEntry->UnusedBytes = (UCHAR)(AllocationSize - Size);
+        return Ptr;
+    }
+
+    if (Flags & HEAP_REALLOC_IN_PLACE_ONLY)
+    {
+        RtlSetLastWin32ErrorAndNtStatusFromNtStatus(STATUS_NO_MEMORY);
+        return NULL;
+    }
+
+    /* Move it, possibly to a bigger bucket or to the back end */
+    NewPtr = RtlAllocateHeap(Heap, Flags & ~HEAP_ZERO_MEMORY, Size);
+    if (!NewPtr) return NULL;
+
+    RtlCopyMemory(NewPtr, Ptr, OldSize);
+    if (Flags & HEAP_ZERO_MEMORY)
+        RtlZeroMemory((PUCHAR)NewPtr + OldSize, Size - OldSize);
+
+    RtlpLowFragHeapFree(Heap, HeapEntry);
+
+    return NewPtr;
+}
+
+BOOLEAN NTAPI
+RtlpLowFragHeapValidateEntry(PHEAP Heap,
+                             PHEAP_ENTRY HeapEntry)
+{
+    if (!RtlpLfhGetSubSegment(Heap, HeapEntry) ||
+        !(HeapEntry->Flags & HEAP_ENTRY_BUSY))
+    {
+        DPRINT1("HEAP: Invalid LFH entry %p in heap %p\n", HeapEntry, Heap);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* EOF */
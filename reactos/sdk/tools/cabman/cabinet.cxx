@@ -20,12 +20,14 @@
 #include <string.h>
 #if !defined(_WIN32)
 # include <dirent.h>
+# include <pthread.h>
 # include <sys/stat.h>
 # include <sys/types.h>
 #endif
 #include "cabinet.h"
 #include "raw.h"
 #include "mszip.h"
+#include "lzx.h"
 
 #if defined(_WIN32)
 #define GetSizeOfFile(handle) _GetSizeOfFile(handle)
@@ -60,8 +62,73 @@ static bool _ReadFileData(FILEHANDLE handle, void* buffer, ULONG size, PULONG by
 }
 #endif
 
+static CCABCodec* NewCodec(LONG Id, ULONG WindowBits)
+/*
+ * FUNCTION: Creates a codec engine
+ * ARGUMENTS:
+ *     Id         = Codec identifier
+ *     WindowBits = Window size of the LZX codec
+ * RETURNS:
+ *     Pointer to the codec, NULL if the codec is unknown
+ */
+{
+    switch (Id)
+    {
+        case CAB_CODEC_RAW:
+            return new CRawCodec();
+
+        case CAB_CODEC_MSZIP:
+            return new CMSZipCodec();
+
+        case CAB_CODEC_LZX:
+            return new CLZXCodec(WindowBits);
+
+        default:
+            return NULL;
+    }
+}
+
 #ifndef CAB_READ_ONLY
 
+/* Number of data blocks queued for each compression thread */
+#define CAB_BLOCKS_PER_THREAD 8
+
+typedef struct _COMPRESS_CONTEXT
+{
+    PCFDATA_JOB Jobs;       // Queued data blocks
+    ULONG First;            // First block compressed by this thread
+    ULONG Count;            // Number of queued data blocks
+    ULONG Stride;           // Distance between blocks of this thread
+    CCABCodec* Codec;       // Codec owned by this thread
+} COMPRESS_CONTEXT, *PCOMPRESS_CONTEXT;
+
+#if defined(_WIN32)
+static DWORD WINAPI CompressThread(LPVOID Parameter)
+#else
+static void* CompressThread(void* Parameter)
+#endif
+/*
+ * FUNCTION: Compresses every Stride'th queued data block
+ * ARGUMENTS:
+ *     Parameter = Pointer to compression context
+ */
+{
+    PCOMPRESS_CONTEXT Context = (PCOMPRESS_CONTEXT)Parameter;
+    PCFDATA_JOB Job;
+    ULONG i;
+
+    for (i = Context->First; i < Context->Count; i += Context->Stride)
+    {
+        Job = &Context->Jobs[i];
+        Job->Status = Context->Codec->Compress(Job->OutputBuffer,
+            Job->InputBuffer,
+            Job->InputLength,
+            &Job->OutputLength);
+    }
+
+    return 0;
+}
+
 #if 0
 #if DBG
 
@@ -329,6 +396,7 @@ CCabinet::CCabinet()
 
     Codec          = NULL;
     CodecId        = -1;
+    CodecWindowBits = LZX_DEFAULT_WINDOW_BITS;
     CodecSelected  = false;
 
     OutputBuffer = NULL;
@@ -337,6 +405,12 @@ CCabinet::CCabinet()
     BlockIsSplit = false;
     ScratchFile  = NULL;
 
+    ThreadCount  = 1;
+    Jobs         = NULL;
+    JobCount     = 0;
+    MaxJobs      = 0;
+    JobCodecs    = NULL;
+
     FolderUncompSize = 0;
     BytesLeftInBlock = 0;
     ReuseBlock       = false;
@@ -605,6 +679,20 @@ bool CCabinet::SetCompressionCodec(char* CodecName)
         SelectCodec(CAB_CODEC_RAW);
     else if( !strcasecmp(CodecName, "mszip") )
         SelectCodec(CAB_CODEC_MSZIP);
+    else if( !strcasecmp(CodecName, "lzx") )
+        SelectCodec(CAB_CODEC_LZX);
+    else if( !strncasecmp(CodecName, "lzx:", 4) )
+    {
+        ULONG WindowBits = strtoul(CodecName + 4, NULL, 10);
+
+        if (WindowBits < LZX_MIN_WINDOW_BITS || WindowBits > LZX_MAX_WINDOW_BITS)
+        {
+            printf("ERROR: LZX window must be %u to %u bits!\n",
+                   LZX_MIN_WINDOW_BITS, LZX_MAX_WINDOW_BITS);
+            return false;
+        }
+        SelectCodec(CAB_CODEC_LZX, WindowBits);
+    }
     else
     {
         printf("ERROR: Invalid codec specified!\n");
@@ -1031,6 +1119,7 @@ ULONG CCabinet::ExtractFile(char* FileName)
     PUCHAR CurrentBuffer;
     FILEHANDLE DestFile;
     PCFFILE_NODE File;
+    PCFDATA_NODE DataNode;
     CFDATA CFData;
     ULONG Status;
     bool Skip;
@@ -1059,6 +1148,10 @@ ULONG CCabinet::ExtractFile(char* FileName)
             SelectCodec(CAB_CODEC_MSZIP);
             break;
 
+        case CAB_COMP_LZX:
+            SelectCodec(CAB_CODEC_LZX, (CurrentFolderNode->Folder.CompressionType >> 8) & 0x1F);
+            break;
+
         default:
             return CAB_STATUS_UNSUPPCOMP;
     }
@@ -1142,7 +1235,7 @@ ULONG CCabinet::ExtractFile(char* FileName)
 #endif
     SetAttributesOnFile(DestName, File->File.Attributes);
 
-    Buffer = (PUCHAR)AllocateMemory(CAB_BLOCKSIZE + 12); // This should be enough
+    Buffer = (PUCHAR)AllocateMemory(CAB_MAX_COMPSIZE);
     if (!Buffer)
     {
         CloseFile(DestFile);
@@ -1150,6 +1243,25 @@ ULONG CCabinet::ExtractFile(char* FileName)
         return CAB_STATUS_NOMEMORY;
     }
 
+    ReuseBlock = (CurrentDataNode == File->DataBlock);
+
+    /* LZX blocks depend on the blocks before them in the folder. Unless
+       the file starts right where the last one ended, decode the folder
+       from its first block */
+    if (((CurrentFolderNode->Folder.CompressionType & CAB_COMP_MASK) == CAB_COMP_LZX) &&
+        (!ReuseBlock) && ((!CurrentDataNode) || (CurrentDataNode->Next != File->DataBlock)))
+    {
+        Codec->Reset();
+
+        Status = DecodeDataBlocks(CurrentFolderNode->DataListHead, File->DataBlock, Buffer);
+        if (Status != CAB_STATUS_SUCCESS)
+        {
+            CloseFile(DestFile);
+            FreeMemory(Buffer);
+            return Status;
+        }
+    }
+
     /* Call OnExtract event handler */
     OnExtract(&File->File, FileName);
 
@@ -1183,7 +1295,7 @@ ULONG CCabinet::ExtractFile(char* FileName)
 
     Skip = true;
 
-    ReuseBlock = (CurrentDataNode == File->DataBlock);
+    DataNode = File->DataBlock;
     if (Size > 0)
     {
         do
@@ -1216,7 +1328,7 @@ ULONG CCabinet::ExtractFile(char* FileName)
                         CFData.CompSize,
                         CFData.UncompSize));
 
-                    ASSERT(CFData.CompSize <= CAB_BLOCKSIZE + 12);
+                    ASSERT(TotalBytesRead + CFData.CompSize <= CAB_MAX_COMPSIZE);
 
                     BytesToRead = CFData.CompSize;
 
@@ -1321,8 +1433,7 @@ ULONG CCabinet::ExtractFile(char* FileName)
                             (UINT)File->DataBlock->AbsoluteOffset,
                             (UINT)File->DataBlock->UncompOffset));
 
-                        CurrentDataNode = File->DataBlock;
-                        ReuseBlock = true;
+                        DataNode = File->DataBlock;
 
                         RestartSearch = true;
                     }
@@ -1330,6 +1441,10 @@ ULONG CCabinet::ExtractFile(char* FileName)
 
                 DPRINT(MAX_TRACE, ("TotalBytesRead (%u).\n", (UINT)TotalBytesRead));
 
+                /* The codec state does not match any block until this one is decoded */
+                CurrentDataNode = NULL;
+
+                BytesToWrite = CFData.UncompSize;
                 Status = Codec->Uncompress(OutputBuffer, Buffer, TotalBytesRead, &BytesToWrite);
                 if (Status != CS_SUCCESS)
                 {
@@ -1351,6 +1466,11 @@ ULONG CCabinet::ExtractFile(char* FileName)
                 }
 
                 BytesLeftInBlock = BytesToWrite;
+
+                CurrentDataNode = DataNode;
+                if (DataNode)
+                    DataNode = DataNode->Next;
+                ReuseBlock = false;
             }
             else
             {
@@ -1397,6 +1517,7 @@ ULONG CCabinet::ExtractFile(char* FileName)
                 }
 #endif
 
+                DataNode = CurrentDataNode->Next;
                 ReuseBlock = false;
             }
 
@@ -1450,6 +1571,74 @@ ULONG CCabinet::ExtractFile(char* FileName)
     return CAB_STATUS_SUCCESS;
 }
 
+ULONG CCabinet::DecodeDataBlocks(PCFDATA_NODE First, PCFDATA_NODE Last, PUCHAR Buffer)
+/*
+ * FUNCTION: Runs data blocks through the codec without writing them anywhere
+ * ARGUMENTS:
+ *     First  = Pointer to first data block to decode
+ *     Last   = Pointer to data block to stop at
+ *     Buffer = Pointer to buffer for compressed data
+ * RETURNS:
+ *     Status of operation
+ * NOTES:
+ *     Used to bring the codec state up to a block inside a folder
+ */
+{
+    PCFDATA_NODE Node;
+    ULONG BytesRead;
+    ULONG BytesToWrite;
+    ULONG Status;
+
+    CurrentDataNode = NULL;
+
+    for (Node = First; Node && Node != Last; Node = Node->Next)
+    {
+        DPRINT(MAX_TRACE, ("Decoding block at absolute offset (0x%X).\n", (UINT)Node->AbsoluteOffset));
+
+        if (Node->Data.CompSize > CAB_MAX_COMPSIZE)
+            return CAB_STATUS_INVALID_CAB;
+
+#if defined(_WIN32)
+        if (SetFilePointer(FileHandle,
+                           Node->AbsoluteOffset + sizeof(CFDATA),
+                           NULL,
+                           FILE_BEGIN) == INVALID_SET_FILE_POINTER)
+        {
+            DPRINT(MIN_TRACE, ("SetFilePointer() failed, error code is %u.\n", (UINT)GetLastError()));
+            return CAB_STATUS_INVALID_CAB;
+        }
+#else
+        if (fseek(FileHandle, (off_t)Node->AbsoluteOffset + sizeof(CFDATA), SEEK_SET) != 0)
+        {
+            DPRINT(MIN_TRACE, ("fseek() failed.\n"));
+            return CAB_STATUS_INVALID_CAB;
+        }
+#endif
+
+        if (((Status = ReadBlock(Buffer, Node->Data.CompSize, &BytesRead)) !=
+            CAB_STATUS_SUCCESS) || (BytesRead != Node->Data.CompSize))
+        {
+            DPRINT(MIN_TRACE, ("Cannot read from file (%u).\n", (UINT)Status));
+            return CAB_STATUS_INVALID_CAB;
+        }
+
+        BytesToWrite = Node->Data.UncompSize;
+        Status = Codec->Uncompress(OutputBuffer, Buffer, BytesRead, &BytesToWrite);
+        if (Status != CS_SUCCESS)
+        {
+            DPRINT(MID_TRACE, ("Cannot uncompress block.\n"));
+            if (Status == CS_NOMEMORY)
+                return CAB_STATUS_NOMEMORY;
+            return CAB_STATUS_INVALID_CAB;
+        }
+
+        CurrentDataNode = Node;
+    }
+
+    return CAB_STATUS_SUCCESS;
+}
+
+
 bool CCabinet::IsCodecSelected()
 /*
  * FUNCTION: Returns the value of CodecSelected
@@ -1460,38 +1649,30 @@ bool CCabinet::IsCodecSelected()
     return CodecSelected;
 }
 
-void CCabinet::SelectCodec(LONG Id)
+void CCabinet::SelectCodec(LONG Id, ULONG WindowBits)
 /*
  * FUNCTION: Selects codec engine to use
  * ARGUMENTS:
- *     Id = Codec identifier
+ *     Id         = Codec identifier
+ *     WindowBits = Window size of the LZX codec
  */
 {
     if (CodecSelected)
     {
-        if (Id == CodecId)
+        if ((Id == CodecId) && ((Id != CAB_CODEC_LZX) || (WindowBits == CodecWindowBits)))
             return;
 
         CodecSelected = false;
         delete Codec;
     }
 
-    switch (Id)
-    {
-        case CAB_CODEC_RAW:
-            Codec = new CRawCodec();
-            break;
-
-        case CAB_CODEC_MSZIP:
-            Codec = new CMSZipCodec();
-            break;
-
-        default:
-            return;
-    }
+    Codec = NewCodec(Id, WindowBits);
+    if (!Codec)
+        return;
 
-    CodecId       = Id;
-    CodecSelected = true;
+    CodecId         = Id;
+    CodecWindowBits = WindowBits;
+    CodecSelected   = true;
 }
 
 
@@ -1510,8 +1691,8 @@ ULONG CCabinet::NewCabinet()
 
     CurrentDiskNumber = 0;
 
-    OutputBuffer = AllocateMemory(CAB_BLOCKSIZE + 12); // This should be enough
-    InputBuffer  = AllocateMemory(CAB_BLOCKSIZE + 12); // This should be enough
+    OutputBuffer = AllocateMemory(CAB_MAX_COMPSIZE);
+    InputBuffer  = AllocateMemory(CAB_MAX_COMPSIZE);
     if ((!OutputBuffer) || (!InputBuffer))
     {
         DPRINT(MIN_TRACE, ("Insufficient memory.\n"));
@@ -1520,6 +1701,17 @@ ULONG CCabinet::NewCabinet()
     CurrentIBuffer     = InputBuffer;
     CurrentIBufferSize = 0;
 
+    UncompressedBytes = 0;
+    CompressedBytes   = 0;
+
+    /* LZX compresses a window worth of blocks at a time */
+    if ((ThreadCount > 1) || (CodecId == CAB_CODEC_LZX))
+    {
+        Status = CreateJobs();
+        if (Status != CAB_STATUS_SUCCESS)
+            return Status;
+    }
+
     CABHeader.Signature     = CAB_SIGNATURE;
     CABHeader.Reserved1     = 0;            // Not used
     CABHeader.CabinetSize   = 0;            // Not yet known
@@ -1601,8 +1793,17 @@ ULONG CCabinet::NewFolder()
  *     Status of operation
  */
 {
+    ULONG Status;
+
     DPRINT(MAX_TRACE, ("Creating new folder.\n"));
 
+    /* Queued data blocks belong to the previous folder */
+    Status = FlushDataBlocks();
+    if (Status != CAB_STATUS_SUCCESS)
+        return Status;
+
+    Codec->Reset();
+
     CurrentFolderNode = NewFolderNode();
     if (!CurrentFolderNode)
     {
@@ -1619,6 +1820,10 @@ ULONG CCabinet::NewFolder()
             CurrentFolderNode->Folder.CompressionType = CAB_COMP_MSZIP;
             break;
 
+        case CAB_CODEC_LZX:
+            CurrentFolderNode->Folder.CompressionType = CAB_COMP_LZX | (CodecWindowBits << 8);
+            break;
+
         default:
             return CAB_STATUS_UNSUPPCOMP;
     }
@@ -1848,6 +2053,10 @@ ULONG CCabinet::WriteDisk(ULONG MoreDisks)
                     return Status;
             }
         } while (CreateNewDisk);
+
+        /* Only the last LZX block of a folder may be short */
+        if (CodecId == CAB_CODEC_LZX)
+            CreateNewFolder = true;
     }
     CommitDisk(MoreDisks);
 
@@ -1867,6 +2076,10 @@ ULONG CCabinet::CommitDisk(ULONG MoreDisks)
     PCFFOLDER_NODE FolderNode;
     ULONG Status;
 
+    Status = FlushDataBlocks();
+    if (Status != CAB_STATUS_SUCCESS)
+        return Status;
+
     OnCabinetName(CurrentDiskNumber, CabinetName);
 
     /* Create file, fail if it already exists */
@@ -1992,6 +2205,8 @@ ULONG CCabinet::CloseCabinet()
 
     DestroyFolderNodes();
 
+    DestroyJobs();
+
     if (InputBuffer)
     {
         FreeMemory(InputBuffer);
@@ -2262,6 +2477,40 @@ void CCabinet::SetMaxDiskSize(ULONG Size)
     MaxDiskSize = Size;
 }
 
+void CCabinet::SetThreadCount(ULONG Count)
+/*
+ * FUNCTION: Sets the number of threads used to compress data blocks
+ * ARGUMENTS:
+ *     Count = Number of threads (1 compresses on the calling thread only)
+ * NOTES:
+ *     Data blocks are compressed independently of each other, so the
+ *     cabinet is the same no matter how many threads are used
+ */
+{
+    if (Count < 1)
+        Count = 1;
+    else if (Count > CAB_MAX_THREADS)
+        Count = CAB_MAX_THREADS;
+
+    ThreadCount = Count;
+}
+
+ULONGLONG CCabinet::GetUncompressedBytes()
+/*
+ * FUNCTION: Returns the number of bytes passed to the codec
+ */
+{
+    return UncompressedBytes;
+}
+
+ULONGLONG CCabinet::GetCompressedBytes()
+/*
+ * FUNCTION: Returns the number of bytes produced by the codec
+ */
+{
+    return CompressedBytes;
+}
+
 #endif /* CAB_READ_ONLY */
 
 
@@ -2878,6 +3127,7 @@ void CCabinet::DestroyFolderNodes()
     }
     FolderListHead = NULL;
     FolderListTail = NULL;
+    CurrentDataNode = NULL;
 }
 
 
@@ -3551,6 +3801,32 @@ ULONG CCabinet::WriteDataBlock()
     ULONG Status;
     ULONG BytesWritten;
     PCFDATA_NODE DataNode;
+    PCFDATA_JOB Job;
+    void* Buffer;
+
+    if ((MaxJobs > 0) && (MaxDiskSize == 0))
+    {
+        /* Queue the block, it is compressed later together with others */
+        Job = &Jobs[JobCount++];
+        Buffer = Job->InputBuffer;
+        Job->InputBuffer = InputBuffer;
+        Job->InputLength = CurrentIBufferSize;
+        Job->FolderNode  = CurrentFolderNode;
+
+        InputBuffer        = Buffer;
+        CurrentIBuffer     = InputBuffer;
+        CurrentIBufferSize = 0;
+
+        if (JobCount == MaxJobs)
+            return FlushDataBlocks();
+
+        return CAB_STATUS_SUCCESS;
+    }
+
+    /* A block that may be split across disks needs its compressed size now */
+    Status = FlushDataBlocks();
+    if (Status != CAB_STATUS_SUCCESS)
+        return Status;
 
     if (!BlockIsSplit)
     {
@@ -3619,6 +3895,9 @@ ULONG CCabinet::WriteDataBlock()
 
     LastBlockStart += DataNode->Data.UncompSize;
 
+    UncompressedBytes += DataNode->Data.UncompSize;
+    CompressedBytes   += DataNode->Data.CompSize;
+
     if (!BlockIsSplit)
     {
         CurrentIBufferSize = 0;
@@ -3628,6 +3907,220 @@ ULONG CCabinet::WriteDataBlock()
     return CAB_STATUS_SUCCESS;
 }
 
+
+ULONG CCabinet::CreateJobs()
+/*
+ * FUNCTION: Allocates the data block queue and a codec for each compression thread
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    ULONG i;
+
+    if (CodecId == CAB_CODEC_LZX)
+        MaxJobs = ((CLZXCodec*)Codec)->GetBatchSize();
+    else
+        MaxJobs = ThreadCount * CAB_BLOCKS_PER_THREAD;
+    JobCount = 0;
+
+    Jobs      = (PCFDATA_JOB)AllocateMemory(MaxJobs * sizeof(CFDATA_JOB));
+    JobCodecs = (CCABCodec**)AllocateMemory(ThreadCount * sizeof(CCABCodec*));
+    if ((!Jobs) || (!JobCodecs))
+    {
+        DPRINT(MIN_TRACE, ("Insufficient memory.\n"));
+        DestroyJobs();
+        return CAB_STATUS_NOMEMORY;
+    }
+
+    memset(Jobs, 0, MaxJobs * sizeof(CFDATA_JOB));
+    memset(JobCodecs, 0, ThreadCount * sizeof(CCABCodec*));
+
+    for (i = 0; i < MaxJobs; i++)
+    {
+        Jobs[i].InputBuffer  = AllocateMemory(CAB_MAX_COMPSIZE);
+        Jobs[i].OutputBuffer = AllocateMemory(CAB_MAX_COMPSIZE);
+        if ((!Jobs[i].InputBuffer) || (!Jobs[i].OutputBuffer))
+        {
+            DPRINT(MIN_TRACE, ("Insufficient memory.\n"));
+            DestroyJobs();
+            return CAB_STATUS_NOMEMORY;
+        }
+    }
+
+    /* LZX blocks depend on each other, the selected codec compresses them in order */
+    if (CodecId == CAB_CODEC_LZX)
+        return CAB_STATUS_SUCCESS;
+
+    for (i = 0; i < ThreadCount; i++)
+    {
+        JobCodecs[i] = NewCodec(CodecId, CodecWindowBits);
+        if (!JobCodecs[i])
+        {
+            DestroyJobs();
+            return CAB_STATUS_UNSUPPCOMP;
+        }
+    }
+
+    return CAB_STATUS_SUCCESS;
+}
+
+
+void CCabinet::DestroyJobs()
+/*
+ * FUNCTION: Frees the data block queue and the codecs of the compression threads
+ */
+{
+    ULONG i;
+
+    if (Jobs)
+    {
+        for (i = 0; i < MaxJobs; i++)
+        {
+            if (Jobs[i].InputBuffer)
+                FreeMemory(Jobs[i].InputBuffer);
+            if (Jobs[i].OutputBuffer)
+                FreeMemory(Jobs[i].OutputBuffer);
+        }
+        FreeMemory(Jobs);
+        Jobs = NULL;
+    }
+
+    if (JobCodecs)
+    {
+        for (i = 0; i < ThreadCount; i++)
+            delete JobCodecs[i];
+        FreeMemory(JobCodecs);
+        JobCodecs = NULL;
+    }
+
+    MaxJobs  = 0;
+    JobCount = 0;
+}
+
+
+ULONG CCabinet::FlushDataBlocks()
+/*
+ * FUNCTION: Compresses the queued data blocks on the compression threads and
+ *           writes them to the scratch file in the order they were queued
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    COMPRESS_CONTEXT Contexts[CAB_MAX_THREADS];
+#if defined(_WIN32)
+    HANDLE Threads[CAB_MAX_THREADS];
+#else
+    pthread_t Threads[CAB_MAX_THREADS];
+#endif
+    bool Started[CAB_MAX_THREADS];
+    PCFDATA_NODE DataNode;
+    PCFDATA_JOB Job;
+    ULONG BytesWritten;
+    ULONG Status;
+    ULONG Count;
+    ULONG i;
+
+    if (JobCount == 0)
+        return CAB_STATUS_SUCCESS;
+
+    if (CodecId == CAB_CODEC_LZX)
+    {
+        ((CLZXCodec*)Codec)->CompressBlocks(Jobs, JobCount);
+    }
+    else
+    {
+        Count = (JobCount < ThreadCount) ? JobCount : ThreadCount;
+
+        for (i = 0; i < Count; i++)
+        {
+            Contexts[i].Jobs   = Jobs;
+            Contexts[i].First  = i;
+            Contexts[i].Count  = JobCount;
+            Contexts[i].Stride = Count;
+            Contexts[i].Codec  = JobCodecs[i];
+        }
+
+        /* The calling thread does the first share of the work itself */
+        for (i = 1; i < Count; i++)
+        {
+#if defined(_WIN32)
+            Threads[i] = CreateThread(NULL, 0, CompressThread, &Contexts[i], 0, NULL);
+            Started[i] = (Threads[i] != NULL);
+#else
+            Started[i] = (pthread_create(&Threads[i], NULL, CompressThread, &Contexts[i]) == 0);
+#endif
+            if (!Started[i])
+                CompressThread(&Contexts[i]);
+        }
+
+        CompressThread(&Contexts[0]);
+
+        for (i = 1; i < Count; i++)
+        {
+            if (!Started[i])
+                continue;
+#if defined(_WIN32)
+            WaitForSingleObject(Threads[i], INFINITE);
+            CloseHandle(Threads[i]);
+#else
+            pthread_join(Threads[i], NULL);
+#endif
+        }
+    }
+
+    for (i = 0; i < JobCount; i++)
+    {
+        Job = &Jobs[i];
+
+        if (Job->Status != CS_SUCCESS)
+        {
+            DPRINT(MIN_TRACE, ("Cannot compress data block (%u).\n", (UINT)Job->Status));
+            JobCount = 0;
+            return (Job->Status == CS_NOMEMORY) ? CAB_STATUS_NOMEMORY : CAB_STATUS_FAILURE;
+        }
+
+        DataNode = NewDataNode(Job->FolderNode);
+        if (!DataNode)
+        {
+            DPRINT(MIN_TRACE, ("Insufficient memory.\n"));
+            JobCount = 0;
+            return CAB_STATUS_NOMEMORY;
+        }
+
+        DataNode->Data.Checksum   = 0;
+        DataNode->Data.CompSize   = (USHORT)Job->OutputLength;
+        DataNode->Data.UncompSize = (USHORT)Job->InputLength;
+        DataNode->ScratchFilePosition = ScratchFile->Position();
+
+        DPRINT(MAX_TRACE, ("Writing block. Checksum (0x%X)  CompSize (%u)  UncompSize (%u).\n",
+            (UINT)DataNode->Data.Checksum,
+            DataNode->Data.CompSize,
+            DataNode->Data.UncompSize));
+
+        Status = ScratchFile->WriteBlock(&DataNode->Data,
+            Job->OutputBuffer, &BytesWritten);
+        if (Status != CAB_STATUS_SUCCESS)
+        {
+            JobCount = 0;
+            return Status;
+        }
+
+        DiskSize += sizeof(CFDATA) + BytesWritten;
+
+        Job->FolderNode->TotalFolderSize += (BytesWritten + sizeof(CFDATA));
+        Job->FolderNode->Folder.DataBlockCount++;
+
+        LastBlockStart += DataNode->Data.UncompSize;
+
+        UncompressedBytes += DataNode->Data.UncompSize;
+        CompressedBytes   += DataNode->Data.CompSize;
+    }
+
+    JobCount = 0;
+
+    return CAB_STATUS_SUCCESS;
+}
+
 #if !defined(_WIN32)
 
 void CCabinet::ConvertDateAndTime(time_t* Time,
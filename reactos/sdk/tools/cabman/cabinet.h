@@ -33,6 +33,7 @@
 #define DIR_SEPARATOR_STRING "\\"
 
 #define strcasecmp _stricmp
+#define strncasecmp _strnicmp
 #define strdup _strdup
 
 #define AllocateMemory(size) HeapAlloc(GetProcessHeap(), 0, size)
@@ -97,6 +98,8 @@ extern ULONG DebugTraceLevel;
 #define CAB_SIGNATURE        0x4643534D // "MSCF"
 #define CAB_VERSION          0x0103
 #define CAB_BLOCKSIZE        32768
+#define CAB_MAX_COMPSIZE     (CAB_BLOCKSIZE + 6144) // LZX may expand data that does not compress
+#define CAB_MAX_THREADS      64
 
 #define CAB_COMP_MASK        0x00FF
 #define CAB_COMP_NONE        0x0000
@@ -236,6 +239,16 @@ typedef struct _CAB_SEARCH
     char*             FileName;  // Current filename
 } CAB_SEARCH, *PCAB_SEARCH;
 
+typedef struct _CFDATA_JOB
+{
+    void*             InputBuffer;   // Uncompressed data of the block
+    ULONG             InputLength;   // Number of uncompressed bytes
+    void*             OutputBuffer;  // Compressed data of the block
+    ULONG             OutputLength;  // Number of compressed bytes
+    ULONG             Status;        // Codec status (CS_*)
+    PCFFOLDER_NODE    FolderNode;    // Folder the block belongs to
+} CFDATA_JOB, *PCFDATA_JOB;
+
 
 /* Constants */
 
@@ -263,6 +276,8 @@ public:
     CCABCodec() {};
     /* Default destructor */
     virtual ~CCABCodec() {};
+    /* Starts a new folder */
+    virtual void Reset() {};
     /* Compresses a data block */
     virtual ULONG Compress(void* OutputBuffer,
                            void* InputBuffer,
@@ -287,6 +302,11 @@ public:
 #define CAB_CODEC_LZX   0x01
 #define CAB_CODEC_MSZIP 0x02
 
+/* LZX window sizes, 2^n bytes */
+#define LZX_MIN_WINDOW_BITS     15
+#define LZX_MAX_WINDOW_BITS     21
+#define LZX_DEFAULT_WINDOW_BITS 21
+
 
 
 /* Classes */
@@ -357,7 +377,7 @@ public:
     /* Extracts a file from the current cabinet file */
     ULONG ExtractFile(char* FileName);
     /* Select codec engine to use */
-    void SelectCodec(LONG Id);
+    void SelectCodec(LONG Id, ULONG WindowBits = LZX_DEFAULT_WINDOW_BITS);
     /* Returns whether a codec engine is selected */
     bool IsCodecSelected();
     /* Adds a search criteria for adding files to a simple cabinet, displaying files in a cabinet or extracting them */
@@ -392,6 +412,12 @@ public:
     ULONG AddFile(char* FileName);
     /* Sets the maximum size of the current disk */
     void SetMaxDiskSize(ULONG Size);
+    /* Sets the number of threads used to compress data blocks */
+    void SetThreadCount(ULONG Count);
+    /* Returns the number of bytes passed to the codec */
+    ULONGLONG GetUncompressedBytes();
+    /* Returns the number of bytes produced by the codec */
+    ULONGLONG GetCompressedBytes();
 #endif /* CAB_READ_ONLY */
 
     /* Default event handlers */
@@ -427,6 +453,7 @@ private:
     void DestroyDeletedFolderNodes();
     ULONG ComputeChecksum(void* Buffer, ULONG Size, ULONG Seed);
     ULONG ReadBlock(void* Buffer, ULONG Size, PULONG BytesRead);
+    ULONG DecodeDataBlocks(PCFDATA_NODE First, PCFDATA_NODE Last, PUCHAR Buffer);
     bool MatchFileNamePattern(char* FileName, char* Pattern);
 #ifndef CAB_READ_ONLY
     ULONG InitCabinetHeader();
@@ -435,6 +462,9 @@ private:
     ULONG WriteFileEntries();
     ULONG CommitDataBlocks(PCFFOLDER_NODE FolderNode);
     ULONG WriteDataBlock();
+    ULONG CreateJobs();
+    void DestroyJobs();
+    ULONG FlushDataBlocks();
     ULONG GetAttributesOnFile(PCFFILE_NODE File);
     ULONG SetAttributesOnFile(char* FileName, USHORT FileAttributes);
     ULONG GetFileTimes(FILEHANDLE FileHandle, PCFFILE_NODE File);
@@ -475,6 +505,7 @@ private:
     PSEARCH_CRITERIA CriteriaListTail;
     CCABCodec *Codec;
     LONG CodecId;
+    ULONG CodecWindowBits;      // LZX window size of the codec
     bool CodecSelected;
     void* InputBuffer;
     void* CurrentIBuffer;               // Current offset in input buffer
@@ -500,6 +531,13 @@ private:
     ULONG TotalBytesLeft;
     bool BlockIsSplit;                  // true if current data block is split
     ULONG NextFolderNumber;     // Zero based folder number
+    ULONG ThreadCount;          // Number of compression threads
+    PCFDATA_JOB Jobs;                   // Data blocks waiting to be compressed
+    ULONG JobCount;             // Number of queued data blocks
+    ULONG MaxJobs;              // Number of data blocks compressed in one go
+    CCABCodec** JobCodecs;              // One codec per compression thread
+    ULONGLONG UncompressedBytes;
+    ULONGLONG CompressedBytes;
 #endif /* CAB_READ_ONLY */
 };
 
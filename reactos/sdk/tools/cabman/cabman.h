@@ -31,6 +31,7 @@ private:
     bool CreateCabinet();
     bool DisplayCabinet();
     bool ExtractFromCabinet();
+    void PrintThroughput(ULONG Milliseconds);
     /* Event handlers */
     virtual bool OnOverwrite(PCFFILE File, char* FileName);
     virtual void OnExtract(PCFFILE File, char* FileName);
@@ -42,6 +43,7 @@ private:
     bool PromptOnOverwrite;
     char FileName[PATH_MAX];
     bool Verbose;
+    bool ShowThroughput;
 };
 
 extern CCABManager CABMgr;
@@ -0,0 +1,299 @@
+/*
+ * COPYRIGHT:   See COPYING in the top level directory
+ * PROJECT:     ReactOS cabinet manager
+ * FILE:        tools/cabman/lzx.cxx
+ * PURPOSE:     CAB codec for LZX compressed data
+ * NOTES:       The compressor is the lzxcomp library that hhpcomp uses.
+ *              The decoder is the one from dll/win32/itss.
+ *              In a cabinet each data block holds one 32 KB LZX frame and
+ *              the decoder state carries over from block to block, so the
+ *              blocks of a folder have to be processed in order.
+ */
+#include "lzx.h"
+
+
+/* CLZXCodec */
+
+CLZXCodec::CLZXCodec(ULONG WindowBits)
+/*
+ * FUNCTION: Constructor
+ * ARGUMENTS:
+ *     WindowBits = The window is 2^WindowBits bytes (15 to 21)
+ */
+{
+    this->WindowBits = WindowBits;
+    WindowSize = 1 << WindowBits;
+
+    Compressor = NULL;
+    Decoder    = NULL;
+    Input      = NULL;
+
+    Reset();
+}
+
+
+CLZXCodec::~CLZXCodec()
+/*
+ * FUNCTION: Default destructor
+ */
+{
+    if (Compressor)
+        lzx_finish(Compressor, NULL);
+
+    if (Decoder)
+        LZXteardown(Decoder);
+
+    if (Input)
+        FreeMemory(Input);
+}
+
+
+void CLZXCodec::Reset()
+/*
+ * FUNCTION: Forgets the data of the previous folder
+ */
+{
+    /* The next block must not refer to data of the previous folder */
+    if (Compressor)
+        lzx_reset(Compressor);
+
+    if (Decoder)
+        LZXreset(Decoder);
+}
+
+
+ULONG CLZXCodec::GetBatchSize()
+/*
+ * FUNCTION: Returns the number of data blocks to pass to CompressBlocks
+ * RETURNS:
+ *     Number of data blocks that fill the window
+ * NOTES:
+ *     Every call makes the compressor look for matches in a whole window
+ *     of history, so compressing fewer blocks at a time is much slower
+ */
+{
+    return WindowSize / CAB_BLOCKSIZE;
+}
+
+
+int CLZXCodec::GetBytes(void* Arg, int Count, void* Buffer)
+/*
+ * FUNCTION: Feeds the uncompressed data of the queued blocks to the compressor
+ */
+{
+    CLZXCodec* This = (CLZXCodec*)Arg;
+    PCFDATA_JOB Job;
+    ULONG Length;
+    int Done = 0;
+
+    while ((Done < Count) && (This->InputJob < This->JobCount))
+    {
+        Job = &This->Jobs[This->InputJob];
+
+        Length = Job->InputLength - This->InputOffset;
+        if (Length > (ULONG)(Count - Done))
+            Length = Count - Done;
+
+        memcpy((PUCHAR)Buffer + Done, (PUCHAR)Job->InputBuffer + This->InputOffset, Length);
+        Done += Length;
+
+        This->InputOffset += Length;
+        if (This->InputOffset == Job->InputLength)
+        {
+            This->InputJob++;
+            This->InputOffset = 0;
+        }
+    }
+
+    return Done;
+}
+
+
+int CLZXCodec::PutBytes(void* Arg, int Count, void* Buffer)
+/*
+ * FUNCTION: Stores compressed data in the block of the current frame
+ */
+{
+    CLZXCodec* This = (CLZXCodec*)Arg;
+    PCFDATA_JOB Job;
+
+    if (This->OutputJob >= This->JobCount)
+    {
+        This->Overflow = true;
+        return Count;
+    }
+
+    Job = &This->Jobs[This->OutputJob];
+    if (Job->OutputLength + Count > CAB_MAX_COMPSIZE)
+    {
+        This->Overflow = true;
+        return Count;
+    }
+
+    memcpy((PUCHAR)Job->OutputBuffer + Job->OutputLength, Buffer, Count);
+    Job->OutputLength += Count;
+
+    return Count;
+}
+
+
+void CLZXCodec::MarkFrame(void* Arg, uint32_t Uncompressed, uint32_t Compressed)
+/*
+ * FUNCTION: Called by the compressor at the aligned end of each frame
+ */
+{
+    CLZXCodec* This = (CLZXCodec*)Arg;
+
+    This->OutputJob++;
+}
+
+
+int CLZXCodec::AtEof(void* Arg)
+/*
+ * FUNCTION: Returns whether all queued data was given to the compressor
+ */
+{
+    CLZXCodec* This = (CLZXCodec*)Arg;
+
+    return (This->InputJob >= This->JobCount);
+}
+
+
+ULONG CLZXCodec::CompressBlocks(PCFDATA_JOB Jobs, ULONG Count)
+/*
+ * FUNCTION: Compresses consecutive data blocks of a folder
+ * ARGUMENTS:
+ *     Jobs  = Pointer to the blocks. Each receives one LZX frame
+ *     Count = Number of blocks, at most GetBatchSize()
+ * RETURNS:
+ *     Status of operation, also stored in each block
+ * NOTES:
+ *     Only the last block of a folder may be shorter than CAB_BLOCKSIZE.
+ *     The compressor pads it with zeros to a whole frame, and the
+ *     decoder stops at the uncompressed size of the block
+ */
+{
+    ULONG Status;
+    ULONG i;
+
+    if (!Compressor)
+    {
+        if (lzx_init(&Compressor, WindowBits,
+                     GetBytes, this, AtEof,
+                     PutBytes, this,
+                     MarkFrame, this) != 0)
+        {
+            DPRINT(MIN_TRACE, ("lzx_init() failed.\n"));
+            Compressor = NULL;
+            return CS_NOMEMORY;
+        }
+    }
+
+    for (i = 0; i < Count; i++)
+        Jobs[i].OutputLength = 0;
+
+    this->Jobs  = Jobs;
+    JobCount    = Count;
+    InputJob    = 0;
+    InputOffset = 0;
+    OutputJob   = 0;
+    Overflow    = false;
+
+    lzx_compress_block(Compressor, Count * CAB_BLOCKSIZE, 1);
+
+    Status = CS_SUCCESS;
+    if (Overflow || (OutputJob != Count))
+    {
+        DPRINT(MIN_TRACE, ("Compressed %u of %u frames.\n", (UINT)OutputJob, (UINT)Count));
+        Status = CS_BADSTREAM;
+    }
+
+    for (i = 0; i < Count; i++)
+        Jobs[i].Status = Status;
+
+    return Status;
+}
+
+
+ULONG CLZXCodec::Compress(void* OutputBuffer,
+                          void* InputBuffer,
+                          ULONG InputLength,
+                          PULONG OutputLength)
+/*
+ * FUNCTION: Compresses data in a buffer
+ * ARGUMENTS:
+ *     OutputBuffer   = Pointer to buffer to place compressed data
+ *     InputBuffer    = Pointer to buffer with data to be compressed
+ *     InputLength    = Length of input buffer
+ *     OutputLength   = Address of buffer to place size of compressed data
+ */
+{
+    CFDATA_JOB Job;
+    ULONG Status;
+
+    Job.InputBuffer  = InputBuffer;
+    Job.InputLength  = InputLength;
+    Job.OutputBuffer = OutputBuffer;
+    Job.FolderNode   = NULL;
+
+    Status = CompressBlocks(&Job, 1);
+
+    *OutputLength = Job.OutputLength;
+
+    return Status;
+}
+
+
+ULONG CLZXCodec::Uncompress(void* OutputBuffer,
+                            void* InputBuffer,
+                            ULONG InputLength,
+                            PULONG OutputLength)
+/*
+ * FUNCTION: Uncompresses data in a buffer
+ * ARGUMENTS:
+ *     OutputBuffer = Pointer to buffer to place uncompressed data
+ *     InputBuffer  = Pointer to buffer with data to be uncompressed
+ *     InputLength  = Length of input buffer
+ *     OutputLength = Uncompressed size of the block before,
+ *                    size of uncompressed data after
+ * NOTES:
+ *     The blocks of a folder must be passed in order, starting after Reset()
+ */
+{
+    int Status;
+
+    DPRINT(MAX_TRACE, ("InputLength (%u)  OutputLength (%u).\n", (UINT)InputLength, (UINT)*OutputLength));
+
+    if ((InputLength == 0) || (InputLength > CAB_MAX_COMPSIZE) ||
+        (*OutputLength == 0) || (*OutputLength > CAB_BLOCKSIZE))
+        return CS_BADSTREAM;
+
+    if (!Decoder)
+    {
+        Decoder = LZXinit(WindowBits);
+        if (!Decoder)
+            return CS_NOMEMORY;
+    }
+
+    if (!Input)
+    {
+        Input = (PUCHAR)AllocateMemory(CAB_MAX_COMPSIZE + LZX_INPUT_SLACK);
+        if (!Input)
+            return CS_NOMEMORY;
+    }
+
+    /* The decoder may read a few bytes past the end of the block */
+    memcpy(Input, InputBuffer, InputLength);
+    memset(Input + InputLength, 0, LZX_INPUT_SLACK);
+
+    Status = LZXdecompress(Decoder, Input, (unsigned char*)OutputBuffer,
+                           (int)InputLength, (int)*OutputLength);
+    if (Status == DECR_NOMEMORY)
+        return CS_NOMEMORY;
+    if (Status != DECR_OK)
+        return CS_BADSTREAM;
+
+    return CS_SUCCESS;
+}
+
+/* EOF */
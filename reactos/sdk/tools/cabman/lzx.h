@@ -0,0 +1,70 @@
+/*
+ * COPYRIGHT:   See COPYING in the top level directory
+ * PROJECT:     ReactOS cabinet manager
+ * FILE:        tools/cabman/lzx.h
+ * PURPOSE:     CAB codec for LZX compressed data
+ */
+
+#pragma once
+
+#include "cabinet.h"
+
+extern "C" {
+#include <stdint.h>
+#include <lzx_compress.h>
+#include "../../../dll/win32/itss/lzx.h"
+}
+
+/* The decoder may read a few bytes past the end of a block */
+#define LZX_INPUT_SLACK  4
+
+
+/* Classes */
+
+class CLZXCodec : public CCABCodec
+{
+public:
+    /* Constructor */
+    CLZXCodec(ULONG WindowBits);
+    /* Default destructor */
+    virtual ~CLZXCodec();
+    /* Starts a new folder */
+    virtual void Reset();
+    /* Compresses a data block */
+    virtual ULONG Compress(void* OutputBuffer,
+                           void* InputBuffer,
+                           ULONG InputLength,
+                           PULONG OutputLength);
+    /* Compresses consecutive data blocks of a folder */
+    ULONG CompressBlocks(PCFDATA_JOB Jobs, ULONG Count);
+    /* Returns the number of data blocks that fit into the window */
+    ULONG GetBatchSize();
+    /* Uncompresses a data block */
+    virtual ULONG Uncompress(void* OutputBuffer,
+                             void* InputBuffer,
+                             ULONG InputLength,
+                             PULONG OutputLength);
+private:
+    static int GetBytes(void* Arg, int Count, void* Buffer);
+    static int PutBytes(void* Arg, int Count, void* Buffer);
+    static void MarkFrame(void* Arg, uint32_t Uncompressed, uint32_t Compressed);
+    static int AtEof(void* Arg);
+
+    ULONG WindowBits;
+    ULONG WindowSize;
+
+    /* Compressor state */
+    lzx_data* Compressor;
+    PCFDATA_JOB Jobs;       // Blocks being compressed
+    ULONG JobCount;
+    ULONG InputJob;         // Block GetBytes reads from
+    ULONG InputOffset;      // Offset in that block
+    ULONG OutputJob;        // Block PutBytes writes to
+    bool Overflow;          // A block did not fit into CAB_MAX_COMPSIZE
+
+    /* Decoder state */
+    struct LZXstate* Decoder;
+    PUCHAR Input;           // Block being decoded, followed by LZX_INPUT_SLACK zeros
+};
+
+/* EOF */
@@ -14,6 +14,9 @@
 #include <stdarg.h>
 #include <string.h>
 #include <stdio.h>
+#if !defined(_WIN32)
+#include <sys/time.h>
+#endif
 #include "cabman.h"
 
 
@@ -162,6 +165,24 @@ char* Attr2Str(char* Str, USHORT Attr)
 }
 
 
+ULONG GetMilliseconds()
+/*
+ * FUNCTION: Returns a wall clock time stamp
+ * RETURNS:
+ *     Time in milliseconds
+ */
+{
+#if defined(_WIN32)
+    return GetTickCount();
+#else
+    struct timeval Time;
+
+    gettimeofday(&Time, NULL);
+    return (ULONG)(Time.tv_sec * 1000 + Time.tv_usec / 1000);
+#endif
+}
+
+
 /* CCABManager */
 
 CCABManager::CCABManager()
@@ -174,6 +195,7 @@ CCABManager::CCABManager()
     Mode = CM_MODE_DISPLAY;
     FileName[0] = 0;
     Verbose = false;
+    ShowThroughput = false;
 }
 
 
@@ -192,8 +214,8 @@ void CCABManager::Usage()
 {
     printf("ReactOS Cabinet Manager\n\n");
     printf("CABMAN [-D | -E] [-A] [-L dir] cabinet [filename ...]\n");
-    printf("CABMAN [-M mode] -C dirfile [-I] [-RC file] [-P dir]\n");
-    printf("CABMAN [-M mode] -S cabinet filename [...]\n");
+    printf("CABMAN [-M mode] [-J n] -C dirfile [-I] [-RC file] [-P dir]\n");
+    printf("CABMAN [-M mode] [-J n] -S cabinet filename [...]\n");
     printf("  cabinet   Cabinet file.\n");
     printf("  filename  Name of the file to add to or extract from the cabinet.\n");
     printf("            Wild cards and multiple filenames\n");
@@ -207,11 +229,16 @@ void CCABManager::Usage()
     printf("  -D        Display cabinet directory.\n");
     printf("  -E        Extract files from cabinet.\n");
     printf("  -I        Don't create the cabinet, only the .inf file.\n");
+    printf("  -J n      Compress data blocks on n threads (default is 1)\n");
+    printf("            and show the compression throughput.\n");
     printf("  -L dir    Location to place extracted or generated files\n");
     printf("            (default is current directory).\n");
     printf("  -M mode   Specify the compression method to use:\n");
     printf("               raw    - No compression\n");
     printf("               mszip  - MsZip compression (default)\n");
+    printf("               lzx:n  - LZX compression with a window of 2^n bytes\n");
+    printf("                        (n is 15 to 21, \"lzx\" alone uses 21). Not\n");
+    printf("                        split across threads with -J\n");
     printf("  -N        Don't create the .inf file, only the cabinet.\n");
     printf("  -RC       Specify file to put in cabinet reserved area\n");
     printf("            (size must be less than 64KB).\n");
@@ -231,6 +258,7 @@ bool CCABManager::ParseCmdline(int argc, char* argv[])
  */
 {
     int i;
+    int Threads;
     bool ShowUsage;
     bool FoundCabinet = false;
 
@@ -267,6 +295,26 @@ bool CCABManager::ParseCmdline(int argc, char* argv[])
                     InfFileOnly = true;
                     break;
 
+                case 'j':
+                case 'J':
+                    if (argv[i][2] == 0)
+                    {
+                        i++;
+                        Threads = (i < argc) ? atoi(&argv[i][0]) : 0;
+                    }
+                    else
+                        Threads = atoi(&argv[i][2]);
+
+                    if (Threads < 1)
+                    {
+                        printf("ERROR: Bad number of threads.\n");
+                        return false;
+                    }
+
+                    SetThreadCount(Threads);
+                    ShowThroughput = true;
+                    break;
+
                 case 'l':
                 case 'L':
                     if (argv[i][2] == 0)
@@ -555,11 +603,36 @@ bool CCABManager::ExtractFromCabinet()
 }
 
 
+void CCABManager::PrintThroughput(ULONG Milliseconds)
+/*
+ * FUNCTION: Display how fast the data was compressed
+ * ARGUMENTS:
+ *     Milliseconds = Time it took to create the cabinet
+ */
+{
+    double Seconds;
+
+    if (Milliseconds == 0)
+        Milliseconds = 1;
+
+    Seconds = Milliseconds / 1000.0;
+
+    printf("Compressed %.1f MB into %.1f MB in %.2f s (%.1f MB/s).\n",
+           GetUncompressedBytes() / (1024.0 * 1024.0),
+           GetCompressedBytes() / (1024.0 * 1024.0),
+           Seconds,
+           GetUncompressedBytes() / (1024.0 * 1024.0) / Seconds);
+}
+
+
 bool CCABManager::Run()
 /*
  * FUNCTION: Process cabinet
  */
 {
+    ULONG StartTime;
+    bool Status;
+
     if (Verbose)
     {
         printf("ReactOS Cabinet Manager\n\n");
@@ -568,7 +641,18 @@ bool CCABManager::Run()
     switch (Mode)
     {
         case CM_MODE_CREATE:
-            return CreateCabinet();
+        case CM_MODE_CREATE_SIMPLE:
+            StartTime = GetMilliseconds();
+
+            if (Mode == CM_MODE_CREATE)
+                Status = CreateCabinet();
+            else
+                Status = CreateSimpleCabinet();
+
+            if (Status && (ShowThroughput || Verbose))
+                PrintThroughput(GetMilliseconds() - StartTime);
+
+            return Status;
 
         case CM_MODE_DISPLAY:
             return DisplayCabinet();
@@ -576,9 +660,6 @@ bool CCABManager::Run()
         case CM_MODE_EXTRACT:
             return ExtractFromCabinet();
 
-        case CM_MODE_CREATE_SIMPLE:
-            return CreateSimpleCabinet();
-
         default:
             break;
     }
@@ -39,6 +39,17 @@
 #define MAX_MATCH 253
 #define MIN_MATCH 2
 
+/* Matches are looked up on hash chains of 3 character prefixes. The hash
+   has about one entry per window position, so chains mostly hold real
+   matches, and the number of links followed per position shrinks as the
+   window grows */
+#define LZ_MIN_HASH_BITS 16
+#define LZ_MAX_HASH_BITS 21
+#define LZ_MAX_CHAIN 256
+#define LZ_MIN_CHAIN 16
+#define LZ_HASH(p, bits) \
+  (((((unsigned)(p)[0] << 16) | ((p)[1] << 8) | (p)[2]) * 2654435761U) >> (32 - (bits)))
+
 void lz_init(lz_info *lzi, int wsize, int max_dist,
 	     int max_match, int min_match,
 	     int frame_size,
@@ -75,16 +86,23 @@ void lz_init(lz_info *lzi, int wsize, int max_dist,
   lzi->output_literal = output_literal;
   lzi->user_data = user_data;
   lzi->frame_size = frame_size;
-  lzi->lentab = calloc(sizeof(int), lzi->block_buf_size);
-  lzi->prevtab = calloc(sizeof(u_char *), lzi->block_buf_size);
+  lzi->hash_bits = LZ_MIN_HASH_BITS;
+  lzi->max_chain = LZ_MAX_CHAIN;
+  while ((lzi->hash_bits < LZ_MAX_HASH_BITS) && ((1 << lzi->hash_bits) < wsize)) {
+    lzi->hash_bits++;
+    if (lzi->max_chain > LZ_MIN_CHAIN)
+      lzi->max_chain >>= 1;
+  }
+  lzi->hashtab = malloc(sizeof(int) << lzi->hash_bits);
+  lzi->chaintab = malloc(sizeof(int) * lzi->block_buf_size);
   lzi->analysis_valid = 0;
 }
 
 void lz_release(lz_info *lzi)
 {
   free(lzi->block_buf);
-  free(lzi->lentab);
-  free(lzi->prevtab);
+  free(lzi->hashtab);
+  free(lzi->chaintab);
 }
 
 void lz_reset(lz_info *lzi)
@@ -164,120 +182,58 @@ fill_blockbuf(lz_info *lzi, int maxchars)
 
 static void lz_analyze_block(lz_info *lzi)
 {
-  int *lentab, *lenp;
-  u_char **prevtab, **prevp;
-  u_char *bbp, *bbe;
-  u_char *chartab[256];
-  u_char *cursor;
-  int prevlen;
-  int ch;
-  int maxlen;
-  long wasinc;
-  int max_dist = lzi->max_dist;
-#ifdef DEBUG_ANALYZE_BLOCK
-  static short n = 0;
-#endif
-#ifdef DEBUG_PERF
-  struct rusage innerloop;
-  struct timeval innertime, tmptime;
-  struct rusage outerloop;
-  struct timeval outertime;
-  struct rusage initialloop;
-  struct timeval initialtime;
-  struct rusage totalloop;
-  struct timeval totaltime;
-#endif
+  int *hashtab = lzi->hashtab;
+  int *chaintab = lzi->chaintab;
+  u_char *bbp = lzi->block_buf;
+  int hash_bits = lzi->hash_bits;
+  int h, i;
 
 #ifdef DEBUG_ANALYZE_BLOCK
-  fprintf(stderr, "Analyzing block %d, cur_loc = %06x\n", n, lzi->cur_loc);
-#endif
-  memset(chartab, 0, sizeof(chartab));
-  prevtab = prevp = lzi->prevtab;
-  lentab = lenp = lzi->lentab;
-  memset(prevtab, 0, sizeof(*prevtab) * lzi->chars_in_buf);
-  memset(lentab, 0, sizeof(*prevtab) * lzi->chars_in_buf);
-#ifdef DEBUG_PERF
-  memset(&innertime, 0, sizeof(innertime));
-  memset(&outertime, 0, sizeof(outertime));
-  getrusage(RUSAGE_SELF, &initialloop);
-  totalloop = initialloop;
+  fprintf(stderr, "Analyzing block, cur_loc = %06x\n", lzi->cur_loc);
 #endif
-  bbp = lzi->block_buf;
-  bbe = bbp + lzi->chars_in_buf;
-  while (bbp < bbe) {
-    if (chartab[ch = *bbp]) {
-      *prevp = chartab[ch];
-      *lenp = 1;
-    }
-    chartab[ch] = bbp;
-    bbp++;
-    prevp++;
-    lenp++;
+  for (i = 0; i < (1 << hash_bits); i++)
+    hashtab[i] = -1;
+  for (i = 0; i + 2 < lzi->chars_in_buf; i++) {
+    h = LZ_HASH(bbp + i, hash_bits);
+    chaintab[i] = hashtab[h];
+    hashtab[h] = i;
   }
-#ifdef DEBUG_PERF
-  initialtime = initialloop.ru_utime;
-  getrusage(RUSAGE_SELF, &initialloop);
-  timersub(&initialloop.ru_utime, &initialtime, &initialtime);
-#endif
-  wasinc = 1;
-  for (maxlen = 1; wasinc && (maxlen < lzi->max_match); maxlen++) {
-#ifdef DEBUG_PERF
-    getrusage(RUSAGE_SELF, &outerloop);
-#endif
-    bbp = bbe - maxlen - 1;
-    lenp = lentab + lzi->chars_in_buf - maxlen - 1;
-    prevp = prevtab + lzi->chars_in_buf - maxlen - 1;
-    wasinc = 0;
-    while (bbp > lzi->block_buf) {
-      if (*lenp == maxlen) {
-#ifdef DEBUG_PERF
-	getrusage(RUSAGE_SELF, &innerloop);
-#endif
-	ch = bbp[maxlen];
-	cursor = *prevp;
-	while(cursor && ((bbp - cursor) <= max_dist)) {
-	  prevlen = *(cursor - lzi->block_buf + lentab);
-	  if (cursor[maxlen] == ch) {
-	    *prevp = cursor;
-	    (*lenp)++;
-	    wasinc++;
-	    break;
-	  }
-	  if (prevlen != maxlen) break;
-	  cursor = *(cursor - lzi->block_buf + prevtab);
-	}
-#ifdef DEBUG_PERF
-	tmptime = innerloop.ru_utime;
-	getrusage(RUSAGE_SELF, &innerloop);
-	timersub(&innerloop.ru_utime, &tmptime, &tmptime);
-	timeradd(&tmptime, &innertime, &innertime);
-#endif
-      }
-      bbp--;
-      prevp--;
-      lenp--;
+  for (; i < lzi->chars_in_buf; i++)
+    chaintab[i] = -1;
+  lzi->analysis_valid = 1;
+}
+
+/* returns the length of the longest earlier match for the characters
+   at pos, and its position in *matchp. The nearest one wins a tie */
+static int lz_find_match(lz_info *lzi, int pos, int *matchp)
+{
+  u_char *bbp = lzi->block_buf + pos;
+  u_char *cursor;
+  int maxlen = lzi->chars_in_buf - pos;
+  int bestlen = 0;
+  int chain = lzi->max_chain;
+  int cand, len;
+
+  if (maxlen > lzi->max_match)
+    maxlen = lzi->max_match;
+  for (cand = lzi->chaintab[pos];
+       (cand >= 0) && ((pos - cand) <= lzi->max_dist) && chain--;
+       cand = lzi->chaintab[cand]) {
+    cursor = lzi->block_buf + cand;
+    /* skip hash collisions and candidates that cannot beat the best one */
+    if ((cursor[bestlen] != bbp[bestlen]) || (cursor[0] != bbp[0]) ||
+	(cursor[1] != bbp[1]) || (cursor[2] != bbp[2]))
+      continue;
+    for (len = 0; (len < maxlen) && (cursor[len] == bbp[len]); len++)
+      ;
+    if (len > bestlen) {
+      bestlen = len;
+      *matchp = cand;
+      if (len == maxlen)
+	break;
     }
-#ifdef DEBUG_PERF
-    tmptime = outerloop.ru_utime;
-    getrusage(RUSAGE_SELF, &outerloop);
-    timersub(&outerloop.ru_utime, &tmptime, &tmptime);
-    timeradd(&tmptime, &outertime, &outertime);
-#endif
-    //    fprintf(stderr, "maxlen = %d, wasinc = %ld\n", maxlen, wasinc);
   }
-#ifdef DEBUG_PERF
-  totaltime = totalloop.ru_utime;
-  getrusage(RUSAGE_SELF, &totalloop);
-  timersub(&totalloop.ru_utime, &totaltime, &totaltime);
-  fprintf(stderr, "Time spend in initial loop = %f\n", initialtime.tv_sec + initialtime.tv_usec/(double)1E6);
-  fprintf(stderr, "Time spend in outer loop = %f\n", outertime.tv_sec + outertime.tv_usec/(double)1E6);
-  fprintf(stderr, "Time spend in inner loop = %f\n", innertime.tv_sec + innertime.tv_usec/(double)1E6);
-  fprintf(stderr, "Time spend in all loops = %f\n", totaltime.tv_sec + totaltime.tv_usec/(double)1E6);
-#endif
-  lzi->analysis_valid = 1;
-#ifdef DEBUG_ANALYZE_BLOCK
-  fprintf(stderr, "Done analyzing block %d, cur_loc = %06x\n", n++, lzi->cur_loc);
-#endif
+  return bestlen;
 }
 
 void lz_stop_compressing(lz_info *lzi) 
@@ -290,9 +246,11 @@ int lz_compress(lz_info *lzi, int nchars)
 {
 
   u_char *bbp, *bbe;
-  int *lentab, *lenp;
-  u_char **prevtab, **prevp;
   int len;
+  int match = 0;
+#ifdef LAZY
+  int next_match;
+#endif
   int holdback;
   short trimmed;
 
@@ -332,8 +290,6 @@ int lz_compress(lz_info *lzi, int nchars)
       lz_analyze_block(lzi);
     }
 #endif
-    prevtab = prevp = lzi->prevtab + lzi->block_loc;
-    lentab = lenp = lzi->lentab + lzi->block_loc;
     bbp = lzi->block_buf + lzi->block_loc;
     holdback = lzi->max_match;
     if (lzi->eofcount) holdback = 0;
@@ -343,7 +299,7 @@ int lz_compress(lz_info *lzi, int nchars)
       bbe = bbp + nchars;
     while ((bbp < bbe) && (!lzi->stop)) {
       trimmed = 0;
-      len = *lenp;
+      len = lz_find_match(lzi, bbp - lzi->block_buf, &match);
       if (lzi->frame_size && (len > (lzi->frame_size - lzi->cur_loc % lzi->frame_size))) {
 #ifdef DEBUG_TRIMMING
 	fprintf(stderr, "Trim for framing: %06x %d %d\n", lzi->cur_loc,len, (lzi->frame_size - lzi->cur_loc % lzi->frame_size));
@@ -361,13 +317,13 @@ int lz_compress(lz_info *lzi, int nchars)
       if (len >= lzi->min_match) {
 #ifdef LAZY
 	if ((bbp < bbe -1) && !trimmed &&
-	    ((lenp[1] > (len + 1)) /* || ((lenp[1] == len) && (prevp[1] > prevp[0])) */)) {
+	    (lz_find_match(lzi, bbp - lzi->block_buf + 1, &next_match) > (len + 1))) {
 	  len = 1;
 	  /* this is the lazy eval case */
 	}
 	else 
 #endif
-	  if (lzi->output_match(lzi, (*prevp - lzi->block_buf) - lzi->block_loc,
+	  if (lzi->output_match(lzi, match - lzi->block_loc,
 				len) < 0) {
 	    //	    fprintf(stderr, "Match rejected: %06x %d\n", lzi->cur_loc, len);
 	    len = 1; /* match rejected */
@@ -382,8 +338,6 @@ int lz_compress(lz_info *lzi, int nchars)
       }
       //      fprintf(stderr, "len = %3d, *lenp = %3d, cur_loc = %06x, block_loc = %06x\n", len, *lenp, lzi->cur_loc, lzi->block_loc);
       bbp += len;
-      prevp += len;
-      lenp += len;
       lzi->cur_loc += len;
       lzi->block_loc += len;
       assert(nchars >= len);
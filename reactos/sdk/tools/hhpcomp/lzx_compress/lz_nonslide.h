@@ -38,8 +38,10 @@ struct lz_info
   int block_loc;
   int frame_size;
   int max_dist;
-  u_char **prevtab;
-  int *lentab;
+  int *hashtab;  /* last position of each 3 character hash in block_buf */
+  int *chaintab; /* previous position with the same hash, -1 for none */
+  int hash_bits; /* hashtab has 1 << hash_bits entries */
+  int max_chain; /* chaintab links followed per position */
   short eofcount;
   short stop;
   short analysis_valid;
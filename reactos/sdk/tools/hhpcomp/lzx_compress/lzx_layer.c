@@ -1245,6 +1245,7 @@ int lzx_finish(struct lzx_data *lzxd, struct lzx_results *lzxr)
   free(lzxd->prev_main_treelengths);
   free(lzxd->main_tree);
   free(lzxd->main_freq_table);
+  free(lzxd->block_codes);
   free(lzxd);
   return 0;
 }
@@ -0,0 +1,267 @@
+/*
+ * COPYRIGHT:   See COPYING in the top level directory
+ * PROJECT:     ReactOS INF parser benchmark
+ * FILE:        tools/infbench/infbench.c
+ * PURPOSE:     Times parsing and querying INF files with the host inflib
+ * NOTES:       Run it on the INF files that are shipped: the hive INFs and
+ *              txtsetup.sif from boot/bootdata and the files in media/inf.
+ *              The query pass does what mkhive and usetup do: it walks the
+ *              lines of every section, reads every field (which looks up
+ *              %strings% in the [Strings] section) and looks up every key.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <typedefs.h>
+#include <infhost.h>
+
+#define MAX_SECTION_NAME_LEN  255
+
+typedef struct _INF_FILE
+{
+    const char *FileName;
+    WCHAR **Sections;       // Names of the sections in the file
+    ULONG SectionCount;
+    double ParseTime;
+    double QueryTime;
+    ULONG Queries;
+    BOOLEAN Failed;         // The file could not be parsed
+} INF_FILE, *PINF_FILE;
+
+static
+void
+Usage(void)
+{
+    printf("Times parsing and querying INF files.\n"
+           "Syntax: infbench [-a] [-n count] file.inf [...]\n"
+           "  -a        Parse the files into an arena (INF_OPEN_ARENA)\n"
+           "  -n count  Number of times to process each file (default is 10)\n");
+}
+
+static
+double
+Elapsed(clock_t Start)
+{
+    return (double)(clock() - Start) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+/* Collect the names of the sections of an ANSI or UTF-8 INF file */
+static
+int
+ReadSectionNames(PINF_FILE File)
+{
+    FILE *Handle;
+    char Line[1024];
+    char *Start;
+    char *End;
+    WCHAR **Sections;
+    WCHAR *Name;
+    ULONG Length;
+    ULONG i;
+
+    Handle = fopen(File->FileName, "rb");
+    if (!Handle)
+    {
+        printf("Cannot open %s\n", File->FileName);
+        return -1;
+    }
+
+    while (fgets(Line, sizeof(Line), Handle))
+    {
+        Start = Line;
+        if (!strncmp(Start, "\xEF\xBB\xBF", 3))
+            Start += 3;
+        while (*Start == ' ' || *Start == '\t')
+            Start++;
+        if (*Start++ != '[')
+            continue;
+        End = strchr(Start, ']');
+        if (!End)
+            continue;
+
+        Length = (ULONG)(End - Start);
+        if (Length > MAX_SECTION_NAME_LEN)
+            continue;
+
+        /* Keep the old array on failure, it still has to be freed */
+        Sections = realloc(File->Sections, (File->SectionCount + 1) * sizeof(WCHAR *));
+        if (!Sections)
+        {
+            printf("Out of memory\n");
+            fclose(Handle);
+            return -1;
+        }
+        File->Sections = Sections;
+
+        Name = malloc((Length + 1) * sizeof(WCHAR));
+        if (!Name)
+        {
+            printf("Out of memory\n");
+            fclose(Handle);
+            return -1;
+        }
+
+        for (i = 0; i < Length; i++)
+            Name[i] = (UCHAR)Start[i];
+        Name[Length] = 0;
+        File->Sections[File->SectionCount++] = Name;
+    }
+
+    fclose(Handle);
+    return 0;
+}
+
+/* Read every line and field of a section and look up each key */
+static
+ULONG
+QuerySection(HINF InfHandle, const WCHAR *Section)
+{
+    PINFCONTEXT Context;
+    PINFCONTEXT KeyContext;
+    WCHAR Buffer[1024];
+    WCHAR *Key;
+    WCHAR *Data;
+    LONG FieldCount;
+    LONG i;
+    ULONG Queries = 1;
+
+    InfHostGetLineCount(InfHandle, Section);
+
+    if (InfHostFindFirstLine(InfHandle, Section, NULL, &Context) != 0)
+        return Queries;
+
+    do
+    {
+        FieldCount = InfHostGetFieldCount(Context);
+        for (i = 1; i <= FieldCount; i++)
+        {
+            InfHostGetStringField(Context, i, Buffer, sizeof(Buffer) / sizeof(WCHAR), NULL);
+            Queries++;
+        }
+
+        /* Field 0 is the key, which only some lines have */
+        if (InfHostGetData(Context, &Key, &Data) == 0 && Key != NULL)
+        {
+            InfHostGetStringField(Context, 0, Buffer, sizeof(Buffer) / sizeof(WCHAR), NULL);
+            if (InfHostFindFirstLine(InfHandle, Section, Key, &KeyContext) == 0)
+                InfHostFreeContext(KeyContext);
+            Queries += 2;
+        }
+    } while (InfHostFindNextLine(Context, Context) == 0);
+
+    InfHostFreeContext(Context);
+
+    return Queries;
+}
+
+int main(int argc, char *argv[])
+{
+    PINF_FILE Files;
+    ULONG FileCount = 0;
+    ULONG Count = 10;
+    ULONG Flags = 0;
+    ULONG Iteration;
+    ULONG i, j;
+    ULONG ErrorLine;
+    HINF InfHandle;
+    clock_t Start;
+    double ParseTime = 0.0;
+    double QueryTime = 0.0;
+    ULONG Queries = 0;
+
+    if (argc < 2)
+    {
+        Usage();
+        return 1;
+    }
+
+    Files = calloc(argc, sizeof(INF_FILE));
+    if (!Files)
+    {
+        printf("Out of memory\n");
+        return 1;
+    }
+
+    for (i = 1; i < (ULONG)argc; i++)
+    {
+        if (!strcmp(argv[i], "-n") && i + 1 < (ULONG)argc)
+        {
+            Count = strtoul(argv[++i], NULL, 0);
+            continue;
+        }
+        if (!strcmp(argv[i], "-a"))
+        {
+            Flags |= INF_OPEN_ARENA;
+            continue;
+        }
+
+        Files[FileCount].FileName = argv[i];
+        if (ReadSectionNames(&Files[FileCount]) != 0)
+            return 1;
+        FileCount++;
+    }
+
+    if (FileCount == 0 || Count == 0)
+    {
+        Usage();
+        return 1;
+    }
+
+    for (Iteration = 0; Iteration < Count; Iteration++)
+    {
+        for (i = 0; i < FileCount; i++)
+        {
+            if (Files[i].Failed)
+                continue;
+
+            Start = clock();
+            if (InfHostOpenFileEx(&InfHandle, Files[i].FileName, 0, Flags, &ErrorLine) != 0)
+            {
+                printf("Cannot parse %s (line %u), skipping it\n", Files[i].FileName, (unsigned int)ErrorLine);
+                Files[i].Failed = TRUE;
+                continue;
+            }
+            Files[i].ParseTime += Elapsed(Start);
+
+            Start = clock();
+            for (j = 0; j < Files[i].SectionCount; j++)
+                Files[i].Queries += QuerySection(InfHandle, Files[i].Sections[j]);
+            Files[i].QueryTime += Elapsed(Start);
+
+            InfHostCloseFile(InfHandle);
+        }
+    }
+
+    printf("%-40s %8s %10s %10s %10s\n", "File", "Sections", "Parse ms", "Query ms", "Queries");
+    for (i = 0; i < FileCount; i++)
+    {
+        if (Files[i].Failed)
+            continue;
+
+        printf("%-40s %8u %10.2f %10.2f %10u\n",
+               Files[i].FileName,
+               (unsigned int)Files[i].SectionCount,
+               Files[i].ParseTime / Count,
+               Files[i].QueryTime / Count,
+               (unsigned int)(Files[i].Queries / Count));
+
+        ParseTime += Files[i].ParseTime;
+        QueryTime += Files[i].QueryTime;
+        Queries += Files[i].Queries;
+    }
+    printf("%-40s %8s %10.2f %10.2f %10u\n", "Total", "",
+           ParseTime / Count, QueryTime / Count, (unsigned int)(Queries / Count));
+
+    for (i = 0; i < FileCount; i++)
+    {
+        for (j = 0; j < Files[i].SectionCount; j++)
+            free(Files[i].Sections[j]);
+        free(Files[i].Sections);
+    }
+    free(Files);
+
+    return 0;
+}
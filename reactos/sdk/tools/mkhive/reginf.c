@@ -480,9 +480,9 @@ ImportRegistryFile(PCHAR FileName)
     ULONG ErrorLine;
 
     /* Load inf file from install media. */
-    if (InfHostOpenFile(&hInf, FileName, 0, &ErrorLine) != 0)
+    if (InfHostOpenFileEx(&hInf, FileName, 0, INF_OPEN_ARENA, &ErrorLine) != 0)
     {
-        DPRINT1("InfHostOpenFile(%s) failed\n", FileName);
+        DPRINT1("InfHostOpenFileEx(%s) failed\n", FileName);
         return FALSE;
     }
 
@@ -24,12 +24,17 @@ typedef struct _FONT_ENTRY_COLL_MEM
 
 typedef struct _FONT_CACHE_ENTRY
 {
-    LIST_ENTRY ListEntry;
+    LIST_ENTRY ListEntry;   /* LRU list, most recently used first */
+    LIST_ENTRY HashEntry;   /* Hash bucket */
+    LIST_ENTRY FaceEntry;   /* SHARED_FACE::GlyphCacheListHead */
     int GlyphIndex;
-    FT_Face Face;
+    PSHARED_FACE SharedFace;
     FT_BitmapGlyph BitmapGlyph;
     int Height;
+    FT_Render_Mode RenderMode;
     MATRIX mxWorldToDevice;
+    ULONG Hash;
+    SIZE_T Size;
 } FONT_CACHE_ENTRY, *PFONT_CACHE_ENTRY;
 
 
@@ -0,0 +1,205 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPL - See COPYING in the top level directory
+ * PURPOSE:         Test and throughput benchmark for ExtTextOutW
+ */
+
+#include <apitest.h>
+
+#include <wingdi.h>
+#include <winuser.h>
+
+#define BMP_WIDTH   640
+#define BMP_HEIGHT  64
+#define ITERATIONS  200
+
+static const WCHAR Sample[] = L"The quick brown fox jumps over the lazy dog 0123456789";
+
+static
+HDC
+CreateTestDC(
+    _Out_ HBITMAP *phbmp,
+    _Out_ PULONG *ppvBits)
+{
+    BITMAPINFO bmi = { { sizeof(BITMAPINFOHEADER), BMP_WIDTH, -BMP_HEIGHT, 1, 32, BI_RGB } };
+    HDC hdc;
+
+    *phbmp = NULL;
+    hdc = CreateCompatibleDC(NULL);
+    if (!hdc)
+        return NULL;
+
+    *phbmp = CreateDIBSection(hdc, &bmi, DIB_RGB_COLORS, (PVOID*)ppvBits, NULL, 0);
+    if (!*phbmp)
+    {
+        DeleteDC(hdc);
+        return NULL;
+    }
+
+    SelectObject(hdc, *phbmp);
+    return hdc;
+}
+
+static
+VOID
+DrawSample(
+    _In_ HDC hdc)
+{
+    RECT rc = { 0, 0, BMP_WIDTH, BMP_HEIGHT };
+
+    ExtTextOutW(hdc, 0, 0, ETO_OPAQUE, &rc, Sample, _countof(Sample) - 1, NULL);
+}
+
+static
+VOID
+TestFont(
+    _In_ PCWSTR FaceName,
+    _In_ INT Height,
+    _In_ BYTE Quality)
+{
+    LARGE_INTEGER Frequency, Start, End;
+    HFONT hFont, hOldFont;
+    HBITMAP hbmp;
+    PULONG pvBits, Reference;
+    HDC hdc;
+    ULONG i;
+    BOOL Same;
+
+    hdc = CreateTestDC(&hbmp, &pvBits);
+    if (!hdc)
+    {
+        skip("Could not create the DC\n");
+        return;
+    }
+
+    hFont = CreateFontW(Height, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE, DEFAULT_CHARSET,
+                        OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS, Quality, DEFAULT_PITCH, FaceName);
+    ok(hFont != NULL, "CreateFontW failed for %S\n", FaceName);
+    Reference = HeapAlloc(GetProcessHeap(), 0, BMP_WIDTH * BMP_HEIGHT * sizeof(ULONG));
+    if (!hFont || !Reference)
+    {
+        skip("Out of resources\n");
+        goto Cleanup;
+    }
+
+    hOldFont = SelectObject(hdc, hFont);
+
+    /* The first pass renders every glyph, the following ones come from the cache */
+    DrawSample(hdc);
+    GdiFlush();
+    CopyMemory(Reference, pvBits, BMP_WIDTH * BMP_HEIGHT * sizeof(ULONG));
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < ITERATIONS; i++)
+        DrawSample(hdc);
+    GdiFlush();
+    QueryPerformanceCounter(&End);
+
+    Same = (memcmp(Reference, pvBits, BMP_WIDTH * BMP_HEIGHT * sizeof(ULONG)) == 0);
+    ok(Same, "[%S %d q%u] Cached rendering differs from the first pass\n",
+       FaceName, Height, Quality);
+
+    trace("%-16S %3d q%u: %lu chars/s\n", FaceName, Height, Quality,
+          (ULONG)((ULONGLONG)ITERATIONS * (_countof(Sample) - 1) * Frequency.QuadPart /
+                  max(End.QuadPart - Start.QuadPart, 1)));
+
+    SelectObject(hdc, hOldFont);
+
+Cleanup:
+    if (Reference)
+        HeapFree(GetProcessHeap(), 0, Reference);
+    if (hFont)
+        DeleteObject(hFont);
+    DeleteDC(hdc);
+    DeleteObject(hbmp);
+}
+
+static
+VOID
+TestRenderModes(VOID)
+{
+    HFONT hMono, hGray;
+    HBITMAP hbmp;
+    PULONG pvBits, Mono;
+    HDC hdc;
+    ULONG i, Size = BMP_WIDTH * BMP_HEIGHT * sizeof(ULONG);
+    BOOL Gray;
+
+    hdc = CreateTestDC(&hbmp, &pvBits);
+    if (!hdc)
+    {
+        skip("Could not create the DC\n");
+        return;
+    }
+
+    hMono = CreateFontW(-32, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE, DEFAULT_CHARSET,
+                        OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS, NONANTIALIASED_QUALITY,
+                        DEFAULT_PITCH, L"Tahoma");
+    hGray = CreateFontW(-32, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE, DEFAULT_CHARSET,
+                        OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS, ANTIALIASED_QUALITY,
+                        DEFAULT_PITCH, L"Tahoma");
+    Mono = HeapAlloc(GetProcessHeap(), 0, Size);
+    if (!hMono || !hGray || !Mono)
+    {
+        skip("Out of resources\n");
+        goto Cleanup;
+    }
+
+    /* A monochrome glyph in the cache must not be returned for an antialiased request */
+    SelectObject(hdc, hMono);
+    DrawSample(hdc);
+    GdiFlush();
+    CopyMemory(Mono, pvBits, Size);
+    Gray = FALSE;
+    for (i = 0; i < BMP_WIDTH * BMP_HEIGHT; i++)
+    {
+        if ((Mono[i] & 0xFFFFFF) != 0 && (Mono[i] & 0xFFFFFF) != 0xFFFFFF)
+        {
+            Gray = TRUE;
+            break;
+        }
+    }
+    ok(!Gray, "Monochrome text contains gray pixels\n");
+
+    SelectObject(hdc, hGray);
+    DrawSample(hdc);
+    GdiFlush();
+    Gray = FALSE;
+    for (i = 0; i < BMP_WIDTH * BMP_HEIGHT; i++)
+    {
+        if ((pvBits[i] & 0xFFFFFF) != 0 && (pvBits[i] & 0xFFFFFF) != 0xFFFFFF)
+        {
+            Gray = TRUE;
+            break;
+        }
+    }
+    ok(Gray, "Antialiased text contains no gray pixels\n");
+
+    SelectObject(hdc, GetStockObject(SYSTEM_FONT));
+
+Cleanup:
+    if (Mono)
+        HeapFree(GetProcessHeap(), 0, Mono);
+    if (hMono)
+        DeleteObject(hMono);
+    if (hGray)
+        DeleteObject(hGray);
+    DeleteDC(hdc);
+    DeleteObject(hbmp);
+}
+
+START_TEST(ExtTextOut)
+{
+    static const INT Heights[] = { -8, -11, -16, -24, -48 };
+    ULONG i;
+
+    for (i = 0; i < _countof(Heights); i++)
+    {
+        TestFont(L"Tahoma", Heights[i], NONANTIALIASED_QUALITY);
+        TestFont(L"Tahoma", Heights[i], ANTIALIASED_QUALITY);
+    }
+    TestFont(L"Courier New", -13, DEFAULT_QUALITY);
+
+    TestRenderModes();
+}
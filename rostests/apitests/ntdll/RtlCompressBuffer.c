@@ -0,0 +1,202 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Round-trip test and benchmark for RtlCompressBuffer
+ */
+
+#include <apitest.h>
+
+#define WIN32_NO_STATUS
+#include <ndk/rtlfuncs.h>
+
+typedef struct _CORPUS_ENTRY
+{
+    PCSTR Name;
+    PUCHAR Data;
+    ULONG Size;
+    BOOLEAN Compressible;
+} CORPUS_ENTRY, *PCORPUS_ENTRY;
+
+static
+VOID
+FillText(
+    _Out_writes_bytes_(Size) PUCHAR Buffer,
+    _In_ ULONG Size)
+{
+    static const PCSTR Words[] = { "Rtl", "Compress", "Buffer ", "NTSTATUS ", "STATUS_SUCCESS;\r\n",
+                                   "    if (", "Status", ")\r\n", "return ", "ULONG ", "0x1000" };
+    ULONG Seed = 0x12345678, Offset = 0, Length;
+    PCSTR Word;
+
+    while (Offset < Size)
+    {
+        Word = Words[RtlRandom(&Seed) % _countof(Words)];
+        Length = min((ULONG)strlen(Word), Size - Offset);
+        RtlCopyMemory(Buffer + Offset, Word, Length);
+        Offset += Length;
+    }
+}
+
+static
+VOID
+FillRandom(
+    _Out_writes_bytes_(Size) PUCHAR Buffer,
+    _In_ ULONG Size)
+{
+    ULONG Seed = 0xCAFEBABE, i;
+
+    for (i = 0; i < Size; i++)
+        Buffer[i] = (UCHAR)RtlRandom(&Seed);
+}
+
+static
+PUCHAR
+GetModuleImage(
+    _In_ PCWSTR ModuleName,
+    _Out_ PULONG Size)
+{
+    PIMAGE_NT_HEADERS NtHeaders;
+    HMODULE Module;
+
+    *Size = 0;
+    Module = GetModuleHandleW(ModuleName);
+    if (!Module)
+        return NULL;
+
+    NtHeaders = RtlImageNtHeader(Module);
+    if (!NtHeaders)
+        return NULL;
+
+    *Size = NtHeaders->OptionalHeader.SizeOfImage;
+    return (PUCHAR)Module;
+}
+
+static
+VOID
+TestRoundTrip(
+    _In_ USHORT FormatAndEngine,
+    _In_ PCORPUS_ENTRY Entry,
+    _In_ PVOID WorkSpace)
+{
+    LARGE_INTEGER Frequency, Start, Middle, End;
+    PUCHAR Compressed, Decompressed;
+    ULONG CompressedSize, BufferSize, FinalSize;
+    NTSTATUS Status;
+
+    /* Worst case: Xpress spends one flag bit per literal, Huffman tables cost 256 bytes per 64 KB */
+    BufferSize = Entry->Size + Entry->Size / 8 + (Entry->Size / 0x10000 + 2) * 0x200;
+    Compressed = RtlAllocateHeap(RtlGetProcessHeap(), 0, BufferSize);
+    Decompressed = RtlAllocateHeap(RtlGetProcessHeap(), 0, Entry->Size);
+    if (!Compressed || !Decompressed)
+    {
+        skip("Out of memory for %s\n", Entry->Name);
+        goto Cleanup;
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+
+    CompressedSize = 0xdeadbeef;
+    QueryPerformanceCounter(&Start);
+    Status = RtlCompressBuffer(FormatAndEngine, Entry->Data, Entry->Size,
+                               Compressed, BufferSize, 0x1000, &CompressedSize, WorkSpace);
+    QueryPerformanceCounter(&Middle);
+    ok(Status == STATUS_SUCCESS, "[%s] RtlCompressBuffer(0x%04x) returned 0x%lx\n",
+       Entry->Name, FormatAndEngine, Status);
+    if (!NT_SUCCESS(Status))
+        goto Cleanup;
+    ok(CompressedSize <= BufferSize, "[%s] CompressedSize = %lu\n", Entry->Name, CompressedSize);
+    if (Entry->Compressible)
+    {
+        ok(CompressedSize < Entry->Size, "[%s] CompressedSize = %lu, expected less than %lu\n",
+           Entry->Name, CompressedSize, Entry->Size);
+    }
+
+    FinalSize = 0xdeadbeef;
+    Status = RtlDecompressBuffer(FormatAndEngine & 0xFF, Decompressed, Entry->Size,
+                                 Compressed, CompressedSize, &FinalSize);
+    QueryPerformanceCounter(&End);
+    ok(Status == STATUS_SUCCESS, "[%s] RtlDecompressBuffer returned 0x%lx\n", Entry->Name, Status);
+    ok(FinalSize == Entry->Size, "[%s] FinalSize = %lu, expected %lu\n",
+       Entry->Name, FinalSize, Entry->Size);
+    ok(RtlCompareMemory(Decompressed, Entry->Data, Entry->Size) == Entry->Size,
+       "[%s] Round-trip mismatch\n", Entry->Name);
+
+    trace("0x%04x %-12s %8lu -> %8lu bytes (%3lu%%), compress %lu KB/s, decompress %lu KB/s\n",
+          FormatAndEngine, Entry->Name, Entry->Size, CompressedSize,
+          (ULONG)((ULONGLONG)CompressedSize * 100 / max(Entry->Size, 1)),
+          (ULONG)((ULONGLONG)Entry->Size * Frequency.QuadPart / 1024 / max(Middle.QuadPart - Start.QuadPart, 1)),
+          (ULONG)((ULONGLONG)Entry->Size * Frequency.QuadPart / 1024 / max(End.QuadPart - Middle.QuadPart, 1)));
+
+Cleanup:
+    if (Compressed)
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Compressed);
+    if (Decompressed)
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Decompressed);
+}
+
+START_TEST(RtlCompressBuffer)
+{
+    static const USHORT Formats[] =
+    {
+        COMPRESSION_FORMAT_LZNT1 | COMPRESSION_ENGINE_STANDARD,
+        COMPRESSION_FORMAT_LZNT1 | COMPRESSION_ENGINE_MAXIMUM,
+        COMPRESSION_FORMAT_XPRESS | COMPRESSION_ENGINE_STANDARD,
+        COMPRESSION_FORMAT_XPRESS | COMPRESSION_ENGINE_MAXIMUM,
+        COMPRESSION_FORMAT_XPRESS_HUFF | COMPRESSION_ENGINE_STANDARD,
+        COMPRESSION_FORMAT_XPRESS_HUFF | COMPRESSION_ENGINE_MAXIMUM,
+    };
+    static UCHAR Text[256 * 1024], Random[64 * 1024], Zeroes[64 * 1024];
+    static const UCHAR Repeated[] = "WineWineWine";
+    CORPUS_ENTRY Corpus[6] = { { 0 } };
+    ULONG CorpusCount = 0, WorkSpaceSize, FragmentSize, i, j;
+    PVOID WorkSpace;
+    NTSTATUS Status;
+
+    FillText(Text, sizeof(Text));
+    FillRandom(Random, sizeof(Random));
+
+    Corpus[CorpusCount].Name = "repeated";
+    Corpus[CorpusCount].Compressible = TRUE;
+    Corpus[CorpusCount].Data = (PUCHAR)Repeated;
+    Corpus[CorpusCount++].Size = sizeof(Repeated);
+    Corpus[CorpusCount].Name = "text";
+    Corpus[CorpusCount].Compressible = TRUE;
+    Corpus[CorpusCount].Data = Text;
+    Corpus[CorpusCount++].Size = sizeof(Text);
+    Corpus[CorpusCount].Name = "random";
+    Corpus[CorpusCount].Data = Random;
+    Corpus[CorpusCount++].Size = sizeof(Random);
+    Corpus[CorpusCount].Name = "zeroes";
+    Corpus[CorpusCount].Compressible = TRUE;
+    Corpus[CorpusCount].Data = Zeroes;
+    Corpus[CorpusCount++].Size = sizeof(Zeroes);
+    Corpus[CorpusCount].Name = "ntdll.dll";
+    Corpus[CorpusCount].Data = GetModuleImage(L"ntdll.dll", &Corpus[CorpusCount].Size);
+    if (Corpus[CorpusCount].Data)
+        CorpusCount++;
+    Corpus[CorpusCount].Name = "kernel32.dll";
+    Corpus[CorpusCount].Data = GetModuleImage(L"kernel32.dll", &Corpus[CorpusCount].Size);
+    if (Corpus[CorpusCount].Data)
+        CorpusCount++;
+
+    for (i = 0; i < _countof(Formats); i++)
+    {
+        Status = RtlGetCompressionWorkSpaceSize(Formats[i], &WorkSpaceSize, &FragmentSize);
+        ok(Status == STATUS_SUCCESS, "RtlGetCompressionWorkSpaceSize(0x%04x) returned 0x%lx\n",
+           Formats[i], Status);
+        if (!NT_SUCCESS(Status))
+            continue;
+
+        WorkSpace = RtlAllocateHeap(RtlGetProcessHeap(), 0, WorkSpaceSize);
+        if (!WorkSpace)
+        {
+            skip("Out of memory\n");
+            continue;
+        }
+
+        for (j = 0; j < CorpusCount; j++)
+            TestRoundTrip(Formats[i], &Corpus[j], WorkSpace);
+
+        RtlFreeHeap(RtlGetProcessHeap(), 0, WorkSpace);
+    }
+}
@@ -0,0 +1,348 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Multithreaded stress test and benchmark for the heap and its front ends
+ */
+
+#include <apitest.h>
+
+#define WIN32_NO_STATUS
+#include <ndk/psfuncs.h>
+#include <ndk/rtlfuncs.h>
+
+#define STRESS_SLOTS       1024
+#define STRESS_OPERATIONS  200000
+#define STRESS_MAX_THREADS 16
+
+#define FRONT_END_NONE      0
+#define FRONT_END_LOOKASIDE 1
+#define FRONT_END_LFH       2
+
+static const PCSTR FrontEndNames[] = { "Backend  ", "Lookaside", "LFH      " };
+
+typedef struct _STRESS_THREAD
+{
+    HANDLE Heap;
+    ULONG Seed;
+    ULONG Allocations;
+    ULONG Errors;
+    SIZE_T LiveBytes;
+    PUCHAR Blocks[STRESS_SLOTS];
+    SIZE_T Sizes[STRESS_SLOTS];
+} STRESS_THREAD, *PSTRESS_THREAD;
+
+static HANDLE StartEvent;
+
+/* Mostly small blocks, as seen in real applications, with a tail up to 4 KB */
+static
+SIZE_T
+RandomSize(
+    _Inout_ PULONG Seed)
+{
+    ULONG Random = RtlRandom(Seed);
+
+    if (Random % 16 < 12)
+        return 1 + Random % 128;
+    if (Random % 16 < 15)
+        return 1 + Random % 1024;
+    return 1 + Random % 4096;
+}
+
+static
+DWORD
+WINAPI
+StressThread(
+    _In_ PVOID Parameter)
+{
+    PSTRESS_THREAD Thread = Parameter;
+    ULONG Operation, Slot;
+    UCHAR Pattern;
+    SIZE_T Size;
+
+    WaitForSingleObject(StartEvent, INFINITE);
+
+    for (Operation = 0; Operation < STRESS_OPERATIONS; Operation++)
+    {
+        Slot = RtlRandom(&Thread->Seed) % STRESS_SLOTS;
+        Pattern = (UCHAR)Slot;
+
+        if (Thread->Blocks[Slot])
+        {
+            /* Make sure nobody else wrote into our block */
+            Size = Thread->Sizes[Slot];
+            if (Thread->Blocks[Slot][0] != Pattern || Thread->Blocks[Slot][Size - 1] != Pattern)
+                Thread->Errors++;
+
+            if (!RtlFreeHeap(Thread->Heap, 0, Thread->Blocks[Slot]))
+                Thread->Errors++;
+            Thread->Blocks[Slot] = NULL;
+            Thread->LiveBytes -= Size;
+            continue;
+        }
+
+        Size = RandomSize(&Thread->Seed);
+        Thread->Blocks[Slot] = RtlAllocateHeap(Thread->Heap, 0, Size);
+        if (!Thread->Blocks[Slot])
+        {
+            Thread->Errors++;
+            continue;
+        }
+
+        if (RtlSizeHeap(Thread->Heap, 0, Thread->Blocks[Slot]) != Size)
+            Thread->Errors++;
+
+        Thread->Blocks[Slot][0] = Pattern;
+        Thread->Blocks[Slot][Size - 1] = Pattern;
+        Thread->Sizes[Slot] = Size;
+        Thread->LiveBytes += Size;
+        Thread->Allocations++;
+    }
+
+    return 0;
+}
+
+static
+SIZE_T
+GetCommittedBytes(VOID)
+{
+    VM_COUNTERS Counters;
+    NTSTATUS Status;
+
+    Status = NtQueryInformationProcess(NtCurrentProcess(),
+                                       ProcessVmCounters,
+                                       &Counters,
+                                       sizeof(Counters),
+                                       NULL);
+    if (!NT_SUCCESS(Status))
+        return 0;
+
+    return Counters.PagefileUsage;
+}
+
+static
+VOID
+RunStress(
+    _In_ ULONG FrontEnd,
+    _In_ ULONG ThreadCount)
+{
+    static STRESS_THREAD Threads[STRESS_MAX_THREADS];
+    HANDLE Handles[STRESS_MAX_THREADS];
+    LARGE_INTEGER Frequency, Start, End;
+    SIZE_T CommittedBefore, Committed, LiveBytes = 0;
+    ULONG Allocations = 0, Errors = 0, Information, i;
+    RTL_HEAP_LOOKASIDE_INFORMATION LookasideInformation;
+    HANDLE Heap;
+    NTSTATUS Status;
+
+    Heap = RtlCreateHeap(HEAP_GROWABLE, NULL, 0, 0, NULL, NULL);
+    ok(Heap != NULL, "RtlCreateHeap failed\n");
+    if (!Heap)
+        return;
+
+    if (FrontEnd != FRONT_END_NONE)
+    {
+        Information = FrontEnd;
+        Status = RtlSetHeapInformation(Heap, HeapCompatibilityInformation, &Information, sizeof(Information));
+        ok(Status == STATUS_SUCCESS, "RtlSetHeapInformation returned 0x%lx\n", Status);
+
+        Information = 0xdeadbeef;
+        Status = RtlQueryHeapInformation(Heap, HeapCompatibilityInformation, &Information, sizeof(Information), NULL);
+        ok(Status == STATUS_SUCCESS, "RtlQueryHeapInformation returned 0x%lx\n", Status);
+        ok(Information == FrontEnd, "Front end heap type = %lu, expected %lu\n", Information, FrontEnd);
+    }
+
+    CommittedBefore = GetCommittedBytes();
+    ResetEvent(StartEvent);
+
+    for (i = 0; i < ThreadCount; i++)
+    {
+        RtlZeroMemory(&Threads[i], sizeof(Threads[i]));
+        Threads[i].Heap = Heap;
+        Threads[i].Seed = 0x1234 + i;
+        Handles[i] = CreateThread(NULL, 0, StressThread, &Threads[i], 0, NULL);
+        ok(Handles[i] != NULL, "CreateThread failed with %lu\n", GetLastError());
+        if (!Handles[i])
+        {
+            ThreadCount = i;
+            break;
+        }
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    SetEvent(StartEvent);
+    WaitForMultipleObjects(ThreadCount, Handles, TRUE, INFINITE);
+    QueryPerformanceCounter(&End);
+
+    for (i = 0; i < ThreadCount; i++)
+    {
+        CloseHandle(Handles[i]);
+        Allocations += Threads[i].Allocations;
+        Errors += Threads[i].Errors;
+        LiveBytes += Threads[i].LiveBytes;
+    }
+
+    ok(Errors == 0, "%lu errors with %lu threads\n", Errors, ThreadCount);
+    ok(RtlValidateHeap(Heap, 0, NULL), "Heap is corrupted\n");
+
+    /* Everything committed on behalf of the heap that is not handed out is overhead */
+    Committed = GetCommittedBytes() - CommittedBefore;
+    trace("%s %2lu thread(s): %8lu allocations/s, %7Iu KB live, %7Iu KB committed, fragmentation %lu%%\n",
+          FrontEndNames[FrontEnd], ThreadCount,
+          (ULONG)((ULONGLONG)Allocations * Frequency.QuadPart / max(End.QuadPart - Start.QuadPart, 1)),
+          LiveBytes / 1024, Committed / 1024,
+          Committed > LiveBytes ? (ULONG)((Committed - LiveBytes) * 100 / Committed) : 0);
+
+    if (FrontEnd == FRONT_END_LOOKASIDE)
+    {
+        Status = RtlQueryHeapInformation(Heap, HeapLookasideInformation,
+                                         &LookasideInformation, sizeof(LookasideInformation), NULL);
+        ok(Status == STATUS_SUCCESS, "RtlQueryHeapInformation returned 0x%lx\n", Status);
+        if (NT_SUCCESS(Status))
+        {
+            trace("          allocations: %lu hits, %lu misses; frees: %lu hits, %lu misses\n",
+                  LookasideInformation.AllocateHits, LookasideInformation.AllocateMisses,
+                  LookasideInformation.FreeHits, LookasideInformation.FreeMisses);
+        }
+    }
+
+    RtlDestroyHeap(Heap);
+}
+
+static
+VOID
+TestLfhBlocks(VOID)
+{
+    ULONG Information = FRONT_END_LFH;
+    PUCHAR Block, NewBlock;
+    HANDLE Heap;
+    NTSTATUS Status;
+
+    Heap = RtlCreateHeap(HEAP_GROWABLE, NULL, 0, 0, NULL, NULL);
+    if (!Heap)
+    {
+        skip("RtlCreateHeap failed\n");
+        return;
+    }
+
+    Status = RtlSetHeapInformation(Heap, HeapCompatibilityInformation, &Information, sizeof(Information));
+    ok(Status == STATUS_SUCCESS, "RtlSetHeapInformation returned 0x%lx\n", Status);
+
+    Block = RtlAllocateHeap(Heap, HEAP_ZERO_MEMORY, 17);
+    ok(Block != NULL, "RtlAllocateHeap failed\n");
+    if (!Block)
+        goto Cleanup;
+    ok(Block[0] == 0 && Block[16] == 0, "Block is not zeroed\n");
+    ok(RtlSizeHeap(Heap, 0, Block) == 17, "RtlSizeHeap returned %Iu\n", RtlSizeHeap(Heap, 0, Block));
+    Block[0] = 0x55;
+    Block[16] = 0x55;
+
+    /* Growing inside the same size class keeps the block */
+    NewBlock = RtlReAllocateHeap(Heap, HEAP_ZERO_MEMORY, Block, 24);
+    ok(NewBlock == Block, "Block moved from %p to %p\n", Block, NewBlock);
+    ok(RtlSizeHeap(Heap, 0, NewBlock) == 24, "RtlSizeHeap returned %Iu\n", RtlSizeHeap(Heap, 0, NewBlock));
+    ok(NewBlock[16] == 0x55 && NewBlock[23] == 0, "Contents not preserved\n");
+
+    NewBlock = RtlReAllocateHeap(Heap, HEAP_REALLOC_IN_PLACE_ONLY, Block, 0x8000);
+    ok(NewBlock == NULL, "In place reallocation returned %p\n", NewBlock);
+
+    NewBlock = RtlReAllocateHeap(Heap, HEAP_ZERO_MEMORY, Block, 0x8000);
+    ok(NewBlock != NULL, "RtlReAllocateHeap failed\n");
+    if (!NewBlock)
+    {
+        RtlFreeHeap(Heap, 0, Block);
+        goto Cleanup;
+    }
+    ok(NewBlock[0] == 0x55 && NewBlock[16] == 0x55 && NewBlock[0x7FFF] == 0, "Contents not preserved\n");
+
+    ok(RtlFreeHeap(Heap, 0, NewBlock), "RtlFreeHeap failed\n");
+
+Cleanup:
+    RtlDestroyHeap(Heap);
+
+    /* Heaps without serialization cannot use the LFH */
+    Heap = RtlCreateHeap(HEAP_GROWABLE | HEAP_NO_SERIALIZE, NULL, 0, 0, NULL, NULL);
+    if (Heap)
+    {
+        Status = RtlSetHeapInformation(Heap, HeapCompatibilityInformation, &Information, sizeof(Information));
+        ok(Status == STATUS_UNSUCCESSFUL, "RtlSetHeapInformation returned 0x%lx\n", Status);
+        RtlDestroyHeap(Heap);
+    }
+}
+
+static
+VOID
+TestLookaside(VOID)
+{
+    RTL_HEAP_LOOKASIDE_INFORMATION Information;
+    ULONG FrontEnd = FRONT_END_LOOKASIDE;
+    PUCHAR Block, NewBlock;
+    HANDLE Heap;
+    NTSTATUS Status;
+
+    Heap = RtlCreateHeap(HEAP_GROWABLE, NULL, 0, 0, NULL, NULL);
+    if (!Heap)
+    {
+        skip("RtlCreateHeap failed\n");
+        return;
+    }
+
+    /* No statistics without the front end */
+    Status = RtlQueryHeapInformation(Heap, HeapLookasideInformation, &Information, sizeof(Information), NULL);
+    ok(Status == STATUS_UNSUCCESSFUL, "RtlQueryHeapInformation returned 0x%lx\n", Status);
+
+    Status = RtlSetHeapInformation(Heap, HeapCompatibilityInformation, &FrontEnd, sizeof(FrontEnd));
+    ok(Status == STATUS_SUCCESS, "RtlSetHeapInformation returned 0x%lx\n", Status);
+
+    /* The second request of the same size is served from the list */
+    Block = RtlAllocateHeap(Heap, 0, 40);
+    ok(Block != NULL, "RtlAllocateHeap failed\n");
+    ok(RtlFreeHeap(Heap, 0, Block), "RtlFreeHeap failed\n");
+    NewBlock = RtlAllocateHeap(Heap, HEAP_ZERO_MEMORY, 40);
+    ok(NewBlock == Block, "Got %p, expected %p\n", NewBlock, Block);
+    ok(NewBlock && NewBlock[0] == 0 && NewBlock[39] == 0, "Block is not zeroed\n");
+    ok(RtlSizeHeap(Heap, 0, NewBlock) == 40, "RtlSizeHeap returned %Iu\n", RtlSizeHeap(Heap, 0, NewBlock));
+
+    RtlZeroMemory(&Information, sizeof(Information));
+    Status = RtlQueryHeapInformation(Heap, HeapLookasideInformation, &Information, sizeof(Information), NULL);
+    ok(Status == STATUS_SUCCESS, "RtlQueryHeapInformation returned 0x%lx\n", Status);
+    ok(Information.AllocateHits == 1, "AllocateHits = %lu\n", Information.AllocateHits);
+    ok(Information.AllocateMisses == 1, "AllocateMisses = %lu\n", Information.AllocateMisses);
+    ok(Information.FreeHits == 1, "FreeHits = %lu\n", Information.FreeHits);
+    ok(Information.FreeMisses == 0, "FreeMisses = %lu\n", Information.FreeMisses);
+
+    /* Front ends cannot be switched */
+    FrontEnd = FRONT_END_LFH;
+    Status = RtlSetHeapInformation(Heap, HeapCompatibilityInformation, &FrontEnd, sizeof(FrontEnd));
+    ok(Status == STATUS_UNSUCCESSFUL, "RtlSetHeapInformation returned 0x%lx\n", Status);
+
+    ok(RtlFreeHeap(Heap, 0, NewBlock), "RtlFreeHeap failed\n");
+    ok(RtlValidateHeap(Heap, 0, NULL), "Heap is corrupted\n");
+    RtlDestroyHeap(Heap);
+}
+
+START_TEST(RtlHeapStress)
+{
+    SYSTEM_INFO SystemInfo;
+    ULONG MaxThreads, ThreadCount;
+
+    TestLfhBlocks();
+    TestLookaside();
+
+    StartEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    ok(StartEvent != NULL, "CreateEventW failed with %lu\n", GetLastError());
+    if (!StartEvent)
+        return;
+
+    GetSystemInfo(&SystemInfo);
+    MaxThreads = min(max(SystemInfo.dwNumberOfProcessors * 2, 4), STRESS_MAX_THREADS);
+
+    for (ThreadCount = 1; ThreadCount <= MaxThreads; ThreadCount *= 2)
+    {
+        RunStress(FRONT_END_NONE, ThreadCount);
+        RunStress(FRONT_END_LOOKASIDE, ThreadCount);
+        RunStress(FRONT_END_LFH, ThreadCount);
+    }
+
+    CloseHandle(StartEvent);
+}
@@ -0,0 +1,174 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPL - See COPYING in the top level directory
+ * PURPOSE:         Stress test for datagram delivery with many bound sockets
+ */
+
+#include <apitest.h>
+#include <winsock2.h>
+
+#define NUM_SOCKETS     1000
+#define RECV_TIMEOUT    2000
+
+static
+SOCKET
+CreateBoundSocket(
+    _In_ ULONG Address,
+    _In_ USHORT Port,
+    _Out_ PUSHORT BoundPort)
+{
+    struct sockaddr_in Local;
+    int Length = sizeof(Local);
+    DWORD Timeout = RECV_TIMEOUT;
+    SOCKET Socket;
+
+    Socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (Socket == INVALID_SOCKET)
+        return INVALID_SOCKET;
+
+    ZeroMemory(&Local, sizeof(Local));
+    Local.sin_family = AF_INET;
+    Local.sin_addr.s_addr = Address;
+    Local.sin_port = Port;
+    if (bind(Socket, (struct sockaddr *)&Local, sizeof(Local)) == SOCKET_ERROR ||
+        getsockname(Socket, (struct sockaddr *)&Local, &Length) == SOCKET_ERROR)
+    {
+        closesocket(Socket);
+        return INVALID_SOCKET;
+    }
+
+    setsockopt(Socket, SOL_SOCKET, SO_RCVTIMEO, (const char *)&Timeout, sizeof(Timeout));
+    *BoundPort = Local.sin_port;
+    return Socket;
+}
+
+static
+BOOL
+SendValue(
+    _In_ SOCKET Sender,
+    _In_ USHORT Port,
+    _In_ ULONG Value)
+{
+    struct sockaddr_in Remote;
+
+    ZeroMemory(&Remote, sizeof(Remote));
+    Remote.sin_family = AF_INET;
+    Remote.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    Remote.sin_port = Port;
+
+    return sendto(Sender, (const char *)&Value, sizeof(Value), 0,
+                  (struct sockaddr *)&Remote, sizeof(Remote)) == sizeof(Value);
+}
+
+static
+BOOL
+ReceiveValue(
+    _In_ SOCKET Socket,
+    _In_ ULONG Expected)
+{
+    ULONG Value = ~Expected;
+
+    return recvfrom(Socket, (char *)&Value, sizeof(Value), 0, NULL, NULL) == sizeof(Value) &&
+           Value == Expected;
+}
+
+static
+VOID
+TestManySockets(
+    _In_ SOCKET Sender)
+{
+    LARGE_INTEGER Frequency, Start, End;
+    SOCKET *Sockets;
+    PUSHORT Ports;
+    ULONG Count, i, Delivered = 0;
+
+    Sockets = HeapAlloc(GetProcessHeap(), 0, NUM_SOCKETS * sizeof(*Sockets));
+    Ports = HeapAlloc(GetProcessHeap(), 0, NUM_SOCKETS * sizeof(*Ports));
+    if (!Sockets || !Ports)
+    {
+        skip("Out of memory\n");
+        goto Cleanup;
+    }
+
+    for (Count = 0; Count < NUM_SOCKETS; Count++)
+    {
+        Sockets[Count] = CreateBoundSocket(htonl(INADDR_LOOPBACK), 0, &Ports[Count]);
+        if (Sockets[Count] == INVALID_SOCKET)
+            break;
+    }
+    ok(Count == NUM_SOCKETS, "Only bound %lu sockets, error %d\n", Count, WSAGetLastError());
+
+    /* Every datagram has to end up on the socket bound to its port */
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < Count; i++)
+    {
+        if (SendValue(Sender, Ports[i], i) && ReceiveValue(Sockets[i], i))
+            Delivered++;
+    }
+    QueryPerformanceCounter(&End);
+
+    ok(Delivered == Count, "Delivered %lu of %lu datagrams\n", Delivered, Count);
+    trace("%lu bound sockets: %lu datagrams/s\n", Count,
+          (ULONG)((ULONGLONG)Count * Frequency.QuadPart / max(End.QuadPart - Start.QuadPart, 1)));
+
+    while (Count--)
+        closesocket(Sockets[Count]);
+
+Cleanup:
+    if (Ports)
+        HeapFree(GetProcessHeap(), 0, Ports);
+    if (Sockets)
+        HeapFree(GetProcessHeap(), 0, Sockets);
+}
+
+static
+VOID
+TestWildcard(
+    _In_ SOCKET Sender)
+{
+    SOCKET Wildcard, Specific;
+    USHORT Port, SpecificPort;
+
+    /* A socket bound to any address receives datagrams sent to loopback */
+    Wildcard = CreateBoundSocket(htonl(INADDR_ANY), 0, &Port);
+    ok(Wildcard != INVALID_SOCKET, "Failed to bind the wildcard socket, error %d\n", WSAGetLastError());
+    if (Wildcard == INVALID_SOCKET)
+        return;
+
+    ok(SendValue(Sender, Port, 0x1234), "sendto failed with %d\n", WSAGetLastError());
+    ok(ReceiveValue(Wildcard, 0x1234), "Wildcard socket did not get the datagram\n");
+
+    /* It must not see datagrams for other ports */
+    Specific = CreateBoundSocket(htonl(INADDR_LOOPBACK), 0, &SpecificPort);
+    ok(Specific != INVALID_SOCKET, "Failed to bind the specific socket, error %d\n", WSAGetLastError());
+    if (Specific != INVALID_SOCKET)
+    {
+        ok(SendValue(Sender, SpecificPort, 0x5678), "sendto failed with %d\n", WSAGetLastError());
+        ok(ReceiveValue(Specific, 0x5678), "Specific socket did not get the datagram\n");
+        ok(SendValue(Sender, Port, 0x9ABC), "sendto failed with %d\n", WSAGetLastError());
+        ok(ReceiveValue(Wildcard, 0x9ABC), "Wildcard socket got the wrong datagram\n");
+        closesocket(Specific);
+    }
+
+    closesocket(Wildcard);
+}
+
+START_TEST(recvfrom)
+{
+    WSADATA WsaData;
+    SOCKET Sender;
+
+    ok(WSAStartup(MAKEWORD(2, 2), &WsaData) == 0, "WSAStartup failed\n");
+
+    Sender = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    ok(Sender != INVALID_SOCKET, "socket failed with %d\n", WSAGetLastError());
+    if (Sender != INVALID_SOCKET)
+    {
+        TestManySockets(Sender);
+        TestWildcard(Sender);
+        closesocket(Sender);
+    }
+
+    WSACleanup();
+}
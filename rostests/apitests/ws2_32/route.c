@@ -0,0 +1,153 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPL - See COPYING in the top level directory
+ * PURPOSE:         Route lookup throughput benchmark against routing table size
+ */
+
+#include <apitest.h>
+#include <winsock2.h>
+#include <iphlpapi.h>
+
+/* Routes go to 198.18.0.0/15, which is reserved for benchmarking (RFC 2544) */
+#define BENCH_NETWORK   0xC6120000
+#define BENCH_SHIFT     4
+#define BENCH_MASK      0xFFFFFFF0
+#define SENDS           2000
+
+static
+BOOL
+GetDefaultRoute(
+    _Out_ PMIB_IPFORWARDROW DefaultRoute)
+{
+    PMIB_IPFORWARDTABLE Table;
+    ULONG Size = 0, i;
+    BOOL Found = FALSE;
+
+    if (GetIpForwardTable(NULL, &Size, FALSE) != ERROR_INSUFFICIENT_BUFFER)
+        return FALSE;
+
+    Table = HeapAlloc(GetProcessHeap(), 0, Size);
+    if (!Table)
+        return FALSE;
+
+    if (GetIpForwardTable(Table, &Size, FALSE) == NO_ERROR)
+    {
+        for (i = 0; i < Table->dwNumEntries; i++)
+        {
+            if (Table->table[i].dwForwardDest == 0 && Table->table[i].dwForwardMask == 0)
+            {
+                *DefaultRoute = Table->table[i];
+                Found = TRUE;
+                break;
+            }
+        }
+    }
+
+    HeapFree(GetProcessHeap(), 0, Table);
+    return Found;
+}
+
+static
+VOID
+InitBenchRoute(
+    _Out_ PMIB_IPFORWARDROW Route,
+    _In_ PMIB_IPFORWARDROW DefaultRoute,
+    _In_ ULONG Index)
+{
+    ZeroMemory(Route, sizeof(*Route));
+    Route->dwForwardDest = htonl(BENCH_NETWORK + (Index << BENCH_SHIFT));
+    Route->dwForwardMask = htonl(BENCH_MASK);
+    Route->dwForwardNextHop = DefaultRoute->dwForwardNextHop;
+    Route->dwForwardIfIndex = DefaultRoute->dwForwardIfIndex;
+    Route->dwForwardType = MIB_IPROUTE_TYPE_INDIRECT;
+    Route->dwForwardProto = MIB_IPPROTO_NETMGMT;
+    Route->dwForwardMetric1 = 1;
+}
+
+static
+ULONG
+MeasureSends(
+    _In_ SOCKET Socket,
+    _In_ ULONG Destinations)
+{
+    LARGE_INTEGER Frequency, Start, End;
+    struct sockaddr_in Address;
+    ULONG i, Sent = 0;
+    CHAR Byte = 0;
+
+    ZeroMemory(&Address, sizeof(Address));
+    Address.sin_family = AF_INET;
+    Address.sin_port = htons(9);
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < SENDS; i++)
+    {
+        /* Every destination falls in a different route's prefix */
+        Address.sin_addr.s_addr = htonl(BENCH_NETWORK + ((i % Destinations) << BENCH_SHIFT) + 1);
+        if (sendto(Socket, &Byte, sizeof(Byte), 0, (struct sockaddr *)&Address, sizeof(Address)) == sizeof(Byte))
+            Sent++;
+    }
+    QueryPerformanceCounter(&End);
+
+    ok(Sent == SENDS, "Only %lu of %u datagrams were routed, error %d\n", Sent, SENDS, WSAGetLastError());
+
+    return (ULONG)((ULONGLONG)SENDS * Frequency.QuadPart / max(End.QuadPart - Start.QuadPart, 1));
+}
+
+START_TEST(route)
+{
+    static const ULONG TableSizes[] = { 0, 16, 128, 1024, 2048 };
+    MIB_IPFORWARDROW DefaultRoute, Route;
+    WSADATA WsaData;
+    SOCKET Socket;
+    ULONG Added = 0, i, j;
+    DWORD Error;
+
+    ok(WSAStartup(MAKEWORD(2, 2), &WsaData) == 0, "WSAStartup failed\n");
+
+    if (!GetDefaultRoute(&DefaultRoute))
+    {
+        skip("No default route\n");
+        WSACleanup();
+        return;
+    }
+
+    Socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    ok(Socket != INVALID_SOCKET, "socket failed with %d\n", WSAGetLastError());
+    if (Socket == INVALID_SOCKET)
+    {
+        WSACleanup();
+        return;
+    }
+
+    for (i = 0; i < _countof(TableSizes); i++)
+    {
+        for (; Added < TableSizes[i]; Added++)
+        {
+            InitBenchRoute(&Route, &DefaultRoute, Added);
+            Error = CreateIpForwardEntry(&Route);
+            if (Error != NO_ERROR)
+                break;
+        }
+        if (Added < TableSizes[i])
+        {
+            skip("CreateIpForwardEntry failed with %lu after %lu routes\n", Error, Added);
+            break;
+        }
+
+        /* Same destination every time, then one per route */
+        trace("%5lu routes: %lu sends/s to one destination, %lu sends/s to %lu destinations\n",
+              Added, MeasureSends(Socket, 1), MeasureSends(Socket, max(Added, 1)), max(Added, 1));
+    }
+
+    for (j = 0; j < Added; j++)
+    {
+        InitBenchRoute(&Route, &DefaultRoute, j);
+        Error = DeleteIpForwardEntry(&Route);
+        ok(Error == NO_ERROR, "DeleteIpForwardEntry failed with %lu\n", Error);
+    }
+
+    closesocket(Socket);
+    WSACleanup();
+}
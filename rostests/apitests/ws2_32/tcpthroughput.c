@@ -0,0 +1,166 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPL - See COPYING in the top level directory
+ * PURPOSE:         Loopback TCP throughput benchmark against receive buffer size
+ */
+
+#include <apitest.h>
+#include <winsock2.h>
+
+#define TRANSFER_SIZE   (16 * 1024 * 1024)
+#define CHUNK_SIZE      (64 * 1024)
+#define RECV_TIMEOUT    10000
+
+typedef struct _SENDER_CONTEXT
+{
+    USHORT Port;
+    ULONG Sent;
+} SENDER_CONTEXT, *PSENDER_CONTEXT;
+
+static
+DWORD
+WINAPI
+SenderThread(
+    _In_ PVOID Parameter)
+{
+    PSENDER_CONTEXT Context = Parameter;
+    struct sockaddr_in Remote;
+    SOCKET Socket;
+    PCHAR Buffer;
+    int Length;
+
+    Buffer = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, CHUNK_SIZE);
+    if (!Buffer)
+        return 1;
+
+    Socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (Socket == INVALID_SOCKET)
+    {
+        HeapFree(GetProcessHeap(), 0, Buffer);
+        return 1;
+    }
+
+    ZeroMemory(&Remote, sizeof(Remote));
+    Remote.sin_family = AF_INET;
+    Remote.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    Remote.sin_port = Context->Port;
+    if (connect(Socket, (struct sockaddr *)&Remote, sizeof(Remote)) != SOCKET_ERROR)
+    {
+        while (Context->Sent < TRANSFER_SIZE)
+        {
+            Length = send(Socket, Buffer, min(CHUNK_SIZE, TRANSFER_SIZE - Context->Sent), 0);
+            if (Length <= 0)
+                break;
+            Context->Sent += Length;
+        }
+        shutdown(Socket, SD_SEND);
+    }
+
+    closesocket(Socket);
+    HeapFree(GetProcessHeap(), 0, Buffer);
+    return 0;
+}
+
+static
+VOID
+MeasureTransfer(
+    _In_ SOCKET Listener,
+    _In_ USHORT Port,
+    _In_ INT ReceiveBuffer,
+    _In_ PCHAR Buffer)
+{
+    LARGE_INTEGER Frequency, Start, End;
+    SENDER_CONTEXT Context;
+    DWORD Timeout = RECV_TIMEOUT;
+    ULONG Received = 0;
+    SOCKET Socket;
+    HANDLE Thread;
+    int Length;
+
+    Context.Port = Port;
+    Context.Sent = 0;
+    Thread = CreateThread(NULL, 0, SenderThread, &Context, 0, NULL);
+    ok(Thread != NULL, "CreateThread failed with %lu\n", GetLastError());
+    if (!Thread)
+        return;
+
+    Socket = accept(Listener, NULL, NULL);
+    ok(Socket != INVALID_SOCKET, "accept failed with %d\n", WSAGetLastError());
+    if (Socket != INVALID_SOCKET)
+    {
+        /* Zero keeps the default window and lets auto-tuning grow it */
+        if (ReceiveBuffer)
+        {
+            ok(setsockopt(Socket, SOL_SOCKET, SO_RCVBUF, (const char *)&ReceiveBuffer, sizeof(ReceiveBuffer)) == 0,
+               "setsockopt(SO_RCVBUF, %d) failed with %d\n", ReceiveBuffer, WSAGetLastError());
+        }
+        setsockopt(Socket, SOL_SOCKET, SO_RCVTIMEO, (const char *)&Timeout, sizeof(Timeout));
+
+        QueryPerformanceFrequency(&Frequency);
+        QueryPerformanceCounter(&Start);
+        while ((Length = recv(Socket, Buffer, CHUNK_SIZE, 0)) > 0)
+            Received += Length;
+        QueryPerformanceCounter(&End);
+
+        ok(Length == 0, "recv failed with %d\n", WSAGetLastError());
+        closesocket(Socket);
+    }
+
+    WaitForSingleObject(Thread, INFINITE);
+    CloseHandle(Thread);
+
+    ok(Context.Sent == TRANSFER_SIZE, "Sent %lu of %u bytes\n", Context.Sent, TRANSFER_SIZE);
+    ok(Received == Context.Sent, "Received %lu of %lu bytes\n", Received, Context.Sent);
+    if (Socket != INVALID_SOCKET)
+    {
+        trace("SO_RCVBUF %7d: %lu KB/s\n", ReceiveBuffer,
+              (ULONG)((ULONGLONG)Received / 1024 * Frequency.QuadPart / max(End.QuadPart - Start.QuadPart, 1)));
+    }
+}
+
+START_TEST(tcpthroughput)
+{
+    static const INT ReceiveBuffers[] = { 0, 8 * 1024, 64 * 1024, 256 * 1024, 1024 * 1024 };
+    struct sockaddr_in Local;
+    int Length = sizeof(Local);
+    WSADATA WsaData;
+    SOCKET Listener;
+    PCHAR Buffer;
+    ULONG i;
+
+    ok(WSAStartup(MAKEWORD(2, 2), &WsaData) == 0, "WSAStartup failed\n");
+
+    Buffer = HeapAlloc(GetProcessHeap(), 0, CHUNK_SIZE);
+    if (!Buffer)
+    {
+        skip("Out of memory\n");
+        WSACleanup();
+        return;
+    }
+
+    Listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    ok(Listener != INVALID_SOCKET, "socket failed with %d\n", WSAGetLastError());
+    if (Listener == INVALID_SOCKET)
+        goto Cleanup;
+
+    ZeroMemory(&Local, sizeof(Local));
+    Local.sin_family = AF_INET;
+    Local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(Listener, (struct sockaddr *)&Local, sizeof(Local)) == SOCKET_ERROR ||
+        getsockname(Listener, (struct sockaddr *)&Local, &Length) == SOCKET_ERROR ||
+        listen(Listener, 1) == SOCKET_ERROR)
+    {
+        ok(0, "Failed to set up the listener, error %d\n", WSAGetLastError());
+        closesocket(Listener);
+        goto Cleanup;
+    }
+
+    for (i = 0; i < _countof(ReceiveBuffers); i++)
+        MeasureTransfer(Listener, Local.sin_port, ReceiveBuffers[i], Buffer);
+
+    closesocket(Listener);
+
+Cleanup:
+    HeapFree(GetProcessHeap(), 0, Buffer);
+    WSACleanup();
+}
@@ -13,7 +13,10 @@ extern void func_ioctlsocket(void);
 extern void func_nonblocking(void);
 extern void func_nostartup(void);
 extern void func_recv(void);
+extern void func_recvfrom(void);
+extern void func_route(void);
 extern void func_send(void);
+extern void func_tcpthroughput(void);
 extern void func_WSAAsync(void);
 extern void func_WSAIoctl(void);
 extern void func_WSARecv(void);
@@ -31,7 +34,10 @@ const struct test winetest_testlist[] =
     { "nonblocking", func_nonblocking },
     { "nostartup", func_nostartup },
     { "recv", func_recv },
+    { "recvfrom", func_recvfrom },
+    { "route", func_route },
     { "send", func_send },
+    { "tcpthroughput", func_tcpthroughput },
     { "WSAAsync", func_WSAAsync },
     { "WSAIoctl", func_WSAIoctl },
     { "WSARecv", func_WSARecv },
@@ -0,0 +1,23 @@
+/*
+ * PROJECT:         ReactOS kernel-mode tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Kernel-Mode Test Suite CcReadAhead test declarations
+ */
+
+#ifndef _KMTEST_CCREADAHEAD_H_
+#define _KMTEST_CCREADAHEAD_H_
+
+typedef struct _READ_COUNTERS
+{
+    ULONG DemandReads;
+    ULONG ReadAheadReads;
+} READ_COUNTERS, *PREAD_COUNTERS;
+
+#define IOCTL_QUERY_COUNTERS 1
+
+/* 16 views of VACB_MAPPING_GRANULARITY */
+#define TEST_FILE_SIZE (4 * 1024 * 1024)
+
+#define PATTERN_AT(Offset) ((ULONG)(Offset) / sizeof(ULONG) ^ 0x5A5A5A5A)
+
+#endif /* !defined _KMTEST_CCREADAHEAD_H_ */
@@ -0,0 +1,101 @@
+/*
+ * PROJECT:         ReactOS kernel-mode tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Kernel-Mode Test Suite CcReadAhead test user-mode part
+ */
+
+#include <kmt_test.h>
+
+#include "CcReadAhead.h"
+
+#define CHUNK_SIZE (64 * 1024)
+
+static
+VOID
+ReadSequentially(
+    _In_ PUNICODE_STRING FileName,
+    _In_ BOOLEAN ReadAheadEnabled)
+{
+    HANDLE Handle;
+    NTSTATUS Status;
+    LARGE_INTEGER ByteOffset, Frequency, Start, End;
+    IO_STATUS_BLOCK IoStatusBlock;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    READ_COUNTERS Counters;
+    DWORD Error, Length;
+    PULONG Buffer;
+    ULONG i, Checksum = 0, Mismatches = 0;
+
+    Buffer = RtlAllocateHeap(RtlGetProcessHeap(), 0, CHUNK_SIZE);
+    if (skip(Buffer != NULL, "Out of memory\n"))
+        return;
+
+    InitializeObjectAttributes(&ObjectAttributes, FileName, OBJ_CASE_INSENSITIVE, NULL, NULL);
+    Status = NtOpenFile(&Handle, FILE_ALL_ACCESS, &ObjectAttributes, &IoStatusBlock, 0, FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT);
+    ok_eq_hex(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+    {
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Buffer);
+        return;
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    for (ByteOffset.QuadPart = 0; ByteOffset.QuadPart < TEST_FILE_SIZE; ByteOffset.QuadPart += CHUNK_SIZE)
+    {
+        Status = NtReadFile(Handle, NULL, NULL, NULL, &IoStatusBlock, Buffer, CHUNK_SIZE, &ByteOffset, NULL);
+        ok_eq_hex(Status, STATUS_SUCCESS);
+        if (!NT_SUCCESS(Status))
+            break;
+        ok_eq_ulongptr(IoStatusBlock.Information, CHUNK_SIZE);
+
+        /* Consume the chunk, giving read ahead time to fetch the next view */
+        for (i = 0; i < CHUNK_SIZE / sizeof(ULONG); i++)
+        {
+            if (Buffer[i] != PATTERN_AT(ByteOffset.QuadPart + i * sizeof(ULONG)))
+                Mismatches++;
+            Checksum = _rotl(Checksum, 5) ^ Buffer[i];
+        }
+    }
+    QueryPerformanceCounter(&End);
+    ok_eq_ulong(Mismatches, 0UL);
+
+    NtClose(Handle);
+
+    RtlZeroMemory(&Counters, sizeof(Counters));
+    Length = sizeof(Counters);
+    Error = KmtSendBufferToDriver(IOCTL_QUERY_COUNTERS, &Counters, 0, &Length);
+    ok(Error == ERROR_SUCCESS, "KmtSendBufferToDriver failed: %lu\n", Error);
+
+    trace("Read ahead %s: %lu KB/s, %lu demand reads, %lu read ahead reads, checksum 0x%08lx\n",
+          ReadAheadEnabled ? "on" : "off",
+          (ULONG)((ULONGLONG)TEST_FILE_SIZE * Frequency.QuadPart / 1024 / max(End.QuadPart - Start.QuadPart, 1)),
+          Counters.DemandReads, Counters.ReadAheadReads, Checksum);
+
+    if (ReadAheadEnabled)
+    {
+        ok(Counters.ReadAheadReads != 0, "No read ahead I/O was issued\n");
+    }
+    else
+    {
+        ok_eq_ulong(Counters.ReadAheadReads, 0UL);
+        ok(Counters.DemandReads != 0, "No demand I/O was issued\n");
+    }
+
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Buffer);
+}
+
+START_TEST(CcReadAhead)
+{
+    UNICODE_STRING ReadAheadOff = RTL_CONSTANT_STRING(L"\\Device\\Kmtest-CcReadAhead\\ReadAheadOff");
+    UNICODE_STRING ReadAheadOn = RTL_CONSTANT_STRING(L"\\Device\\Kmtest-CcReadAhead\\ReadAheadOn");
+
+    KmtLoadDriver(L"CcReadAhead", FALSE);
+    KmtOpenDriver();
+
+    ReadSequentially(&ReadAheadOff, FALSE);
+    ReadSequentially(&ReadAheadOn, TRUE);
+
+    KmtCloseDriver();
+    KmtUnloadDriver();
+}
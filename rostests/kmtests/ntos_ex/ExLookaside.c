@@ -0,0 +1,69 @@
+/*
+ * PROJECT:         ReactOS kernel-mode tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Kernel-Mode Test Suite lookaside list depth tuning test
+ */
+
+#include <kmt_test.h>
+
+#define NDEBUG
+#include <debug.h>
+
+#define TAG_LOOKASIDE   'LLkT'
+#define BURST_SIZE      128
+
+static
+VOID
+AllocateBurst(
+    _In_ PNPAGED_LOOKASIDE_LIST Lookaside)
+{
+    PVOID Entries[BURST_SIZE];
+    ULONG i;
+
+    for (i = 0; i < BURST_SIZE; i++)
+        Entries[i] = ExAllocateFromNPagedLookasideList(Lookaside);
+
+    for (i = 0; i < BURST_SIZE; i++)
+    {
+        if (Entries[i])
+            ExFreeToNPagedLookasideList(Lookaside, Entries[i]);
+    }
+}
+
+START_TEST(ExLookaside)
+{
+    NPAGED_LOOKASIDE_LIST Lookaside;
+    LARGE_INTEGER Interval;
+    USHORT InitialDepth, GrownDepth;
+    ULONG i;
+
+    ExInitializeNPagedLookasideList(&Lookaside, NULL, NULL, 0, 64, TAG_LOOKASIDE, 0);
+    InitialDepth = Lookaside.L.Depth;
+    ok(InitialDepth <= Lookaside.L.MaximumDepth, "Depth %u above maximum %u\n",
+       InitialDepth, Lookaside.L.MaximumDepth);
+
+    /* A busy list that keeps missing should be made deeper */
+    Interval.QuadPart = -100 * 1000 * 10;
+    for (i = 0; i < 40; i++)
+    {
+        AllocateBurst(&Lookaside);
+        KeDelayExecutionThread(KernelMode, FALSE, &Interval);
+    }
+    GrownDepth = Lookaside.L.Depth;
+    trace("Depth %u -> %u, %lu allocations, %lu misses\n",
+          InitialDepth, GrownDepth, Lookaside.L.TotalAllocates, Lookaside.L.AllocateMisses);
+    ok(GrownDepth > InitialDepth, "Depth did not grow: %u\n", GrownDepth);
+    ok(GrownDepth <= Lookaside.L.MaximumDepth, "Depth %u above maximum %u\n",
+       GrownDepth, Lookaside.L.MaximumDepth);
+
+    /* And shrink again once it goes idle */
+    Interval.QuadPart = -4000 * 1000 * 10;
+    KeDelayExecutionThread(KernelMode, FALSE, &Interval);
+    trace("Idle depth %u\n", Lookaside.L.Depth);
+    ok(Lookaside.L.Depth < GrownDepth, "Depth did not shrink: %u\n", Lookaside.L.Depth);
+    ok(ExQueryDepthSList(&Lookaside.L.ListHead) <= Lookaside.L.Depth,
+       "List holds %u entries for a depth of %u\n",
+       ExQueryDepthSList(&Lookaside.L.ListHead), Lookaside.L.Depth);
+
+    ExDeleteNPagedLookasideList(&Lookaside);
+}
@@ -0,0 +1,175 @@
+/*
+ * PROJECT:         ReactOS kernel-mode tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Kernel-Mode Test Suite thread distribution and wakeup latency test
+ */
+
+#include <kmt_test.h>
+
+#define NDEBUG
+#include <debug.h>
+
+#define SPIN_TIME_MS    1000
+#define NUM_WAKEUPS     200
+
+typedef struct _SPIN_THREAD_DATA
+{
+    PKEVENT StartEvent;
+    ULONG Samples[MAXIMUM_PROCESSORS];
+} SPIN_THREAD_DATA, *PSPIN_THREAD_DATA;
+
+typedef struct _WAKE_THREAD_DATA
+{
+    KEVENT WakeEvent;
+    KEVENT AckEvent;
+    LARGE_INTEGER SignalTime;
+    LARGE_INTEGER WakeTime;
+    volatile BOOLEAN Stop;
+} WAKE_THREAD_DATA, *PWAKE_THREAD_DATA;
+
+static
+VOID
+NTAPI
+SpinThread(
+    IN PVOID Context)
+{
+    PSPIN_THREAD_DATA ThreadData = Context;
+    ULONGLONG EndTime;
+    NTSTATUS Status;
+
+    Status = KeWaitForSingleObject(ThreadData->StartEvent, Executive, KernelMode, FALSE, NULL);
+    ok_eq_hex(Status, STATUS_SUCCESS);
+
+    /* Stay runnable for the whole period and record where we run */
+    EndTime = KeQueryInterruptTime() + SPIN_TIME_MS * 10 * 1000ULL;
+    while (KeQueryInterruptTime() < EndTime)
+    {
+        ThreadData->Samples[KeGetCurrentProcessorNumber()]++;
+        YieldProcessor();
+    }
+}
+
+static
+VOID
+TestThreadDistribution(VOID)
+{
+    PSPIN_THREAD_DATA ThreadData;
+    PKTHREAD Threads[MAXIMUM_PROCESSORS];
+    ULONG Totals[MAXIMUM_PROCESSORS] = { 0 };
+    ULONGLONG Sum = 0;
+    KEVENT StartEvent;
+    ULONG NumberOfThreads, i, j;
+
+    NumberOfThreads = (ULONG)KeNumberProcessors;
+    ThreadData = ExAllocatePoolWithTag(NonPagedPool, NumberOfThreads * sizeof(*ThreadData), 'SeKT');
+    if (skip(ThreadData != NULL, "Out of memory\n"))
+        return;
+    RtlZeroMemory(ThreadData, NumberOfThreads * sizeof(*ThreadData));
+
+    /* One CPU-bound thread per processor, released at the same time */
+    KeInitializeEvent(&StartEvent, NotificationEvent, FALSE);
+    for (i = 0; i < NumberOfThreads; i++)
+    {
+        ThreadData[i].StartEvent = &StartEvent;
+        Threads[i] = KmtStartThread(SpinThread, &ThreadData[i]);
+    }
+    KeSetEvent(&StartEvent, IO_NO_INCREMENT, FALSE);
+
+    for (i = 0; i < NumberOfThreads; i++)
+    {
+        KmtFinishThread(Threads[i], NULL);
+        for (j = 0; j < NumberOfThreads; j++)
+        {
+            Totals[j] += ThreadData[i].Samples[j];
+            Sum += ThreadData[i].Samples[j];
+        }
+    }
+
+    /* Every processor should have carried a fair share of the load */
+    for (j = 0; j < NumberOfThreads; j++)
+    {
+        trace("Processor %lu: %lu samples (%lu%%)\n",
+              j, Totals[j], (ULONG)(Totals[j] * 100ULL / max(Sum, 1)));
+        ok(Totals[j] * 4ULL * NumberOfThreads >= Sum,
+           "Processor %lu only got %lu of %I64u samples\n", j, Totals[j], Sum);
+    }
+
+    ExFreePoolWithTag(ThreadData, 'SeKT');
+}
+
+static
+VOID
+NTAPI
+WakeThread(
+    IN PVOID Context)
+{
+    PWAKE_THREAD_DATA ThreadData = Context;
+    NTSTATUS Status;
+
+    for (;;)
+    {
+        Status = KeWaitForSingleObject(&ThreadData->WakeEvent, Executive, KernelMode, FALSE, NULL);
+        ok_eq_hex(Status, STATUS_SUCCESS);
+        if (ThreadData->Stop)
+            break;
+
+        ThreadData->WakeTime = KeQueryPerformanceCounter(NULL);
+        KeSetEvent(&ThreadData->AckEvent, IO_NO_INCREMENT, FALSE);
+    }
+}
+
+static
+VOID
+TestWakeupLatency(VOID)
+{
+    PWAKE_THREAD_DATA ThreadData;
+    PKTHREAD Thread;
+    LARGE_INTEGER Frequency, Timeout;
+    ULONGLONG Latency, Total = 0, Worst = 0;
+    NTSTATUS Status;
+    ULONG i, Count = 0;
+
+    ThreadData = ExAllocatePoolWithTag(NonPagedPool, sizeof(*ThreadData), 'SeKT');
+    if (skip(ThreadData != NULL, "Out of memory\n"))
+        return;
+    KeInitializeEvent(&ThreadData->WakeEvent, SynchronizationEvent, FALSE);
+    KeInitializeEvent(&ThreadData->AckEvent, SynchronizationEvent, FALSE);
+    ThreadData->Stop = FALSE;
+
+    Thread = KmtStartThread(WakeThread, ThreadData);
+    KeQueryPerformanceCounter(&Frequency);
+
+    Timeout.QuadPart = -1000 * 1000 * 10;
+    for (i = 0; i < NUM_WAKEUPS; i++)
+    {
+        ThreadData->SignalTime = KeQueryPerformanceCounter(NULL);
+        KeSetEvent(&ThreadData->WakeEvent, IO_NO_INCREMENT, FALSE);
+        Status = KeWaitForSingleObject(&ThreadData->AckEvent, Executive, KernelMode, FALSE, &Timeout);
+        ok_eq_hex(Status, STATUS_SUCCESS);
+        if (Status != STATUS_SUCCESS)
+            break;
+
+        /* In microseconds */
+        Latency = (ThreadData->WakeTime.QuadPart - ThreadData->SignalTime.QuadPart) *
+                  1000000ULL / Frequency.QuadPart;
+        Total += Latency;
+        Worst = max(Worst, Latency);
+        Count++;
+    }
+
+    trace("%lu wakeups, average %I64u us, worst %I64u us\n",
+          Count, Total / max(Count, 1), Worst);
+
+    ThreadData->Stop = TRUE;
+    KmtFinishThread(Thread, &ThreadData->WakeEvent);
+    ExFreePoolWithTag(ThreadData, 'SeKT');
+}
+
+START_TEST(KeScheduler)
+{
+    TestWakeupLatency();
+
+    if (skip(KeNumberProcessors > 1, "Distribution test needs more than one processor\n"))
+        return;
+    TestThreadDistribution();
+}